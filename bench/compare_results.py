@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""Compares two Google Benchmark JSON reports and fails on regressions.
+
+Usage: compare_results.py BASELINE.json CONTENDER.json [--threshold PERCENT]
+"""
+
+import argparse
+import json
+import sys
+
+
+def load_times(file_name):
+    with open(file_name) as report:
+        benchmarks = json.load(report)["benchmarks"]
+    times = {}
+    for benchmark in benchmarks:
+        # With repetitions only the median is comparable between runs
+        if benchmark.get("run_type") == "aggregate" and benchmark.get("aggregate_name") != "median":
+            continue
+        name = benchmark.get("run_name", benchmark["name"])
+        times[name] = benchmark["cpu_time"]
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("contender")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed slowdown in percent (default: 10)")
+    args = parser.parse_args()
+
+    baseline = load_times(args.baseline)
+    contender = load_times(args.contender)
+
+    regressions = 0
+    for name in sorted(baseline.keys() & contender.keys()):
+        change = (contender[name] - baseline[name]) / baseline[name] * 100
+        mark = ""
+        if change > args.threshold:
+            mark = "  REGRESSION"
+            regressions += 1
+        print(f"{name:80} {baseline[name]:14.1f} {contender[name]:14.1f} {change:+8.1f}%{mark}")
+
+    for name in sorted(baseline.keys() - contender.keys()):
+        print(f"{name:80} missing in {args.contender}")
+
+    if regressions:
+        print(f"{regressions} benchmark(s) slower by more than {args.threshold}%")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
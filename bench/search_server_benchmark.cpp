@@ -0,0 +1,690 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <dataset_generator.h>
+#include <document_filter.h>
+#include <durable_search_server.h>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numa_search_server.h>
+#include <paginator.h>
+#include <process_queries.h>
+#include <remove_duplicates.h>
+#include <search_server.h>
+#include <set>
+#include <sharded_search_server.h>
+#include <static_search_server.h>
+#include <stop_word_set.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// FIXTURES ///////////////////////////////////////////////////////////////////
+
+const int QUERY_COUNT = 100;
+
+struct Corpus {
+    Dataset dataset;
+    SearchServer server;
+};
+
+// Documents and queries come from DatasetGenerator. If SEARCH_BENCHMARK_DATASET names a
+// directory written by generate_dataset, its documents are used instead, truncated to the
+// requested count. Every tenth document repeats the previous one, so RemoveDuplicates has
+// work to do.
+Dataset LoadDataset(int document_count) {
+    if (const char *directory = getenv("SEARCH_BENCHMARK_DATASET")) {
+        auto dataset = ReadDataset(directory);
+        if (dataset.documents.size() > static_cast<size_t>(document_count)) {
+            dataset.documents.resize(static_cast<size_t>(document_count));
+        }
+        return dataset;
+    }
+    DatasetOptions options;
+    options.document_count = document_count;
+    options.stop_word_count = 1;
+    options.query_count = 0;
+    return DatasetGenerator(options).Generate();
+}
+
+unique_ptr<Corpus> MakeCorpus(int document_count) {
+    auto dataset = LoadDataset(document_count);
+    for (size_t i = 10; i < dataset.documents.size(); i += 10) {
+        dataset.documents[i].text = dataset.documents[i - 1].text;
+    }
+
+    auto server = MakeSearchServer(dataset);
+    return make_unique<Corpus>(Corpus{move(dataset), move(server)});
+}
+
+const Corpus &GetCorpus(int document_count) {
+    static map<int, unique_ptr<Corpus>> corpora;
+    auto &corpus = corpora[document_count];
+    if (!corpus) {
+        corpus = MakeCorpus(document_count);
+    }
+    return *corpus;
+}
+
+// Queries of a fixed length over the corpus vocabulary, with Zipf-distributed words and
+// repeats, so popular terms with long posting lists dominate as they do in real logs
+vector<string> GetQueries(const Corpus &corpus, int word_count, int minus_percent) {
+    DatasetOptions options;
+    options.seed = static_cast<uint32_t>(word_count * 100 + minus_percent);
+    options.vocabulary_size = static_cast<int>(corpus.dataset.vocabulary.size());
+    options.query_count = QUERY_COUNT;
+    options.distinct_query_count = QUERY_COUNT / 2;
+    options.min_query_length = word_count;
+    options.max_query_length = word_count;
+    options.minus_word_probability = minus_percent / 100.0;
+    return DatasetGenerator(options).GenerateQueries(corpus.dataset.vocabulary);
+}
+
+void SetCorpusArgs(benchmark::internal::Benchmark *benchmark) {
+    benchmark->ArgNames({"docs"})->Arg(1'000)->Arg(10'000);
+}
+
+void SetQueryArgs(benchmark::internal::Benchmark *benchmark) {
+    benchmark->ArgNames({"docs", "words", "minus%"})
+        ->ArgsProduct({{1'000, 10'000}, {1, 10, 50}, {0, 10, 50}});
+}
+
+// BENCHMARKS /////////////////////////////////////////////////////////////////
+
+void BM_AddDocument(benchmark::State &state) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        SearchServer server(corpus.dataset.stop_words);
+        for (const auto &document : corpus.dataset.documents) {
+            server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        benchmark::DoNotOptimize(server.GetDocumentCount());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    const auto stats = corpus.server.GetMemoryStats();
+    state.counters["index_bytes"] = static_cast<double>(stats.GetTotal().allocated_bytes);
+    state.counters["forward_index_bytes"] =
+        static_cast<double>(stats.document_to_words_freqs.allocated_bytes);
+}
+BENCHMARK(BM_AddDocument)->Apply(SetCorpusArgs)->Unit(benchmark::kMillisecond);
+
+template <typename ExecutionPolicy>
+void BM_RemoveDocument(benchmark::State &state, ExecutionPolicy policy) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        state.PauseTiming();
+        SearchServer server = corpus.server;
+        state.ResumeTiming();
+        for (int id = 0; id < state.range(0); ++id) {
+            server.RemoveDocument(policy, id);
+        }
+        benchmark::DoNotOptimize(server.GetDocumentCount());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_CAPTURE(BM_RemoveDocument, seq, execution::seq)
+    ->Apply(SetCorpusArgs)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_RemoveDocument, par, execution::par)
+    ->Apply(SetCorpusArgs)
+    ->Unit(benchmark::kMillisecond);
+
+// Rewrites of documents: a small edit of the text, a status flip, and the same edit made
+// by removing and adding the document again
+enum class UpdateKind { TEXT, METADATA, REMOVE_ADD };
+
+void BM_UpdateDocument(benchmark::State &state, UpdateKind kind) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    SearchServer server = corpus.server;
+    vector<string> edited_texts;
+    for (const auto &document : corpus.dataset.documents) {
+        // The first word of the document is dropped
+        const auto space = document.text.find(' ');
+        edited_texts.push_back(space == string::npos ? document.text
+                                                     : document.text.substr(space + 1));
+    }
+    size_t index = 0;
+    for (auto _ : state) {
+        const auto &document = corpus.dataset.documents[index];
+        const auto &text = edited_texts[index];
+        switch (kind) {
+        case UpdateKind::TEXT:
+            server.UpdateDocument(document.id, text, document.status, document.ratings);
+            break;
+        case UpdateKind::METADATA:
+            server.UpdateDocument(document.id, DocumentStatus::BANNED, document.ratings);
+            break;
+        case UpdateKind::REMOVE_ADD:
+            server.RemoveDocument(document.id);
+            server.AddDocument(document.id, text, document.status, document.ratings);
+            break;
+        }
+        index = (index + 1) % corpus.dataset.documents.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_UpdateDocument, text, UpdateKind::TEXT)->Apply(SetCorpusArgs);
+BENCHMARK_CAPTURE(BM_UpdateDocument, metadata, UpdateKind::METADATA)->Apply(SetCorpusArgs);
+BENCHMARK_CAPTURE(BM_UpdateDocument, remove_add, UpdateKind::REMOVE_ADD)->Apply(SetCorpusArgs);
+
+// A deep copy against a clone, alone and followed by the first change, which copies the
+// structures it touches
+enum class CloneKind { COPY, CLONE, CLONE_METADATA, CLONE_TEXT };
+
+void BM_CloneSearchServer(benchmark::State &state, CloneKind kind) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto &document = corpus.dataset.documents.front();
+    for (auto _ : state) {
+        SearchServer server = kind == CloneKind::COPY ? corpus.server : corpus.server.Clone();
+        if (kind == CloneKind::CLONE_METADATA) {
+            server.UpdateDocument(document.id, DocumentStatus::BANNED, document.ratings);
+        } else if (kind == CloneKind::CLONE_TEXT) {
+            server.UpdateDocument(document.id, "cat"s, document.status, document.ratings);
+        }
+        benchmark::DoNotOptimize(server.GetDocumentCount());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_CloneSearchServer, copy, CloneKind::COPY)->Apply(SetCorpusArgs);
+BENCHMARK_CAPTURE(BM_CloneSearchServer, clone, CloneKind::CLONE)->Apply(SetCorpusArgs);
+BENCHMARK_CAPTURE(BM_CloneSearchServer, clone_metadata, CloneKind::CLONE_METADATA)
+    ->Apply(SetCorpusArgs);
+BENCHMARK_CAPTURE(BM_CloneSearchServer, clone_text, CloneKind::CLONE_TEXT)
+    ->Apply(SetCorpusArgs);
+
+// Text updates logged through a write-ahead log synced once per group of "group" records,
+// against BM_UpdateDocument/text without a log
+void BM_DurableUpdateDocument(benchmark::State &state) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto directory = filesystem::temp_directory_path() / "search_server_wal_benchmark";
+    filesystem::remove_all(directory);
+    WalOptions options;
+    options.group_commit_size = static_cast<size_t>(state.range(1));
+    options.group_commit_delay = chrono::milliseconds(0);
+    {
+        // The log holds the updates only, the server is never reopened
+        DurableSearchServer server(directory.string(), corpus.server, options);
+        size_t index = 0;
+        for (auto _ : state) {
+            const auto &document = corpus.dataset.documents[index];
+            // The first word of the document is dropped, as in BM_UpdateDocument
+            const auto space = document.text.find(' ');
+            const auto text = space == string::npos ? string_view(document.text)
+                                                    : string_view(document.text).substr(space + 1);
+            server.UpdateDocument(document.id, text, document.status, document.ratings);
+            index = (index + 1) % corpus.dataset.documents.size();
+        }
+        server.Commit();
+    }
+    filesystem::remove_all(directory);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DurableUpdateDocument)
+    ->ArgNames({"docs", "group"})
+    ->ArgsProduct({{10'000}, {1, 64, 1024}});
+
+template <typename ExecutionPolicy>
+void BM_MatchDocument(benchmark::State &state, ExecutionPolicy policy) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto queries =
+        GetQueries(corpus, static_cast<int>(state.range(1)), static_cast<int>(state.range(2)));
+    size_t query_index = 0;
+    int document_id = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            corpus.server.MatchDocument(policy, queries[query_index], document_id));
+        query_index = (query_index + 1) % queries.size();
+        document_id = (document_id + 1) % static_cast<int>(state.range(0));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_MatchDocument, seq, execution::seq)->Apply(SetQueryArgs);
+BENCHMARK_CAPTURE(BM_MatchDocument, par, execution::par)->Apply(SetQueryArgs);
+
+template <typename ExecutionPolicy>
+void BM_MatchPreparedDocument(benchmark::State &state, ExecutionPolicy policy) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    vector<PreparedQuery> queries;
+    for (const auto &query : GetQueries(corpus, static_cast<int>(state.range(1)),
+                                        static_cast<int>(state.range(2)))) {
+        queries.push_back(corpus.server.PrepareQuery(query));
+    }
+    size_t query_index = 0;
+    int document_id = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            corpus.server.MatchDocument(policy, queries[query_index], document_id));
+        query_index = (query_index + 1) % queries.size();
+        document_id = (document_id + 1) % static_cast<int>(state.range(0));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_MatchPreparedDocument, seq, execution::seq)->Apply(SetQueryArgs);
+BENCHMARK_CAPTURE(BM_MatchPreparedDocument, par, execution::par)->Apply(SetQueryArgs);
+
+template <typename ExecutionPolicy>
+void BM_FindTopDocuments(benchmark::State &state, ExecutionPolicy policy) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto queries =
+        GetQueries(corpus, static_cast<int>(state.range(1)), static_cast<int>(state.range(2)));
+    size_t query_index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(corpus.server.FindTopDocuments(policy, queries[query_index]));
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_FindTopDocuments, seq, execution::seq)->Apply(SetQueryArgs);
+BENCHMARK_CAPTURE(BM_FindTopDocuments, par, execution::par)->Apply(SetQueryArgs);
+
+// Document-at-a-time evaluation of the same queries: no map of all found documents
+void BM_FindTopDocumentsDaat(benchmark::State &state) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto queries =
+        GetQueries(corpus, static_cast<int>(state.range(1)), static_cast<int>(state.range(2)));
+    static map<int, unique_ptr<SearchServer>> servers;
+    auto &server = servers[static_cast<int>(state.range(0))];
+    if (!server) {
+        SearchServerOptions options;
+        options.evaluation = QueryEvaluation::DOCUMENT_AT_A_TIME;
+        server = make_unique<SearchServer>(corpus.dataset.stop_words, options);
+        for (const auto &document : corpus.dataset.documents) {
+            server->AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+    }
+    size_t query_index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server->FindTopDocuments(queries[query_index]));
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FindTopDocumentsDaat)->Apply(SetQueryArgs);
+
+// The same search as BM_FindTopDocumentsDaat with its settings fixed at compile time. Both
+// servers are built without stop words, the generated ones are not known to the compiler.
+enum class ServerKind { DYNAMIC, STATIC };
+
+void BM_FindTopDocumentsStatic(benchmark::State &state, ServerKind kind) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto queries =
+        GetQueries(corpus, static_cast<int>(state.range(1)), static_cast<int>(state.range(2)));
+    SearchServerOptions options;
+    options.evaluation = QueryEvaluation::DOCUMENT_AT_A_TIME;
+    SearchServer dynamic_server(""s, options);
+    StaticSearchServer<> static_server;
+    for (const auto &document : corpus.dataset.documents) {
+        if (kind == ServerKind::DYNAMIC) {
+            dynamic_server.AddDocument(document.id, document.text, document.status,
+                                       document.ratings);
+        } else {
+            static_server.AddDocument(document.id, document.text, document.status,
+                                      document.ratings);
+        }
+    }
+    size_t query_index = 0;
+    for (auto _ : state) {
+        if (kind == ServerKind::DYNAMIC) {
+            benchmark::DoNotOptimize(dynamic_server.FindTopDocuments(queries[query_index]));
+        } else {
+            benchmark::DoNotOptimize(static_server.FindTopDocuments(queries[query_index]));
+        }
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_FindTopDocumentsStatic, dynamic, ServerKind::DYNAMIC)
+    ->ArgNames({"docs", "words", "minus%"})
+    ->ArgsProduct({{10'000}, {1, 10}, {0}});
+BENCHMARK_CAPTURE(BM_FindTopDocumentsStatic, static, ServerKind::STATIC)
+    ->ArgNames({"docs", "words", "minus%"})
+    ->ArgsProduct({{10'000}, {1, 10}, {0}});
+
+// Stop word checks of every word of the corpus against a list of common English stop
+// words: the ordered set SearchServer used to keep them in, the perfect hash table built at
+// run time and the one built by the compiler
+constexpr auto ENGLISH_STOP_WORDS = MakeStaticStopWordSet(
+    "a", "about", "above", "after", "again", "against", "all", "am", "an", "and", "any", "are",
+    "as", "at", "be", "because", "been", "before", "being", "below", "between", "both", "but",
+    "by", "can", "did", "do", "does", "doing", "down", "during", "each", "few", "for", "from",
+    "further", "had", "has", "have", "having", "he", "her", "here", "hers", "herself", "him",
+    "himself", "his", "how", "i", "if", "in", "into", "is", "it", "its", "itself", "just", "me",
+    "more", "most", "my", "myself", "no", "nor", "not", "now", "of", "off", "on", "once", "only",
+    "or", "other", "our", "ours", "ourselves", "out", "over", "own", "same", "she", "should",
+    "so", "some", "such", "than", "that", "the", "their", "theirs", "them", "themselves",
+    "then", "there", "these", "they", "this", "those", "through", "to", "too", "under", "until",
+    "up", "very", "was", "we", "were", "what", "when", "where", "which", "while", "who", "whom",
+    "why", "will", "with", "you", "your", "yours", "yourself", "yourselves");
+
+enum class StopWordsKind { SET, HASH, STATIC_HASH };
+
+void BM_IsStopWord(benchmark::State &state, StopWordsKind kind) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    vector<string_view> words;
+    for (const auto &document : corpus.dataset.documents) {
+        for (const auto word : SplitIntoWords(document.text)) {
+            words.push_back(word);
+        }
+    }
+    // Every fourth word is a stop word, as in ordinary text
+    for (size_t i = 0; i < words.size(); i += 4) {
+        words[i] = *(ENGLISH_STOP_WORDS.begin() + i % ENGLISH_STOP_WORDS.size());
+    }
+    const set<string, less<>> stop_word_set(ENGLISH_STOP_WORDS.begin(), ENGLISH_STOP_WORDS.end());
+    const StopWordSet stop_word_hash(
+        vector<string>(ENGLISH_STOP_WORDS.begin(), ENGLISH_STOP_WORDS.end()));
+    for (auto _ : state) {
+        size_t stop_word_count = 0;
+        for (const auto word : words) {
+            switch (kind) {
+            case StopWordsKind::SET:
+                stop_word_count += stop_word_set.count(word);
+                break;
+            case StopWordsKind::HASH:
+                stop_word_count += stop_word_hash.Contains(word);
+                break;
+            case StopWordsKind::STATIC_HASH:
+                stop_word_count += ENGLISH_STOP_WORDS.Contains(word);
+                break;
+            }
+        }
+        benchmark::DoNotOptimize(stop_word_count);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(words.size()));
+}
+BENCHMARK_CAPTURE(BM_IsStopWord, set, StopWordsKind::SET)->ArgNames({"docs"})->Arg(10'000);
+BENCHMARK_CAPTURE(BM_IsStopWord, hash, StopWordsKind::HASH)->ArgNames({"docs"})->Arg(10'000);
+BENCHMARK_CAPTURE(BM_IsStopWord, static_hash, StopWordsKind::STATIC_HASH)
+    ->ArgNames({"docs"})
+    ->Arg(10'000);
+
+// All-terms mode: posting lists are intersected before scoring
+template <typename ExecutionPolicy>
+void BM_FindTopDocumentsAllTerms(benchmark::State &state, ExecutionPolicy policy) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    vector<PreparedQuery> queries;
+    for (const auto &query : GetQueries(corpus, static_cast<int>(state.range(1)), 0)) {
+        queries.push_back(corpus.server.PrepareQuery(query, QueryMode::ALL));
+    }
+    size_t query_index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(corpus.server.FindTopDocuments(policy, queries[query_index]));
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_FindTopDocumentsAllTerms, seq, execution::seq)
+    ->ArgNames({"docs", "words"})
+    ->ArgsProduct({{1'000, 10'000}, {1, 2, 10}});
+BENCHMARK_CAPTURE(BM_FindTopDocumentsAllTerms, par, execution::par)
+    ->ArgNames({"docs", "words"})
+    ->ArgsProduct({{1'000, 10'000}, {1, 2, 10}});
+
+// Relevance policies on the same queries, TF-IDF is the baseline
+template <typename Scorer>
+void BM_FindTopDocumentsScorer(benchmark::State &state) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto queries =
+        GetQueries(corpus, static_cast<int>(state.range(1)), static_cast<int>(state.range(2)));
+    size_t query_index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(corpus.server.FindTopDocuments<Scorer>(queries[query_index]));
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_FindTopDocumentsScorer, TfIdfScorer)
+    ->ArgNames({"docs", "words", "minus%"})
+    ->ArgsProduct({{10'000}, {1, 10}, {0}});
+BENCHMARK_TEMPLATE(BM_FindTopDocumentsScorer, Bm25Scorer)
+    ->ArgNames({"docs", "words", "minus%"})
+    ->ArgsProduct({{10'000}, {1, 10}, {0}});
+BENCHMARK_TEMPLATE(BM_FindTopDocumentsScorer, Bm25PlusScorer)
+    ->ArgNames({"docs", "words", "minus%"})
+    ->ArgsProduct({{10'000}, {1, 10}, {0}});
+
+// A tenant's id range with a rating floor, as a lambda and as a DocumentFilter. The range
+// covers range% of the corpus.
+void BM_FindTopDocumentsFilter(benchmark::State &state, bool declarative) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto queries = GetQueries(corpus, static_cast<int>(state.range(1)), 0);
+    const int max_id = static_cast<int>(state.range(0) * state.range(2) / 100);
+    const auto filter = DocumentFilter()
+                            .SetStatus(DocumentStatus::ACTUAL)
+                            .SetRatingRange(1, 100)
+                            .SetIdRange(0, max_id);
+    const auto lambda = [max_id](int document_id, DocumentStatus status, int rating) {
+        return status == DocumentStatus::ACTUAL && rating >= 1 && rating <= 100 &&
+               document_id >= 0 && document_id <= max_id;
+    };
+    size_t query_index = 0;
+    for (auto _ : state) {
+        if (declarative) {
+            benchmark::DoNotOptimize(corpus.server.FindTopDocuments(queries[query_index], filter));
+        } else {
+            benchmark::DoNotOptimize(corpus.server.FindTopDocuments(queries[query_index], lambda));
+        }
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_FindTopDocumentsFilter, lambda, false)
+    ->ArgNames({"docs", "words", "range%"})
+    ->ArgsProduct({{10'000}, {1, 10}, {1, 10, 100}});
+BENCHMARK_CAPTURE(BM_FindTopDocumentsFilter, filter, true)
+    ->ArgNames({"docs", "words", "range%"})
+    ->ArgsProduct({{10'000}, {1, 10}, {1, 10, 100}});
+
+// Best rated documents found by the query, taken from the top of the rating index
+void BM_FindTopRatedDocuments(benchmark::State &state) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto queries = GetQueries(corpus, static_cast<int>(state.range(1)), 0);
+    size_t query_index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(corpus.server.FindTopRatedDocuments(queries[query_index]));
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FindTopRatedDocuments)
+    ->ArgNames({"docs", "words"})
+    ->ArgsProduct({{1'000, 10'000}, {1, 10}});
+
+// A rating range holding few documents gives the candidates from the rating index
+void BM_FindTopDocumentsRatingRange(benchmark::State &state) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto queries = GetQueries(corpus, static_cast<int>(state.range(1)), 0);
+    const auto filter = DocumentFilter().SetRatingRange(static_cast<int>(state.range(2)), 100);
+    size_t query_index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(corpus.server.FindTopDocuments(queries[query_index], filter));
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FindTopDocumentsRatingRange)
+    ->ArgNames({"docs", "words", "min_rating"})
+    ->ArgsProduct({{10'000}, {1, 10}, {0, 6, 9}});
+
+// Score-at-a-time search on the quantized impact index against the exact scan of every
+// posting, same queries and scorer
+void BM_FindTopDocumentsByImpact(benchmark::State &state, bool use_impacts) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto queries = GetQueries(corpus, static_cast<int>(state.range(1)), 0);
+    static map<int, unique_ptr<SearchServer>> servers;
+    auto &server = servers[static_cast<int>(state.range(0))];
+    if (!server) {
+        server = make_unique<SearchServer>(corpus.server);
+        server->BuildImpactIndex<Bm25Scorer>();
+    }
+    size_t query_index = 0;
+    for (auto _ : state) {
+        if (use_impacts) {
+            benchmark::DoNotOptimize(
+                server->FindTopDocumentsByImpact<Bm25Scorer>(queries[query_index]));
+        } else {
+            benchmark::DoNotOptimize(server->FindTopDocuments<Bm25Scorer>(queries[query_index]));
+        }
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_FindTopDocumentsByImpact, exact, false)
+    ->ArgNames({"docs", "words"})
+    ->ArgsProduct({{10'000}, {1, 3, 10}});
+BENCHMARK_CAPTURE(BM_FindTopDocumentsByImpact, impacts, true)
+    ->ArgNames({"docs", "words"})
+    ->ArgsProduct({{10'000}, {1, 3, 10}});
+
+// A page deep in the results: by offset it is partially sorted down to its end, by a cursor
+// only the documents after the cursor are
+void BM_FindDocumentsPage(benchmark::State &state, bool by_cursor) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto queries = GetQueries(corpus, static_cast<int>(state.range(1)), 0);
+    const size_t offset = static_cast<size_t>(state.range(2));
+    vector<PageRequest> requests;
+    for (const auto &query : queries) {
+        PageRequest request{offset, 10, nullopt};
+        if (by_cursor) {
+            // The cursor of the previous page
+            const auto previous = corpus.server.FindDocumentsPage(query, {0, offset, nullopt});
+            request = {0, 10, previous.next};
+        }
+        requests.push_back(request);
+    }
+    size_t query_index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            corpus.server.FindDocumentsPage(queries[query_index], requests[query_index]));
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_FindDocumentsPage, offset, false)
+    ->ArgNames({"docs", "words", "offset"})
+    ->ArgsProduct({{10'000}, {1, 10}, {10, 1'000}});
+BENCHMARK_CAPTURE(BM_FindDocumentsPage, cursor, true)
+    ->ArgNames({"docs", "words", "offset"})
+    ->ArgsProduct({{10'000}, {1, 10}, {10, 1'000}});
+
+// Autocomplete: the first letters of a query word followed by a star
+template <typename ExecutionPolicy>
+void BM_FindTopDocumentsPrefix(benchmark::State &state, ExecutionPolicy policy) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto prefix_length = static_cast<size_t>(state.range(1));
+    vector<string> queries;
+    for (const auto &query : GetQueries(corpus, 1, 0)) {
+        queries.push_back(query.substr(0, prefix_length) + '*');
+    }
+    size_t query_index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(corpus.server.FindTopDocuments(policy, queries[query_index]));
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_FindTopDocumentsPrefix, seq, execution::seq)
+    ->ArgNames({"docs", "prefix"})
+    ->ArgsProduct({{1'000, 10'000}, {1, 2, 4}});
+
+// Typo tolerance: a query word with up to the given number of edits
+template <typename ExecutionPolicy>
+void BM_FindTopDocumentsFuzzy(benchmark::State &state, ExecutionPolicy policy) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    vector<string> queries;
+    for (const auto &query : GetQueries(corpus, 1, 0)) {
+        queries.push_back(query + '~' + to_string(state.range(1)));
+    }
+    size_t query_index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(corpus.server.FindTopDocuments(policy, queries[query_index]));
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_FindTopDocumentsFuzzy, seq, execution::seq)
+    ->ArgNames({"docs", "edits"})
+    ->ArgsProduct({{1'000, 10'000}, {1, 2}});
+
+// Scatter-gather over the given number of shards, each searched sequentially
+void BM_ShardedFindTopDocuments(benchmark::State &state) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    ShardedSearchServer server(static_cast<size_t>(state.range(1)), corpus.dataset.stop_words);
+    for (const auto &document : corpus.dataset.documents) {
+        server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    const auto queries = GetQueries(corpus, static_cast<int>(state.range(2)), 10);
+    size_t query_index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.FindTopDocuments(queries[query_index]));
+        query_index = (query_index + 1) % queries.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ShardedFindTopDocuments)
+    ->ArgNames({"docs", "shards", "words"})
+    ->ArgsProduct({{10'000}, {1, 2, 4, 8}, {1, 10}});
+
+void BM_ProcessQueries(benchmark::State &state) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const auto queries =
+        GetQueries(corpus, static_cast<int>(state.range(1)), static_cast<int>(state.range(2)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ProcessQueries(corpus.server, queries));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(queries.size()));
+}
+BENCHMARK(BM_ProcessQueries)->Apply(SetQueryArgs)->Unit(benchmark::kMillisecond);
+
+// The same batch answered by node-local replicas and workers pinned to their nodes
+void BM_ProcessQueriesNuma(benchmark::State &state) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    const NumaSearchServer server(corpus.server);
+    const auto queries =
+        GetQueries(corpus, static_cast<int>(state.range(1)), static_cast<int>(state.range(2)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ProcessQueries(server, queries));
+    }
+    state.counters["nodes"] = static_cast<double>(server.GetNodeCount());
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(queries.size()));
+}
+BENCHMARK(BM_ProcessQueriesNuma)->Apply(SetQueryArgs)->Unit(benchmark::kMillisecond);
+
+void BM_RemoveDuplicates(benchmark::State &state) {
+    const auto &corpus = GetCorpus(static_cast<int>(state.range(0)));
+    streambuf *orig_buf = cout.rdbuf();
+    cout.rdbuf(nullptr);
+    for (auto _ : state) {
+        state.PauseTiming();
+        SearchServer server = corpus.server;
+        state.ResumeTiming();
+        RemoveDuplicates(server);
+        benchmark::DoNotOptimize(server.GetDocumentCount());
+    }
+    cout.rdbuf(orig_buf);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RemoveDuplicates)->Apply(SetCorpusArgs)->Unit(benchmark::kMillisecond);
+
+void BM_Paginate(benchmark::State &state) {
+    vector<Document> documents(static_cast<size_t>(state.range(0)));
+    for (size_t i = 0; i < documents.size(); ++i) {
+        documents[i] = {static_cast<int>(i), 1.0 / (i + 1), 0};
+    }
+    for (auto _ : state) {
+        size_t total = 0;
+        for (const auto &page : Paginate(documents, static_cast<size_t>(state.range(1)))) {
+            total += page.size();
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Paginate)
+    ->ArgNames({"results", "page"})
+    ->ArgsProduct({{10, 1'000, 100'000}, {1, 10, 100}});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+// Owner of a value that can be shared with other owners until one of them changes it.
+// Const access reads the shared value; non-const access first copies it if anybody else
+// still shares it, so every write goes to a value of a single owner.
+//
+// Copying a CowPtr copies the value, like copying the value itself would; Share gives an
+// owner of the same value instead. A moved-from CowPtr holds nothing and may only be
+// assigned or destroyed.
+//
+// Owners sharing a value may be used from different threads, each by one thread at a time.
+template <typename T>
+class CowPtr {
+  public:
+    using element_type = T;
+
+    CowPtr() : data_(std::make_shared<T>()) {}
+    explicit CowPtr(T value) : data_(std::make_shared<T>(std::move(value))) {}
+
+    CowPtr(const CowPtr &other) : data_(std::make_shared<T>(*other.data_)) {}
+    CowPtr &operator=(const CowPtr &other) {
+        if (this != &other) {
+            data_ = std::make_shared<T>(*other.data_);
+        }
+        return *this;
+    }
+    CowPtr(CowPtr &&) noexcept = default;
+    CowPtr &operator=(CowPtr &&) noexcept = default;
+
+    // Owner of the same value, in O(1)
+    CowPtr Share() const {
+        return CowPtr(data_);
+    }
+
+    const T &operator*() const noexcept {
+        return *data_;
+    }
+
+    const T *operator->() const noexcept {
+        return data_.get();
+    }
+
+    T &operator*() {
+        Detach();
+        return *data_;
+    }
+
+    T *operator->() {
+        Detach();
+        return data_.get();
+    }
+
+    // Replaces the value without copying the old one
+    void Reset(T value = T()) {
+        data_ = std::make_shared<T>(std::move(value));
+    }
+
+    bool IsShared() const noexcept {
+        return data_.use_count() > 1;
+    }
+
+  private:
+    explicit CowPtr(std::shared_ptr<T> data) noexcept : data_(std::move(data)) {}
+
+    void Detach() {
+        if (data_.use_count() > 1) {
+            data_ = std::make_shared<T>(std::as_const(*data_));
+        }
+    }
+
+    std::shared_ptr<T> data_;
+};
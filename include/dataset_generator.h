@@ -0,0 +1,103 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+struct DatasetOptions {
+    uint32_t seed = 42;
+
+    // Word of rank k is used with probability proportional to 1 / (k + 1) ^ zipf_exponent,
+    // frequent words are shorter
+    int vocabulary_size = 10'000;
+    double zipf_exponent = 1.0;
+    int max_word_length = 12;
+    // The most frequent words become stop words
+    int stop_word_count = 0;
+
+    // Document lengths follow a log-normal distribution
+    int document_count = 10'000;
+    double mean_document_length = 50.0;
+    double document_length_sigma = 0.6;
+    int max_document_length = 1'000;
+
+    // Weights of ACTUAL, IRRELEVANT, BANNED and REMOVED statuses
+    std::array<double, 4> status_weights = {0.85, 0.1, 0.04, 0.01};
+
+    // Each document has a skewed base rating, its ratings are scattered around it
+    int max_rating_count = 5;
+    double mean_rating = 3.0;
+    double rating_stddev = 2.0;
+
+    // Query log draws queries from a pool of distinct queries with Zipf popularity, smaller
+    // pools and larger exponents give more repeated queries
+    int query_count = 10'000;
+    int distinct_query_count = 1'000;
+    double query_zipf_exponent = 1.0;
+    // Query lengths are geometric with the given mean, clamped to the given range
+    double mean_query_length = 3.0;
+    int min_query_length = 1;
+    int max_query_length = 20;
+    double minus_word_probability = 0.05;
+};
+
+struct GeneratedDocument {
+    int id = 0;
+    std::string text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
+struct Dataset {
+    std::vector<std::string> vocabulary;
+    std::vector<std::string> stop_words;
+    std::vector<GeneratedDocument> documents;
+    std::vector<std::string> queries;
+};
+
+// Samples ranks 0..n-1 with probability proportional to 1 / (rank + 1) ^ exponent
+class ZipfDistribution {
+  public:
+    ZipfDistribution(size_t n, double exponent);
+
+    // uniform must be in [0, 1)
+    size_t operator()(double uniform) const;
+
+  private:
+    std::vector<double> cumulative_;
+};
+
+// Generates a synthetic corpus and query log. The same options always give the same dataset:
+// all randomness comes from std::mt19937, whose output is fixed by the standard.
+class DatasetGenerator {
+  public:
+    explicit DatasetGenerator(const DatasetOptions &options);
+
+    Dataset Generate();
+
+    std::vector<std::string> GenerateVocabulary();
+    std::vector<GeneratedDocument> GenerateDocuments(const std::vector<std::string> &vocabulary);
+    std::vector<std::string> GenerateQueries(const std::vector<std::string> &vocabulary);
+
+  private:
+    double NextUniform();
+    int NextInt(int min, int max);
+    double NextNormal();
+
+    std::string GenerateQuery(const std::vector<std::string> &vocabulary,
+                              const ZipfDistribution &words);
+
+    DatasetOptions options_;
+    std::mt19937 generator_;
+};
+
+// Writes vocabulary.txt, stop_words.txt, documents.tsv and queries.txt to the directory
+void WriteDataset(const Dataset &dataset, const std::string &directory);
+Dataset ReadDataset(const std::string &directory);
+
+SearchServer MakeSearchServer(const Dataset &dataset);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cmath>
 #include <ostream>
 
 struct Document {
@@ -20,4 +21,43 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+// Relevances closer than this are treated as equal and ordered by rating
+const double RELEVANCE_TOLERANCE = 1e-6;
+
+// Nearly equal relevance by higher rating, otherwise more relevant first. The tolerance
+// makes it no strict weak ordering, so it is meant for showing and comparing results, not
+// for sorting them: a chain of scores apart by small steps has no consistent order.
+inline bool IsMoreRelevant(const Document &lhs, const Document &rhs) {
+    return (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_TOLERANCE)
+               ? lhs.rating > rhs.rating
+               : lhs.relevance > rhs.relevance;
+}
+
+// Relevance rounded down to a multiple of RELEVANCE_TOLERANCE. Relevances with the same
+// bucket are equal for ranking, which keeps the tolerance and still orders consistently.
+inline double GetRelevanceBucket(double relevance) {
+    return std::floor(relevance / RELEVANCE_TOLERANCE);
+}
+
+// Total order of search results: more relevant first, relevance in the same bucket by
+// higher rating, then lower id first. Sorting, top selection and page cursors all use it.
+// It agrees with IsMoreRelevant except for nearly equal relevances on both sides of a
+// bucket bound, which are ordered by relevance.
+inline bool IsRankedBefore(const Document &lhs, const Document &rhs) {
+    const double lhs_bucket = GetRelevanceBucket(lhs.relevance);
+    const double rhs_bucket = GetRelevanceBucket(rhs.relevance);
+    if (lhs_bucket != rhs_bucket) {
+        return lhs_bucket > rhs_bucket;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+
+// Order of rating sorted results: higher rating first, equal ratings by IsRankedBefore
+inline bool IsHigherRated(const Document &lhs, const Document &rhs) {
+    return lhs.rating != rhs.rating ? lhs.rating > rhs.rating : IsRankedBefore(lhs, rhs);
+}
+
 std::ostream &operator<<(std::ostream &out, const Document &document);
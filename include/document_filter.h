@@ -0,0 +1,99 @@
+#pragma once
+
+#include "document.h"
+
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <optional>
+#include <vector>
+
+// Declarative document predicate: a set of statuses, inclusive ranges of ratings and ids, and
+// lists of allowed and denied ids. Conditions combine by AND, an unset one passes everything.
+//
+// It can be called like any predicate, but SearchServer looks inside: ids are applied to the
+// posting lists before the scan (ranges are seeked to, allow lists intersected with them,
+// denied documents dropped after scoring), so a posting only costs a status bit test and a
+// rating range compare.
+class DocumentFilter {
+  public:
+    DocumentFilter() = default;
+
+    // Only documents of the given statuses pass
+    DocumentFilter &SetStatuses(std::initializer_list<DocumentStatus> statuses);
+    DocumentFilter &SetStatus(DocumentStatus status) {
+        return SetStatuses({status});
+    }
+
+    DocumentFilter &SetRatingRange(int min_rating, int max_rating);
+    DocumentFilter &SetIdRange(int min_id, int max_id);
+
+    // Only the given documents pass; repeated calls intersect the lists
+    DocumentFilter &AllowIds(std::vector<int> document_ids);
+    DocumentFilter &DenyIds(std::vector<int> document_ids);
+
+    bool operator()(int document_id, DocumentStatus status, int rating) const {
+        return MatchesMetadata(status, rating) && MatchesId(document_id);
+    }
+
+    // Status and rating conditions only. Branchless, as it runs for every posting scanned.
+    bool MatchesMetadata(DocumentStatus status, int rating) const noexcept {
+        const bool status_matches = (status_mask_ >> static_cast<unsigned>(status)) & 1u;
+        // One unsigned compare checks both bounds
+        const bool rating_matches =
+            static_cast<uint32_t>(rating) - static_cast<uint32_t>(min_rating_) <=
+            static_cast<uint32_t>(max_rating_) - static_cast<uint32_t>(min_rating_);
+        return status_matches & rating_matches & !has_empty_range_;
+    }
+
+    bool MatchesId(int document_id) const;
+
+    // True if no document can pass, then there is nothing to scan
+    bool IsEmpty() const noexcept;
+
+    bool HasRatingRange() const noexcept {
+        return min_rating_ != std::numeric_limits<int>::min() ||
+               max_rating_ != std::numeric_limits<int>::max();
+    }
+
+    int GetMinRating() const noexcept {
+        return min_rating_;
+    }
+
+    int GetMaxRating() const noexcept {
+        return max_rating_;
+    }
+
+    int GetMinId() const noexcept {
+        return min_id_;
+    }
+
+    int GetMaxId() const noexcept {
+        return max_id_;
+    }
+
+    // Sorted, without repeats
+    const std::vector<int> &GetDeniedIds() const noexcept {
+        return denied_ids_;
+    }
+
+    // Narrows sorted candidate documents, nothing meaning all, to the ids that pass. The
+    // result is nothing only if neither the candidates nor the filter limit the ids to a list.
+    std::optional<std::vector<int>>
+    RestrictCandidates(std::optional<std::vector<int>> candidates) const;
+
+  private:
+    static const unsigned ALL_STATUSES =
+        (1u << (static_cast<unsigned>(DocumentStatus::REMOVED) + 1)) - 1;
+
+    unsigned status_mask_ = ALL_STATUSES;
+    // Set by an empty range, which the unsigned compare cannot express
+    bool has_empty_range_ = false;
+    int min_rating_ = std::numeric_limits<int>::min();
+    int max_rating_ = std::numeric_limits<int>::max();
+    int min_id_ = std::numeric_limits<int>::min();
+    int max_id_ = std::numeric_limits<int>::max();
+    // Sorted, without repeats
+    std::optional<std::vector<int>> allowed_ids_;
+    std::vector<int> denied_ids_;
+};
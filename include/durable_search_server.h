@@ -0,0 +1,65 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+#include "write_ahead_log.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// SearchServer whose changes survive a restart. The directory holds a snapshot of the index
+// and a write-ahead log of the changes made since it. On start the snapshot is loaded into
+// the given server and the log is replayed on top of it; Checkpoint writes a new snapshot
+// and empties the log.
+//
+// A change is applied to the server first, so an invalid one throws and is not logged, and
+// then appended to the log. It is on the disk once its group is committed, see WalOptions.
+// Once the log fails every change throws after it is applied, so the server runs ahead of
+// the disk; a restart recovers the state of the last committed group.
+// Like SearchServer, changes are not to be made concurrently with anything else.
+class DurableSearchServer {
+  public:
+    // server is empty, with the stop words and options the directory was written with
+    DurableSearchServer(const std::string &directory,
+                        SearchServer server,
+                        const WalOptions &options = {});
+
+    void AddDocument(int document_id,
+                     std::string_view document,
+                     DocumentStatus status,
+                     const std::vector<int> &ratings);
+    void RemoveDocument(int document_id);
+    void UpdateDocument(int document_id,
+                        std::string_view document,
+                        DocumentStatus status,
+                        const std::vector<int> &ratings);
+    void UpdateDocument(int document_id, DocumentStatus status, const std::vector<int> &ratings);
+
+    // Makes every change so far durable
+    void Commit();
+
+    // Replaces the snapshot with the current index and truncates the log. The server keeps
+    // no texts, so documents are written as GetDocumentText rebuilds them, with their
+    // average rating as the only rating.
+    void Checkpoint();
+
+    const SearchServer &GetServer() const noexcept {
+        return server_;
+    }
+
+    uint64_t GetLastSequence() const {
+        return wal_.GetLastSequence();
+    }
+
+  private:
+    // Loads the snapshot and replays the log, returns the last sequence seen
+    static uint64_t Recover(const std::string &directory, SearchServer &server);
+    static void Apply(SearchServer &server, const WalRecord &record);
+
+    std::string directory_;
+    WalOptions options_;
+    SearchServer server_;
+    WriteAheadLog wal_;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "memory_stats.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Postings of a word for score-at-a-time search. Every posting keeps its score under a fixed
+// scorer quantized to a byte, the impact: round(score / quantum), so it is off by at most
+// half a quantum. Postings are grouped into segments of equal impact, highest first, with
+// the documents of a segment sorted by id. A posting takes 4 bytes instead of a tree node.
+class ImpactPostings {
+  public:
+    static const int MAX_IMPACT = 255;
+
+    // Memory is counted with the index holding the postings
+    using allocator_type = TrackingAllocator<int>;
+
+    ImpactPostings() = default;
+    // Scores of the word in every document containing it, quantum > 0 for nonzero impacts
+    ImpactPostings(const std::vector<std::pair<int, double>> &scores, double quantum);
+    ImpactPostings(const ImpactPostings &other, const allocator_type &allocator)
+        : segments_(other.segments_, allocator), document_ids_(other.document_ids_, allocator) {}
+    ImpactPostings(ImpactPostings &&other, const allocator_type &allocator)
+        : segments_(std::move(other.segments_), allocator),
+          document_ids_(std::move(other.document_ids_), allocator) {}
+    ImpactPostings(const ImpactPostings &) = default;
+    ImpactPostings(ImpactPostings &&) = default;
+    ImpactPostings &operator=(const ImpactPostings &) = default;
+    ImpactPostings &operator=(ImpactPostings &&) = default;
+
+    size_t GetSegmentCount() const noexcept {
+        return segments_.size();
+    }
+
+    uint8_t GetImpact(size_t segment) const noexcept {
+        return segments_[segment].impact;
+    }
+
+    std::span<const int> GetDocuments(size_t segment) const noexcept {
+        const uint32_t begin = segment == 0 ? 0 : segments_[segment - 1].end;
+        return {document_ids_.data() + begin, document_ids_.data() + segments_[segment].end};
+    }
+
+    size_t size() const noexcept {
+        return document_ids_.size();
+    }
+
+    size_t GetEncodedBytes() const noexcept {
+        return document_ids_.capacity() * sizeof(int) + segments_.capacity() * sizeof(Segment);
+    }
+
+  private:
+    struct Segment {
+        uint8_t impact;
+        // Offset of the next segment in document_ids_
+        uint32_t end;
+    };
+
+    std::vector<Segment, TrackingAllocator<Segment>> segments_;
+    std::vector<int, allocator_type> document_ids_;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Collection-wide numbers relevance depends on. Servers holding parts of one collection share
+// an instance, so each of them ranks its documents as a single server of the whole collection
+// would. Updates may come from several servers at once, reads must not overlap with them.
+class IndexStatistics {
+  public:
+    IndexStatistics() = default;
+    // Numbers as they are now, for a server that goes on apart from the others
+    IndexStatistics(const IndexStatistics &other);
+    IndexStatistics &operator=(const IndexStatistics &) = delete;
+
+    // words are the distinct words of the document, length counts all its words
+    void AddDocument(const std::vector<std::string_view> &words, uint32_t length);
+    void RemoveDocument(const std::vector<std::string_view> &words, uint32_t length);
+
+    size_t GetDocumentCount() const noexcept {
+        return document_count_;
+    }
+
+    uint64_t GetTotalDocumentLength() const noexcept {
+        return total_document_length_;
+    }
+
+    // Number of documents containing the word
+    size_t GetDocumentFreq(std::string_view word) const;
+
+  private:
+    mutable std::mutex mutex_;
+    size_t document_count_ = 0;
+    uint64_t total_document_length_ = 0;
+    std::map<std::string, size_t, std::less<>> document_freqs_;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+
+// Rough per-allocation overhead of a general purpose allocator: a size header and rounding
+// of the block up to 16 bytes, with a 32 bytes minimum (glibc malloc on 64-bit systems).
+inline size_t EstimateAllocatedBytes(size_t requested_bytes) {
+    const size_t block = (requested_bytes + sizeof(size_t) + 15) & ~static_cast<size_t>(15);
+    return block < 32 ? 32 : block;
+}
+
+struct MemoryCounter {
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> allocated_bytes{0};
+    std::atomic<size_t> allocations{0};
+
+    void Add(size_t size) noexcept {
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        allocated_bytes.fetch_add(EstimateAllocatedBytes(size), std::memory_order_relaxed);
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Remove(size_t size) noexcept {
+        bytes.fetch_sub(size, std::memory_order_relaxed);
+        allocated_bytes.fetch_sub(EstimateAllocatedBytes(size), std::memory_order_relaxed);
+        allocations.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+
+// Allocator that counts memory of a container in a MemoryCounter. The counter is shared by
+// all rebound copies of the allocator, so nested containers built through
+// std::scoped_allocator_adaptor count into the counter of the outer container. A copied
+// container gets a new counter.
+template <typename T>
+class TrackingAllocator {
+  public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    TrackingAllocator() : counter_(std::make_shared<MemoryCounter>()) {}
+
+    template <typename U>
+    TrackingAllocator(const TrackingAllocator<U> &other) noexcept : counter_(other.counter_) {}
+
+    T *allocate(size_t n) {
+        T *data = std::allocator<T>().allocate(n);
+        counter_->Add(n * sizeof(T));
+        return data;
+    }
+
+    void deallocate(T *data, size_t n) noexcept {
+        counter_->Remove(n * sizeof(T));
+        std::allocator<T>().deallocate(data, n);
+    }
+
+    TrackingAllocator select_on_container_copy_construction() const {
+        return TrackingAllocator();
+    }
+
+    const MemoryCounter &GetCounter() const noexcept {
+        return *counter_;
+    }
+
+    template <typename U>
+    bool operator==(const TrackingAllocator<U> &other) const noexcept {
+        return counter_ == other.counter_;
+    }
+
+    template <typename U>
+    bool operator!=(const TrackingAllocator<U> &other) const noexcept {
+        return !(*this == other);
+    }
+
+  private:
+    template <typename U>
+    friend class TrackingAllocator;
+
+    std::shared_ptr<MemoryCounter> counter_;
+};
+
+struct MemoryUsage {
+    // Bytes requested by the structure
+    size_t bytes = 0;
+    // Bytes taken from the system allocator, estimated with EstimateAllocatedBytes
+    size_t allocated_bytes = 0;
+    size_t allocations = 0;
+    size_t elements = 0;
+
+    MemoryUsage &operator+=(const MemoryUsage &other);
+};
+
+MemoryUsage GetMemoryUsage(const MemoryCounter &counter, size_t elements);
+
+struct MemoryStats {
+    MemoryUsage all_words;
+    MemoryUsage stop_words;
+    MemoryUsage word_to_document_freqs;
+    MemoryUsage document_to_words_freqs;
+    MemoryUsage positions;
+    MemoryUsage documents;
+    MemoryUsage document_ids;
+    MemoryUsage rating_index;
+    MemoryUsage impact_index;
+
+    MemoryUsage GetTotal() const;
+};
+
+std::ostream &operator<<(std::ostream &out, const MemoryUsage &usage);
+std::ostream &operator<<(std::ostream &out, const MemoryStats &stats);
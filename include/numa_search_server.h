@@ -0,0 +1,155 @@
+#pragma once
+
+#include "document.h"
+#include "scorer.h"
+#include "search_server.h"
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+
+// Replicas of a SearchServer, one per NUMA node, each searched by TBB workers pinned to the
+// CPUs of its node. A replica is copied by a thread of its node, so its postings are placed
+// in the node's memory by first touch, and a query never reads memory of another socket.
+// Queries are spread over the nodes round robin; parallel policies inside a query only use
+// the workers of its node.
+//
+// Without NUMA support in TBB (no tbbbind or hwloc) there is a single unpinned replica.
+// The server must not be attached to IndexStatistics, replicas would count its documents
+// once each.
+class NumaSearchServer {
+  public:
+    // A replica on every NUMA node of the machine
+    explicit NumaSearchServer(const SearchServer &server);
+    // A replica on each of the given nodes, tbb::task_arena::automatic for an unpinned one
+    NumaSearchServer(const SearchServer &server, const std::vector<tbb::numa_node_id> &nodes);
+
+    // Arenas keep pointers to themselves, the server can be neither copied nor moved
+    NumaSearchServer(const NumaSearchServer &) = delete;
+    NumaSearchServer &operator=(const NumaSearchServer &) = delete;
+
+    auto begin() const noexcept {
+        return GetReplica(0).begin();
+    }
+
+    auto end() const noexcept {
+        return GetReplica(0).end();
+    }
+
+    // Changes every replica, each on its own node. Like SearchServer, not to be called
+    // concurrently with anything else.
+    void AddDocument(int document_id,
+                     std::string_view document,
+                     DocumentStatus status,
+                     const std::vector<int> &ratings);
+    void RemoveDocument(int document_id);
+    void UpdateDocument(int document_id,
+                        std::string_view document,
+                        DocumentStatus status,
+                        const std::vector<int> &ratings);
+    void UpdateDocument(int document_id, DocumentStatus status, const std::vector<int> &ratings);
+
+    int GetDocumentCount() const noexcept {
+        return GetReplica(0).GetDocumentCount();
+    }
+
+    // Takes the arguments of any SearchServer::FindTopDocuments overload with a raw query
+    template <typename Scorer = TfIdfScorer, typename... Args>
+    std::vector<Document> FindTopDocuments(const Args &...args) const;
+
+    template <typename... Args>
+    std::tuple<std::vector<std::string>, DocumentStatus>
+    MatchDocument(const Args &...args) const;
+
+    size_t GetNodeCount() const noexcept {
+        return nodes_.size();
+    }
+
+    tbb::numa_node_id GetNodeId(size_t index) const {
+        return nodes_.at(index)->id;
+    }
+
+    const SearchServer &GetReplica(size_t index) const {
+        return *nodes_.at(index)->replica;
+    }
+
+    // Runs function(replica) on the workers of the given node and returns its result
+    template <typename Function>
+    auto ExecuteOnNode(size_t index, Function function) const;
+
+    // Runs function(node index) on every node at once, waits for all of them and
+    // rethrows the first exception
+    template <typename Function>
+    void ExecuteOnEachNode(Function function) const;
+
+    // Node of the next query, round robin
+    size_t NextNode() const noexcept {
+        return next_node_.fetch_add(1, std::memory_order_relaxed) % nodes_.size();
+    }
+
+  private:
+    struct Node {
+        explicit Node(tbb::numa_node_id id) : id(id), arena(tbb::task_arena::constraints(id)) {}
+
+        tbb::numa_node_id id;
+        mutable tbb::task_arena arena;
+        std::unique_ptr<SearchServer> replica;
+    };
+
+    std::vector<std::unique_ptr<Node>> nodes_;
+    mutable std::atomic<size_t> next_node_ = 0;
+};
+
+template <typename Scorer, typename... Args>
+std::vector<Document> NumaSearchServer::FindTopDocuments(const Args &...args) const {
+    return ExecuteOnNode(NextNode(), [&](const SearchServer &replica) {
+        return replica.FindTopDocuments<Scorer>(args...);
+    });
+}
+
+template <typename... Args>
+std::tuple<std::vector<std::string>, DocumentStatus>
+NumaSearchServer::MatchDocument(const Args &...args) const {
+    return ExecuteOnNode(NextNode(), [&](const SearchServer &replica) {
+        return replica.MatchDocument(args...);
+    });
+}
+
+template <typename Function>
+auto NumaSearchServer::ExecuteOnNode(size_t index, Function function) const {
+    const auto &node = *nodes_.at(index);
+    return node.arena.execute([&] { return function(*node.replica); });
+}
+
+template <typename Function>
+void NumaSearchServer::ExecuteOnEachNode(Function function) const {
+    // A task group per arena: tasks go to the arena the group runs them in
+    std::vector<tbb::task_group> groups(nodes_.size());
+    std::vector<std::exception_ptr> errors(nodes_.size());
+    for (size_t index = 0; index < nodes_.size(); ++index) {
+        auto &node = *nodes_[index];
+        node.arena.execute([&, index] {
+            groups[index].run([&, index] {
+                try {
+                    function(index);
+                } catch (...) {
+                    errors[index] = std::current_exception();
+                }
+            });
+        });
+    }
+    for (size_t index = 0; index < nodes_.size(); ++index) {
+        nodes_[index]->arena.execute([&groups, index] { groups[index].wait(); });
+    }
+    for (const auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
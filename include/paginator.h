@@ -1,7 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
 #include <ostream>
-#include <vector>
 
 template <typename Iterator>
 class IteratorRange {
@@ -24,32 +26,85 @@ class IteratorRange {
     size_t size_;
 };
 
+// Pages of a range, made on the fly: nothing is stored but the bounds, so construction costs
+// a single distance, O(1) for random access iterators, and so does access to any page.
 template <typename Iterator>
 class Paginator {
   public:
-    Paginator(Iterator begin, Iterator end, size_t page_size) {
-        for (size_t left = static_cast<size_t>(distance(begin, end)); left > 0;) {
-            const size_t current_page_size = std::min(page_size, left);
-            const Iterator current_page_end = next(begin, static_cast<int>(current_page_size));
-            pages_.push_back({begin, current_page_end});
-
-            left -= current_page_size;
-            begin = current_page_end;
+    class PageIterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = IteratorRange<Iterator>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        PageIterator() = default;
+        PageIterator(Iterator page_begin, size_t left, size_t page_size)
+            : page_begin_(page_begin), left_(left), page_size_(page_size) {}
+
+        value_type operator*() const {
+            return {page_begin_, std::next(page_begin_, GetPageLength())};
         }
-    }
 
-    auto begin() const noexcept {
-        return pages_.begin();
+        PageIterator &operator++() {
+            const size_t length = GetPageLength();
+            std::advance(page_begin_, length);
+            left_ -= length;
+            return *this;
+        }
+
+        PageIterator operator++(int) {
+            auto old = *this;
+            ++*this;
+            return old;
+        }
+
+        // Pages of one paginator differ by the number of elements left after them
+        bool operator==(const PageIterator &other) const noexcept {
+            return left_ == other.left_;
+        }
+        bool operator!=(const PageIterator &other) const noexcept {
+            return !(*this == other);
+        }
+
+      private:
+        difference_type GetPageLength() const noexcept {
+            return static_cast<difference_type>(std::min(page_size_, left_));
+        }
+
+        Iterator page_begin_{};
+        size_t left_ = 0;
+        size_t page_size_ = 1;
+    };
+
+    Paginator(Iterator begin, Iterator end, size_t page_size)
+        : begin_(begin), end_(end), size_(static_cast<size_t>(distance(begin, end))),
+          page_size_(std::max<size_t>(page_size, 1)) {}
+
+    PageIterator begin() const {
+        return {begin_, size_, page_size_};
     }
-    auto end() const noexcept {
-        return pages_.end();
+    PageIterator end() const {
+        return {end_, 0, page_size_};
     }
-    size_t size() const {
-        return pages_.size();
+    size_t size() const noexcept {
+        return (size_ + page_size_ - 1) / page_size_;
+    }
+
+    // Page of the given number, which must be less than size()
+    IteratorRange<Iterator> operator[](size_t index) const {
+        const size_t offset = index * page_size_;
+        const auto page_begin = std::next(begin_, static_cast<std::ptrdiff_t>(offset));
+        return {page_begin,
+                std::next(page_begin,
+                          static_cast<std::ptrdiff_t>(std::min(page_size_, size_ - offset)))};
     }
 
   private:
-    std::vector<IteratorRange<Iterator>> pages_;
+    Iterator begin_, end_;
+    size_t size_;
+    size_t page_size_;
 };
 
 template <typename Iterator>
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "memory_stats.h"
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <scoped_allocator>
+#include <utility>
+#include <vector>
+
+// Increasing word positions of a term in one document. Gaps between positions are stored as
+// variable length integers, 7 bits per byte, so a typical position takes a single byte. The
+// bytes are allocated with the allocator of the index holding the list, so they are counted
+// with it.
+class PositionList {
+  public:
+    using allocator_type = TrackingAllocator<uint8_t>;
+
+    PositionList() = default;
+    explicit PositionList(const allocator_type &allocator) : bytes_(allocator) {}
+    PositionList(const PositionList &other, const allocator_type &allocator)
+        : bytes_(other.bytes_, allocator), last_(other.last_), count_(other.count_) {}
+    PositionList(PositionList &&other, const allocator_type &allocator)
+        : bytes_(std::move(other.bytes_), allocator), last_(other.last_), count_(other.count_) {}
+    PositionList(const PositionList &) = default;
+    PositionList(PositionList &&) = default;
+    PositionList &operator=(const PositionList &) = default;
+    PositionList &operator=(PositionList &&) = default;
+
+    class Iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = uint32_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const uint32_t *;
+        using reference = uint32_t;
+
+        Iterator() = default;
+
+        uint32_t operator*() const noexcept {
+            return value_;
+        }
+
+        Iterator &operator++() noexcept {
+            data_ = next_;
+            Decode();
+            return *this;
+        }
+
+        Iterator operator++(int) noexcept {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const Iterator &other) const noexcept {
+            return data_ == other.data_;
+        }
+
+        bool operator!=(const Iterator &other) const noexcept {
+            return data_ != other.data_;
+        }
+
+      private:
+        friend class PositionList;
+
+        Iterator(const uint8_t *data, const uint8_t *end, uint32_t value) noexcept
+            : data_(data), end_(end), value_(value) {
+            Decode();
+        }
+
+        // Reads the gap at data_ and adds it to value_
+        void Decode() noexcept;
+
+        const uint8_t *data_ = nullptr;
+        const uint8_t *next_ = nullptr;
+        const uint8_t *end_ = nullptr;
+        uint32_t value_ = 0;
+    };
+
+    // position must be greater than every position already in the list
+    void Append(uint32_t position);
+
+    Iterator begin() const noexcept {
+        return {bytes_.data(), bytes_.data() + bytes_.size(), 0};
+    }
+
+    Iterator end() const noexcept {
+        const auto *data_end = bytes_.data() + bytes_.size();
+        return {data_end, data_end, 0};
+    }
+
+    size_t size() const noexcept {
+        return count_;
+    }
+
+    bool empty() const noexcept {
+        return count_ == 0;
+    }
+
+    size_t GetEncodedBytes() const noexcept {
+        return bytes_.capacity();
+    }
+
+  private:
+    std::vector<uint8_t, allocator_type> bytes_;
+    uint32_t last_ = 0;
+    uint32_t count_ = 0;
+};
+
+// Documents containing a word, with the word's positions in each of them. The lists take the
+// allocator of the map, so their bytes are counted in its counter.
+using PositionPostings =
+    std::map<int,
+             PositionList,
+             std::less<int>,
+             std::scoped_allocator_adaptor<TrackingAllocator<std::pair<const int, PositionList>>>>;
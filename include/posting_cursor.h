@@ -0,0 +1,51 @@
+#pragma once
+
+#include "posting_list.h"
+
+#include <limits>
+
+// Position in postings sorted by document id, for document-at-a-time evaluation. Postings
+// past max_id count as the end, so a cursor can walk a slice of a list.
+template <typename Postings>
+class PostingCursor {
+  public:
+    explicit PostingCursor(const Postings &postings,
+                           int min_id = std::numeric_limits<int>::min(),
+                           int max_id = std::numeric_limits<int>::max())
+        : postings_(&postings), it_(SeekPosting(postings, postings.begin(), min_id)),
+          max_id_(max_id) {}
+
+    bool IsAtEnd() const noexcept {
+        return it_ == postings_->end() || it_->first > max_id_;
+    }
+
+    int GetDocumentId() const noexcept {
+        return it_->first;
+    }
+
+    double GetValue() const noexcept {
+        return it_->second;
+    }
+
+    void Next() {
+        ++it_;
+    }
+
+    // Moves to the first posting whose document is not less than document_id
+    void SeekTo(int document_id) {
+        if (it_ != postings_->end() && it_->first < document_id) {
+            it_ = SeekPosting(*postings_, it_, document_id);
+        }
+    }
+
+    // Seeks to the document and tells if it is there
+    bool Contains(int document_id) {
+        SeekTo(document_id);
+        return !IsAtEnd() && it_->first == document_id;
+    }
+
+  private:
+    const Postings *postings_;
+    typename Postings::const_iterator it_;
+    int max_id_;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "memory_stats.h"
+
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Documents containing a word, with the word's term frequency in each of them
+using PostingList =
+    std::map<int, double, std::less<int>, TrackingAllocator<std::pair<const int, double>>>;
+
+// Postings merged from several words, sorted by document id
+using MergedPostings = std::vector<std::pair<int, double>>;
+
+// Returns the first posting at or after it whose document is not less than document_id.
+// Nearby postings are reached by a few steps, farther ones by a search from the tree root.
+PostingList::const_iterator
+SeekPosting(const PostingList &postings, PostingList::const_iterator it, int document_id);
+
+// Same for merged postings: the distance is galloped with doubling steps, then the last
+// step is binary searched, so a seek costs the logarithm of the distance skipped
+MergedPostings::const_iterator
+SeekPosting(const MergedPostings &postings, MergedPostings::const_iterator it, int document_id);
+
+// Postings of the given documents, in the order of document_ids, which must be sorted
+template <typename Postings>
+MergedPostings IntersectPostings(const Postings &postings, const std::vector<int> &document_ids) {
+    MergedPostings result;
+    auto it = postings.begin();
+    for (const int document_id : document_ids) {
+        it = SeekPosting(postings, it, document_id);
+        if (it == postings.end()) {
+            break;
+        }
+        if (it->first == document_id) {
+            result.emplace_back(it->first, it->second);
+        }
+    }
+    return result;
+}
+
+// Postings whose documents lie in [min_id, max_id], as a pair of iterators
+template <typename Postings>
+std::pair<typename Postings::const_iterator, typename Postings::const_iterator>
+SlicePostings(const Postings &postings, int min_id, int max_id) {
+    const auto first = SeekPosting(postings, postings.begin(), min_id);
+    if (max_id == std::numeric_limits<int>::max()) {
+        return {first, postings.end()};
+    }
+    return {first, SeekPosting(postings, first, max_id + 1)};
+}
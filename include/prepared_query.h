@@ -0,0 +1,107 @@
+#pragma once
+
+#include "position_list.h"
+#include "posting_list.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class SearchServer;
+
+// Query that has been parsed, validated, stop-word filtered and resolved against the index
+// of a SearchServer once. It can be passed to FindTopDocuments and MatchDocument as many
+// times as needed. If the server has been modified since preparation, the words are
+// re-resolved on use, but the text is never parsed again.
+class PreparedQuery {
+  public:
+    PreparedQuery() = default;
+
+    std::vector<std::string_view> GetPlusWords() const;
+    std::vector<std::string_view> GetMinusWords() const;
+
+    const std::vector<std::string_view> &GetStopWords() const noexcept {
+        return stop_words_;
+    }
+
+    // Plus words and patterns every found document must contain: +word, or all of them in
+    // the all-terms mode
+    std::vector<std::string_view> GetRequiredWords() const;
+
+    // Index words that prefix* and word~N patterns stand for
+    std::vector<std::string_view> GetExpandedWords() const;
+
+    // Words of every quoted phrase, stop words excluded
+    std::vector<std::vector<std::string_view>> GetPhrases() const;
+
+    bool IsEmpty() const noexcept {
+        return plus_terms_.empty() && plus_expanded_terms_.empty();
+    }
+
+  private:
+    friend class SearchServer;
+
+    struct Term {
+        std::string_view word;
+        const PostingList *postings = nullptr;
+        double inverse_document_freq = 0.0;
+        bool is_required = false;
+
+        bool Contains(int document_id) const {
+            return postings != nullptr && postings->count(document_id) > 0;
+        }
+    };
+
+    struct ExpandedWord : Term {
+        // Share of the word's tf-idf that goes to the score
+        double weight = 1.0;
+    };
+
+    // Pattern matching several words of the index: prefix* or word~N, the words within N
+    // edits of the word. Its documents are the union of the words' documents, and score as
+    // if the words were all in the query, each with its weight.
+    struct ExpandedTerm {
+        // Pattern as written, without the minus
+        std::string_view text;
+        std::string_view word;
+        // -1 for a prefix
+        int max_edits = -1;
+        bool is_required = false;
+        std::vector<ExpandedWord> words;
+        // Sorted by document id, with the weighted sum of the words' term frequencies. Inverse
+        // document frequencies change with the collection, so a search applies them when it
+        // scores the words one by one.
+        MergedPostings postings;
+
+        bool Contains(int document_id) const;
+    };
+
+    struct PhraseTerm {
+        std::string_view word;
+        // Position of the word relative to the first word of the phrase
+        uint32_t offset = 0;
+        const PositionPostings *positions = nullptr;
+    };
+
+    // Document matches a plus phrase if it contains all the words at the same offsets, a
+    // minus phrase excludes such documents. Terms are kept rarest first once resolved.
+    struct Phrase {
+        std::vector<PhraseTerm> terms;
+        bool is_minus = false;
+    };
+
+    // Owns the query text the words point to; shared so that copies stay cheap
+    std::shared_ptr<const std::string> text_;
+
+    std::vector<Term> plus_terms_;
+    std::vector<Term> minus_terms_;
+    std::vector<ExpandedTerm> plus_expanded_terms_;
+    std::vector<ExpandedTerm> minus_expanded_terms_;
+    std::vector<std::string_view> stop_words_;
+    std::vector<Phrase> phrases_;
+
+    const SearchServer *server_ = nullptr;
+    uint64_t revision_ = 0;
+};
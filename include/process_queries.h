@@ -1,5 +1,6 @@
 #pragma once
 
+#include "numa_search_server.h"
 #include "search_server.h"
 
 #include <list>
@@ -8,4 +9,11 @@ std::vector<std::vector<Document>> ProcessQueries(const SearchServer &search_ser
                                                   const std::vector<std::string> &queries);
 
 std::list<Document> ProcessQueriesJoined(const SearchServer &search_server,
-                                         const std::vector<std::string> &queries);
\ No newline at end of file
+                                         const std::vector<std::string> &queries);
+
+// Each NUMA node answers a contiguous block of the queries from its own replica
+std::vector<std::vector<Document>> ProcessQueries(const NumaSearchServer &search_server,
+                                                  const std::vector<std::string> &queries);
+
+std::list<Document> ProcessQueriesJoined(const NumaSearchServer &search_server,
+                                         const std::vector<std::string> &queries);
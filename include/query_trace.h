@@ -0,0 +1,79 @@
+#pragma once
+
+#include "document.h"
+#include "search_metrics.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct QueryTermTrace {
+    std::string word;
+    // 0 if the word is not in the index
+    size_t posting_length = 0;
+    double inverse_document_freq = 0.0;
+    // For a plus term the postings accepted by the predicate, for a minus term the
+    // candidates it removed
+    size_t documents = 0;
+    // Number of index words a pattern like prefix* stood for, 0 for an ordinary word
+    size_t expansions = 0;
+};
+
+// What happened to a query on its way through FindTopDocuments, filled by
+// SearchServer::ExplainQuery
+struct QueryTrace {
+    std::string raw_query;
+    std::vector<QueryTermTrace> plus_terms;
+    std::vector<QueryTermTrace> minus_terms;
+    std::vector<std::string> stop_words;
+
+    // Postings visited: a plus term is scanned over the candidates and the id range of a
+    // filter only, so this may be less than the sum of the posting lengths
+    size_t postings_scanned = 0;
+    size_t postings_accepted = 0;
+    size_t documents_scored = 0;
+    size_t documents_excluded = 0;
+    // Documents left after minus words, before the top is cut
+    size_t candidate_count = 0;
+
+    // Durations in nanoseconds, in the order the stages ran
+    std::vector<std::pair<SearchStage, uint64_t>> stage_durations;
+
+    std::vector<Document> results;
+
+    uint64_t GetStageDuration(SearchStage stage) const;
+
+    void WriteJson(std::ostream &out) const;
+    std::string ToJson() const;
+};
+
+// Adds duration of the enclosing scope to the trace, does nothing without a trace
+class TraceTimer {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    TraceTimer(QueryTrace *trace, SearchStage stage)
+        : trace_(trace), stage_(stage),
+          start_time_(trace != nullptr ? Clock::now() : Clock::time_point{}) {}
+
+    TraceTimer(const TraceTimer &) = delete;
+    TraceTimer &operator=(const TraceTimer &) = delete;
+
+    ~TraceTimer() {
+        if (trace_ != nullptr) {
+            const auto duration = Clock::now() - start_time_;
+            trace_->stage_durations.emplace_back(
+                stage_, static_cast<uint64_t>(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+                                .count()));
+        }
+    }
+
+  private:
+    QueryTrace *const trace_;
+    const SearchStage stage_;
+    const Clock::time_point start_time_;
+};
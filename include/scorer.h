@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Scorers are passed to FindTopDocuments as a template parameter. Both functions are static,
+// so the call in the scoring loop is resolved at compile time and inlined.
+//
+// term_freq is the share of the document's words equal to the query word, document_length
+// is the number of the document's words, stop words excluded.
+
+// Classic tf * log(N / df)
+struct TfIdfScorer {
+    static double ComputeInverseDocumentFreq(size_t document_count, size_t document_freq) {
+        return std::log(static_cast<double>(document_count) / static_cast<double>(document_freq));
+    }
+
+    static double Score(double term_freq,
+                        double inverse_document_freq,
+                        uint32_t /*document_length*/,
+                        double /*average_document_length*/) {
+        return term_freq * inverse_document_freq;
+    }
+};
+
+// Okapi BM25: term frequency saturates with K1, B controls length normalization. The length
+// norm is computed per posting rather than stored with the document: it depends on the
+// average length, which every change of the collection moves, and its division costs little
+// next to the lookup of the document's metadata that precedes it.
+template <double K1 = 1.2, double B = 0.75>
+struct BasicBm25Scorer {
+    static double ComputeInverseDocumentFreq(size_t document_count, size_t document_freq) {
+        const auto df = static_cast<double>(document_freq);
+        return std::log(1.0 + (static_cast<double>(document_count) - df + 0.5) / (df + 0.5));
+    }
+
+    static double Score(double term_freq,
+                        double inverse_document_freq,
+                        uint32_t document_length,
+                        double average_document_length) {
+        const double count = term_freq * document_length;
+        const double length_norm = 1.0 - B + B * document_length / average_document_length;
+        return inverse_document_freq * count * (K1 + 1.0) / (count + K1 * length_norm);
+    }
+};
+
+// BM25+: every occurrence is worth at least DELTA, so long documents are not pushed below
+// short ones that lack the word
+template <double K1 = 1.2, double B = 0.75, double DELTA = 1.0>
+struct BasicBm25PlusScorer {
+    static double ComputeInverseDocumentFreq(size_t document_count, size_t document_freq) {
+        return BasicBm25Scorer<K1, B>::ComputeInverseDocumentFreq(document_count,
+                                                                  document_freq);
+    }
+
+    static double Score(double term_freq,
+                        double inverse_document_freq,
+                        uint32_t document_length,
+                        double average_document_length) {
+        return BasicBm25Scorer<K1, B>::Score(term_freq, inverse_document_freq, document_length,
+                                             average_document_length) +
+               inverse_document_freq * DELTA;
+    }
+};
+
+using Bm25Scorer = BasicBm25Scorer<>;
+using Bm25PlusScorer = BasicBm25PlusScorer<>;
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "search_protocol.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Blocking client of SearchService. Requests can be pipelined: Send* only queue a request and
+// return its id, Flush writes the queue and Receive reads the next response. The blocking
+// calls send one request and wait for its response, they throw std::runtime_error with the
+// server's message if the request failed.
+class SearchClient {
+  public:
+    static SearchClient ConnectUnix(const std::string &path);
+    static SearchClient ConnectTcp(const std::string &host, uint16_t port);
+
+    SearchClient(SearchClient &&other) noexcept;
+    SearchClient &operator=(SearchClient &&other) noexcept;
+    SearchClient(const SearchClient &) = delete;
+    SearchClient &operator=(const SearchClient &) = delete;
+    ~SearchClient();
+
+    uint32_t SendSearch(std::string_view raw_query,
+                        DocumentStatus status = DocumentStatus::ACTUAL);
+    uint32_t SendMatch(std::string_view raw_query, int document_id);
+    uint32_t SendAdd(int document_id,
+                     std::string_view document,
+                     DocumentStatus status,
+                     const std::vector<int> &ratings);
+    uint32_t SendRemove(int document_id);
+
+    void Flush();
+    SearchResponse Receive();
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+                                           DocumentStatus status = DocumentStatus::ACTUAL);
+    std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(std::string_view raw_query,
+                                                                       int document_id);
+    void AddDocument(int document_id,
+                     std::string_view document,
+                     DocumentStatus status,
+                     const std::vector<int> &ratings);
+    void RemoveDocument(int document_id);
+
+  private:
+    explicit SearchClient(int fd) : fd_(fd) {}
+
+    // Flushes and returns the response of the last request sent
+    SearchResponse Call();
+
+    int fd_ = -1;
+    uint32_t next_request_id_ = 1;
+    std::string output_;
+    std::string input_;
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class SearchStage {
+    PARSE_QUERY,
+    SCORE_PLUS_WORDS,
+    BUILD_ORDINARY_MAP,
+    FILTER_MINUS_WORDS,
+    FILTER_PHRASES,
+    SORT_RESULTS,
+    ADD_DOCUMENT,
+    REMOVE_DOCUMENT,
+    UPDATE_DOCUMENT,
+};
+
+enum class SearchCounter {
+    POSTINGS_SCANNED,
+    DOCUMENTS_SCORED,
+    DOCUMENTS_EXCLUDED,
+};
+
+// Histogram of durations in nanoseconds with logarithmic buckets, each power of two split
+// into 16 linear sub-buckets, so a percentile is reported with at most 1/16 relative error.
+class LatencyHistogram {
+  public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+    static size_t GetBucketIndex(uint64_t value) noexcept;
+    static uint64_t GetBucketUpperBound(size_t index) noexcept;
+
+    void Record(uint64_t value, uint64_t count = 1) noexcept;
+
+    // Adds values known only by their bucket, their exact total goes to AddSum
+    void RecordBucket(size_t index, uint64_t count) noexcept;
+    void AddSum(uint64_t sum) noexcept;
+
+    void Merge(const LatencyHistogram &other) noexcept;
+    // Takes back values merged before, other must be a part of this histogram
+    void Subtract(const LatencyHistogram &other) noexcept;
+
+    uint64_t GetCount() const noexcept {
+        return count_;
+    }
+    uint64_t GetSum() const noexcept {
+        return sum_;
+    }
+    uint64_t GetBucket(size_t index) const noexcept {
+        return buckets_[index];
+    }
+
+    // Upper bound of the bucket holding the given quantile, 0 for an empty histogram
+    uint64_t GetPercentile(double quantile) const noexcept;
+
+  private:
+    std::array<uint64_t, BUCKET_COUNT> buckets_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+};
+
+// Process-wide metrics of the search pipeline. Every thread records into its own lock-free
+// storage, the storages are merged only when a snapshot is taken.
+class SearchMetrics {
+  public:
+    static const size_t STAGE_COUNT = static_cast<size_t>(SearchStage::UPDATE_DOCUMENT) + 1;
+    static const size_t COUNTER_COUNT =
+        static_cast<size_t>(SearchCounter::DOCUMENTS_EXCLUDED) + 1;
+
+    struct Snapshot {
+        std::array<LatencyHistogram, STAGE_COUNT> stages;
+        std::array<uint64_t, COUNTER_COUNT> counters{};
+    };
+
+    // Initially enabled if the SEARCH_SERVER_METRICS environment variable is set to 1
+    static SearchMetrics &Instance();
+
+    bool IsEnabled() const noexcept {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    void SetEnabled(bool enabled) noexcept {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+
+    void Record(SearchStage stage, uint64_t nanoseconds) noexcept;
+    void Add(SearchCounter counter, uint64_t value) noexcept;
+
+    Snapshot GetSnapshot() const;
+    // Later snapshots count from now on. Threads may go on recording meanwhile.
+    void Reset();
+
+    // Prometheus text exposition format: a summary per stage and a counter per counter
+    void WritePrometheus(std::ostream &out) const;
+    std::string ExportPrometheus() const;
+    void ExportPrometheus(const std::string &file_name) const;
+    void ExportPrometheus(const std::function<void(std::string_view)> &callback) const;
+
+    static std::string_view GetStageName(SearchStage stage);
+    static std::string_view GetCounterName(SearchCounter counter);
+
+  private:
+    struct ThreadStorage {
+        std::array<std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT>,
+                   STAGE_COUNT>
+            buckets{};
+        std::array<std::atomic<uint64_t>, STAGE_COUNT> sums{};
+        std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+    };
+
+    class ThreadStorageHolder;
+
+    SearchMetrics();
+
+    ThreadStorage &GetThreadStorage();
+    void Unregister(ThreadStorage *storage);
+    static void AddTo(const ThreadStorage &storage, Snapshot &snapshot);
+    // Everything recorded since the start, under mutex_
+    Snapshot GetTotal() const;
+
+    std::atomic<bool> enabled_{false};
+
+    mutable std::mutex mutex_;
+    std::vector<ThreadStorage *> storages_;
+    // Data of the threads that have already exited
+    Snapshot retired_;
+    // Totals at the last Reset, subtracted from snapshots. A storage is written by its
+    // thread only, so Reset leaves it alone rather than race with the thread.
+    Snapshot reset_totals_;
+};
+
+// Records duration of the enclosing scope as the given stage, if metrics were enabled when
+// the scope was entered
+class StageTimer {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit StageTimer(SearchStage stage) noexcept
+        : stage_(stage), enabled_(SearchMetrics::Instance().IsEnabled()),
+          start_time_(enabled_ ? Clock::now() : Clock::time_point{}) {}
+
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    ~StageTimer() {
+        if (enabled_) {
+            const auto duration = Clock::now() - start_time_;
+            SearchMetrics::Instance().Record(
+                stage_, static_cast<uint64_t>(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+                                .count()));
+        }
+    }
+
+  private:
+    const SearchStage stage_;
+    const bool enabled_;
+    const Clock::time_point start_time_;
+};
+
+#ifdef SEARCH_SERVER_METRICS
+#define METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define METRICS_CONCAT(X, Y) METRICS_CONCAT_INTERNAL(X, Y)
+#define SEARCH_METRICS_STAGE(stage)                                                           \
+    StageTimer METRICS_CONCAT(stageTimer, __LINE__)(SearchStage::stage)
+#define SEARCH_METRICS_ADD(counter, value)                                                    \
+    SearchMetrics::Instance().Add(SearchCounter::counter, static_cast<uint64_t>(value))
+#else
+#define SEARCH_METRICS_STAGE(stage)
+#define SEARCH_METRICS_ADD(counter, value)
+#endif
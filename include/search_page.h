@@ -0,0 +1,44 @@
+#pragma once
+
+#include "document.h"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Place of a document in the order of search results. Results after it are the next page,
+// however many documents were added or removed meanwhile.
+struct SearchCursor {
+    double relevance = 0.0;
+    int rating = 0;
+    int id = 0;
+};
+
+struct PageRequest {
+    // Documents skipped after the cursor, or from the start without one
+    size_t offset = 0;
+    size_t limit = 10;
+    std::optional<SearchCursor> search_after;
+};
+
+struct SearchPage {
+    std::vector<Document> documents;
+    // Cursor of the last document of the page, nothing if no documents follow it
+    std::optional<SearchCursor> next;
+};
+
+inline SearchCursor MakeCursor(const Document &document) {
+    return {document.relevance, document.rating, document.id};
+}
+
+// True if the document comes after the cursor in the order of IsRankedBefore
+inline bool IsAfterCursor(const Document &document, const SearchCursor &cursor) {
+    return IsRankedBefore({cursor.id, cursor.relevance, cursor.rating}, document);
+}
+
+// Opaque text form of a cursor, safe to hand to clients and take back. Decoding throws
+// std::invalid_argument if the text is not a cursor.
+std::string EncodeCursor(const SearchCursor &cursor);
+SearchCursor DecodeCursor(std::string_view text);
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "document.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Binary protocol of SearchService. Every message is a frame: a little-endian uint32 with the
+// size of the rest of the frame, then the header and the payload. Strings are a uint32 size
+// followed by the bytes, integers are little-endian, doubles are IEEE 754 bit patterns.
+//
+// Request header: uint32 request id, uint8 request type. Payloads:
+//   SEARCH  uint8 status, string query
+//   MATCH   int32 document id, string query
+//   ADD     int32 document id, uint8 status, uint32 rating count, int32 ratings, string text
+//   REMOVE  int32 document id
+//
+// Response header: uint32 request id, uint8 request type, uint8 response code. OK payloads:
+//   SEARCH  uint32 count, then int32 id, double relevance, int32 rating of each document
+//   MATCH   uint8 status, uint32 count, strings
+//   ADD, REMOVE  nothing
+// An ERROR payload is the message string.
+//
+// Requests of a connection may be pipelined, they are executed and answered in order.
+enum class SearchRequestType : uint8_t {
+    SEARCH = 1,
+    MATCH = 2,
+    ADD = 3,
+    REMOVE = 4,
+};
+
+enum class SearchResponseCode : uint8_t {
+    OK = 0,
+    ERROR = 1,
+};
+
+const size_t FRAME_SIZE_BYTES = 4;
+
+// Text fields point into the frame the request was parsed from
+struct SearchRequest {
+    uint32_t id = 0;
+    SearchRequestType type = SearchRequestType::SEARCH;
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::string_view text;
+    std::vector<int> ratings;
+};
+
+struct SearchResponse {
+    uint32_t request_id = 0;
+    SearchRequestType type = SearchRequestType::SEARCH;
+    SearchResponseCode code = SearchResponseCode::OK;
+    std::string error;
+    std::vector<Document> documents;
+    std::vector<std::string> words;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+};
+
+// Appends values to a buffer. A frame is written in place: BeginFrame reserves its size and
+// EndFrame fills it in, so nothing is serialized twice.
+class ByteWriter {
+  public:
+    explicit ByteWriter(std::string &buffer) : buffer_(buffer) {}
+
+    void PutUint8(uint8_t value);
+    void PutUint32(uint32_t value);
+    void PutInt32(int32_t value);
+    void PutDouble(double value);
+    void PutString(std::string_view value);
+
+    void BeginFrame();
+    void EndFrame();
+
+  private:
+    std::string &buffer_;
+    size_t frame_start_ = 0;
+};
+
+// Reads values of a frame, throws std::invalid_argument if the frame ends too early
+class ByteReader {
+  public:
+    explicit ByteReader(std::string_view data) : data_(data) {}
+
+    uint8_t GetUint8();
+    uint32_t GetUint32();
+    int32_t GetInt32();
+    double GetDouble();
+    std::string_view GetString();
+
+    bool IsEmpty() const noexcept {
+        return data_.empty();
+    }
+
+  private:
+    std::string_view Take(size_t size);
+
+    std::string_view data_;
+};
+
+// Size of the first frame of the buffer with its size field, nothing if it is incomplete
+std::optional<size_t> GetFrameSize(std::string_view buffer);
+
+// frame is a whole frame with its size field
+SearchRequest ParseSearchRequest(std::string_view frame);
+SearchResponse ParseSearchResponse(std::string_view frame);
+
+void WriteSearchRequest(std::string &buffer,
+                        uint32_t id,
+                        std::string_view query,
+                        DocumentStatus status);
+void WriteMatchRequest(std::string &buffer,
+                       uint32_t id,
+                       std::string_view query,
+                       int document_id);
+void WriteAddRequest(std::string &buffer,
+                     uint32_t id,
+                     int document_id,
+                     std::string_view text,
+                     DocumentStatus status,
+                     const std::vector<int> &ratings);
+void WriteRemoveRequest(std::string &buffer, uint32_t id, int document_id);
+
+void WriteSearchResponse(std::string &buffer,
+                         uint32_t request_id,
+                         const std::vector<Document> &documents);
+void WriteMatchResponse(std::string &buffer,
+                        uint32_t request_id,
+                        const std::tuple<std::vector<std::string>, DocumentStatus> &match);
+void WriteEmptyResponse(std::string &buffer, uint32_t request_id, SearchRequestType type);
+void WriteErrorResponse(std::string &buffer,
+                        uint32_t request_id,
+                        SearchRequestType type,
+                        std::string_view message);
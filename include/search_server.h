@@ -1,14 +1,38 @@
 #pragma once
 
 #include "concurrent_map.h"
+#include "cow_ptr.h"
 #include "document.h"
+#include "document_filter.h"
+#include "impact_postings.h"
+#include "index_statistics.h"
+#include "memory_stats.h"
+#include "posting_cursor.h"
+#include "prepared_query.h"
+#include "query_trace.h"
+#include "scorer.h"
+#include "search_metrics.h"
+#include "search_page.h"
+#include "stop_word_set.h"
+#include "string_pool.h"
 #include "string_processing.h"
+#include "word_frequencies.h"
 
 #include <algorithm>
 #include <execution>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <memory>
+#include <optional>
+#include <scoped_allocator>
+#include <set>
 #include <stdexcept>
-#include <unordered_set>
+#include <tuple>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
 
 #define GetStatusPredicate(status)                                                            \
     [status](int document_id, DocumentStatus document_status, int rating) {                   \
@@ -17,22 +41,73 @@
 
 static const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
+// How plus words of a query combine. In ANY mode a document is found if it has any of them,
+// unless some are marked +word; in ALL mode it must have every one.
+enum class QueryMode {
+    ANY,
+    ALL,
+};
+
+// How a sequential FindTopDocuments walks the postings
+enum class QueryEvaluation {
+    // Word by word, the scores of all found documents are added up in a map
+    TERM_AT_A_TIME,
+    // Document by document, all the words at once: a document is scored and checked in one
+    // step, and only the top is kept
+    DOCUMENT_AT_A_TIME,
+};
+
+struct SearchServerOptions {
+    // Keep word positions of every document, needed for "quoted phrase" queries. Without
+    // them the index holds nothing but term frequencies.
+    bool store_positions = false;
+    // A prefix* pattern stands for at most this many words, the most frequent ones
+    size_t max_term_expansions = 64;
+    // Largest N accepted in a word~N pattern
+    int max_edit_distance = 2;
+    // Mode of queries that do not choose one
+    QueryMode query_mode = QueryMode::ANY;
+    // Parallel searches and ExplainQuery are always term at a time
+    QueryEvaluation evaluation = QueryEvaluation::TERM_AT_A_TIME;
+    // Statistics shared with other servers of the same collection, used for ranking instead
+    // of the server's own. The server keeps them up to date, so they must outlive it. A copy
+    // or clone of the server is not one of the servers: it gets its own copy of the
+    // statistics as they were, so its changes are not counted in the collection.
+    IndexStatistics *statistics = nullptr;
+};
+
 class SearchServer {
   public:
+    using WordFrequencies = ::WordFrequencies;
+
     template <typename StringContainer>
-    explicit SearchServer(StringContainer stop_words);
+    explicit SearchServer(StringContainer stop_words, const SearchServerOptions &options = {});
+
+    explicit SearchServer(std::string stop_words_text, const SearchServerOptions &options = {})
+        : SearchServer(std::string_view(stop_words_text), options) {}
+    explicit SearchServer(std::string_view stop_words_text,
+                          const SearchServerOptions &options = {})
+        : SearchServer(SplitIntoWords(stop_words_text), options) {}
+
+    // A copy owns all of its memory, so a replica can be placed apart from the original
+    SearchServer(const SearchServer &) = default;
+    SearchServer &operator=(const SearchServer &) = default;
+    SearchServer(SearchServer &&) = default;
+    SearchServer &operator=(SearchServer &&) = default;
 
-    explicit SearchServer(std::string stop_words_text)
-        : SearchServer(std::string_view(stop_words_text)) {}
-    explicit SearchServer(std::string_view stop_words_text)
-        : SearchServer(SplitIntoWords(stop_words_text)) {}
+    // Copy that shares every structure of the index with this server, taken in O(1). The
+    // first change of a structure by either server copies it, so a change costs as much as
+    // copying the structures it touches: a new status or rating copies the document table,
+    // not the postings. Prepared queries of this server stay valid for the clone. Shared
+    // statistics are the exception: the clone copies them, see SearchServerOptions.
+    SearchServer Clone() const;
 
     auto begin() const noexcept {
-        return document_ids_.begin();
+        return document_ids_->begin();
     }
 
     auto end() const noexcept {
-        return document_ids_.end();
+        return document_ids_->end();
     }
 
     void AddDocument(int document_id,
@@ -40,40 +115,115 @@ class SearchServer {
                      DocumentStatus status,
                      const std::vector<int> &ratings);
 
+    // Replaces the text, status and ratings of a document at once. Only postings of the words
+    // whose frequency changed are touched, the others stay as they are.
+    void UpdateDocument(int document_id,
+                        std::string_view document,
+                        DocumentStatus status,
+                        const std::vector<int> &ratings);
+    // Changes status and ratings only, the postings are not touched
+    void UpdateDocument(int document_id, DocumentStatus status, const std::vector<int> &ratings);
+
     int GetDocumentCount() const noexcept {
-        return static_cast<int>(documents_.size());
+        return static_cast<int>(documents_->size());
     }
 
-    const std::map<std::string_view, double, std::less<>> &
-    GetWordFrequencies(int document_id) const;
+    // View of the document's row of the forward index, valid until the server is changed
+    WordFrequencies GetWordFrequencies(int document_id) const;
+
+    DocumentStatus GetDocumentStatus(int document_id) const;
+    // Average of the ratings the document was added with
+    int GetDocumentRating(int document_id) const;
+
+    // Text that indexes into the same postings as the document did. Stop words and word
+    // order are lost, unless positions are stored: then the words are in their order and
+    // a stop word fills each gap, so phrases still match.
+    std::string GetDocumentText(int document_id) const;
+
+    MemoryStats GetMemoryStats() const;
 
     void RemoveDocument(const int document_id);
     void RemoveDocument(const std::execution::sequenced_policy &, int document_id);
     void RemoveDocument(const std::execution::parallel_policy &, int document_id);
 
+    // Scorer is a compile-time relevance policy from scorer.h, TF-IDF by default
+    template <typename Scorer = TfIdfScorer>
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
+    template <typename Scorer = TfIdfScorer>
     std::vector<Document> FindTopDocuments(std::string_view raw_query,
                                            DocumentStatus status) const;
 
-    template <typename DocumentPredicate>
+    template <typename Scorer = TfIdfScorer, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(std::string_view raw_query,
                                            const DocumentPredicate &document_predicate) const;
 
-    template <typename ExecutionPolicy>
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
                                            std::string_view raw_query) const;
 
-    template <typename ExecutionPolicy>
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
                                            std::string_view raw_query,
                                            DocumentStatus status) const;
 
-    template <typename ExecutionPolicy, typename DocumentPredicate>
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
                                            std::string_view raw_query,
                                            const DocumentPredicate &document_predicate) const;
 
+    PreparedQuery PrepareQuery(std::string_view raw_query) const;
+    PreparedQuery PrepareQuery(std::string_view raw_query, QueryMode mode) const;
+
+    template <typename Scorer = TfIdfScorer>
+    std::vector<Document> FindTopDocuments(const PreparedQuery &query) const;
+
+    template <typename Scorer = TfIdfScorer>
+    std::vector<Document> FindTopDocuments(const PreparedQuery &query,
+                                           DocumentStatus status) const;
+
+    template <typename Scorer = TfIdfScorer, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const PreparedQuery &query,
+                                           const DocumentPredicate &document_predicate) const;
+
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
+                                           const PreparedQuery &query) const;
+
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
+                                           const PreparedQuery &query,
+                                           DocumentStatus status) const;
+
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
+                                           const PreparedQuery &query,
+                                           const DocumentPredicate &document_predicate) const;
+
+    // Runs the query the way FindTopDocuments does and reports what every stage did
+    template <typename Scorer = TfIdfScorer>
+    QueryTrace ExplainQuery(std::string_view raw_query) const;
+
+    template <typename Scorer = TfIdfScorer>
+    QueryTrace ExplainQuery(std::string_view raw_query, DocumentStatus status) const;
+
+    template <typename Scorer = TfIdfScorer, typename DocumentPredicate>
+    QueryTrace ExplainQuery(std::string_view raw_query,
+                            const DocumentPredicate &document_predicate) const;
+
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy>
+    QueryTrace ExplainQuery(ExecutionPolicy &&policy, std::string_view raw_query) const;
+
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy>
+    QueryTrace ExplainQuery(ExecutionPolicy &&policy,
+                            std::string_view raw_query,
+                            DocumentStatus status) const;
+
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy, typename DocumentPredicate>
+    QueryTrace ExplainQuery(ExecutionPolicy &&policy,
+                            std::string_view raw_query,
+                            const DocumentPredicate &document_predicate) const;
+
     std::tuple<std::vector<std::string>, DocumentStatus>
     MatchDocument(std::string_view raw_query, int document_id) const;
 
@@ -87,154 +237,1379 @@ class SearchServer {
                   std::string_view raw_query,
                   int document_id) const;
 
+    std::tuple<std::vector<std::string>, DocumentStatus>
+    MatchDocument(const PreparedQuery &query, int document_id) const;
+
+    std::tuple<std::vector<std::string>, DocumentStatus>
+    MatchDocument(const std::execution::sequenced_policy &,
+                  const PreparedQuery &query,
+                  int document_id) const;
+
+    std::tuple<std::vector<std::string>, DocumentStatus>
+    MatchDocument(const std::execution::parallel_policy &,
+                  const PreparedQuery &query,
+                  int document_id) const;
+
+    std::vector<std::tuple<std::vector<std::string>, DocumentStatus>>
+    MatchDocuments(const PreparedQuery &query, const std::vector<int> &document_ids) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<std::tuple<std::vector<std::string>, DocumentStatus>>
+    MatchDocuments(ExecutionPolicy &&policy,
+                   const PreparedQuery &query,
+                   const std::vector<int> &document_ids) const;
+
+    // A page of the results in the order of IsRankedBefore, MAX_RESULT_DOCUMENT_COUNT does
+    // not apply. Only the top offset + limit documents after the cursor are selected: in the
+    // heap of a document-at-a-time search, or by a partial sort of all found documents.
+    template <typename Scorer = TfIdfScorer>
+    SearchPage FindDocumentsPage(std::string_view raw_query, const PageRequest &page) const;
+
+    template <typename Scorer = TfIdfScorer>
+    SearchPage FindDocumentsPage(std::string_view raw_query,
+                                 DocumentStatus status,
+                                 const PageRequest &page) const;
+
+    template <typename Scorer = TfIdfScorer, typename DocumentPredicate>
+    SearchPage FindDocumentsPage(std::string_view raw_query,
+                                 const DocumentPredicate &document_predicate,
+                                 const PageRequest &page) const;
+
+    // Ids of the documents rated within [min_rating, max_rating], highest rated first
+    std::vector<int> GetDocumentsByRating(int min_rating, int max_rating) const;
+
+    // Documents found by the query ordered by rating, equally rated ones by relevance. The
+    // rating index is searched from the top, so a broad query stops at the first few
+    // hundred best rated documents instead of scoring all of them.
+    template <typename Scorer = TfIdfScorer>
+    std::vector<Document> FindTopRatedDocuments(std::string_view raw_query) const;
+
+    template <typename Scorer = TfIdfScorer>
+    std::vector<Document> FindTopRatedDocuments(std::string_view raw_query,
+                                                DocumentStatus status) const;
+
+    template <typename Scorer = TfIdfScorer, typename DocumentPredicate>
+    std::vector<Document>
+    FindTopRatedDocuments(std::string_view raw_query,
+                          const DocumentPredicate &document_predicate) const;
+
+    // Impact index: a read-only copy of the postings where every posting holds its score
+    // under Scorer, quantized to a byte, ordered by impact. It is dropped by the next change
+    // of the server and has to be built again.
+    template <typename Scorer = TfIdfScorer>
+    void BuildImpactIndex();
+
+    // True if the impact index is built for Scorer
+    template <typename Scorer = TfIdfScorer>
+    bool HasImpactIndex() const noexcept {
+        return impact_scorer_ == std::type_index(typeid(Scorer));
+    }
+
+    // Score of one impact unit, a posting's impact is off its score by half of it at most
+    double GetImpactQuantum() const noexcept {
+        return impact_quantum_;
+    }
+
+    // Top documents found score-at-a-time on the impact index: postings of all the words are
+    // taken highest impact first, and the scan stops once the rest of them cannot bring
+    // another document into the top. Found documents are scored exactly, only their choice is
+    // approximate: a document left out is not more relevant than a returned one by more
+    // than GetImpactQuantum() times the number of plus words. Without the index for Scorer,
+    // and for queries with patterns, phrases or required words, it is FindTopDocuments.
+    template <typename Scorer = TfIdfScorer>
+    std::vector<Document> FindTopDocumentsByImpact(std::string_view raw_query) const;
+
+    template <typename Scorer = TfIdfScorer>
+    std::vector<Document> FindTopDocumentsByImpact(std::string_view raw_query,
+                                                   DocumentStatus status) const;
+
+    template <typename Scorer = TfIdfScorer, typename DocumentPredicate>
+    std::vector<Document>
+    FindTopDocumentsByImpact(std::string_view raw_query,
+                             const DocumentPredicate &document_predicate) const;
+
   private:
+    // Calls the search with its configured top size and evaluation fixed at compile time
+    template <typename Config>
+    friend class StaticSearchServer;
+
+    struct CloneTag {};
+
+    SearchServer(const SearchServer &other, CloneTag);
+
     struct DocumentData {
         int rating;
         DocumentStatus status;
+        // Number of words, stop words excluded
+        uint32_t length;
+        // Row of the document in forward_index_
+        uint32_t word_count = 0;
+        size_t words_offset = 0;
     };
 
     struct QueryWord {
         std::string_view data;
         bool is_minus;
-        bool is_stop;
+        // +word
+        bool is_required;
+        bool is_prefix;
+        // Edits allowed by word~N, -1 for an exact word
+        int max_edits;
     };
 
-    struct Query {
-        std::set<std::string_view> plus_words;
-        std::set<std::string_view> minus_words;
+    template <typename T>
+    using Allocator = std::scoped_allocator_adaptor<TrackingAllocator<T>>;
+
+    // Structures of the index are shared by clones until one of them changes, see Clone
+    CowPtr<StringPool> all_words_;
+    CowPtr<StopWordSet> stop_words_;
+
+    CowPtr<std::map<std::string_view,
+                    PostingList,
+                    std::less<>,
+                    Allocator<std::pair<const std::string_view, PostingList>>>>
+        word_to_document_freqs_;
+    // Forward index in compressed sparse row layout: the rows of all documents, each sorted
+    // by word, in one buffer. A removed or rewritten row is left in place as garbage until
+    // garbage makes up half of the buffer, then the live rows are compacted.
+    CowPtr<std::vector<WordFrequency, TrackingAllocator<WordFrequency>>> forward_index_;
+    size_t forward_index_garbage_ = 0;
+
+    size_t max_term_expansions_ = 0;
+    int max_edit_distance_ = 0;
+    QueryMode query_mode_ = QueryMode::ANY;
+    QueryEvaluation evaluation_ = QueryEvaluation::TERM_AT_A_TIME;
+    // Points to the shared statistics or to a copy of them the server owns, see
+    // SearchServerOptions::statistics
+    class Statistics {
+      public:
+        Statistics() = default;
+        explicit Statistics(IndexStatistics *shared) : statistics_(shared) {}
+        Statistics(const Statistics &other) {
+            *this = other;
+        }
+        Statistics &operator=(const Statistics &other) {
+            if (this != &other) {
+                owned_ = other.statistics_ != nullptr
+                             ? std::make_unique<IndexStatistics>(*other.statistics_)
+                             : nullptr;
+                statistics_ = owned_.get();
+            }
+            return *this;
+        }
+        // The owned copy stays where it is, so the pointer moves along with it
+        Statistics(Statistics &&other) noexcept
+            : owned_(std::move(other.owned_)),
+              statistics_(std::exchange(other.statistics_, nullptr)) {}
+        Statistics &operator=(Statistics &&other) noexcept {
+            owned_ = std::move(other.owned_);
+            statistics_ = std::exchange(other.statistics_, nullptr);
+            return *this;
+        }
+
+        explicit operator bool() const noexcept {
+            return statistics_ != nullptr;
+        }
+        IndexStatistics *operator->() const noexcept {
+            return statistics_;
+        }
+
+      private:
+        std::unique_ptr<IndexStatistics> owned_;
+        IndexStatistics *statistics_ = nullptr;
     };
+    Statistics statistics_;
+
+    // Empty unless positions are stored
+    bool store_positions_ = false;
+    CowPtr<std::map<std::string_view,
+                    PositionPostings,
+                    std::less<>,
+                    Allocator<std::pair<const std::string_view, PositionPostings>>>>
+        word_to_document_positions_;
 
-    std::unordered_set<std::string> all_words_;
-    std::set<std::string, std::less<>> stop_words_;
+    CowPtr<std::map<int, DocumentData, std::less<>, Allocator<std::pair<const int, DocumentData>>>>
+        documents_;
+    CowPtr<std::set<int, std::less<>, Allocator<int>>> document_ids_;
+    // Documents by rating and id, for rating range filters and rating ordered retrieval
+    CowPtr<std::set<std::pair<int, int>, std::less<>, Allocator<std::pair<int, int>>>>
+        rating_index_;
+    // Sum of the lengths of all documents, for length normalization of the scorers
+    uint64_t total_document_length_ = 0;
 
-    std::map<std::string_view, std::map<int, double>, std::less<>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double, std::less<>>> document_to_words_freqs_;
+    // Empty unless built, see BuildImpactIndex
+    CowPtr<std::map<std::string_view,
+                    ImpactPostings,
+                    std::less<>,
+                    Allocator<std::pair<const std::string_view, ImpactPostings>>>>
+        word_to_impacts_;
+    std::optional<std::type_index> impact_scorer_;
+    double impact_quantum_ = 0.0;
 
-    std::map<int, DocumentData> documents_;
-    std::set<int> document_ids_;
+    // Lets prepared queries detect stale lookups. Renewed on every modification, and a server
+    // copied or moved into gets a new one: a query prepared by the assigned server points
+    // into structures the assignment has freed.
+    class Revision {
+      public:
+        Revision() : value_(NextRevision()) {}
+        Revision(const Revision &) : Revision() {}
+        Revision &operator=(const Revision &) {
+            Renew();
+            return *this;
+        }
+
+        void Renew() {
+            value_ = NextRevision();
+        }
+
+        uint64_t Get() const noexcept {
+            return value_;
+        }
+
+      private:
+        uint64_t value_;
+    };
+    Revision revision_;
 
   private:
+    static uint64_t NextRevision();
+
     static int ComputeAverageRating(const std::vector<int> &ratings);
 
     [[nodiscard]] static bool IsValidWord(const std::string_view word);
 
-    [[nodiscard]] bool IsStopWord(const std::string_view word) const {
-        return stop_words_.count(word) > 0;
-    }
-    [[nodiscard]] bool IsWordFound(const std::string_view word, const int document_id) const {
-        return word_to_document_freqs_.count(word) &&
-               word_to_document_freqs_.at(word).count(document_id);
-    }
+    // Words of a document but the stop words, with their positions among all words of the
+    // text if positions are stored
+    struct DocumentWords {
+        std::vector<std::string_view> words;
+        std::vector<uint32_t> positions;
+    };
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+    // Documents and queries are split with the server's own StopWordSet, or with the
+    // StaticStopWordSet of a StaticSearchServer, known to the compiler
+    template <typename StopWords>
+    DocumentWords SplitDocument(std::string_view text, const StopWords &stop_words) const;
+
+    void AddDocumentWords(int document_id,
+                          const DocumentWords &document_words,
+                          DocumentStatus status,
+                          const std::vector<int> &ratings);
+    void UpdateDocumentWords(int document_id,
+                             const DocumentWords &document_words,
+                             DocumentStatus status,
+                             const std::vector<int> &ratings);
 
     QueryWord ParseQueryWord(std::string_view text) const;
 
-    Query ParseQuery(std::string_view text) const;
+    void ParseQuery(std::string_view text, PreparedQuery &query, QueryMode mode) const;
+    // Terms, phrases and stop words of the text go to query, unsorted and not resolved
+    template <typename StopWords>
+    void ParseQueryWords(std::string_view text,
+                         const StopWords &stop_words,
+                         PreparedQuery &query,
+                         QueryMode mode) const;
+    // Drops repeated terms and resolves the query
+    void FinishQuery(PreparedQuery &query) const;
+
+    void ResolveQuery(PreparedQuery &query) const;
+
+    // Index word matching a pattern, with its edit distance from the pattern
+    using Expansion =
+        std::pair<int, decltype(word_to_document_freqs_)::element_type::const_iterator>;
+
+    void ExpandPrefix(PreparedQuery::ExpandedTerm &term) const;
+    void ExpandFuzzy(PreparedQuery::ExpandedTerm &term) const;
+
+    // Keeps at most max_term_expansions_ closest and then most frequent expansions
+    void AddExpansion(std::vector<Expansion> &expansions, Expansion expansion) const;
+    void SetExpansions(PreparedQuery::ExpandedTerm &term,
+                       std::vector<Expansion> &expansions) const;
+
+    // Unions postings of the words of the term into its own sorted list
+    static void MergePostings(PreparedQuery::ExpandedTerm &term);
+
+    static void AddMatchedExpansions(const PreparedQuery &query,
+                                     int document_id,
+                                     std::vector<std::string> &matched_words);
+
+    // Returns query itself if it is resolved against the current index, otherwise
+    // re-resolves a copy of it in storage
+    const PreparedQuery &ActualizeQuery(const PreparedQuery &query,
+                                        PreparedQuery &storage) const;
+
+    // Collection-wide numbers: from the shared statistics if there are any
+    size_t GetCollectionDocumentCount() const;
+    size_t GetCollectionDocumentFreq(std::string_view word, const PostingList &postings) const;
+    double GetAverageDocumentLength() const;
+
+    double ComputeInverseDocumentFreq(std::string_view word, const PostingList &postings) const;
+
+    std::vector<std::string_view> GetDocumentWords(int document_id) const;
+
+    bool MatchesPhrase(const PreparedQuery::Phrase &phrase, int document_id) const;
+
+    // True if the document has every plus phrase of the query and none of the minus ones
+    bool MatchesPhrases(const PreparedQuery &query, int document_id) const;
+
+    void FilterPhrases(const PreparedQuery &query, std::map<int, double> &doc_to_rel) const;
+
+    void ErasePositions(std::string_view word, int document_id);
+
+    // Appends row, sorted by word, to the forward index as the document's new row
+    void SetDocumentWords(DocumentData &data, const std::vector<WordFrequency> &row);
+    // Leaves the document's row as garbage
+    void ReleaseDocumentWords(DocumentData &data) noexcept;
+    // Rewrites the live rows into a new buffer once garbage makes up half of it
+    void CompactForwardIndex();
 
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+    // True if the document has every required term of the query
+    static bool MatchesRequiredTerms(const PreparedQuery &query, int document_id);
 
-    template <typename ExecutionPolicy, typename DocumentPredicate>
+    // Documents having all the required terms, nothing if the query requires none. Posting
+    // lists are intersected from the shortest one, so the candidates only shrink.
+    static std::optional<std::vector<int>> FindRequiredDocuments(const PreparedQuery &query);
+
+    // Sorted ids of the documents rated within the range, nothing if there are more than limit
+    std::optional<std::vector<int>>
+    FindDocumentsByRating(int min_rating, int max_rating, size_t limit) const;
+
+    // Candidates limited to the sorted document_ids, which are taken if there were no limits
+    static std::optional<std::vector<int>>
+    RestrictCandidates(std::optional<std::vector<int>> candidates,
+                       std::vector<int> document_ids);
+
+    // A rating range matching few documents gives candidates from the rating index instead
+    // of being tested on every posting
+    std::optional<std::vector<int>> RestrictCandidates(std::optional<std::vector<int>> candidates,
+                                                       const DocumentFilter &filter) const;
+
+    void DropImpactIndex();
+
+    // Sum of impacts of a document met by the impact scan, and the plus words it was met in
+    struct ImpactAccumulator {
+        uint32_t score = 0;
+        // Bit of the word's index, the words past 32 are never marked
+        uint32_t seen_terms = 0;
+    };
+    using ImpactAccumulators = std::unordered_map<int, ImpactAccumulator>;
+    // Score of a document excluded by a minus word or the predicate
+    static const uint32_t REJECTED_IMPACT = std::numeric_limits<uint32_t>::max();
+
+    // Top documents of the impact scan, best first, once no other document can get into the
+    // top: a document can still gain the next impacts of the words it was not met in.
+    // next_impacts are 0 for the words scanned to the end, is_complete is set if all are.
+    static std::optional<std::vector<int>>
+    SelectImpactTop(const ImpactAccumulators &accumulators,
+                    const std::vector<uint32_t> &next_impacts,
+                    bool is_complete);
+
+    // Rating ordered retrieval takes this many best rated documents first, then doubles it
+    static const size_t RATING_BLOCK_SIZE = 256;
+
+    // trace may be null, then nothing but the metrics is recorded. At most TopK documents
+    // are returned.
+    template <typename Scorer,
+              size_t TopK = MAX_RESULT_DOCUMENT_COUNT,
+              typename ExecutionPolicy,
+              typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsImpl(ExecutionPolicy &&policy,
+                                               const PreparedQuery &query,
+                                               const DocumentPredicate &document_predicate,
+                                               QueryTrace *trace) const;
+
+    // Sorted documents the query may find, nothing if any: those having the required terms,
+    // among document_ids if given, narrowed by a DocumentFilter
+    template <typename DocumentPredicate>
+    std::optional<std::vector<int>>
+    FindCandidates(const PreparedQuery &query,
+                   const DocumentPredicate &document_predicate,
+                   const std::vector<int> *document_ids) const;
+
+    // Document-at-a-time search: cursors over the postings of all the words advance together,
+    // each document is scored and checked once, and a heap keeps the top. Memory does not
+    // grow with the number of documents found. Only documents ranked after search_after, if
+    // given, make it into the top of top_count.
+    template <typename Scorer, typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsDaat(const PreparedQuery &query,
+                                               const DocumentPredicate &document_predicate,
+                                               size_t top_count,
+                                               const SearchCursor *search_after = nullptr) const;
+
+    // document_ids, if given, are the sorted documents to search among
+    template <typename Scorer, typename ExecutionPolicy, typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(ExecutionPolicy &&policy,
-                                           const Query &query,
-                                           const DocumentPredicate &document_predicate) const;
+                                           const PreparedQuery &query,
+                                           const DocumentPredicate &document_predicate,
+                                           QueryTrace *trace,
+                                           const std::vector<int> *document_ids = nullptr) const;
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(StringContainer stop_words) {
+SearchServer::SearchServer(StringContainer stop_words, const SearchServerOptions &options)
+    : max_term_expansions_(options.max_term_expansions),
+      max_edit_distance_(options.max_edit_distance), query_mode_(options.query_mode),
+      evaluation_(options.evaluation),
+      statistics_(options.statistics),
+      store_positions_(options.store_positions) {
     using namespace std::literals::string_literals;
     if (any_of(stop_words.begin(), stop_words.end(),
                [](const std::string_view word) { return !IsValidWord(word); })) {
         throw std::invalid_argument("Some of stop words are invalid"s);
     }
-    stop_words_ = MakeUniqueNonEmptyStrings(stop_words);
+    const auto unique_stop_words = MakeUniqueNonEmptyStrings(stop_words);
+    stop_words_.Reset(
+        StopWordSet(std::vector<std::string>(unique_stop_words.begin(), unique_stop_words.end())));
 }
 
-template <typename DocumentPredicate>
+template <typename StopWords>
+SearchServer::DocumentWords SearchServer::SplitDocument(std::string_view text,
+                                                        const StopWords &stop_words) const {
+    using namespace std::literals::string_literals;
+    DocumentWords document_words;
+    uint32_t position = 0;
+    for (const auto word : SplitIntoWords(text)) {
+        if (!IsValidWord(word)) {
+            throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
+        }
+        if (!stop_words.Contains(word)) {
+            document_words.words.push_back(word);
+            if (store_positions_) {
+                document_words.positions.push_back(position);
+            }
+        }
+        ++position;
+    }
+    return document_words;
+}
+
+template <typename StopWords>
+void SearchServer::ParseQueryWords(std::string_view text,
+                                   const StopWords &stop_words,
+                                   PreparedQuery &query,
+                                   QueryMode mode) const {
+    using namespace std::literals;
+    // Phrase being read: "words" requires the words in a row, -"words" excludes them
+    std::optional<PreparedQuery::Phrase> phrase;
+    uint32_t offset = 0;
+    for (auto word : SplitIntoWords(text)) {
+        bool is_quoted = false;
+        if (!phrase && (word.substr(0, 1) == "\""sv || word.substr(0, 2) == "-\""sv)) {
+            if (!store_positions_) {
+                throw std::invalid_argument("Phrase queries need stored positions"s);
+            }
+            phrase.emplace();
+            phrase->is_minus = word[0] == '-';
+            word.remove_prefix(phrase->is_minus ? 2 : 1);
+            offset = 0;
+            is_quoted = true;
+        }
+        if (!phrase) {
+            const auto query_word = ParseQueryWord(word);
+            const bool is_required = query_word.is_required || mode == QueryMode::ALL;
+            if (query_word.is_prefix || query_word.max_edits >= 0) {
+                // The pattern as written is the word followed by * or ~N
+                const std::string_view pattern(
+                    query_word.data.data(), query_word.data.size() + (query_word.is_prefix ? 1 : 2));
+                (query_word.is_minus ? query.minus_expanded_terms_ : query.plus_expanded_terms_)
+                    .push_back({pattern, query_word.data, query_word.max_edits,
+                                !query_word.is_minus && is_required});
+            } else if (stop_words.Contains(query_word.data)) {
+                query.stop_words_.push_back(query_word.data);
+            } else {
+                (query_word.is_minus ? query.minus_terms_ : query.plus_terms_)
+                    .push_back(
+                        {query_word.data, nullptr, 0.0, !query_word.is_minus && is_required});
+            }
+            continue;
+        }
+
+        const bool closes = !word.empty() && word.back() == '"';
+        if (closes) {
+            word.remove_suffix(1);
+            is_quoted = true;
+        }
+        // A quote may stand apart from the words: " cat dog "
+        if (!word.empty() || !is_quoted) {
+            const auto query_word = ParseQueryWord(word);
+            if (query_word.is_minus || query_word.is_required || query_word.is_prefix ||
+                query_word.max_edits >= 0) {
+                throw std::invalid_argument("Phrase word "s + std::string(word) +
+                                            " is invalid"s);
+            }
+            if (stop_words.Contains(query_word.data)) {
+                query.stop_words_.push_back(query_word.data);
+            } else {
+                phrase->terms.push_back({query_word.data, offset});
+                // A plus phrase needs all its words anyway
+                if (!phrase->is_minus) {
+                    query.plus_terms_.push_back({query_word.data, nullptr, 0.0, true});
+                }
+            }
+            ++offset;
+        }
+        if (closes) {
+            if (!phrase->terms.empty()) {
+                query.phrases_.push_back(std::move(*phrase));
+            }
+            phrase.reset();
+        }
+    }
+    if (phrase) {
+        throw std::invalid_argument("Phrase is not closed"s);
+    }
+}
+
+template <typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query) const {
+    return FindTopDocuments<Scorer>(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
+                                                     DocumentStatus status) const {
+    return FindTopDocuments<Scorer>(std::execution::seq, raw_query,
+                                    DocumentFilter().SetStatus(status));
+}
+
+template <typename Scorer, typename DocumentPredicate>
 std::vector<Document>
 SearchServer::FindTopDocuments(std::string_view raw_query,
                                const DocumentPredicate &document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    return FindTopDocuments<Scorer>(std::execution::seq, raw_query, document_predicate);
 }
 
-template <typename ExecutionPolicy>
+template <typename Scorer, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
                                                      std::string_view raw_query) const {
-    return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+    return FindTopDocuments<Scorer>(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
-template <typename ExecutionPolicy>
+template <typename Scorer, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
                                                      std::string_view raw_query,
                                                      DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query, GetStatusPredicate(status));
+    return FindTopDocuments<Scorer>(policy, raw_query, DocumentFilter().SetStatus(status));
 }
 
-template <typename ExecutionPolicy, typename DocumentPredicate>
+template <typename Scorer, typename ExecutionPolicy, typename DocumentPredicate>
 std::vector<Document>
 SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
                                std::string_view raw_query,
                                const DocumentPredicate &document_predicate) const {
-    const auto query = ParseQuery(raw_query);
+    PreparedQuery query;
+    ParseQuery(raw_query, query, query_mode_);
+    return FindTopDocuments<Scorer>(policy, query, document_predicate);
+}
 
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+template <typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(const PreparedQuery &query) const {
+    return FindTopDocuments<Scorer>(std::execution::seq, query, DocumentStatus::ACTUAL);
+}
+
+template <typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(const PreparedQuery &query,
+                                                     DocumentStatus status) const {
+    return FindTopDocuments<Scorer>(std::execution::seq, query, DocumentFilter().SetStatus(status));
+}
+
+template <typename Scorer, typename DocumentPredicate>
+std::vector<Document>
+SearchServer::FindTopDocuments(const PreparedQuery &query,
+                               const DocumentPredicate &document_predicate) const {
+    return FindTopDocuments<Scorer>(std::execution::seq, query, document_predicate);
+}
+
+template <typename Scorer, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
+                                                     const PreparedQuery &query) const {
+    return FindTopDocuments<Scorer>(policy, query, DocumentStatus::ACTUAL);
+}
+
+template <typename Scorer, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
+                                                     const PreparedQuery &query,
+                                                     DocumentStatus status) const {
+    return FindTopDocuments<Scorer>(policy, query, DocumentFilter().SetStatus(status));
+}
+
+template <typename Scorer, typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document>
+SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
+                               const PreparedQuery &query,
+                               const DocumentPredicate &document_predicate) const {
+    return FindTopDocumentsImpl<Scorer>(policy, query, document_predicate, nullptr);
+}
+
+template <typename Scorer>
+QueryTrace SearchServer::ExplainQuery(std::string_view raw_query) const {
+    return ExplainQuery<Scorer>(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename Scorer>
+QueryTrace SearchServer::ExplainQuery(std::string_view raw_query, DocumentStatus status) const {
+    return ExplainQuery<Scorer>(std::execution::seq, raw_query, status);
+}
+
+template <typename Scorer, typename DocumentPredicate>
+QueryTrace SearchServer::ExplainQuery(std::string_view raw_query,
+                                      const DocumentPredicate &document_predicate) const {
+    return ExplainQuery<Scorer>(std::execution::seq, raw_query, document_predicate);
+}
+
+template <typename Scorer, typename ExecutionPolicy>
+QueryTrace SearchServer::ExplainQuery(ExecutionPolicy &&policy,
+                                      std::string_view raw_query) const {
+    return ExplainQuery<Scorer>(policy, raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename Scorer, typename ExecutionPolicy>
+QueryTrace SearchServer::ExplainQuery(ExecutionPolicy &&policy,
+                                      std::string_view raw_query,
+                                      DocumentStatus status) const {
+    return ExplainQuery<Scorer>(policy, raw_query, DocumentFilter().SetStatus(status));
+}
+
+template <typename Scorer, typename ExecutionPolicy, typename DocumentPredicate>
+QueryTrace SearchServer::ExplainQuery(ExecutionPolicy &&policy,
+                                      std::string_view raw_query,
+                                      const DocumentPredicate &document_predicate) const {
+    QueryTrace trace;
+    trace.raw_query = std::string(raw_query);
+
+    PreparedQuery query;
+    {
+        TraceTimer timer(&trace, SearchStage::PARSE_QUERY);
+        ParseQuery(raw_query, query, query_mode_);
+    }
+    for (const auto word : query.stop_words_) {
+        trace.stop_words.emplace_back(word);
+    }
 
-    sort(policy, matched_documents.begin(), matched_documents.end(),
-         [](const Document &lhs, const Document &rhs) {
-             return (std::abs(lhs.relevance - rhs.relevance) < 1e-6)
-                      ? lhs.rating > rhs.rating
-                      : lhs.relevance > rhs.relevance;
-         });
+    trace.results = FindTopDocumentsImpl<Scorer>(policy, query, document_predicate, &trace);
+    return trace;
+}
 
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename Scorer, size_t TopK, typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document>
+SearchServer::FindTopDocumentsImpl(ExecutionPolicy &&policy,
+                                   const PreparedQuery &query,
+                                   const DocumentPredicate &document_predicate,
+                                   QueryTrace *trace) const {
+    PreparedQuery storage;
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>,
+                                 std::execution::sequenced_policy>) {
+        if (evaluation_ == QueryEvaluation::DOCUMENT_AT_A_TIME && trace == nullptr) {
+            return FindTopDocumentsDaat<Scorer>(ActualizeQuery(query, storage),
+                                                document_predicate, TopK);
+        }
     }
+    auto matched_documents =
+        FindAllDocuments<Scorer>(policy, ActualizeQuery(query, storage), document_predicate,
+                                 trace);
+    if (trace != nullptr) {
+        trace->candidate_count = matched_documents.size();
+    }
+
+    SEARCH_METRICS_STAGE(SORT_RESULTS);
+    TraceTimer timer(trace, SearchStage::SORT_RESULTS);
+    // Only the top is sorted. Ties go by id, so the order does not depend on the sort.
+    const size_t result_count = std::min(matched_documents.size(), TopK);
+    std::partial_sort(policy, matched_documents.begin(), matched_documents.begin() + result_count,
+                      matched_documents.end(), IsRankedBefore);
+    matched_documents.resize(result_count);
 
     return matched_documents;
 }
 
-template <typename ExecutionPolicy, typename DocumentPredicate>
+template <typename ExecutionPolicy>
+std::vector<std::tuple<std::vector<std::string>, DocumentStatus>>
+SearchServer::MatchDocuments(ExecutionPolicy &&policy,
+                             const PreparedQuery &query,
+                             const std::vector<int> &document_ids) const {
+    PreparedQuery storage;
+    const auto &actual_query = ActualizeQuery(query, storage);
+
+    std::vector<std::tuple<std::vector<std::string>, DocumentStatus>> result(
+        document_ids.size());
+    std::transform(policy, document_ids.begin(), document_ids.end(), result.begin(),
+                   [this, &actual_query](int document_id) {
+                       return MatchDocument(actual_query, document_id);
+                   });
+    return result;
+}
+
+template <typename Scorer>
+SearchPage SearchServer::FindDocumentsPage(std::string_view raw_query,
+                                           const PageRequest &page) const {
+    return FindDocumentsPage<Scorer>(raw_query, DocumentStatus::ACTUAL, page);
+}
+
+template <typename Scorer>
+SearchPage SearchServer::FindDocumentsPage(std::string_view raw_query,
+                                           DocumentStatus status,
+                                           const PageRequest &page) const {
+    return FindDocumentsPage<Scorer>(raw_query, DocumentFilter().SetStatus(status), page);
+}
+
+template <typename Scorer, typename DocumentPredicate>
+SearchPage SearchServer::FindDocumentsPage(std::string_view raw_query,
+                                           const DocumentPredicate &document_predicate,
+                                           const PageRequest &page) const {
+    PreparedQuery query;
+    ParseQuery(raw_query, query, query_mode_);
+    const SearchCursor *search_after = page.search_after ? &*page.search_after : nullptr;
+    // One document past the page tells if another page follows
+    const size_t top_count = page.limit < std::numeric_limits<size_t>::max() - page.offset
+                                 ? page.offset + page.limit + 1
+                                 : std::numeric_limits<size_t>::max();
+
+    std::vector<Document> documents;
+    if (evaluation_ == QueryEvaluation::DOCUMENT_AT_A_TIME) {
+        documents =
+            FindTopDocumentsDaat<Scorer>(query, document_predicate, top_count, search_after);
+    } else {
+        documents =
+            FindAllDocuments<Scorer>(std::execution::seq, query, document_predicate, nullptr);
+        if (search_after != nullptr) {
+            documents.erase(std::remove_if(documents.begin(), documents.end(),
+                                           [search_after](const Document &document) {
+                                               return !IsAfterCursor(document, *search_after);
+                                           }),
+                            documents.end());
+        }
+        // Bounded selection: the documents of later pages are left unsorted
+        const size_t sorted_count = std::min(top_count, documents.size());
+        std::partial_sort(documents.begin(), documents.begin() + sorted_count, documents.end(),
+                          IsRankedBefore);
+        documents.resize(sorted_count);
+    }
+
+    const size_t first = std::min(page.offset, documents.size());
+    const size_t last = first + std::min(page.limit, documents.size() - first);
+    SearchPage result;
+    if (last < documents.size() && last > 0) {
+        result.next = MakeCursor(documents[last - 1]);
+    }
+    result.documents.assign(documents.begin() + first, documents.begin() + last);
+    return result;
+}
+
+template <typename Scorer>
+std::vector<Document> SearchServer::FindTopRatedDocuments(std::string_view raw_query) const {
+    return FindTopRatedDocuments<Scorer>(raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename Scorer>
+std::vector<Document> SearchServer::FindTopRatedDocuments(std::string_view raw_query,
+                                                          DocumentStatus status) const {
+    return FindTopRatedDocuments<Scorer>(raw_query, DocumentFilter().SetStatus(status));
+}
+
+template <typename Scorer, typename DocumentPredicate>
+std::vector<Document>
+SearchServer::FindTopRatedDocuments(std::string_view raw_query,
+                                    const DocumentPredicate &document_predicate) const {
+    PreparedQuery query;
+    ParseQuery(raw_query, query, query_mode_);
+
+    // A query with few postings is cheaper to answer whole
+    size_t posting_count = 0;
+    for (const auto &term : query.plus_terms_) {
+        posting_count += term.postings != nullptr ? term.postings->size() : 0;
+    }
+    for (const auto &term : query.plus_expanded_terms_) {
+        posting_count += term.postings.size();
+    }
+
+    std::vector<Document> documents;
+    if (posting_count <= rating_index_->size() / 8) {
+        documents = FindAllDocuments<Scorer>(std::execution::seq, query, document_predicate,
+                                             nullptr);
+    } else {
+        // Blocks hold whole groups of equally rated documents, so once enough documents are
+        // found every later block is rated lower than all of them
+        auto it = rating_index_->rbegin();
+        size_t block_size = RATING_BLOCK_SIZE;
+        while (it != rating_index_->rend() && documents.size() < MAX_RESULT_DOCUMENT_COUNT) {
+            std::vector<int> block;
+            while (it != rating_index_->rend() &&
+                   (block.size() < block_size || it->first == std::prev(it)->first)) {
+                block.push_back(it->second);
+                ++it;
+            }
+            std::sort(block.begin(), block.end());
+            const auto found = FindAllDocuments<Scorer>(std::execution::seq, query,
+                                                        document_predicate, nullptr, &block);
+            documents.insert(documents.end(), found.begin(), found.end());
+            block_size *= 2;
+        }
+    }
+
+    std::sort(documents.begin(), documents.end(), IsHigherRated);
+    if (documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    return documents;
+}
+
+template <typename Scorer>
+void SearchServer::BuildImpactIndex() {
+    DropImpactIndex();
+    const size_t document_count = GetCollectionDocumentCount();
+    const double average_document_length = GetAverageDocumentLength();
+
+    // Every posting is scored first, the quantum is only known from the highest score
+    std::vector<std::vector<std::pair<int, double>>> word_scores;
+    word_scores.reserve(word_to_document_freqs_->size());
+    double max_score = 0.0;
+    for (const auto &[word, postings] : *word_to_document_freqs_) {
+        const double inverse_document_freq = Scorer::ComputeInverseDocumentFreq(
+            document_count, GetCollectionDocumentFreq(word, postings));
+        auto &scores = word_scores.emplace_back();
+        scores.reserve(postings.size());
+        for (const auto &[document_id, term_freq] : postings) {
+            const double score = Scorer::Score(term_freq, inverse_document_freq,
+                                               documents_->at(document_id).length,
+                                               average_document_length);
+            scores.emplace_back(document_id, score);
+            max_score = std::max(max_score, score);
+        }
+    }
+
+    const double quantum = max_score / ImpactPostings::MAX_IMPACT;
+    auto scores = word_scores.begin();
+    for (const auto &[word, _] : *word_to_document_freqs_) {
+        word_to_impacts_->emplace(word, ImpactPostings(*scores, quantum));
+        scores->clear();
+        scores->shrink_to_fit();
+        ++scores;
+    }
+    impact_quantum_ = quantum;
+    impact_scorer_ = std::type_index(typeid(Scorer));
+}
+
+template <typename Scorer>
+std::vector<Document> SearchServer::FindTopDocumentsByImpact(std::string_view raw_query) const {
+    return FindTopDocumentsByImpact<Scorer>(raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename Scorer>
+std::vector<Document> SearchServer::FindTopDocumentsByImpact(std::string_view raw_query,
+                                                             DocumentStatus status) const {
+    return FindTopDocumentsByImpact<Scorer>(raw_query, DocumentFilter().SetStatus(status));
+}
+
+template <typename Scorer, typename DocumentPredicate>
+std::vector<Document>
+SearchServer::FindTopDocumentsByImpact(std::string_view raw_query,
+                                       const DocumentPredicate &document_predicate) const {
+    PreparedQuery query;
+    ParseQuery(raw_query, query, query_mode_);
+    const bool has_required_terms =
+        std::any_of(query.plus_terms_.begin(), query.plus_terms_.end(),
+                    [](const PreparedQuery::Term &term) { return term.is_required; });
+    if (!HasImpactIndex<Scorer>() || !query.plus_expanded_terms_.empty() ||
+        !query.phrases_.empty() || has_required_terms) {
+        return FindTopDocuments<Scorer>(std::execution::seq, query, document_predicate);
+    }
+
+    ImpactAccumulators accumulators;
+    std::vector<int> top;
+    {
+        SEARCH_METRICS_STAGE(SCORE_PLUS_WORDS);
+        // Documents of minus words are excluded before they are met
+        for (const auto &term : query.minus_terms_) {
+            if (term.postings != nullptr) {
+                for (const auto &[document_id, _] : *term.postings) {
+                    accumulators[document_id].score = REJECTED_IMPACT;
+                }
+            }
+        }
+        for (const auto &term : query.minus_expanded_terms_) {
+            for (const auto &[document_id, _] : term.postings) {
+                accumulators[document_id].score = REJECTED_IMPACT;
+            }
+        }
+
+        // Postings of every plus word and the next segment to take from them
+        std::vector<const ImpactPostings *> postings;
+        std::vector<size_t> segments;
+        for (const auto &term : query.plus_terms_) {
+            const auto impacts = word_to_impacts_->find(term.word);
+            postings.push_back(impacts != word_to_impacts_->end() ? &impacts->second : nullptr);
+            segments.push_back(0);
+        }
+        const auto next_impact = [&postings, &segments](size_t term) {
+            return postings[term] != nullptr &&
+                           segments[term] < postings[term]->GetSegmentCount()
+                       ? static_cast<int>(postings[term]->GetImpact(segments[term]))
+                       : -1;
+        };
+
+        size_t accepted_count = 0;
+        size_t scanned_since_check = 0;
+        uint32_t max_score = 0;
+        std::vector<uint32_t> next_impacts(postings.size());
+        for (;;) {
+            int impact = -1;
+            for (size_t term = 0; term < postings.size(); ++term) {
+                impact = std::max(impact, next_impact(term));
+            }
+            if (impact < 0) {
+                break;
+            }
+            // Segments of this impact of all the words
+            for (size_t term = 0; term < postings.size(); ++term) {
+                if (next_impact(term) != impact) {
+                    continue;
+                }
+                const auto documents = postings[term]->GetDocuments(segments[term]++);
+                SEARCH_METRICS_ADD(POSTINGS_SCANNED, documents.size());
+                scanned_since_check += documents.size();
+                const uint32_t term_bit = term < 32 ? 1u << term : 0u;
+                for (const int document_id : documents) {
+                    const auto [it, is_new] = accumulators.try_emplace(document_id);
+                    auto &accumulator = it->second;
+                    if (is_new) {
+                        // The predicate is asked once per document
+                        const auto &data = documents_->at(document_id);
+                        if (!document_predicate(document_id, data.status, data.rating)) {
+                            accumulator.score = REJECTED_IMPACT;
+                            continue;
+                        }
+                        ++accepted_count;
+                    } else if (accumulator.score == REJECTED_IMPACT) {
+                        continue;
+                    }
+                    accumulator.score += static_cast<uint32_t>(impact);
+                    accumulator.seen_terms |= term_bit;
+                    max_score = std::max(max_score, accumulator.score);
+                }
+            }
+
+            uint32_t remaining = 0;
+            for (size_t term = 0; term < postings.size(); ++term) {
+                next_impacts[term] = static_cast<uint32_t>(std::max(next_impact(term), 0));
+                remaining += next_impacts[term];
+            }
+            // A check passes over all the accumulators, so it waits for as many new postings
+            if (accepted_count >= static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT) &&
+                remaining <= max_score && scanned_since_check >= accepted_count) {
+                scanned_since_check = 0;
+                if (auto settled = SelectImpactTop(accumulators, next_impacts, false)) {
+                    top = std::move(*settled);
+                    break;
+                }
+            }
+        }
+        if (top.empty()) {
+            std::fill(next_impacts.begin(), next_impacts.end(), 0);
+            top = *SelectImpactTop(accumulators, next_impacts, true);
+        }
+    }
+
+    // The chosen documents are scored exactly, the way FindAllDocuments does
+    const size_t document_count = GetCollectionDocumentCount();
+    const double average_document_length = GetAverageDocumentLength();
+    std::vector<double> inverse_document_freqs;
+    for (const auto &term : query.plus_terms_) {
+        inverse_document_freqs.push_back(
+            term.postings != nullptr && !term.postings->empty()
+                ? Scorer::ComputeInverseDocumentFreq(
+                      document_count, GetCollectionDocumentFreq(term.word, *term.postings))
+                : 0.0);
+    }
+    std::vector<Document> documents;
+    for (const int document_id : top) {
+        const auto &data = documents_->at(document_id);
+        const auto words_freqs = GetWordFrequencies(document_id);
+        double relevance = 0.0;
+        for (size_t i = 0; i < query.plus_terms_.size(); ++i) {
+            const auto word_freq = words_freqs.find(query.plus_terms_[i].word);
+            if (word_freq != words_freqs.end()) {
+                relevance += Scorer::Score(word_freq->second, inverse_document_freqs[i],
+                                           data.length, average_document_length);
+            }
+        }
+        documents.push_back({document_id, relevance, data.rating});
+    }
+    std::sort(documents.begin(), documents.end(), IsRankedBefore);
+    return documents;
+}
+
+template <typename DocumentPredicate>
+std::optional<std::vector<int>>
+SearchServer::FindCandidates(const PreparedQuery &query,
+                             const DocumentPredicate &document_predicate,
+                             const std::vector<int> *document_ids) const {
+    // With required terms only the documents having all of them are scored
+    auto candidates = FindRequiredDocuments(query);
+    if (document_ids != nullptr) {
+        candidates = RestrictCandidates(std::move(candidates), *document_ids);
+    }
+    if constexpr (std::is_same_v<DocumentPredicate, DocumentFilter>) {
+        candidates = RestrictCandidates(
+            document_predicate.RestrictCandidates(std::move(candidates)), document_predicate);
+    }
+    return candidates;
+}
+
+template <typename Scorer, typename DocumentPredicate>
+std::vector<Document>
+SearchServer::FindTopDocumentsDaat(const PreparedQuery &query,
+                                   const DocumentPredicate &document_predicate,
+                                   size_t top_count,
+                                   const SearchCursor *search_after) const {
+    constexpr bool is_filter = std::is_same_v<DocumentPredicate, DocumentFilter>;
+    int min_id = std::numeric_limits<int>::min();
+    int max_id = std::numeric_limits<int>::max();
+    if constexpr (is_filter) {
+        if (document_predicate.IsEmpty()) {
+            return {};
+        }
+        min_id = document_predicate.GetMinId();
+        max_id = document_predicate.GetMaxId();
+    }
+
+    SEARCH_METRICS_STAGE(SCORE_PLUS_WORDS);
+    const auto candidates = FindCandidates(query, document_predicate, nullptr);
+    const size_t document_count = GetCollectionDocumentCount();
+    const double average_document_length = GetAverageDocumentLength();
+
+    // Scored postings in the order FindAllDocuments adds them up: plus words, then the words
+    // of patterns one by one
+    struct WordCursor {
+        PostingCursor<PostingList> cursor;
+        double inverse_document_freq;
+        double weight;
+    };
+    std::vector<WordCursor> word_cursors;
+    for (const auto &term : query.plus_terms_) {
+        if (term.postings != nullptr && !term.postings->empty()) {
+            word_cursors.push_back(
+                {PostingCursor(*term.postings, min_id, max_id),
+                 Scorer::ComputeInverseDocumentFreq(
+                     document_count, GetCollectionDocumentFreq(term.word, *term.postings)),
+                 1.0});
+        }
+    }
+    for (const auto &term : query.plus_expanded_terms_) {
+        for (const auto &word : term.words) {
+            word_cursors.push_back(
+                {PostingCursor(*word.postings, min_id, max_id),
+                 Scorer::ComputeInverseDocumentFreq(
+                     document_count, GetCollectionDocumentFreq(word.word, *word.postings)),
+                 word.weight});
+        }
+    }
+    std::vector<PostingCursor<PostingList>> minus_cursors;
+    for (const auto &term : query.minus_terms_) {
+        if (term.postings != nullptr) {
+            minus_cursors.emplace_back(*term.postings, min_id, max_id);
+        }
+    }
+    std::vector<PostingCursor<MergedPostings>> minus_merged_cursors;
+    for (const auto &term : query.minus_expanded_terms_) {
+        minus_merged_cursors.emplace_back(term.postings, min_id, max_id);
+    }
+    // Documents come in increasing order, so the denied ones are passed once
+    std::vector<int>::const_iterator denied_id;
+    if constexpr (is_filter) {
+        denied_id = document_predicate.GetDeniedIds().begin();
+    }
+
+    const auto is_excluded = [&](int document_id, const DocumentData &data) {
+        if constexpr (is_filter) {
+            if (!document_predicate.MatchesMetadata(data.status, data.rating)) {
+                return true;
+            }
+            const auto &denied_ids = document_predicate.GetDeniedIds();
+            denied_id = std::lower_bound(denied_id, denied_ids.end(), document_id);
+            if (denied_id != denied_ids.end() && *denied_id == document_id) {
+                return true;
+            }
+        } else {
+            if (!document_predicate(document_id, data.status, data.rating)) {
+                return true;
+            }
+        }
+        for (auto &cursor : minus_cursors) {
+            if (cursor.Contains(document_id)) {
+                return true;
+            }
+        }
+        for (auto &cursor : minus_merged_cursors) {
+            if (cursor.Contains(document_id)) {
+                return true;
+            }
+        }
+        return !query.phrases_.empty() && !MatchesPhrases(query, document_id);
+    };
+
+    // Heap of the top, the lowest ranked document in front
+    std::vector<Document> top;
+    [[maybe_unused]] size_t postings_scanned = 0;
+    size_t candidate_index = 0;
+    for (;;) {
+        // Next document: the next candidate if there are candidates, otherwise the lowest one
+        // the cursors stand at
+        int document_id = std::numeric_limits<int>::max();
+        if (candidates) {
+            while (candidate_index < candidates->size() &&
+                   (*candidates)[candidate_index] < min_id) {
+                ++candidate_index;
+            }
+            if (candidate_index == candidates->size() ||
+                (*candidates)[candidate_index] > max_id) {
+                break;
+            }
+            document_id = (*candidates)[candidate_index++];
+            for (auto &word : word_cursors) {
+                word.cursor.SeekTo(document_id);
+            }
+        } else {
+            bool is_found = false;
+            for (const auto &word : word_cursors) {
+                if (!word.cursor.IsAtEnd() && word.cursor.GetDocumentId() <= document_id) {
+                    document_id = word.cursor.GetDocumentId();
+                    is_found = true;
+                }
+            }
+            if (!is_found) {
+                break;
+            }
+        }
+
+        // An id allowed by a filter is a candidate even if it is not in the index
+        const auto document_data = documents_->find(document_id);
+        if (document_data == documents_->end()) {
+            continue;
+        }
+        const auto &data = document_data->second;
+        const bool is_excluded_document = is_excluded(document_id, data);
+        bool is_matched = false;
+        double relevance = 0.0;
+        for (auto &[cursor, inverse_document_freq, weight] : word_cursors) {
+            if (!cursor.IsAtEnd() && cursor.GetDocumentId() == document_id) {
+                if (!is_excluded_document) {
+                    relevance += Scorer::Score(cursor.GetValue(), inverse_document_freq,
+                                               data.length, average_document_length) *
+                                 weight;
+                }
+                is_matched = true;
+                ++postings_scanned;
+                cursor.Next();
+            }
+        }
+        if (is_excluded_document || !is_matched) {
+            continue;
+        }
+
+        Document document{document_id, relevance, data.rating};
+        if (search_after != nullptr && !IsAfterCursor(document, *search_after)) {
+            continue;
+        }
+        if (top.size() < top_count) {
+            top.push_back(document);
+            std::push_heap(top.begin(), top.end(), IsRankedBefore);
+        } else if (IsRankedBefore(document, top.front())) {
+            std::pop_heap(top.begin(), top.end(), IsRankedBefore);
+            top.back() = document;
+            std::push_heap(top.begin(), top.end(), IsRankedBefore);
+        }
+    }
+    SEARCH_METRICS_ADD(POSTINGS_SCANNED, postings_scanned);
+
+    std::sort_heap(top.begin(), top.end(), IsRankedBefore);
+    return top;
+}
+
+template <typename Scorer, typename ExecutionPolicy, typename DocumentPredicate>
 std::vector<Document>
 SearchServer::FindAllDocuments(ExecutionPolicy &&policy,
-                               const Query &query,
-                               const DocumentPredicate &document_predicate) const {
+                               const PreparedQuery &query,
+                               const DocumentPredicate &document_predicate,
+                               QueryTrace *trace,
+                               const std::vector<int> *document_ids) const {
+    // A DocumentFilter is applied by ids before the scan and by metadata during it
+    constexpr bool is_filter = std::is_same_v<DocumentPredicate, DocumentFilter>;
+    if constexpr (is_filter) {
+        if (document_predicate.IsEmpty()) {
+            return {};
+        }
+    }
+
     ConcurrentMap<int, double> document_to_relevance(6);
+    {
+        SEARCH_METRICS_STAGE(SCORE_PLUS_WORDS);
+        TraceTimer timer(trace, SearchStage::SCORE_PLUS_WORDS);
+
+        const size_t document_count = GetCollectionDocumentCount();
+        const double average_document_length = GetAverageDocumentLength();
+
+        // Postings a term visited, after candidates and the id range of a filter, and those
+        // the predicate accepted; accepted ones are counted with a trace only
+        struct ScanCounts {
+            size_t scanned = 0;
+            size_t accepted = 0;
+
+            ScanCounts &operator+=(const ScanCounts &other) {
+                scanned += other.scanned;
+                accepted += other.accepted;
+                return *this;
+            }
+        };
+
+        // Adds score(frequency, document) of every posting accepted by the predicate
+        const auto accepts = [&document_predicate](int document_id, const DocumentData &data) {
+            if constexpr (is_filter) {
+                return document_predicate.MatchesMetadata(data.status, data.rating);
+            } else {
+                return document_predicate(document_id, data.status, data.rating);
+            }
+        };
+        const auto score_postings = [this, &document_predicate, &document_to_relevance, &accepts,
+                                     policy, trace](const auto &postings,
+                                                    const auto &score) -> ScanCounts {
+            auto [first, last] = std::pair(postings.begin(), postings.end());
+            if constexpr (is_filter) {
+                std::tie(first, last) = SlicePostings(postings, document_predicate.GetMinId(),
+                                                      document_predicate.GetMaxId());
+            }
+            std::atomic<size_t> accepted_count = 0;
+            for_each(policy, first, last,
+                     [this, &document_to_relevance, &accepts, &score, &accepted_count,
+                      trace](const auto &doc_freq) {
+                         const auto &doc_data = this->documents_->at(doc_freq.first);
+                         if (accepts(doc_freq.first, doc_data)) {
+                             document_to_relevance[doc_freq.first].ref_to_value +=
+                                 score(doc_freq.second, doc_data);
+                             if (trace != nullptr) {
+                                 accepted_count.fetch_add(1, std::memory_order_relaxed);
+                             }
+                         };
+                     });
+            return {static_cast<size_t>(std::distance(first, last)), accepted_count};
+        };
+        const auto candidates = FindCandidates(query, document_predicate, document_ids);
+        const auto score_term = [&score_postings, &candidates](const auto &postings,
+                                                               const auto &score) -> ScanCounts {
+            if (candidates) {
+                return score_postings(IntersectPostings(postings, *candidates), score);
+            }
+            return score_postings(postings, score);
+        };
+        const auto make_score = [average_document_length](double inverse_document_freq,
+                                                          double weight) {
+            return [=](double term_freq, const DocumentData &doc_data) {
+                return Scorer::Score(term_freq, inverse_document_freq, doc_data.length,
+                                     average_document_length) *
+                       weight;
+            };
+        };
+
+        for (const auto &term : query.plus_terms_) {
+            const size_t posting_length = term.postings != nullptr ? term.postings->size() : 0;
+            const double inverse_document_freq =
+                posting_length > 0
+                    ? Scorer::ComputeInverseDocumentFreq(
+                          document_count, GetCollectionDocumentFreq(term.word, *term.postings))
+                    : 0.0;
+            ScanCounts counts;
+            if (term.postings != nullptr) {
+                counts = score_term(*term.postings, make_score(inverse_document_freq, 1.0));
+                SEARCH_METRICS_ADD(POSTINGS_SCANNED, counts.scanned);
+            }
+            if (trace != nullptr) {
+                trace->plus_terms.push_back({std::string(term.word), posting_length,
+                                             inverse_document_freq, counts.accepted});
+                trace->postings_scanned += counts.scanned;
+                trace->postings_accepted += counts.accepted;
+            }
+        }
 
-    for_each(query.plus_words.begin(), query.plus_words.end(),
-             [this, &document_predicate, &document_to_relevance, policy](const auto &word) {
-                 if (word_to_document_freqs_.count(word) == 0) {
-                     return;
-                 }
-                 const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                 const auto &document_freqs = word_to_document_freqs_.at(word);
-                 for_each(policy, document_freqs.begin(), document_freqs.end(),
-                          [this, &document_to_relevance, &document_predicate,
-                           &inverse_document_freq](const auto &doc_freq) {
-                              const auto &doc_data = this->documents_.at(doc_freq.first);
-                              if (document_predicate(doc_freq.first, doc_data.status,
-                                                     doc_data.rating)) {
-                                  document_to_relevance[doc_freq.first].ref_to_value +=
-                                      doc_freq.second * inverse_document_freq;
-                              };
-                          });
-             });
-
-    auto doc_to_rel = document_to_relevance.BuildOrdinaryMap();
-
-    std::for_each(policy, query.minus_words.begin(), query.minus_words.end(),
-                  [this, &doc_to_rel](const std::string_view word) {
-                      if (word_to_document_freqs_.count(word) == 0) {
-                          return;
-                      }
-                      for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                          doc_to_rel.erase(document_id);
-                      }
-                  });
+        for (const auto &term : query.plus_expanded_terms_) {
+            // Words are scored one by one: the document lengths are only known here, and the
+            // collection may have changed since the query was resolved
+            ScanCounts counts;
+            for (const auto &word : term.words) {
+                const double inverse_document_freq = Scorer::ComputeInverseDocumentFreq(
+                    document_count, GetCollectionDocumentFreq(word.word, *word.postings));
+                counts +=
+                    score_term(*word.postings, make_score(inverse_document_freq, word.weight));
+            }
+            SEARCH_METRICS_ADD(POSTINGS_SCANNED, counts.scanned);
+            if (trace != nullptr) {
+                trace->plus_terms.push_back({std::string(term.text), term.postings.size(), 0.0,
+                                             counts.accepted, term.words.size()});
+                trace->postings_scanned += counts.scanned;
+                trace->postings_accepted += counts.accepted;
+            }
+        }
+    }
+
+    std::map<int, double> doc_to_rel;
+    {
+        SEARCH_METRICS_STAGE(BUILD_ORDINARY_MAP);
+        TraceTimer timer(trace, SearchStage::BUILD_ORDINARY_MAP);
+        doc_to_rel = document_to_relevance.BuildOrdinaryMap();
+    }
+    if constexpr (is_filter) {
+        for (const int document_id : document_predicate.GetDeniedIds()) {
+            doc_to_rel.erase(document_id);
+        }
+    }
+    [[maybe_unused]] const size_t scored_count = doc_to_rel.size();
+    SEARCH_METRICS_ADD(DOCUMENTS_SCORED, scored_count);
+
+    {
+        SEARCH_METRICS_STAGE(FILTER_MINUS_WORDS);
+        TraceTimer timer(trace, SearchStage::FILTER_MINUS_WORDS);
+        // doc_to_rel is an ordinary map, so erasing from it must stay sequential
+        for (const auto &term : query.minus_terms_) {
+            size_t excluded_count = 0;
+            if (term.postings != nullptr) {
+                SEARCH_METRICS_ADD(POSTINGS_SCANNED, term.postings->size());
+                for (const auto &[document_id, _] : *term.postings) {
+                    excluded_count += doc_to_rel.erase(document_id);
+                }
+            }
+            if (trace != nullptr) {
+                const size_t posting_length =
+                    term.postings != nullptr ? term.postings->size() : 0;
+                trace->minus_terms.push_back({std::string(term.word), posting_length,
+                                              term.inverse_document_freq, excluded_count});
+                trace->postings_scanned += posting_length;
+            }
+        }
+        for (const auto &term : query.minus_expanded_terms_) {
+            SEARCH_METRICS_ADD(POSTINGS_SCANNED, term.postings.size());
+            size_t excluded_count = 0;
+            for (const auto &[document_id, _] : term.postings) {
+                excluded_count += doc_to_rel.erase(document_id);
+            }
+            if (trace != nullptr) {
+                trace->minus_terms.push_back({std::string(term.text), term.postings.size(), 0.0,
+                                              excluded_count, term.words.size()});
+                trace->postings_scanned += term.postings.size();
+            }
+        }
+    }
+    if (!query.phrases_.empty()) {
+        SEARCH_METRICS_STAGE(FILTER_PHRASES);
+        TraceTimer timer(trace, SearchStage::FILTER_PHRASES);
+        FilterPhrases(query, doc_to_rel);
+    }
+    SEARCH_METRICS_ADD(DOCUMENTS_EXCLUDED, scored_count - doc_to_rel.size());
+    if (trace != nullptr) {
+        trace->documents_scored = scored_count;
+        trace->documents_excluded = scored_count - doc_to_rel.size();
+    }
 
     std::vector<Document> matched_documents;
     for (const auto &[document_id, relevance] : doc_to_rel) {
         matched_documents.push_back(
-            {document_id, relevance, documents_.at(document_id).rating});
+            {document_id, relevance, documents_->at(document_id).rating});
     }
 
     return matched_documents;
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "search_protocol.h"
+#include "search_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SearchServiceOptions {
+    // Listening sockets, at least one is needed. Port 0 binds a free port, see GetTcpPort.
+    std::string unix_socket_path;
+    std::optional<uint16_t> tcp_port;
+    std::string tcp_host = "127.0.0.1";
+
+    size_t worker_count = std::max(1u, std::thread::hardware_concurrency());
+    // Larger frames close the connection
+    size_t max_frame_size = size_t{16} << 20;
+    // Bytes of requests waiting for a worker and of responses not yet sent, per connection.
+    // A connection that has more is not read until the workers and the client catch up. A
+    // single request may be larger, up to max_frame_size.
+    size_t max_queued_size = size_t{4} << 20;
+};
+
+// Serves a SearchServer over the binary protocol of search_protocol.h. One thread runs an
+// epoll loop that accepts connections, reads requests and writes responses; a fixed pool of
+// workers executes them. Searches and matches run concurrently, additions and removals get
+// the server alone. Requests of one connection are executed one after another by one worker
+// at a time, so pipelined requests are answered in order. A client that sends faster than it
+// is served or than it reads its responses is held back by its socket, not by buffers here.
+class SearchService {
+  public:
+    // Binds and listens, throws std::runtime_error if a socket cannot be set up
+    SearchService(SearchServer &server, const SearchServiceOptions &options);
+    ~SearchService();
+
+    SearchService(const SearchService &) = delete;
+    SearchService &operator=(const SearchService &) = delete;
+
+    // Serves until Stop is called
+    void Run();
+
+    // Safe to call from any thread and from signal handlers
+    void Stop() noexcept;
+
+    uint16_t GetTcpPort() const noexcept {
+        return tcp_port_;
+    }
+
+  private:
+    struct Connection;
+    class WorkerPool;
+
+    void Accept(int listen_fd);
+    void OnReadable(const std::shared_ptr<Connection> &connection);
+    void OnWritable(const std::shared_ptr<Connection> &connection);
+    void OnResponsesReady();
+    void Flush(const std::shared_ptr<Connection> &connection);
+    void Close(const std::shared_ptr<Connection> &connection);
+    // Stops reading a connection with max_queued_size bytes queued, resumes below it
+    void SetQueuedSize(Connection &connection, size_t queued_size);
+    // Polls the connection for what it waits for: reading, writing, both or neither
+    void UpdateEvents(Connection &connection);
+
+    // Runs on a worker until the connection has no requests left
+    void Process(const std::shared_ptr<Connection> &connection);
+    void Execute(std::string_view frame, std::string &responses);
+
+    void Wake() noexcept;
+    void CloseDescriptors() noexcept;
+
+    SearchServer &server_;
+    std::shared_mutex server_mutex_;
+    SearchServiceOptions options_;
+
+    int epoll_fd_ = -1;
+    int event_fd_ = -1;
+    int unix_fd_ = -1;
+    int tcp_fd_ = -1;
+    uint16_t tcp_port_ = 0;
+
+    // Touched by the event loop only
+    std::map<uint64_t, std::shared_ptr<Connection>> connections_;
+    uint64_t next_connection_id_;
+
+    // Connections whose workers have produced responses
+    std::mutex ready_mutex_;
+    std::vector<std::shared_ptr<Connection>> ready_;
+
+    std::atomic<bool> stopping_{false};
+    std::unique_ptr<WorkerPool> workers_;
+};
@@ -0,0 +1,232 @@
+#pragma once
+
+#include "document.h"
+#include "index_statistics.h"
+#include "search_server.h"
+
+#include <algorithm>
+#include <exception>
+#include <execution>
+#include <memory>
+#include <numeric>
+#include <set>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// SearchServer split into shards by document id. Document frequencies are kept for the whole
+// collection, so documents are ranked exactly as by a single server holding all of them.
+// Searches run on all shards in parallel and their top documents are merged; a document is
+// matched, read and removed by its own shard only.
+class ShardedSearchServer {
+  public:
+    template <typename StringContainer>
+    ShardedSearchServer(size_t shard_count,
+                        const StringContainer &stop_words,
+                        const SearchServerOptions &options = {});
+
+    ShardedSearchServer(size_t shard_count,
+                        const std::string &stop_words_text,
+                        const SearchServerOptions &options = {})
+        : ShardedSearchServer(shard_count, std::string_view(stop_words_text), options) {}
+    ShardedSearchServer(size_t shard_count,
+                        std::string_view stop_words_text,
+                        const SearchServerOptions &options = {})
+        : ShardedSearchServer(shard_count, SplitIntoWords(stop_words_text), options) {}
+
+    // Shards point to the shared statistics, so the server can be moved but not copied
+    ShardedSearchServer(const ShardedSearchServer &) = delete;
+    ShardedSearchServer &operator=(const ShardedSearchServer &) = delete;
+    ShardedSearchServer(ShardedSearchServer &&) = default;
+    ShardedSearchServer &operator=(ShardedSearchServer &&) = default;
+
+    auto begin() const noexcept {
+        return document_ids_.begin();
+    }
+
+    auto end() const noexcept {
+        return document_ids_.end();
+    }
+
+    void AddDocument(int document_id,
+                     std::string_view document,
+                     DocumentStatus status,
+                     const std::vector<int> &ratings);
+
+    // Updates the document in its shard, see SearchServer::UpdateDocument
+    void UpdateDocument(int document_id,
+                        std::string_view document,
+                        DocumentStatus status,
+                        const std::vector<int> &ratings);
+    void UpdateDocument(int document_id, DocumentStatus status, const std::vector<int> &ratings);
+
+    int GetDocumentCount() const noexcept {
+        return static_cast<int>(document_ids_.size());
+    }
+
+    SearchServer::WordFrequencies GetWordFrequencies(int document_id) const;
+
+    void RemoveDocument(int document_id);
+    void RemoveDocument(const std::execution::sequenced_policy &, int document_id);
+    void RemoveDocument(const std::execution::parallel_policy &, int document_id);
+
+    // Removes documents of different shards in parallel
+    void RemoveDocuments(const std::vector<int> &document_ids);
+
+    template <typename Scorer = TfIdfScorer>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    template <typename Scorer = TfIdfScorer>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+                                           DocumentStatus status) const;
+
+    template <typename Scorer = TfIdfScorer, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+                                           const DocumentPredicate &document_predicate) const;
+
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
+                                           std::string_view raw_query) const;
+
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
+                                           std::string_view raw_query,
+                                           DocumentStatus status) const;
+
+    // policy is what every shard searches with, the shards themselves always run in parallel
+    template <typename Scorer = TfIdfScorer, typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
+                                           std::string_view raw_query,
+                                           const DocumentPredicate &document_predicate) const;
+
+    std::tuple<std::vector<std::string>, DocumentStatus>
+    MatchDocument(std::string_view raw_query, int document_id) const;
+
+    std::tuple<std::vector<std::string>, DocumentStatus>
+    MatchDocument(const std::execution::sequenced_policy &,
+                  std::string_view raw_query,
+                  int document_id) const;
+
+    std::tuple<std::vector<std::string>, DocumentStatus>
+    MatchDocument(const std::execution::parallel_policy &,
+                  std::string_view raw_query,
+                  int document_id) const;
+
+    // The query is prepared once per shard, shards match their documents in parallel
+    std::vector<std::tuple<std::vector<std::string>, DocumentStatus>>
+    MatchDocuments(std::string_view raw_query, const std::vector<int> &document_ids) const;
+
+    size_t GetShardCount() const noexcept {
+        return shards_.size();
+    }
+
+    // Index of the shard holding the document
+    size_t GetShardIndex(int document_id) const noexcept;
+
+    const SearchServer &GetShard(size_t index) const {
+        return shards_.at(index);
+    }
+
+    const IndexStatistics &GetStatistics() const noexcept {
+        return *statistics_;
+    }
+
+  private:
+    // Runs function(shard_index) for every shard in parallel. Parallel algorithms terminate
+    // on exceptions, so they are caught and the first one is rethrown afterwards.
+    template <typename Function>
+    void ForEachShard(const Function &function) const;
+
+    // Groups the documents by shard, keeping their order within a shard
+    std::vector<std::vector<int>> SplitByShard(const std::vector<int> &document_ids) const;
+
+    static std::vector<Document> MergeTopDocuments(std::vector<std::vector<Document>> results);
+
+    // Heap-allocated so that moving the server does not move the statistics shards point to
+    std::unique_ptr<IndexStatistics> statistics_;
+    std::vector<SearchServer> shards_;
+    std::set<int> document_ids_;
+};
+
+template <typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(size_t shard_count,
+                                         const StringContainer &stop_words,
+                                         const SearchServerOptions &options)
+    : statistics_(std::make_unique<IndexStatistics>()) {
+    using namespace std::literals::string_literals;
+    if (shard_count == 0) {
+        throw std::invalid_argument("Sharded server needs at least one shard"s);
+    }
+    SearchServerOptions shard_options = options;
+    shard_options.statistics = statistics_.get();
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.emplace_back(stop_words, shard_options);
+    }
+}
+
+template <typename Scorer>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query) const {
+    return FindTopDocuments<Scorer>(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename Scorer>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query,
+                                                            DocumentStatus status) const {
+    return FindTopDocuments<Scorer>(std::execution::seq, raw_query,
+                                    DocumentFilter().SetStatus(status));
+}
+
+template <typename Scorer, typename DocumentPredicate>
+std::vector<Document>
+ShardedSearchServer::FindTopDocuments(std::string_view raw_query,
+                                      const DocumentPredicate &document_predicate) const {
+    return FindTopDocuments<Scorer>(std::execution::seq, raw_query, document_predicate);
+}
+
+template <typename Scorer, typename ExecutionPolicy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(ExecutionPolicy &&policy,
+                                                            std::string_view raw_query) const {
+    return FindTopDocuments<Scorer>(policy, raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename Scorer, typename ExecutionPolicy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(ExecutionPolicy &&policy,
+                                                            std::string_view raw_query,
+                                                            DocumentStatus status) const {
+    return FindTopDocuments<Scorer>(policy, raw_query, DocumentFilter().SetStatus(status));
+}
+
+template <typename Scorer, typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document>
+ShardedSearchServer::FindTopDocuments(ExecutionPolicy &&policy,
+                                      std::string_view raw_query,
+                                      const DocumentPredicate &document_predicate) const {
+    std::vector<std::vector<Document>> results(shards_.size());
+    ForEachShard([&](size_t index) {
+        results[index] =
+            shards_[index].FindTopDocuments<Scorer>(policy, raw_query, document_predicate);
+    });
+    return MergeTopDocuments(std::move(results));
+}
+
+template <typename Function>
+void ShardedSearchServer::ForEachShard(const Function &function) const {
+    std::vector<size_t> indexes(shards_.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::vector<std::exception_ptr> errors(shards_.size());
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(),
+                  [&function, &errors](size_t index) {
+                      try {
+                          function(index);
+                      } catch (...) {
+                          errors[index] = std::current_exception();
+                      }
+                  });
+    for (const auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "document.h"
+#include "prepared_query.h"
+#include "scorer.h"
+#include "search_server.h"
+#include "stop_word_set.h"
+
+#include <algorithm>
+#include <execution>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Settings of a StaticSearchServer, known at compile time. A deployment derives its own
+// config from this one and overrides what it needs:
+//
+//     struct NewsConfig : SearchServerConfig {
+//         static constexpr auto STOP_WORDS = MakeStaticStopWordSet("a", "in", "the");
+//         static constexpr size_t TOP_K = 10;
+//         using Scorer = Bm25Scorer;
+//     };
+struct SearchServerConfig {
+    static constexpr StaticStopWordSet<0> STOP_WORDS{};
+    // Documents a search returns at most
+    static constexpr size_t TOP_K = MAX_RESULT_DOCUMENT_COUNT;
+    using Scorer = TfIdfScorer;
+    static constexpr QueryMode QUERY_MODE = QueryMode::ANY;
+    static constexpr QueryEvaluation EVALUATION = QueryEvaluation::DOCUMENT_AT_A_TIME;
+    // Positions are needed by "quoted phrase" queries only
+    static constexpr bool STORE_POSITIONS = false;
+};
+
+// SearchServer specialized for a config. Documents and queries are split with the
+// StaticStopWordSet of the config, whose table is a constant of the program, and the top size,
+// scorer, query mode and evaluation are template arguments of the search instead of run time
+// settings: only the configured evaluation is instantiated. For anything not forwarded here
+// GetServer gives the underlying server, which keeps the same stop words in a StopWordSet.
+template <typename Config = SearchServerConfig>
+class StaticSearchServer {
+  public:
+    using Scorer = typename Config::Scorer;
+    static constexpr size_t TOP_K = Config::TOP_K;
+
+    static_assert(TOP_K > 0, "A search must return at least one document");
+
+    StaticSearchServer() : server_(MakeServer()) {}
+
+    void AddDocument(int document_id,
+                     std::string_view document,
+                     DocumentStatus status,
+                     const std::vector<int> &ratings) {
+        SEARCH_METRICS_STAGE(ADD_DOCUMENT);
+        server_.AddDocumentWords(document_id, server_.SplitDocument(document, Config::STOP_WORDS),
+                                 status, ratings);
+    }
+
+    void UpdateDocument(int document_id,
+                        std::string_view document,
+                        DocumentStatus status,
+                        const std::vector<int> &ratings) {
+        SEARCH_METRICS_STAGE(UPDATE_DOCUMENT);
+        server_.UpdateDocumentWords(document_id,
+                                    server_.SplitDocument(document, Config::STOP_WORDS), status,
+                                    ratings);
+    }
+
+    void UpdateDocument(int document_id, DocumentStatus status, const std::vector<int> &ratings) {
+        server_.UpdateDocument(document_id, status, ratings);
+    }
+
+    void RemoveDocument(int document_id) {
+        server_.RemoveDocument(document_id);
+    }
+
+    int GetDocumentCount() const noexcept {
+        return server_.GetDocumentCount();
+    }
+
+    PreparedQuery PrepareQuery(std::string_view raw_query) const {
+        SEARCH_METRICS_STAGE(PARSE_QUERY);
+        PreparedQuery query;
+        server_.ParseQueryWords(raw_query, Config::STOP_WORDS, query, Config::QUERY_MODE);
+        server_.FinishQuery(query);
+        return query;
+    }
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const {
+        return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+    }
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+                                           DocumentStatus status) const {
+        return FindTopDocuments(raw_query, DocumentFilter().SetStatus(status));
+    }
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+                                           const DocumentPredicate &document_predicate) const {
+        return FindTopDocuments(PrepareQuery(raw_query), document_predicate);
+    }
+
+    std::vector<Document> FindTopDocuments(const PreparedQuery &query) const {
+        return FindTopDocuments(query, DocumentStatus::ACTUAL);
+    }
+
+    std::vector<Document> FindTopDocuments(const PreparedQuery &query,
+                                           DocumentStatus status) const {
+        return FindTopDocuments(query, DocumentFilter().SetStatus(status));
+    }
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const PreparedQuery &query,
+                                           const DocumentPredicate &document_predicate) const {
+        PreparedQuery storage;
+        const auto &actual_query = server_.ActualizeQuery(query, storage);
+        if constexpr (Config::EVALUATION == QueryEvaluation::DOCUMENT_AT_A_TIME) {
+            return server_.template FindTopDocumentsDaat<Scorer>(actual_query, document_predicate,
+                                                                 TOP_K);
+        } else {
+            auto documents = server_.template FindAllDocuments<Scorer>(
+                std::execution::seq, actual_query, document_predicate, nullptr);
+            SEARCH_METRICS_STAGE(SORT_RESULTS);
+            const size_t result_count = std::min(documents.size(), TOP_K);
+            std::partial_sort(documents.begin(), documents.begin() + result_count,
+                              documents.end(), IsRankedBefore);
+            documents.resize(result_count);
+            return documents;
+        }
+    }
+
+    std::tuple<std::vector<std::string>, DocumentStatus>
+    MatchDocument(std::string_view raw_query, int document_id) const {
+        return server_.MatchDocument(PrepareQuery(raw_query), document_id);
+    }
+
+    const SearchServer &GetServer() const noexcept {
+        return server_;
+    }
+
+  private:
+    static SearchServer MakeServer() {
+        SearchServerOptions options;
+        options.store_positions = Config::STORE_POSITIONS;
+        options.query_mode = Config::QUERY_MODE;
+        options.evaluation = Config::EVALUATION;
+        return SearchServer(std::vector<std::string_view>(Config::STOP_WORDS.begin(),
+                                                          Config::STOP_WORDS.end()),
+                            options);
+    }
+
+    SearchServer server_;
+};
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "memory_stats.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Stop words are looked up in a perfect hash table built by hash and displace: a word's
+// bucket holds a displacement, chosen when the table is built, that sends every word of the
+// bucket to a slot of its own. A lookup hashes the word once and compares it with a single
+// slot. The table is laid out as BUCKET_COUNT displacements followed by the slots, a slot
+// holding the index of its word plus one, or zero if it is empty.
+
+// FNV-1a of the word
+constexpr uint64_t HashStopWord(std::string_view word) noexcept {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (const char c : word) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// Hash of the word under a displacement, the bucket is chosen with displacement zero
+constexpr uint64_t MixStopWordHash(uint64_t hash, uint32_t displacement) noexcept {
+    hash ^= displacement * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// A bucket per word on average and at least twice as many slots as words, both powers of two
+constexpr size_t GetStopWordBucketCount(size_t word_count) noexcept {
+    return std::bit_ceil(std::max<size_t>(word_count, 1));
+}
+
+constexpr size_t GetStopWordTableSize(size_t word_count) noexcept {
+    return GetStopWordBucketCount(word_count) * 3;
+}
+
+// Fills table for the unique non-empty words. Throws std::invalid_argument for an empty or
+// repeated word, which would never find a slot; in a constant expression that is a compile
+// error.
+template <typename Words, typename Table>
+constexpr void BuildStopWordTable(const Words &words, Table &table) {
+    const size_t bucket_count = GetStopWordBucketCount(words.size());
+    const size_t slot_count = bucket_count * 2;
+    std::fill(table.begin(), table.end(), 0u);
+
+    // Words grouped by bucket, the fullest buckets are placed first while slots are free
+    std::vector<std::pair<size_t, size_t>> bucket_words;
+    std::vector<size_t> bucket_sizes(bucket_count);
+    for (size_t i = 0; i < words.size(); ++i) {
+        const std::string_view word = words[i];
+        if (word.empty()) {
+            throw std::invalid_argument("Empty stop word");
+        }
+        const size_t bucket = MixStopWordHash(HashStopWord(word), 0) & (bucket_count - 1);
+        bucket_words.emplace_back(bucket, i);
+        ++bucket_sizes[bucket];
+    }
+    std::sort(bucket_words.begin(), bucket_words.end(),
+              [&bucket_sizes](const auto &lhs, const auto &rhs) {
+                  return bucket_sizes[lhs.first] != bucket_sizes[rhs.first]
+                             ? bucket_sizes[lhs.first] > bucket_sizes[rhs.first]
+                             : lhs < rhs;
+              });
+
+    std::vector<size_t> bucket_slots;
+    for (auto begin = bucket_words.begin(); begin != bucket_words.end();) {
+        const auto end = std::find_if(begin, bucket_words.end(), [begin](const auto &entry) {
+            return entry.first != begin->first;
+        });
+        // Equal words share a bucket and would never get slots of their own
+        for (auto it = begin; it != end; ++it) {
+            for (auto other = std::next(it); other != end; ++other) {
+                if (std::string_view(words[it->second]) ==
+                    std::string_view(words[other->second])) {
+                    throw std::invalid_argument("Repeated stop word");
+                }
+            }
+        }
+        for (uint32_t displacement = 1;; ++displacement) {
+            bucket_slots.clear();
+            for (auto it = begin; it != end; ++it) {
+                const size_t slot =
+                    MixStopWordHash(HashStopWord(words[it->second]), displacement) &
+                    (slot_count - 1);
+                if (table[bucket_count + slot] != 0 ||
+                    std::find(bucket_slots.begin(), bucket_slots.end(), slot) !=
+                        bucket_slots.end()) {
+                    break;
+                }
+                bucket_slots.push_back(slot);
+            }
+            if (bucket_slots.size() == static_cast<size_t>(end - begin)) {
+                table[begin->first] = displacement;
+                for (size_t i = 0; i < bucket_slots.size(); ++i) {
+                    table[bucket_count + bucket_slots[i]] =
+                        static_cast<uint32_t>((begin + i)->second + 1);
+                }
+                break;
+            }
+            // Only words with equal 64-bit hashes get here
+            if (displacement == 1'000'000) {
+                throw std::invalid_argument("Stop words cannot be placed in the table");
+            }
+        }
+        begin = end;
+    }
+}
+
+template <typename Words, typename Table>
+constexpr bool ContainsStopWord(const Words &words, const Table &table, std::string_view word) {
+    const size_t bucket_count = GetStopWordBucketCount(words.size());
+    const uint64_t hash = HashStopWord(word);
+    const uint32_t displacement = table[MixStopWordHash(hash, 0) & (bucket_count - 1)];
+    const uint32_t index =
+        table[bucket_count + (MixStopWordHash(hash, displacement) & (bucket_count * 2 - 1))];
+    return index != 0 && std::string_view(words[index - 1]) == word;
+}
+
+// Stop words fixed at compile time, see MakeStaticStopWordSet. The table is a constant of
+// the program, lookups need no memory but it.
+template <size_t N>
+class StaticStopWordSet {
+  public:
+    constexpr StaticStopWordSet()
+        requires(N == 0)
+    {
+        BuildStopWordTable(words_, table_);
+    }
+
+    constexpr explicit StaticStopWordSet(const std::array<std::string_view, N> &words)
+        : words_(words) {
+        for (const auto word : words_) {
+            if (std::any_of(word.begin(), word.end(),
+                            [](char c) { return c >= '\0' && c < ' '; })) {
+                throw std::invalid_argument("Stop word with a control character");
+            }
+        }
+        BuildStopWordTable(words_, table_);
+    }
+
+    constexpr bool Contains(std::string_view word) const {
+        return ContainsStopWord(words_, table_, word);
+    }
+
+    constexpr size_t size() const noexcept {
+        return N;
+    }
+
+    constexpr auto begin() const noexcept {
+        return words_.begin();
+    }
+
+    constexpr auto end() const noexcept {
+        return words_.end();
+    }
+
+  private:
+    std::array<std::string_view, N> words_{};
+    std::array<uint32_t, GetStopWordTableSize(N)> table_{};
+};
+
+// MakeStaticStopWordSet("a", "in", "the") in a constexpr variable; an invalid or repeated
+// word fails to compile
+template <typename... Words>
+constexpr StaticStopWordSet<sizeof...(Words)> MakeStaticStopWordSet(const Words &...words) {
+    return StaticStopWordSet<sizeof...(Words)>({std::string_view(words)...});
+}
+
+// Stop words known at run time, with the same table as StaticStopWordSet
+class StopWordSet {
+  public:
+    StopWordSet();
+    // words are unique and non-empty
+    explicit StopWordSet(std::vector<std::string> words);
+
+    bool Contains(std::string_view word) const {
+        return ContainsStopWord(words_, table_, word);
+    }
+
+    size_t size() const noexcept {
+        return words_.size();
+    }
+
+    bool empty() const noexcept {
+        return words_.empty();
+    }
+
+    auto begin() const noexcept {
+        return words_.begin();
+    }
+
+    auto end() const noexcept {
+        return words_.end();
+    }
+
+    // Words with their long string buffers, and the table
+    MemoryUsage GetMemoryUsage() const;
+
+  private:
+    std::vector<std::string> words_;
+    std::vector<uint32_t> table_;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "memory_stats.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Set of unique strings whose bytes are stored in large contiguous chunks. A pooled string
+// keeps its address until it is released, so views to it may be used as keys elsewhere.
+// Lookup takes string_view and never constructs a std::string.
+//
+// Copies of the pool share the chunks: bytes already written are immutable for everybody,
+// new strings go to chunks owned by a single pool, and space is reused only in those.
+class StringPool {
+  public:
+    static const size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    explicit StringPool(size_t chunk_size = DEFAULT_CHUNK_SIZE) : chunk_size_(chunk_size) {}
+
+    // Returns pooled copy of str, adding it to the pool if needed
+    std::string_view Intern(std::string_view str);
+
+    std::optional<std::string_view> Find(std::string_view str) const;
+
+    // Removes str from the pool. Its bytes are reused by later strings of the same length,
+    // a chunk is freed as soon as it holds no live strings.
+    void Release(std::string_view str);
+
+    size_t size() const noexcept {
+        return count_;
+    }
+
+    bool empty() const noexcept {
+        return count_ == 0;
+    }
+
+    // Bytes of all live strings
+    size_t GetStringBytes() const noexcept {
+        return string_bytes_;
+    }
+
+    // Bytes allocated for chunks, including unused and released space
+    size_t GetChunkBytes() const noexcept;
+
+    // Bytes allocated for the hash table
+    size_t GetTableBytes() const noexcept {
+        return table_.capacity() * sizeof(Slot);
+    }
+
+    // Chunks and hash table together
+    MemoryUsage GetMemoryUsage() const;
+
+  private:
+    struct Chunk {
+        std::shared_ptr<char[]> data;
+        size_t size = 0;
+        size_t live_bytes = 0;
+    };
+
+    enum class SlotState : uint8_t {
+        EMPTY,
+        USED,
+        DELETED,
+    };
+
+    struct Slot {
+        std::string_view str;
+        SlotState state = SlotState::EMPTY;
+    };
+
+    size_t chunk_size_;
+
+    // Chunks ordered by descending address, so lower_bound finds the one holding a pointer
+    std::map<const char *, Chunk, std::greater<>> chunks_;
+    const char *current_chunk_ = nullptr;
+    char *current_ = nullptr;
+    size_t current_left_ = 0;
+
+    std::unordered_map<size_t, std::vector<char *>> free_slots_;
+
+    // Open addressing hash table with linear probing, capacity is a power of two
+    std::vector<Slot> table_;
+    size_t count_ = 0;
+    size_t deleted_count_ = 0;
+    size_t string_bytes_ = 0;
+
+  private:
+    size_t FindSlot(std::string_view str) const;
+    void Rehash(size_t capacity);
+
+    Chunk &GetChunk(const char *data);
+    char *Allocate(size_t size);
+};
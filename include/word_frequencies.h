@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+using WordFrequency = std::pair<std::string_view, double>;
+
+// Words of one document with their term frequencies, sorted by word. A view of a row of the
+// forward index: it is invalidated by any change of the server it came from.
+class WordFrequencies {
+  public:
+    using value_type = WordFrequency;
+    using const_iterator = const WordFrequency *;
+    using iterator = const_iterator;
+
+    WordFrequencies() = default;
+    WordFrequencies(const WordFrequency *begin, const WordFrequency *end) noexcept
+        : begin_(begin), end_(end) {}
+
+    const_iterator begin() const noexcept {
+        return begin_;
+    }
+
+    const_iterator end() const noexcept {
+        return end_;
+    }
+
+    size_t size() const noexcept {
+        return static_cast<size_t>(end_ - begin_);
+    }
+
+    bool empty() const noexcept {
+        return begin_ == end_;
+    }
+
+    const_iterator find(std::string_view word) const noexcept {
+        const auto it = std::lower_bound(begin_, end_, word,
+                                         [](const WordFrequency &word_freq, std::string_view key) {
+                                             return word_freq.first < key;
+                                         });
+        return it != end_ && it->first == word ? it : end_;
+    }
+
+    size_t count(std::string_view word) const noexcept {
+        return find(word) != end_ ? 1 : 0;
+    }
+
+    double at(std::string_view word) const {
+        const auto it = find(word);
+        if (it == end_) {
+            using namespace std::string_literals;
+            throw std::out_of_range("No word "s + std::string(word) + " in the document"s);
+        }
+        return it->second;
+    }
+
+    friend bool operator==(const WordFrequencies &lhs, const WordFrequencies &rhs) noexcept {
+        return std::equal(lhs.begin_, lhs.end_, rhs.begin_, rhs.end_);
+    }
+
+    friend bool operator!=(const WordFrequencies &lhs, const WordFrequencies &rhs) noexcept {
+        return !(lhs == rhs);
+    }
+
+  private:
+    const WordFrequency *begin_ = nullptr;
+    const WordFrequency *end_ = nullptr;
+};
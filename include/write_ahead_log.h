@@ -0,0 +1,123 @@
+#pragma once
+
+#include "document.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Change of a search index as the write-ahead log keeps it
+enum class WalRecordType : uint8_t {
+    ADD = 1,
+    REMOVE = 2,
+    UPDATE = 3,
+    // Status and ratings only
+    UPDATE_METADATA = 4,
+    // First record of a snapshot: the sequence of the last change it includes
+    CHECKPOINT = 5,
+};
+
+struct WalRecord {
+    uint64_t sequence = 0;
+    WalRecordType type = WalRecordType::ADD;
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string text;
+};
+
+struct WalOptions {
+    // Records written and synced together; 1 makes every change durable before it returns
+    size_t group_commit_size = 64;
+    // Longest time a record waits for its group, zero for no background commits
+    std::chrono::milliseconds group_commit_delay{10};
+    // Without it records reach the file but not the disk, for tests and benchmarks
+    bool sync = true;
+};
+
+// Append-only log of index changes. A record is a frame of the search protocol: uint32 size,
+// uint32 CRC-32 of the rest, uint64 sequence, uint8 type, int32 document id, then for ADD and
+// UPDATE uint8 status, ratings and text, for UPDATE_METADATA status and ratings.
+//
+// Records are buffered and written with a single write and fdatasync per group: when
+// group_commit_size records are waiting, when the oldest has waited group_commit_delay, or
+// on Commit. Append and Commit may be called from several threads.
+//
+// A group that fails to be written or synced is cut off the file and the log stays failed:
+// the records of the group and every later Append and Commit throw std::runtime_error, even
+// when the group was committed in the background. Nothing is lost silently, and the file
+// holds whole records only.
+class WriteAheadLog {
+  public:
+    // Opens or creates the log at path. A torn or corrupt record at the end, left by a crash
+    // in the middle of a write, is cut off. Sequences continue after the last one in the file
+    // or after last_sequence, whichever is greater.
+    explicit WriteAheadLog(std::string path,
+                           const WalOptions &options = {},
+                           uint64_t last_sequence = 0);
+    // Commits what is left
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    // Assigns the record the next sequence and returns it
+    uint64_t Append(const WalRecord &record);
+
+    // Writes and syncs every record appended so far
+    void Commit();
+
+    // True once a group failed to commit, see the class comment
+    bool IsFailed() const;
+
+    // Drops all records, once a snapshot holds their changes
+    void Truncate();
+
+    uint64_t GetLastSequence() const;
+    // Last sequence that is on the disk
+    uint64_t GetCommittedSequence() const;
+
+    const std::string &GetPath() const noexcept {
+        return path_;
+    }
+
+    // Whole records of a log or snapshot file, up to the first torn or corrupt one. Its
+    // offset goes to valid_size, if given. A missing file has no records.
+    static std::vector<WalRecord> ReadRecords(const std::string &path,
+                                              size_t *valid_size = nullptr);
+
+    // Appends the record as a frame to buffer
+    static void EncodeRecord(std::string &buffer, const WalRecord &record);
+
+  private:
+    void RunCommitter();
+    // Under mutex_
+    void ThrowIfFailed() const;
+
+    std::string path_;
+    WalOptions options_;
+    int fd_ = -1;
+
+    // Guards the pending records and the sequences
+    mutable std::mutex mutex_;
+    std::condition_variable commit_requested_;
+    std::string pending_;
+    size_t pending_count_ = 0;
+    uint64_t last_sequence_ = 0;
+    uint64_t committed_sequence_ = 0;
+    bool stopping_ = false;
+    // Error of the group that failed to commit, empty while the log works
+    std::string failure_;
+
+    // Serializes writes of groups to the file
+    std::mutex write_mutex_;
+    std::string writing_;
+    // Size of the whole records in the file
+    size_t committed_size_ = 0;
+
+    std::thread committer_;
+};
@@ -0,0 +1,294 @@
+#include "dataset_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace std::string_literals;
+
+namespace {
+const double PI = 3.14159265358979323846;
+
+std::ofstream OpenForWriting(const std::filesystem::path &path) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Cannot open "s + path.string() + " for writing"s);
+    }
+    return out;
+}
+
+std::ifstream OpenForReading(const std::filesystem::path &path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot open "s + path.string());
+    }
+    return in;
+}
+
+std::vector<std::string> ReadLines(const std::filesystem::path &path) {
+    auto in = OpenForReading(path);
+    std::vector<std::string> lines;
+    for (std::string line; getline(in, line);) {
+        lines.push_back(std::move(line));
+    }
+    return lines;
+}
+
+void WriteLines(const std::filesystem::path &path, const std::vector<std::string> &lines) {
+    auto out = OpenForWriting(path);
+    for (const auto &line : lines) {
+        out << line << '\n';
+    }
+}
+} // namespace
+
+ZipfDistribution::ZipfDistribution(size_t n, double exponent) {
+    if (n == 0) {
+        throw std::invalid_argument("Zipf distribution needs at least one rank"s);
+    }
+    cumulative_.reserve(n);
+    double sum = 0.0;
+    for (size_t rank = 0; rank < n; ++rank) {
+        sum += 1.0 / std::pow(static_cast<double>(rank + 1), exponent);
+        cumulative_.push_back(sum);
+    }
+}
+
+size_t ZipfDistribution::operator()(double uniform) const {
+    const auto it =
+        std::upper_bound(cumulative_.begin(), cumulative_.end(), uniform * cumulative_.back());
+    return std::min(static_cast<size_t>(it - cumulative_.begin()), cumulative_.size() - 1);
+}
+
+DatasetGenerator::DatasetGenerator(const DatasetOptions &options)
+    : options_(options), generator_(options.seed) {
+    if (options_.vocabulary_size <= 0 || options_.max_word_length <= 0) {
+        throw std::invalid_argument("Vocabulary must not be empty"s);
+    }
+    if (options_.stop_word_count >= options_.vocabulary_size) {
+        throw std::invalid_argument("Too many stop words"s);
+    }
+}
+
+Dataset DatasetGenerator::Generate() {
+    Dataset dataset;
+    dataset.vocabulary = GenerateVocabulary();
+    dataset.stop_words.assign(dataset.vocabulary.begin(),
+                              dataset.vocabulary.begin() + options_.stop_word_count);
+    dataset.documents = GenerateDocuments(dataset.vocabulary);
+    dataset.queries = GenerateQueries(dataset.vocabulary);
+    return dataset;
+}
+
+std::vector<std::string> DatasetGenerator::GenerateVocabulary() {
+    std::vector<std::string> vocabulary;
+    vocabulary.reserve(static_cast<size_t>(options_.vocabulary_size));
+    std::unordered_set<std::string> used;
+
+    const double log_size = std::log2(options_.vocabulary_size + 1.0);
+    for (int rank = 0; rank < options_.vocabulary_size; ++rank) {
+        // Frequent words are short, length grows with the logarithm of the rank
+        int length = 1 + static_cast<int>(std::log2(rank + 1.0) / log_size *
+                                          (options_.max_word_length - 1)) +
+                     NextInt(-1, 1);
+        length = std::clamp(length, 1, options_.max_word_length);
+
+        std::string word;
+        for (int attempt = 0;; ++attempt) {
+            word.clear();
+            for (int i = 0; i < length; ++i) {
+                word.push_back(static_cast<char>('a' + NextInt(0, 25)));
+            }
+            if (used.insert(word).second) {
+                break;
+            }
+            // All short words may already be taken
+            if (attempt % 8 == 7) {
+                ++length;
+            }
+        }
+        vocabulary.push_back(std::move(word));
+    }
+    return vocabulary;
+}
+
+std::vector<GeneratedDocument>
+DatasetGenerator::GenerateDocuments(const std::vector<std::string> &vocabulary) {
+    const ZipfDistribution words(vocabulary.size(), options_.zipf_exponent);
+
+    const double length_sigma = options_.document_length_sigma;
+    const double length_mu =
+        std::log(options_.mean_document_length) - length_sigma * length_sigma / 2;
+
+    double status_weight_sum = 0.0;
+    for (const double weight : options_.status_weights) {
+        status_weight_sum += weight;
+    }
+
+    // Base ratings are log-normal with sigma 0.5, rescaled to the requested mean and stddev
+    const double rating_sigma = 0.5;
+    const double log_normal_mean = std::exp(rating_sigma * rating_sigma / 2);
+    const double log_normal_stddev =
+        log_normal_mean * std::sqrt(std::exp(rating_sigma * rating_sigma) - 1);
+
+    std::vector<GeneratedDocument> documents;
+    documents.reserve(static_cast<size_t>(options_.document_count));
+    for (int id = 0; id < options_.document_count; ++id) {
+        GeneratedDocument document;
+        document.id = id;
+
+        const double length_sample = std::exp(length_mu + length_sigma * NextNormal());
+        const int length = std::clamp(static_cast<int>(std::lround(length_sample)), 1,
+                                      options_.max_document_length);
+        for (int i = 0; i < length; ++i) {
+            if (i > 0) {
+                document.text.push_back(' ');
+            }
+            document.text += vocabulary[words(NextUniform())];
+        }
+
+        double status_point = NextUniform() * status_weight_sum;
+        size_t status = 0;
+        while (status + 1 < options_.status_weights.size() &&
+               status_point >= options_.status_weights[status]) {
+            status_point -= options_.status_weights[status];
+            ++status;
+        }
+        document.status = static_cast<DocumentStatus>(status);
+
+        const double base_rating =
+            options_.mean_rating + options_.rating_stddev *
+                                       (std::exp(rating_sigma * NextNormal()) - log_normal_mean) /
+                                       log_normal_stddev;
+        const int rating_count = NextInt(0, options_.max_rating_count);
+        for (int i = 0; i < rating_count; ++i) {
+            document.ratings.push_back(static_cast<int>(std::lround(base_rating + NextNormal())));
+        }
+
+        documents.push_back(std::move(document));
+    }
+    return documents;
+}
+
+std::vector<std::string>
+DatasetGenerator::GenerateQueries(const std::vector<std::string> &vocabulary) {
+    const ZipfDistribution words(vocabulary.size(), options_.zipf_exponent);
+
+    std::vector<std::string> distinct_queries;
+    distinct_queries.reserve(static_cast<size_t>(options_.distinct_query_count));
+    for (int i = 0; i < options_.distinct_query_count; ++i) {
+        distinct_queries.push_back(GenerateQuery(vocabulary, words));
+    }
+
+    std::vector<std::string> queries;
+    if (distinct_queries.empty()) {
+        return queries;
+    }
+    const ZipfDistribution popularity(distinct_queries.size(), options_.query_zipf_exponent);
+    queries.reserve(static_cast<size_t>(options_.query_count));
+    for (int i = 0; i < options_.query_count; ++i) {
+        queries.push_back(distinct_queries[popularity(NextUniform())]);
+    }
+    return queries;
+}
+
+double DatasetGenerator::NextUniform() {
+    // 53 random bits, the way std::generate_canonical would take them from two draws
+    const uint64_t high = generator_() >> 5;
+    const uint64_t low = generator_() >> 6;
+    return static_cast<double>((high << 26) | low) / 9007199254740992.0;
+}
+
+int DatasetGenerator::NextInt(int min, int max) {
+    const auto range = static_cast<double>(max - min + 1);
+    return std::min(max, min + static_cast<int>(NextUniform() * range));
+}
+
+double DatasetGenerator::NextNormal() {
+    // Box-Muller transform
+    const double u1 = 1.0 - NextUniform();
+    const double u2 = NextUniform();
+    return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * PI * u2);
+}
+
+std::string DatasetGenerator::GenerateQuery(const std::vector<std::string> &vocabulary,
+                                            const ZipfDistribution &words) {
+    // Geometric length with the requested mean
+    int length = 1;
+    if (options_.mean_query_length > 1.0) {
+        const double p = 1.0 / options_.mean_query_length;
+        length += static_cast<int>(std::log(1.0 - NextUniform()) / std::log(1.0 - p));
+    }
+    length = std::clamp(length, options_.min_query_length,
+                        std::max(options_.min_query_length, options_.max_query_length));
+
+    std::string query;
+    for (int i = 0; i < length; ++i) {
+        if (i > 0) {
+            query.push_back(' ');
+        }
+        if (NextUniform() < options_.minus_word_probability) {
+            query.push_back('-');
+        }
+        query += vocabulary[words(NextUniform())];
+    }
+    return query;
+}
+
+void WriteDataset(const Dataset &dataset, const std::string &directory) {
+    const std::filesystem::path path(directory);
+    std::filesystem::create_directories(path);
+
+    WriteLines(path / "vocabulary.txt", dataset.vocabulary);
+    WriteLines(path / "stop_words.txt", dataset.stop_words);
+    WriteLines(path / "queries.txt", dataset.queries);
+
+    auto out = OpenForWriting(path / "documents.tsv");
+    for (const auto &document : dataset.documents) {
+        out << document.id << '\t' << static_cast<int>(document.status) << '\t';
+        for (size_t i = 0; i < document.ratings.size(); ++i) {
+            out << (i > 0 ? ","s : ""s) << document.ratings[i];
+        }
+        out << '\t' << document.text << '\n';
+    }
+}
+
+Dataset ReadDataset(const std::string &directory) {
+    const std::filesystem::path path(directory);
+
+    Dataset dataset;
+    dataset.vocabulary = ReadLines(path / "vocabulary.txt");
+    dataset.stop_words = ReadLines(path / "stop_words.txt");
+    dataset.queries = ReadLines(path / "queries.txt");
+
+    for (const auto &line : ReadLines(path / "documents.tsv")) {
+        std::istringstream fields(line);
+        std::string id, status, ratings;
+        GeneratedDocument document;
+        if (!getline(fields, id, '\t') || !getline(fields, status, '\t') ||
+            !getline(fields, ratings, '\t')) {
+            throw std::invalid_argument("Invalid document line: "s + line);
+        }
+        getline(fields, document.text);
+        document.id = std::stoi(id);
+        document.status = static_cast<DocumentStatus>(std::stoi(status));
+        std::istringstream rating_values(ratings);
+        for (std::string rating; getline(rating_values, rating, ',');) {
+            document.ratings.push_back(std::stoi(rating));
+        }
+        dataset.documents.push_back(std::move(document));
+    }
+    return dataset;
+}
+
+SearchServer MakeSearchServer(const Dataset &dataset) {
+    SearchServer server(dataset.stop_words);
+    for (const auto &document : dataset.documents) {
+        server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    return server;
+}
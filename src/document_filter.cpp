@@ -0,0 +1,84 @@
+#include "document_filter.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+void SortUnique(std::vector<int> &document_ids) {
+    std::sort(document_ids.begin(), document_ids.end());
+    document_ids.erase(std::unique(document_ids.begin(), document_ids.end()), document_ids.end());
+}
+} // namespace
+
+DocumentFilter &DocumentFilter::SetStatuses(std::initializer_list<DocumentStatus> statuses) {
+    status_mask_ = 0;
+    for (const auto status : statuses) {
+        status_mask_ |= 1u << static_cast<unsigned>(status);
+    }
+    return *this;
+}
+
+DocumentFilter &DocumentFilter::SetRatingRange(int min_rating, int max_rating) {
+    min_rating_ = min_rating;
+    max_rating_ = max_rating;
+    has_empty_range_ = min_rating_ > max_rating_ || min_id_ > max_id_;
+    return *this;
+}
+
+DocumentFilter &DocumentFilter::SetIdRange(int min_id, int max_id) {
+    min_id_ = min_id;
+    max_id_ = max_id;
+    has_empty_range_ = min_rating_ > max_rating_ || min_id_ > max_id_;
+    return *this;
+}
+
+DocumentFilter &DocumentFilter::AllowIds(std::vector<int> document_ids) {
+    SortUnique(document_ids);
+    if (allowed_ids_) {
+        std::vector<int> common;
+        std::set_intersection(allowed_ids_->begin(), allowed_ids_->end(), document_ids.begin(),
+                              document_ids.end(), std::back_inserter(common));
+        document_ids.swap(common);
+    }
+    allowed_ids_ = std::move(document_ids);
+    return *this;
+}
+
+DocumentFilter &DocumentFilter::DenyIds(std::vector<int> document_ids) {
+    denied_ids_.insert(denied_ids_.end(), document_ids.begin(), document_ids.end());
+    SortUnique(denied_ids_);
+    return *this;
+}
+
+bool DocumentFilter::MatchesId(int document_id) const {
+    return document_id >= min_id_ && document_id <= max_id_ &&
+           (!allowed_ids_ ||
+            std::binary_search(allowed_ids_->begin(), allowed_ids_->end(), document_id)) &&
+           !std::binary_search(denied_ids_.begin(), denied_ids_.end(), document_id);
+}
+
+bool DocumentFilter::IsEmpty() const noexcept {
+    return status_mask_ == 0 || has_empty_range_ || (allowed_ids_ && allowed_ids_->empty());
+}
+
+std::optional<std::vector<int>>
+DocumentFilter::RestrictCandidates(std::optional<std::vector<int>> candidates) const {
+    if (allowed_ids_) {
+        if (candidates) {
+            std::vector<int> common;
+            std::set_intersection(candidates->begin(), candidates->end(), allowed_ids_->begin(),
+                                  allowed_ids_->end(), std::back_inserter(common));
+            candidates->swap(common);
+        } else {
+            candidates = *allowed_ids_;
+        }
+    }
+    if (candidates) {
+        // The id range of a list is cut right away, scans of plain postings are seeked
+        const auto first = std::lower_bound(candidates->begin(), candidates->end(), min_id_);
+        const auto last = std::upper_bound(first, candidates->end(), max_id_);
+        candidates->erase(last, candidates->end());
+        candidates->erase(candidates->begin(), first);
+    }
+    return candidates;
+}
@@ -0,0 +1,176 @@
+#include "durable_search_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+namespace {
+[[noreturn]] void ThrowSystemError(const std::string &what) {
+    throw std::runtime_error(what + ": "s + std::strerror(errno));
+}
+
+std::string GetWalPath(const std::string &directory) {
+    return (std::filesystem::path(directory) / "wal").string();
+}
+
+std::string GetSnapshotPath(const std::string &directory) {
+    return (std::filesystem::path(directory) / "snapshot").string();
+}
+
+void SyncPath(const std::string &path, int flags) {
+    const int fd = open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0) {
+        ThrowSystemError("Cannot open "s + path);
+    }
+    const int result = fsync(fd);
+    close(fd);
+    if (result < 0) {
+        ThrowSystemError("Cannot sync "s + path);
+    }
+}
+
+// Replaces the file at path with data: written to a temporary file, then renamed over it
+void ReplaceFile(const std::string &path, std::string_view data, bool sync) {
+    const std::string temporary_path = path + ".tmp"s;
+    const int fd = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ThrowSystemError("Cannot open "s + temporary_path);
+    }
+    while (!data.empty()) {
+        const ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0 && errno != EINTR) {
+            const int error = errno;
+            close(fd);
+            errno = error;
+            ThrowSystemError("Cannot write "s + temporary_path);
+        }
+        data.remove_prefix(static_cast<size_t>(std::max<ssize_t>(written, 0)));
+    }
+    if (sync && fsync(fd) < 0) {
+        const int error = errno;
+        close(fd);
+        errno = error;
+        ThrowSystemError("Cannot sync "s + temporary_path);
+    }
+    close(fd);
+    if (rename(temporary_path.c_str(), path.c_str()) < 0) {
+        ThrowSystemError("Cannot rename "s + temporary_path);
+    }
+    // The new name itself is durable only once the directory is synced
+    if (sync) {
+        SyncPath(std::filesystem::path(path).parent_path().string(), O_RDONLY | O_DIRECTORY);
+    }
+}
+} // namespace
+
+DurableSearchServer::DurableSearchServer(const std::string &directory,
+                                         SearchServer server,
+                                         const WalOptions &options)
+    : directory_(directory), options_(options), server_(std::move(server)),
+      wal_(GetWalPath(directory), options, Recover(directory, server_)) {}
+
+void DurableSearchServer::AddDocument(int document_id,
+                                      std::string_view document,
+                                      DocumentStatus status,
+                                      const std::vector<int> &ratings) {
+    server_.AddDocument(document_id, document, status, ratings);
+    wal_.Append({0, WalRecordType::ADD, document_id, status, ratings, std::string(document)});
+}
+
+void DurableSearchServer::RemoveDocument(int document_id) {
+    const int document_count = server_.GetDocumentCount();
+    server_.RemoveDocument(document_id);
+    // SearchServer ignores an unknown id, so does the log
+    if (server_.GetDocumentCount() < document_count) {
+        wal_.Append({0, WalRecordType::REMOVE, document_id});
+    }
+}
+
+void DurableSearchServer::UpdateDocument(int document_id,
+                                         std::string_view document,
+                                         DocumentStatus status,
+                                         const std::vector<int> &ratings) {
+    server_.UpdateDocument(document_id, document, status, ratings);
+    wal_.Append({0, WalRecordType::UPDATE, document_id, status, ratings, std::string(document)});
+}
+
+void DurableSearchServer::UpdateDocument(int document_id,
+                                         DocumentStatus status,
+                                         const std::vector<int> &ratings) {
+    server_.UpdateDocument(document_id, status, ratings);
+    wal_.Append({0, WalRecordType::UPDATE_METADATA, document_id, status, ratings});
+}
+
+void DurableSearchServer::Commit() {
+    wal_.Commit();
+}
+
+void DurableSearchServer::Checkpoint() {
+    wal_.Commit();
+    const uint64_t sequence = wal_.GetLastSequence();
+
+    std::string snapshot;
+    WriteAheadLog::EncodeRecord(snapshot, {sequence, WalRecordType::CHECKPOINT});
+    for (const int document_id : server_) {
+        WriteAheadLog::EncodeRecord(snapshot,
+                                    {sequence,
+                                     WalRecordType::ADD,
+                                     document_id,
+                                     server_.GetDocumentStatus(document_id),
+                                     {server_.GetDocumentRating(document_id)},
+                                     server_.GetDocumentText(document_id)});
+    }
+    ReplaceFile(GetSnapshotPath(directory_), snapshot, options_.sync);
+    // A crash before this point leaves the old log, its records are skipped by sequence
+    wal_.Truncate();
+}
+
+uint64_t DurableSearchServer::Recover(const std::string &directory, SearchServer &server) {
+    std::filesystem::create_directories(directory);
+
+    uint64_t snapshot_sequence = 0;
+    const auto snapshot = WriteAheadLog::ReadRecords(GetSnapshotPath(directory));
+    if (!snapshot.empty()) {
+        if (snapshot.front().type != WalRecordType::CHECKPOINT) {
+            throw std::runtime_error("Snapshot in "s + directory + " has no checkpoint"s);
+        }
+        snapshot_sequence = snapshot.front().sequence;
+        std::for_each(std::next(snapshot.begin()), snapshot.end(),
+                      [&server](const WalRecord &record) { Apply(server, record); });
+    }
+
+    uint64_t last_sequence = snapshot_sequence;
+    for (const auto &record : WriteAheadLog::ReadRecords(GetWalPath(directory))) {
+        if (record.sequence > snapshot_sequence) {
+            Apply(server, record);
+        }
+        last_sequence = std::max(last_sequence, record.sequence);
+    }
+    return last_sequence;
+}
+
+void DurableSearchServer::Apply(SearchServer &server, const WalRecord &record) {
+    switch (record.type) {
+    case WalRecordType::ADD:
+        server.AddDocument(record.document_id, record.text, record.status, record.ratings);
+        break;
+    case WalRecordType::REMOVE:
+        server.RemoveDocument(record.document_id);
+        break;
+    case WalRecordType::UPDATE:
+        server.UpdateDocument(record.document_id, record.text, record.status, record.ratings);
+        break;
+    case WalRecordType::UPDATE_METADATA:
+        server.UpdateDocument(record.document_id, record.status, record.ratings);
+        break;
+    case WalRecordType::CHECKPOINT:
+        break;
+    }
+}
@@ -0,0 +1,29 @@
+#include "impact_postings.h"
+
+#include <algorithm>
+#include <cmath>
+
+ImpactPostings::ImpactPostings(const std::vector<std::pair<int, double>> &scores,
+                               double quantum) {
+    std::vector<std::pair<uint8_t, int>> impacts;
+    impacts.reserve(scores.size());
+    for (const auto &[document_id, score] : scores) {
+        const double impact = quantum > 0.0 ? std::round(score / quantum) : 0.0;
+        impacts.emplace_back(
+            static_cast<uint8_t>(std::clamp(impact, 0.0, static_cast<double>(MAX_IMPACT))),
+            document_id);
+    }
+    std::sort(impacts.begin(), impacts.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.first > rhs.first || (lhs.first == rhs.first && lhs.second < rhs.second);
+    });
+
+    document_ids_.reserve(impacts.size());
+    for (const auto &[impact, document_id] : impacts) {
+        if (segments_.empty() || segments_.back().impact != impact) {
+            segments_.push_back({impact, 0});
+        }
+        document_ids_.push_back(document_id);
+        segments_.back().end = static_cast<uint32_t>(document_ids_.size());
+    }
+    segments_.shrink_to_fit();
+}
@@ -0,0 +1,40 @@
+#include "index_statistics.h"
+
+IndexStatistics::IndexStatistics(const IndexStatistics &other) {
+    std::lock_guard guard(other.mutex_);
+    document_count_ = other.document_count_;
+    total_document_length_ = other.total_document_length_;
+    document_freqs_ = other.document_freqs_;
+}
+
+void IndexStatistics::AddDocument(const std::vector<std::string_view> &words, uint32_t length) {
+    std::lock_guard guard(mutex_);
+    ++document_count_;
+    total_document_length_ += length;
+    for (const auto word : words) {
+        const auto word_freq = document_freqs_.find(word);
+        if (word_freq == document_freqs_.end()) {
+            document_freqs_.emplace(word, 1);
+        } else {
+            ++word_freq->second;
+        }
+    }
+}
+
+void IndexStatistics::RemoveDocument(const std::vector<std::string_view> &words,
+                                     uint32_t length) {
+    std::lock_guard guard(mutex_);
+    --document_count_;
+    total_document_length_ -= length;
+    for (const auto word : words) {
+        const auto word_freq = document_freqs_.find(word);
+        if (--word_freq->second == 0) {
+            document_freqs_.erase(word_freq);
+        }
+    }
+}
+
+size_t IndexStatistics::GetDocumentFreq(std::string_view word) const {
+    const auto word_freq = document_freqs_.find(word);
+    return word_freq == document_freqs_.end() ? 0 : word_freq->second;
+}
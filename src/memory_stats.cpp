@@ -0,0 +1,50 @@
+#include "memory_stats.h"
+
+using namespace std::string_literals;
+
+MemoryUsage &MemoryUsage::operator+=(const MemoryUsage &other) {
+    bytes += other.bytes;
+    allocated_bytes += other.allocated_bytes;
+    allocations += other.allocations;
+    elements += other.elements;
+    return *this;
+}
+
+MemoryUsage GetMemoryUsage(const MemoryCounter &counter, size_t elements) {
+    return {counter.bytes.load(std::memory_order_relaxed),
+            counter.allocated_bytes.load(std::memory_order_relaxed),
+            counter.allocations.load(std::memory_order_relaxed), elements};
+}
+
+MemoryUsage MemoryStats::GetTotal() const {
+    MemoryUsage total;
+    for (const auto *usage : {&all_words, &stop_words, &word_to_document_freqs,
+                              &document_to_words_freqs, &positions, &documents,
+                              &document_ids, &rating_index, &impact_index}) {
+        total += *usage;
+    }
+    return total;
+}
+
+std::ostream &operator<<(std::ostream &out, const MemoryUsage &usage) {
+    out << "{ "s
+        << "bytes = "s << usage.bytes << ", "s
+        << "allocated_bytes = "s << usage.allocated_bytes << ", "s
+        << "allocations = "s << usage.allocations << ", "s
+        << "elements = "s << usage.elements << " }"s;
+    return out;
+}
+
+std::ostream &operator<<(std::ostream &out, const MemoryStats &stats) {
+    out << "all_words: "s << stats.all_words << '\n'
+        << "stop_words: "s << stats.stop_words << '\n'
+        << "word_to_document_freqs: "s << stats.word_to_document_freqs << '\n'
+        << "document_to_words_freqs: "s << stats.document_to_words_freqs << '\n'
+        << "positions: "s << stats.positions << '\n'
+        << "documents: "s << stats.documents << '\n'
+        << "document_ids: "s << stats.document_ids << '\n'
+        << "rating_index: "s << stats.rating_index << '\n'
+        << "impact_index: "s << stats.impact_index << '\n'
+        << "total: "s << stats.GetTotal() << '\n';
+    return out;
+}
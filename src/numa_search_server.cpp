@@ -0,0 +1,60 @@
+#include "numa_search_server.h"
+
+#include <stdexcept>
+
+#include <tbb/info.h>
+
+using namespace std::string_literals;
+
+NumaSearchServer::NumaSearchServer(const SearchServer &server)
+    : NumaSearchServer(server, tbb::info::numa_nodes()) {}
+
+NumaSearchServer::NumaSearchServer(const SearchServer &server,
+                                   const std::vector<tbb::numa_node_id> &nodes) {
+    if (nodes.empty()) {
+        throw std::invalid_argument("No NUMA nodes to place replicas on"s);
+    }
+    for (const auto id : nodes) {
+        nodes_.push_back(std::make_unique<Node>(id));
+    }
+    // Pages are placed on the node of the thread that touches them first
+    ExecuteOnEachNode([this, &server](size_t index) {
+        nodes_[index]->replica = std::make_unique<SearchServer>(server);
+    });
+}
+
+void NumaSearchServer::AddDocument(int document_id,
+                                   std::string_view document,
+                                   DocumentStatus status,
+                                   const std::vector<int> &ratings) {
+    // The first replica rejects an invalid document before the others are changed
+    for (auto &node : nodes_) {
+        node->arena.execute(
+            [&] { node->replica->AddDocument(document_id, document, status, ratings); });
+    }
+}
+
+void NumaSearchServer::RemoveDocument(int document_id) {
+    for (auto &node : nodes_) {
+        node->arena.execute([&] { node->replica->RemoveDocument(document_id); });
+    }
+}
+
+void NumaSearchServer::UpdateDocument(int document_id,
+                                      std::string_view document,
+                                      DocumentStatus status,
+                                      const std::vector<int> &ratings) {
+    // As with AddDocument, the first replica rejects an invalid update
+    for (auto &node : nodes_) {
+        node->arena.execute(
+            [&] { node->replica->UpdateDocument(document_id, document, status, ratings); });
+    }
+}
+
+void NumaSearchServer::UpdateDocument(int document_id,
+                                      DocumentStatus status,
+                                      const std::vector<int> &ratings) {
+    for (auto &node : nodes_) {
+        node->arena.execute([&] { node->replica->UpdateDocument(document_id, status, ratings); });
+    }
+}
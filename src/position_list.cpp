@@ -0,0 +1,35 @@
+#include "position_list.h"
+
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+void PositionList::Iterator::Decode() noexcept {
+    uint32_t gap = 0;
+    int shift = 0;
+    next_ = data_;
+    while (next_ != end_) {
+        const uint8_t byte = *next_++;
+        gap |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+        shift += 7;
+    }
+    value_ += gap;
+}
+
+void PositionList::Append(uint32_t position) {
+    if (count_ > 0 && position <= last_) {
+        throw std::invalid_argument("Positions must be appended in increasing order"s);
+    }
+    // The first gap is counted from zero
+    uint32_t gap = position - last_;
+    while (gap >= 0x80) {
+        bytes_.push_back(static_cast<uint8_t>(gap | 0x80));
+        gap >>= 7;
+    }
+    bytes_.push_back(static_cast<uint8_t>(gap));
+    last_ = position;
+    ++count_;
+}
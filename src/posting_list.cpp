@@ -0,0 +1,35 @@
+#include "posting_list.h"
+
+#include <algorithm>
+
+namespace {
+// Tree nodes are not contiguous, so a search from the root pays off only for long skips
+const int LINEAR_SEEK_STEPS = 4;
+} // namespace
+
+PostingList::const_iterator
+SeekPosting(const PostingList &postings, PostingList::const_iterator it, int document_id) {
+    for (int step = 0; step < LINEAR_SEEK_STEPS; ++step) {
+        if (it == postings.end() || it->first >= document_id) {
+            return it;
+        }
+        ++it;
+    }
+    return postings.lower_bound(document_id);
+}
+
+MergedPostings::const_iterator
+SeekPosting(const MergedPostings &postings, MergedPostings::const_iterator it, int document_id) {
+    if (it == postings.end() || it->first >= document_id) {
+        return it;
+    }
+    // it stays before the target, the target is within step of it
+    ptrdiff_t step = 1;
+    while (step < postings.end() - it && (it + step)->first < document_id) {
+        it += step;
+        step *= 2;
+    }
+    const auto last = step < postings.end() - it ? it + step + 1 : postings.end();
+    return std::lower_bound(it + 1, last, document_id,
+                            [](const auto &posting, int id) { return posting.first < id; });
+}
@@ -0,0 +1,71 @@
+#include "prepared_query.h"
+
+#include <algorithm>
+
+std::vector<std::string_view> PreparedQuery::GetPlusWords() const {
+    std::vector<std::string_view> words;
+    words.reserve(plus_terms_.size());
+    for (const auto &term : plus_terms_) {
+        words.push_back(term.word);
+    }
+    return words;
+}
+
+std::vector<std::string_view> PreparedQuery::GetMinusWords() const {
+    std::vector<std::string_view> words;
+    words.reserve(minus_terms_.size());
+    for (const auto &term : minus_terms_) {
+        words.push_back(term.word);
+    }
+    return words;
+}
+
+std::vector<std::string_view> PreparedQuery::GetRequiredWords() const {
+    std::vector<std::string_view> words;
+    for (const auto &term : plus_terms_) {
+        if (term.is_required) {
+            words.push_back(term.word);
+        }
+    }
+    for (const auto &term : plus_expanded_terms_) {
+        if (term.is_required) {
+            words.push_back(term.text);
+        }
+    }
+    return words;
+}
+
+std::vector<std::string_view> PreparedQuery::GetExpandedWords() const {
+    std::vector<std::string_view> words;
+    for (const auto *terms : {&plus_expanded_terms_, &minus_expanded_terms_}) {
+        for (const auto &term : *terms) {
+            for (const auto &word : term.words) {
+                words.push_back(word.word);
+            }
+        }
+    }
+    return words;
+}
+
+std::vector<std::vector<std::string_view>> PreparedQuery::GetPhrases() const {
+    std::vector<std::vector<std::string_view>> phrases;
+    phrases.reserve(phrases_.size());
+    for (const auto &phrase : phrases_) {
+        // Terms are ordered by rarity, restore the order of the text
+        auto terms = phrase.terms;
+        std::sort(terms.begin(), terms.end(),
+                  [](const auto &lhs, const auto &rhs) { return lhs.offset < rhs.offset; });
+        auto &words = phrases.emplace_back();
+        for (const auto &term : terms) {
+            words.push_back(term.word);
+        }
+    }
+    return phrases;
+}
+
+bool PreparedQuery::ExpandedTerm::Contains(int document_id) const {
+    const auto posting = std::lower_bound(
+        postings.begin(), postings.end(), document_id,
+        [](const auto &posting, int document_id) { return posting.first < document_id; });
+    return posting != postings.end() && posting->first == document_id;
+}
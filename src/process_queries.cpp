@@ -1,6 +1,16 @@
 #include "process_queries.h"
 #include <execution>
 
+namespace {
+std::list<Document> JoinDocuments(const std::vector<std::vector<Document>> &docs) {
+    std::list<Document> joined_docs;
+    for (const auto &query_docs : docs) {
+        joined_docs.insert(joined_docs.end(), query_docs.begin(), query_docs.end());
+    }
+    return joined_docs;
+}
+} // namespace
+
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer &search_server,
                                                   const std::vector<std::string> &queries) {
     std::vector<std::vector<Document>> docs(queries.size());
@@ -12,9 +22,25 @@ std::vector<std::vector<Document>> ProcessQueries(const SearchServer &search_ser
 
 std::list<Document> ProcessQueriesJoined(const SearchServer &search_server,
                                          const std::vector<std::string> &queries) {
-    std::list<Document> joined_docs;
-    for (const auto &query_docs : ProcessQueries(search_server, queries)) {
-        joined_docs.insert(joined_docs.end(), query_docs.begin(), query_docs.end());
-    }
-    return joined_docs;
-}
\ No newline at end of file
+    return JoinDocuments(ProcessQueries(search_server, queries));
+}
+
+std::vector<std::vector<Document>> ProcessQueries(const NumaSearchServer &search_server,
+                                                  const std::vector<std::string> &queries) {
+    std::vector<std::vector<Document>> docs(queries.size());
+    const size_t node_count = search_server.GetNodeCount();
+    search_server.ExecuteOnEachNode([&](size_t index) {
+        const auto first = queries.begin() + queries.size() * index / node_count;
+        const auto last = queries.begin() + queries.size() * (index + 1) / node_count;
+        const auto &replica = search_server.GetReplica(index);
+        // Runs in the arena of the node, so the parallel policy only uses its workers
+        std::transform(std::execution::par, first, last, docs.begin() + (first - queries.begin()),
+                       [&replica](const auto &query) { return replica.FindTopDocuments(query); });
+    });
+    return docs;
+}
+
+std::list<Document> ProcessQueriesJoined(const NumaSearchServer &search_server,
+                                         const std::vector<std::string> &queries) {
+    return JoinDocuments(ProcessQueries(search_server, queries));
+}
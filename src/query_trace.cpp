@@ -0,0 +1,92 @@
+#include "query_trace.h"
+
+#include <sstream>
+
+using namespace std::string_literals;
+
+namespace {
+void WriteJsonString(std::ostream &out, std::string_view text) {
+    out << '"';
+    for (const char c : text) {
+        switch (c) {
+        case '"':
+            out << "\\\""s;
+            break;
+        case '\\':
+            out << "\\\\"s;
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                const char *digits = "0123456789abcdef";
+                out << "\\u00"s << digits[c >> 4] << digits[c & 0xf];
+            } else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+}
+
+void WriteJsonTerms(std::ostream &out, const std::vector<QueryTermTrace> &terms,
+                    std::string_view documents_key) {
+    out << '[';
+    for (size_t i = 0; i < terms.size(); ++i) {
+        const auto &term = terms[i];
+        out << (i > 0 ? ","s : ""s) << "{\"word\":"s;
+        WriteJsonString(out, term.word);
+        out << ",\"posting_length\":"s << term.posting_length
+            << ",\"inverse_document_freq\":"s << term.inverse_document_freq << ",\""s
+            << documents_key << "\":"s << term.documents << ",\"expansions\":"s
+            << term.expansions << '}';
+    }
+    out << ']';
+}
+} // namespace
+
+uint64_t QueryTrace::GetStageDuration(SearchStage stage) const {
+    uint64_t duration = 0;
+    for (const auto &[traced_stage, nanoseconds] : stage_durations) {
+        if (traced_stage == stage) {
+            duration += nanoseconds;
+        }
+    }
+    return duration;
+}
+
+void QueryTrace::WriteJson(std::ostream &out) const {
+    out << "{\"query\":"s;
+    WriteJsonString(out, raw_query);
+    out << ",\"plus_terms\":"s;
+    WriteJsonTerms(out, plus_terms, "postings_accepted");
+    out << ",\"minus_terms\":"s;
+    WriteJsonTerms(out, minus_terms, "documents_excluded");
+    out << ",\"stop_words\":["s;
+    for (size_t i = 0; i < stop_words.size(); ++i) {
+        out << (i > 0 ? ","s : ""s);
+        WriteJsonString(out, stop_words[i]);
+    }
+    out << "],\"postings_scanned\":"s << postings_scanned
+        << ",\"postings_accepted\":"s << postings_accepted
+        << ",\"documents_scored\":"s << documents_scored
+        << ",\"documents_excluded\":"s << documents_excluded
+        << ",\"candidate_count\":"s << candidate_count << ",\"stages\":["s;
+    for (size_t i = 0; i < stage_durations.size(); ++i) {
+        const auto &[stage, nanoseconds] = stage_durations[i];
+        out << (i > 0 ? ","s : ""s) << "{\"stage\":\""s << SearchMetrics::GetStageName(stage)
+            << "\",\"nanoseconds\":"s << nanoseconds << '}';
+    }
+    out << "],\"results\":["s;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &document = results[i];
+        out << (i > 0 ? ","s : ""s) << "{\"id\":"s << document.id
+            << ",\"relevance\":"s << document.relevance << ",\"rating\":"s << document.rating
+            << '}';
+    }
+    out << "]}"s;
+}
+
+std::string QueryTrace::ToJson() const {
+    std::ostringstream out;
+    WriteJson(out);
+    return out.str();
+}
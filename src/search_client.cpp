@@ -0,0 +1,191 @@
+#include "search_client.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace std::string_literals;
+
+namespace {
+[[noreturn]] void ThrowSystemError(const std::string &what) {
+    throw std::runtime_error(what + ": "s + std::strerror(errno));
+}
+
+int Connect(int domain, const sockaddr *address, socklen_t address_size) {
+    const int fd = socket(domain, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        ThrowSystemError("socket"s);
+    }
+    if (connect(fd, address, address_size) < 0) {
+        const int error = errno;
+        close(fd);
+        errno = error;
+        ThrowSystemError("Cannot connect"s);
+    }
+    return fd;
+}
+} // namespace
+
+SearchClient SearchClient::ConnectUnix(const std::string &path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Unix socket path is too long: "s + path);
+    }
+    std::memcpy(address.sun_path, path.data(), path.size());
+    return SearchClient(
+        Connect(AF_UNIX, reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+}
+
+SearchClient SearchClient::ConnectTcp(const std::string &host, uint16_t port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+        throw std::invalid_argument("Invalid IPv4 address "s + host);
+    }
+    const int fd = Connect(AF_INET, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    const int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    return SearchClient(fd);
+}
+
+SearchClient::SearchClient(SearchClient &&other) noexcept
+    : fd_(std::exchange(other.fd_, -1)),
+      next_request_id_(other.next_request_id_),
+      output_(std::move(other.output_)),
+      input_(std::move(other.input_)) {}
+
+SearchClient &SearchClient::operator=(SearchClient &&other) noexcept {
+    if (this != &other) {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+        fd_ = std::exchange(other.fd_, -1);
+        next_request_id_ = other.next_request_id_;
+        output_ = std::move(other.output_);
+        input_ = std::move(other.input_);
+    }
+    return *this;
+}
+
+SearchClient::~SearchClient() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+uint32_t SearchClient::SendSearch(std::string_view raw_query, DocumentStatus status) {
+    const uint32_t id = next_request_id_++;
+    WriteSearchRequest(output_, id, raw_query, status);
+    return id;
+}
+
+uint32_t SearchClient::SendMatch(std::string_view raw_query, int document_id) {
+    const uint32_t id = next_request_id_++;
+    WriteMatchRequest(output_, id, raw_query, document_id);
+    return id;
+}
+
+uint32_t SearchClient::SendAdd(int document_id,
+                               std::string_view document,
+                               DocumentStatus status,
+                               const std::vector<int> &ratings) {
+    const uint32_t id = next_request_id_++;
+    WriteAddRequest(output_, id, document_id, document, status, ratings);
+    return id;
+}
+
+uint32_t SearchClient::SendRemove(int document_id) {
+    const uint32_t id = next_request_id_++;
+    WriteRemoveRequest(output_, id, document_id);
+    return id;
+}
+
+void SearchClient::Flush() {
+    size_t offset = 0;
+    while (offset < output_.size()) {
+        const auto size =
+            send(fd_, output_.data() + offset, output_.size() - offset, MSG_NOSIGNAL);
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("send"s);
+        }
+        offset += static_cast<size_t>(size);
+    }
+    output_.clear();
+}
+
+SearchResponse SearchClient::Receive() {
+    const size_t READ_CHUNK_SIZE = 64 * 1024;
+    for (;;) {
+        if (const auto frame_size = GetFrameSize(input_)) {
+            auto response = ParseSearchResponse(std::string_view(input_).substr(0, *frame_size));
+            input_.erase(0, *frame_size);
+            return response;
+        }
+        const size_t old_size = input_.size();
+        input_.resize(old_size + READ_CHUNK_SIZE);
+        const auto size = read(fd_, input_.data() + old_size, READ_CHUNK_SIZE);
+        const int error = errno;
+        input_.resize(old_size + static_cast<size_t>(size > 0 ? size : 0));
+        if (size == 0) {
+            throw std::runtime_error("Connection closed by the server"s);
+        }
+        if (size < 0 && error != EINTR) {
+            errno = error;
+            ThrowSystemError("read"s);
+        }
+    }
+}
+
+std::vector<Document> SearchClient::FindTopDocuments(std::string_view raw_query,
+                                                     DocumentStatus status) {
+    SendSearch(raw_query, status);
+    return std::move(Call().documents);
+}
+
+std::tuple<std::vector<std::string>, DocumentStatus>
+SearchClient::MatchDocument(std::string_view raw_query, int document_id) {
+    SendMatch(raw_query, document_id);
+    auto response = Call();
+    return {std::move(response.words), response.status};
+}
+
+void SearchClient::AddDocument(int document_id,
+                               std::string_view document,
+                               DocumentStatus status,
+                               const std::vector<int> &ratings) {
+    SendAdd(document_id, document, status, ratings);
+    Call();
+}
+
+void SearchClient::RemoveDocument(int document_id) {
+    SendRemove(document_id);
+    Call();
+}
+
+SearchResponse SearchClient::Call() {
+    const uint32_t id = next_request_id_ - 1;
+    Flush();
+    // Responses come in order, earlier pipelined ones are dropped
+    for (;;) {
+        auto response = Receive();
+        if (response.request_id != id) {
+            continue;
+        }
+        if (response.code == SearchResponseCode::ERROR) {
+            throw std::runtime_error(response.error);
+        }
+        return response;
+    }
+}
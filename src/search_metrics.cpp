@@ -0,0 +1,261 @@
+#include "search_metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+namespace {
+// Single writer per storage, so a plain load and store is enough for an increment
+void Increment(std::atomic<uint64_t> &value, uint64_t delta) noexcept {
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+} // namespace
+
+size_t LatencyHistogram::GetBucketIndex(uint64_t value) noexcept {
+    const uint64_t sub_bucket_count = uint64_t{1} << SUB_BUCKET_BITS;
+    if (value < sub_bucket_count) {
+        return static_cast<size_t>(value);
+    }
+    const int highest_bit = 63 - __builtin_clzll(value);
+    const int shift = highest_bit - SUB_BUCKET_BITS;
+    return static_cast<size_t>(shift) * sub_bucket_count + static_cast<size_t>(value >> shift);
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) noexcept {
+    const size_t sub_bucket_count = size_t{1} << SUB_BUCKET_BITS;
+    if (index < sub_bucket_count) {
+        return index;
+    }
+    const size_t shift = index / sub_bucket_count - 1;
+    const uint64_t mantissa = index % sub_bucket_count + sub_bucket_count;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t value, uint64_t count) noexcept {
+    buckets_[GetBucketIndex(value)] += count;
+    count_ += count;
+    sum_ += value * count;
+}
+
+void LatencyHistogram::RecordBucket(size_t index, uint64_t count) noexcept {
+    buckets_[index] += count;
+    count_ += count;
+}
+
+void LatencyHistogram::AddSum(uint64_t sum) noexcept {
+    sum_ += sum;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram &other) noexcept {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+}
+
+void LatencyHistogram::Subtract(const LatencyHistogram &other) noexcept {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        buckets_[i] -= other.buckets_[i];
+    }
+    count_ -= other.count_;
+    sum_ -= other.sum_;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double quantile) const noexcept {
+    if (count_ == 0) {
+        return 0;
+    }
+    const auto rank = std::max<uint64_t>(
+        1, static_cast<uint64_t>(std::ceil(quantile * static_cast<double>(count_))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets_[i];
+        if (seen >= rank) {
+            return GetBucketUpperBound(i);
+        }
+    }
+    return GetBucketUpperBound(BUCKET_COUNT - 1);
+}
+
+class SearchMetrics::ThreadStorageHolder {
+  public:
+    explicit ThreadStorageHolder(SearchMetrics &metrics)
+        : metrics_(metrics), storage_(std::make_unique<ThreadStorage>()) {
+        std::lock_guard guard(metrics_.mutex_);
+        metrics_.storages_.push_back(storage_.get());
+    }
+
+    ~ThreadStorageHolder() {
+        metrics_.Unregister(storage_.get());
+    }
+
+    ThreadStorage &Get() noexcept {
+        return *storage_;
+    }
+
+  private:
+    SearchMetrics &metrics_;
+    std::unique_ptr<ThreadStorage> storage_;
+};
+
+SearchMetrics::SearchMetrics() {
+    const char *enabled = std::getenv("SEARCH_SERVER_METRICS");
+    enabled_ = enabled != nullptr && enabled == "1"s;
+}
+
+SearchMetrics &SearchMetrics::Instance() {
+    // Never destroyed: worker threads may still record while static objects are destroyed
+    static SearchMetrics *const instance = new SearchMetrics();
+    return *instance;
+}
+
+void SearchMetrics::Record(SearchStage stage, uint64_t nanoseconds) noexcept {
+    auto &storage = GetThreadStorage();
+    const auto stage_index = static_cast<size_t>(stage);
+    Increment(storage.buckets[stage_index][LatencyHistogram::GetBucketIndex(nanoseconds)], 1);
+    Increment(storage.sums[stage_index], nanoseconds);
+}
+
+void SearchMetrics::Add(SearchCounter counter, uint64_t value) noexcept {
+    if (!IsEnabled()) {
+        return;
+    }
+    Increment(GetThreadStorage().counters[static_cast<size_t>(counter)], value);
+}
+
+SearchMetrics::Snapshot SearchMetrics::GetSnapshot() const {
+    std::lock_guard guard(mutex_);
+    // Totals only grow, a thread that exits moves its own to retired_
+    Snapshot snapshot = GetTotal();
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        snapshot.stages[i].Subtract(reset_totals_.stages[i]);
+    }
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        snapshot.counters[i] -= reset_totals_.counters[i];
+    }
+    return snapshot;
+}
+
+void SearchMetrics::Reset() {
+    std::lock_guard guard(mutex_);
+    reset_totals_ = GetTotal();
+}
+
+SearchMetrics::Snapshot SearchMetrics::GetTotal() const {
+    Snapshot total = retired_;
+    for (const auto *storage : storages_) {
+        AddTo(*storage, total);
+    }
+    return total;
+}
+
+void SearchMetrics::WritePrometheus(std::ostream &out) const {
+    const auto snapshot = GetSnapshot();
+
+    out << "# HELP search_server_stage_duration_seconds Duration of search pipeline stages.\n"s
+        << "# TYPE search_server_stage_duration_seconds summary\n"s;
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        const auto &histogram = snapshot.stages[i];
+        const auto stage_name = GetStageName(static_cast<SearchStage>(i));
+        for (const double quantile : {0.5, 0.9, 0.99, 0.999}) {
+            out << "search_server_stage_duration_seconds{stage=\""s << stage_name
+                << "\",quantile=\""s << quantile << "\"} "s
+                << static_cast<double>(histogram.GetPercentile(quantile)) * 1e-9 << '\n';
+        }
+        out << "search_server_stage_duration_seconds_sum{stage=\""s << stage_name << "\"} "s
+            << static_cast<double>(histogram.GetSum()) * 1e-9 << '\n'
+            << "search_server_stage_duration_seconds_count{stage=\""s << stage_name << "\"} "s
+            << histogram.GetCount() << '\n';
+    }
+
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        const auto counter_name = GetCounterName(static_cast<SearchCounter>(i));
+        out << "# TYPE search_server_"s << counter_name << "_total counter\n"s
+            << "search_server_"s << counter_name << "_total "s << snapshot.counters[i] << '\n';
+    }
+}
+
+std::string SearchMetrics::ExportPrometheus() const {
+    std::ostringstream out;
+    WritePrometheus(out);
+    return out.str();
+}
+
+void SearchMetrics::ExportPrometheus(const std::string &file_name) const {
+    std::ofstream out(file_name);
+    if (!out) {
+        throw std::runtime_error("Cannot open metrics file "s + file_name);
+    }
+    WritePrometheus(out);
+}
+
+void SearchMetrics::ExportPrometheus(
+    const std::function<void(std::string_view)> &callback) const {
+    callback(ExportPrometheus());
+}
+
+std::string_view SearchMetrics::GetStageName(SearchStage stage) {
+    switch (stage) {
+    case SearchStage::PARSE_QUERY:
+        return "parse_query";
+    case SearchStage::SCORE_PLUS_WORDS:
+        return "score_plus_words";
+    case SearchStage::BUILD_ORDINARY_MAP:
+        return "build_ordinary_map";
+    case SearchStage::FILTER_MINUS_WORDS:
+        return "filter_minus_words";
+    case SearchStage::FILTER_PHRASES:
+        return "filter_phrases";
+    case SearchStage::SORT_RESULTS:
+        return "sort_results";
+    case SearchStage::ADD_DOCUMENT:
+        return "add_document";
+    case SearchStage::REMOVE_DOCUMENT:
+        return "remove_document";
+    case SearchStage::UPDATE_DOCUMENT:
+        return "update_document";
+    }
+    return "unknown";
+}
+
+std::string_view SearchMetrics::GetCounterName(SearchCounter counter) {
+    switch (counter) {
+    case SearchCounter::POSTINGS_SCANNED:
+        return "postings_scanned";
+    case SearchCounter::DOCUMENTS_SCORED:
+        return "documents_scored";
+    case SearchCounter::DOCUMENTS_EXCLUDED:
+        return "documents_excluded";
+    }
+    return "unknown";
+}
+
+SearchMetrics::ThreadStorage &SearchMetrics::GetThreadStorage() {
+    thread_local ThreadStorageHolder holder(*this);
+    return holder.Get();
+}
+
+void SearchMetrics::Unregister(ThreadStorage *storage) {
+    std::lock_guard guard(mutex_);
+    AddTo(*storage, retired_);
+    storages_.erase(std::remove(storages_.begin(), storages_.end(), storage), storages_.end());
+}
+
+void SearchMetrics::AddTo(const ThreadStorage &storage, Snapshot &snapshot) {
+    for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+        auto &histogram = snapshot.stages[stage];
+        for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+            histogram.RecordBucket(i, storage.buckets[stage][i].load(std::memory_order_relaxed));
+        }
+        histogram.AddSum(storage.sums[stage].load(std::memory_order_relaxed));
+    }
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        snapshot.counters[i] += storage.counters[i].load(std::memory_order_relaxed);
+    }
+}
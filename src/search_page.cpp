@@ -0,0 +1,54 @@
+#include "search_page.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+namespace {
+const char HEX_DIGITS[] = "0123456789abcdef";
+// 16 hex digits of the relevance bits, 8 of the rating and 8 of the id
+const size_t CURSOR_LENGTH = 32;
+
+void AppendHex(std::string &text, uint64_t value, int digits) {
+    for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4) {
+        text.push_back(HEX_DIGITS[(value >> shift) & 0xF]);
+    }
+}
+
+uint64_t ParseHex(std::string_view text) {
+    uint64_t value = 0;
+    for (const char c : text) {
+        const char *digit = std::strchr(HEX_DIGITS, c);
+        if (c == '\0' || digit == nullptr) {
+            throw std::invalid_argument("Invalid search cursor"s);
+        }
+        value = (value << 4) | static_cast<uint64_t>(digit - HEX_DIGITS);
+    }
+    return value;
+}
+} // namespace
+
+std::string EncodeCursor(const SearchCursor &cursor) {
+    uint64_t relevance_bits = 0;
+    std::memcpy(&relevance_bits, &cursor.relevance, sizeof(relevance_bits));
+    std::string text;
+    text.reserve(CURSOR_LENGTH);
+    AppendHex(text, relevance_bits, 16);
+    AppendHex(text, static_cast<uint32_t>(cursor.rating), 8);
+    AppendHex(text, static_cast<uint32_t>(cursor.id), 8);
+    return text;
+}
+
+SearchCursor DecodeCursor(std::string_view text) {
+    if (text.size() != CURSOR_LENGTH) {
+        throw std::invalid_argument("Invalid search cursor"s);
+    }
+    SearchCursor cursor;
+    const uint64_t relevance_bits = ParseHex(text.substr(0, 16));
+    std::memcpy(&cursor.relevance, &relevance_bits, sizeof(relevance_bits));
+    cursor.rating = static_cast<int>(static_cast<uint32_t>(ParseHex(text.substr(16, 8))));
+    cursor.id = static_cast<int>(static_cast<uint32_t>(ParseHex(text.substr(24, 8))));
+    return cursor;
+}
@@ -0,0 +1,295 @@
+#include "search_protocol.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+namespace {
+void WriteRequestHeader(ByteWriter &writer, uint32_t id, SearchRequestType type) {
+    writer.PutUint32(id);
+    writer.PutUint8(static_cast<uint8_t>(type));
+}
+
+void WriteResponseHeader(ByteWriter &writer,
+                         uint32_t request_id,
+                         SearchRequestType type,
+                         SearchResponseCode code) {
+    writer.PutUint32(request_id);
+    writer.PutUint8(static_cast<uint8_t>(type));
+    writer.PutUint8(static_cast<uint8_t>(code));
+}
+
+SearchRequestType ToRequestType(uint8_t value) {
+    if (value < static_cast<uint8_t>(SearchRequestType::SEARCH) ||
+        value > static_cast<uint8_t>(SearchRequestType::REMOVE)) {
+        throw std::invalid_argument("Unknown request type "s + std::to_string(value));
+    }
+    return static_cast<SearchRequestType>(value);
+}
+
+DocumentStatus ToDocumentStatus(uint8_t value) {
+    if (value > static_cast<uint8_t>(DocumentStatus::REMOVED)) {
+        throw std::invalid_argument("Unknown document status "s + std::to_string(value));
+    }
+    return static_cast<DocumentStatus>(value);
+}
+
+// Skips the size field of a whole frame
+ByteReader ReadFrame(std::string_view frame) {
+    const auto size = GetFrameSize(frame);
+    if (!size || *size != frame.size()) {
+        throw std::invalid_argument("Frame size does not match"s);
+    }
+    return ByteReader(frame.substr(FRAME_SIZE_BYTES));
+}
+} // namespace
+
+void ByteWriter::PutUint8(uint8_t value) {
+    buffer_.push_back(static_cast<char>(value));
+}
+
+void ByteWriter::PutUint32(uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        buffer_.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+void ByteWriter::PutInt32(int32_t value) {
+    PutUint32(static_cast<uint32_t>(value));
+}
+
+void ByteWriter::PutDouble(double value) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    PutUint32(static_cast<uint32_t>(bits));
+    PutUint32(static_cast<uint32_t>(bits >> 32));
+}
+
+void ByteWriter::PutString(std::string_view value) {
+    PutUint32(static_cast<uint32_t>(value.size()));
+    buffer_.append(value);
+}
+
+void ByteWriter::BeginFrame() {
+    frame_start_ = buffer_.size();
+    PutUint32(0);
+}
+
+void ByteWriter::EndFrame() {
+    const auto size = static_cast<uint32_t>(buffer_.size() - frame_start_ - FRAME_SIZE_BYTES);
+    for (size_t i = 0; i < FRAME_SIZE_BYTES; ++i) {
+        buffer_[frame_start_ + i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+    }
+}
+
+uint8_t ByteReader::GetUint8() {
+    return static_cast<uint8_t>(Take(1)[0]);
+}
+
+uint32_t ByteReader::GetUint32() {
+    const auto bytes = Take(4);
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(bytes[i])) << (8 * i);
+    }
+    return value;
+}
+
+int32_t ByteReader::GetInt32() {
+    return static_cast<int32_t>(GetUint32());
+}
+
+double ByteReader::GetDouble() {
+    const uint64_t low = GetUint32();
+    const uint64_t high = GetUint32();
+    const uint64_t bits = low | (high << 32);
+    double value = 0.0;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+std::string_view ByteReader::GetString() {
+    return Take(GetUint32());
+}
+
+std::string_view ByteReader::Take(size_t size) {
+    if (size > data_.size()) {
+        throw std::invalid_argument("Frame is truncated"s);
+    }
+    const auto bytes = data_.substr(0, size);
+    data_.remove_prefix(size);
+    return bytes;
+}
+
+std::optional<size_t> GetFrameSize(std::string_view buffer) {
+    if (buffer.size() < FRAME_SIZE_BYTES) {
+        return std::nullopt;
+    }
+    const size_t size = ByteReader(buffer).GetUint32() + FRAME_SIZE_BYTES;
+    if (buffer.size() < size) {
+        return std::nullopt;
+    }
+    return size;
+}
+
+SearchRequest ParseSearchRequest(std::string_view frame) {
+    auto reader = ReadFrame(frame);
+    SearchRequest request;
+    request.id = reader.GetUint32();
+    request.type = ToRequestType(reader.GetUint8());
+    switch (request.type) {
+    case SearchRequestType::SEARCH:
+        request.status = ToDocumentStatus(reader.GetUint8());
+        request.text = reader.GetString();
+        break;
+    case SearchRequestType::MATCH:
+        request.document_id = reader.GetInt32();
+        request.text = reader.GetString();
+        break;
+    case SearchRequestType::ADD: {
+        request.document_id = reader.GetInt32();
+        request.status = ToDocumentStatus(reader.GetUint8());
+        const uint32_t rating_count = reader.GetUint32();
+        for (uint32_t i = 0; i < rating_count; ++i) {
+            request.ratings.push_back(reader.GetInt32());
+        }
+        request.text = reader.GetString();
+        break;
+    }
+    case SearchRequestType::REMOVE:
+        request.document_id = reader.GetInt32();
+        break;
+    }
+    if (!reader.IsEmpty()) {
+        throw std::invalid_argument("Request has extra bytes"s);
+    }
+    return request;
+}
+
+SearchResponse ParseSearchResponse(std::string_view frame) {
+    auto reader = ReadFrame(frame);
+    SearchResponse response;
+    response.request_id = reader.GetUint32();
+    response.type = ToRequestType(reader.GetUint8());
+    response.code = static_cast<SearchResponseCode>(reader.GetUint8());
+    if (response.code == SearchResponseCode::ERROR) {
+        response.error = reader.GetString();
+        return response;
+    }
+    if (response.type == SearchRequestType::SEARCH) {
+        const uint32_t count = reader.GetUint32();
+        for (uint32_t i = 0; i < count; ++i) {
+            const int id = reader.GetInt32();
+            const double relevance = reader.GetDouble();
+            const int rating = reader.GetInt32();
+            response.documents.emplace_back(id, relevance, rating);
+        }
+    } else if (response.type == SearchRequestType::MATCH) {
+        response.status = ToDocumentStatus(reader.GetUint8());
+        const uint32_t count = reader.GetUint32();
+        for (uint32_t i = 0; i < count; ++i) {
+            response.words.emplace_back(reader.GetString());
+        }
+    }
+    return response;
+}
+
+void WriteSearchRequest(std::string &buffer,
+                        uint32_t id,
+                        std::string_view query,
+                        DocumentStatus status) {
+    ByteWriter writer(buffer);
+    writer.BeginFrame();
+    WriteRequestHeader(writer, id, SearchRequestType::SEARCH);
+    writer.PutUint8(static_cast<uint8_t>(status));
+    writer.PutString(query);
+    writer.EndFrame();
+}
+
+void WriteMatchRequest(std::string &buffer,
+                       uint32_t id,
+                       std::string_view query,
+                       int document_id) {
+    ByteWriter writer(buffer);
+    writer.BeginFrame();
+    WriteRequestHeader(writer, id, SearchRequestType::MATCH);
+    writer.PutInt32(document_id);
+    writer.PutString(query);
+    writer.EndFrame();
+}
+
+void WriteAddRequest(std::string &buffer,
+                     uint32_t id,
+                     int document_id,
+                     std::string_view text,
+                     DocumentStatus status,
+                     const std::vector<int> &ratings) {
+    ByteWriter writer(buffer);
+    writer.BeginFrame();
+    WriteRequestHeader(writer, id, SearchRequestType::ADD);
+    writer.PutInt32(document_id);
+    writer.PutUint8(static_cast<uint8_t>(status));
+    writer.PutUint32(static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        writer.PutInt32(rating);
+    }
+    writer.PutString(text);
+    writer.EndFrame();
+}
+
+void WriteRemoveRequest(std::string &buffer, uint32_t id, int document_id) {
+    ByteWriter writer(buffer);
+    writer.BeginFrame();
+    WriteRequestHeader(writer, id, SearchRequestType::REMOVE);
+    writer.PutInt32(document_id);
+    writer.EndFrame();
+}
+
+void WriteSearchResponse(std::string &buffer,
+                         uint32_t request_id,
+                         const std::vector<Document> &documents) {
+    ByteWriter writer(buffer);
+    writer.BeginFrame();
+    WriteResponseHeader(writer, request_id, SearchRequestType::SEARCH, SearchResponseCode::OK);
+    writer.PutUint32(static_cast<uint32_t>(documents.size()));
+    for (const auto &document : documents) {
+        writer.PutInt32(document.id);
+        writer.PutDouble(document.relevance);
+        writer.PutInt32(document.rating);
+    }
+    writer.EndFrame();
+}
+
+void WriteMatchResponse(std::string &buffer,
+                        uint32_t request_id,
+                        const std::tuple<std::vector<std::string>, DocumentStatus> &match) {
+    const auto &[words, status] = match;
+    ByteWriter writer(buffer);
+    writer.BeginFrame();
+    WriteResponseHeader(writer, request_id, SearchRequestType::MATCH, SearchResponseCode::OK);
+    writer.PutUint8(static_cast<uint8_t>(status));
+    writer.PutUint32(static_cast<uint32_t>(words.size()));
+    for (const auto &word : words) {
+        writer.PutString(word);
+    }
+    writer.EndFrame();
+}
+
+void WriteEmptyResponse(std::string &buffer, uint32_t request_id, SearchRequestType type) {
+    ByteWriter writer(buffer);
+    writer.BeginFrame();
+    WriteResponseHeader(writer, request_id, type, SearchResponseCode::OK);
+    writer.EndFrame();
+}
+
+void WriteErrorResponse(std::string &buffer,
+                        uint32_t request_id,
+                        SearchRequestType type,
+                        std::string_view message) {
+    ByteWriter writer(buffer);
+    writer.BeginFrame();
+    WriteResponseHeader(writer, request_id, type, SearchResponseCode::ERROR);
+    writer.PutString(message);
+    writer.EndFrame();
+}
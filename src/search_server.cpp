@@ -1,55 +1,236 @@
 #include "search_server.h"
 
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <tuple>
 #include <math.h>
 
 using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+SearchServer::SearchServer(const SearchServer &other, CloneTag)
+    : all_words_(other.all_words_.Share()), stop_words_(other.stop_words_.Share()),
+      word_to_document_freqs_(other.word_to_document_freqs_.Share()),
+      forward_index_(other.forward_index_.Share()),
+      forward_index_garbage_(other.forward_index_garbage_),
+      max_term_expansions_(other.max_term_expansions_),
+      max_edit_distance_(other.max_edit_distance_), query_mode_(other.query_mode_),
+      evaluation_(other.evaluation_), statistics_(other.statistics_),
+      store_positions_(other.store_positions_),
+      word_to_document_positions_(other.word_to_document_positions_.Share()),
+      documents_(other.documents_.Share()), document_ids_(other.document_ids_.Share()),
+      rating_index_(other.rating_index_.Share()),
+      total_document_length_(other.total_document_length_),
+      word_to_impacts_(other.word_to_impacts_.Share()), impact_scorer_(other.impact_scorer_),
+      impact_quantum_(other.impact_quantum_) {}
+
+SearchServer SearchServer::Clone() const {
+    return SearchServer(*this, CloneTag{});
+}
 
 void SearchServer::AddDocument(int document_id,
                                const std::string_view document,
                                DocumentStatus status,
                                const std::vector<int> &ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    SEARCH_METRICS_STAGE(ADD_DOCUMENT);
+    AddDocumentWords(document_id, SplitDocument(document, *stop_words_), status, ratings);
+}
+
+void SearchServer::AddDocumentWords(int document_id,
+                                    const DocumentWords &document_words,
+                                    DocumentStatus status,
+                                    const std::vector<int> &ratings) {
+    if ((document_id < 0) || (std::as_const(documents_)->count(document_id) > 0)) {
         throw std::invalid_argument("Invalid document_id"s);
     }
-    const auto words = SplitIntoWordsNoStop(document);
+    const auto &[words, positions] = document_words;
     const double inv_word_count = 1.0 / words.size();
 
+    std::vector<std::string_view> pooled_words;
+    pooled_words.reserve(words.size());
+    for (size_t i = 0; i < words.size(); ++i) {
+        std::string_view word_ = all_words_->Intern(words[i]);
+        (*word_to_document_freqs_)[word_][document_id] += inv_word_count;
+        if (store_positions_) {
+            (*word_to_document_positions_)[word_][document_id].Append(positions[i]);
+        }
+        pooled_words.push_back(word_);
+    }
+    // Frequencies are added up the same way as in the postings, so they compare equal
+    std::sort(pooled_words.begin(), pooled_words.end());
+    std::vector<WordFrequency> row;
+    for (const auto word : pooled_words) {
+        if (!row.empty() && row.back().first == word) {
+            row.back().second += inv_word_count;
+        } else {
+            row.emplace_back(word, inv_word_count);
+        }
+    }
+    const int rating = ComputeAverageRating(ratings);
+    document_ids_->emplace(document_id);
+    const auto data =
+        documents_->emplace(document_id,
+                            DocumentData{rating, status, static_cast<uint32_t>(words.size())})
+            .first;
+    SetDocumentWords(data->second, row);
+    rating_index_->emplace(rating, document_id);
+    total_document_length_ += words.size();
+    if (statistics_) {
+        statistics_->AddDocument(GetDocumentWords(document_id),
+                                 static_cast<uint32_t>(words.size()));
+    }
+    revision_.Renew();
+    DropImpactIndex();
+}
+
+SearchServer::WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    const auto doc = documents_->find(document_id);
+    if (doc == documents_->end()) {
+        return {};
+    }
+    const auto *row = forward_index_->data() + doc->second.words_offset;
+    return {row, row + doc->second.word_count};
+}
+
+DocumentStatus SearchServer::GetDocumentStatus(int document_id) const {
+    const auto doc = documents_->find(document_id);
+    if (doc == documents_->end()) {
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    return doc->second.status;
+}
+
+int SearchServer::GetDocumentRating(int document_id) const {
+    const auto doc = documents_->find(document_id);
+    if (doc == documents_->end()) {
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    return doc->second.rating;
+}
+
+std::string SearchServer::GetDocumentText(int document_id) const {
+    const auto doc = documents_->find(document_id);
+    if (doc == documents_->end()) {
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    const auto &words_freqs = GetWordFrequencies(document_id);
+
+    std::vector<std::string_view> words;
+    if (store_positions_) {
+        std::vector<std::pair<uint32_t, std::string_view>> positioned_words;
+        positioned_words.reserve(doc->second.length);
+        for (const auto &[word, _] : words_freqs) {
+            for (const uint32_t position :
+                 word_to_document_positions_->find(word)->second.at(document_id)) {
+                positioned_words.emplace_back(position, word);
+            }
+        }
+        std::sort(positioned_words.begin(), positioned_words.end());
+        uint32_t next_position = 0;
+        for (const auto &[position, word] : positioned_words) {
+            for (; next_position < position && !stop_words_->empty(); ++next_position) {
+                words.push_back(*stop_words_->begin());
+            }
+            words.push_back(word);
+            next_position = position + 1;
+        }
+    } else {
+        for (const auto &[word, freq] : words_freqs) {
+            words.insert(words.end(), std::lround(freq * doc->second.length), word);
+        }
+    }
+
+    std::string text;
     for (const auto word : words) {
-        std::string_view word_ = *all_words_.insert(std::string(word)).first;
-        word_to_document_freqs_[word_][document_id] += inv_word_count;
-        document_to_words_freqs_[document_id][word_] += inv_word_count;
+        if (!text.empty()) {
+            text += ' ';
+        }
+        text += word;
     }
-    document_ids_.emplace(document_id);
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
+    return text;
 }
 
-const std::map<std::string_view, double, std::less<>> &
-SearchServer::GetWordFrequencies(int document_id) const {
-    auto doc = document_to_words_freqs_.find(document_id);
-    if (doc != document_to_words_freqs_.end()) {
-        return doc->second;
+MemoryStats SearchServer::GetMemoryStats() const {
+    MemoryStats stats;
+
+    stats.all_words = all_words_->GetMemoryUsage();
+
+    stats.stop_words = stop_words_->GetMemoryUsage();
+
+    size_t postings_count = 0;
+    for (const auto &[_, postings] : *word_to_document_freqs_) {
+        postings_count += postings.size();
     }
-    const static std::map<std::string_view, double, std::less<>> &empty{};
-    return empty;
+    stats.word_to_document_freqs =
+        GetMemoryUsage(word_to_document_freqs_->get_allocator().GetCounter(),
+                       word_to_document_freqs_->size() + postings_count);
+
+    // Garbage rows take space but are not counted as elements
+    stats.document_to_words_freqs =
+        GetMemoryUsage(forward_index_->get_allocator().GetCounter(),
+                       forward_index_->size() - forward_index_garbage_);
+
+    size_t position_lists_count = 0;
+    for (const auto &[_, document_positions] : *word_to_document_positions_) {
+        position_lists_count += document_positions.size();
+    }
+    // Encoded positions are allocated through the same counter as the maps
+    stats.positions =
+        GetMemoryUsage(word_to_document_positions_->get_allocator().GetCounter(),
+                       word_to_document_positions_->size() + position_lists_count);
+
+    stats.documents = GetMemoryUsage(documents_->get_allocator().GetCounter(), documents_->size());
+    stats.document_ids =
+        GetMemoryUsage(document_ids_->get_allocator().GetCounter(), document_ids_->size());
+    stats.rating_index =
+        GetMemoryUsage(rating_index_->get_allocator().GetCounter(), rating_index_->size());
+
+    size_t impact_postings_count = 0;
+    for (const auto &[_, impacts] : *word_to_impacts_) {
+        impact_postings_count += impacts.size();
+    }
+    // Segments and documents of a word are allocated through the counter of the map
+    stats.impact_index = GetMemoryUsage(word_to_impacts_->get_allocator().GetCounter(),
+                                        word_to_impacts_->size() + impact_postings_count);
+
+    return stats;
 }
 
 void SearchServer::RemoveDocument(const int document_id) {
-    auto doc = document_to_words_freqs_.find(document_id);
-    if (doc == document_to_words_freqs_.end()) {
+    SEARCH_METRICS_STAGE(REMOVE_DOCUMENT);
+    // Nothing is detached from clones for an unknown id
+    if (std::as_const(documents_)->count(document_id) == 0) {
         return;
     }
-    for (auto word_from_doc = doc->second.begin(); word_from_doc != doc->second.end();
-         ++word_from_doc) {
-        auto word_in_docs = word_to_document_freqs_.find(word_from_doc->first);
+    if (statistics_) {
+        statistics_->RemoveDocument(GetDocumentWords(document_id),
+                                    documents_->at(document_id).length);
+    }
+    // Empty for a document of nothing but stop words
+    for (const auto &[word, _] : GetWordFrequencies(document_id)) {
+        if (store_positions_) {
+            ErasePositions(word, document_id);
+        }
+        auto word_in_docs = word_to_document_freqs_->find(word);
         if (word_in_docs->second.size() == 1) {
-            word_to_document_freqs_.erase(word_in_docs);
+            word_to_document_freqs_->erase(word_in_docs);
+            all_words_->Release(word);
         } else {
             word_in_docs->second.erase(document_id);
         }
     }
-    document_to_words_freqs_.erase(doc);
-    document_ids_.erase(document_id);
-    documents_.erase(document_id);
+    document_ids_->erase(document_id);
+    rating_index_->erase({documents_->at(document_id).rating, document_id});
+    total_document_length_ -= documents_->at(document_id).length;
+    ReleaseDocumentWords(documents_->at(document_id));
+    documents_->erase(document_id);
+    CompactForwardIndex();
+    revision_.Renew();
+    DropImpactIndex();
 }
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy &, int document_id) {
@@ -57,74 +238,274 @@ void SearchServer::RemoveDocument(const std::execution::sequenced_policy &, int
 }
 
 void SearchServer::RemoveDocument(const std::execution::parallel_policy &, int document_id) {
-    if (document_to_words_freqs_.count(document_id) == 0) {
+    SEARCH_METRICS_STAGE(REMOVE_DOCUMENT);
+    // Nothing is detached from clones for an unknown id
+    if (std::as_const(documents_)->count(document_id) == 0) {
         return;
     }
+    if (statistics_) {
+        statistics_->RemoveDocument(GetDocumentWords(document_id),
+                                    documents_->at(document_id).length);
+    }
 
-    auto &words_freqs = document_to_words_freqs_.at(document_id);
+    // Empty for a document of nothing but stop words
+    const auto words_freqs = GetWordFrequencies(document_id);
 
+    // Detached before the workers share it
+    auto &word_to_document_freqs = *word_to_document_freqs_;
     for_each(std::execution::par, words_freqs.begin(), words_freqs.end(),
-             [this, document_id](auto &word_freq) {
-                 this->word_to_document_freqs_.at(word_freq.first).erase(document_id);
+             [&word_to_document_freqs, document_id](auto &word_freq) {
+                 word_to_document_freqs.at(word_freq.first).erase(document_id);
              });
 
-    document_ids_.erase(document_id);
-    documents_.erase(document_id);
-    document_to_words_freqs_.erase(document_id);
+    for (const auto &[word, _] : words_freqs) {
+        if (store_positions_) {
+            ErasePositions(word, document_id);
+        }
+        const auto word_in_docs = word_to_document_freqs_->find(word);
+        if (word_in_docs->second.empty()) {
+            word_to_document_freqs_->erase(word_in_docs);
+            all_words_->Release(word);
+        }
+    }
+
+    document_ids_->erase(document_id);
+    rating_index_->erase({documents_->at(document_id).rating, document_id});
+    total_document_length_ -= documents_->at(document_id).length;
+    ReleaseDocumentWords(documents_->at(document_id));
+    documents_->erase(document_id);
+    CompactForwardIndex();
+    revision_.Renew();
+    DropImpactIndex();
+}
+
+void SearchServer::UpdateDocument(int document_id,
+                                  std::string_view document,
+                                  DocumentStatus status,
+                                  const std::vector<int> &ratings) {
+    SEARCH_METRICS_STAGE(UPDATE_DOCUMENT);
+    // Invalid words throw before anything is changed
+    UpdateDocumentWords(document_id, SplitDocument(document, *stop_words_), status, ratings);
+}
+
+void SearchServer::UpdateDocumentWords(int document_id,
+                                       const DocumentWords &document_words,
+                                       DocumentStatus status,
+                                       const std::vector<int> &ratings) {
+    const auto data = documents_->find(document_id);
+    if (data == documents_->end()) {
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    const auto &[words, positions] = document_words;
+
+    // Frequencies are added up the way AddDocument does, so unchanged ones compare equal
+    const double inv_word_count = 1.0 / words.size();
+    std::map<std::string_view, double> new_freqs;
+    for (const auto word : words) {
+        new_freqs[word] += inv_word_count;
+    }
+    std::map<std::string_view, PositionList> new_positions;
+    if (store_positions_) {
+        for (size_t i = 0; i < words.size(); ++i) {
+            new_positions[words[i]].Append(positions[i]);
+        }
+    }
+
+    if (statistics_) {
+        statistics_->RemoveDocument(GetDocumentWords(document_id), data->second.length);
+    }
+    const auto erase_word = [this, document_id](std::string_view word) {
+        if (store_positions_) {
+            ErasePositions(word, document_id);
+        }
+        const auto word_in_docs = word_to_document_freqs_->find(word);
+        word_in_docs->second.erase(document_id);
+        if (word_in_docs->second.empty()) {
+            word_to_document_freqs_->erase(word_in_docs);
+            all_words_->Release(word);
+        }
+    };
+    // Both rows are sorted by word, so they are merged in one pass. A released word may be
+    // reused by a new one, so an old entry is never read once the merge has passed it.
+    const auto old_row = GetWordFrequencies(document_id);
+    auto old_freq = old_row.begin();
+    std::vector<WordFrequency> row;
+    row.reserve(new_freqs.size());
+    for (const auto &[word, freq] : new_freqs) {
+        // Words the document no longer has
+        for (; old_freq != old_row.end() && old_freq->first < word; ++old_freq) {
+            erase_word(old_freq->first);
+        }
+        std::string_view pooled_word;
+        if (old_freq != old_row.end() && old_freq->first == word) {
+            pooled_word = old_freq->first;
+            if (old_freq->second != freq) {
+                word_to_document_freqs_->find(word)->second.at(document_id) = freq;
+            }
+            ++old_freq;
+        } else {
+            pooled_word = all_words_->Intern(word);
+            (*word_to_document_freqs_)[pooled_word].emplace(document_id, freq);
+        }
+        if (store_positions_) {
+            // Positions move whenever the text changes around the word. Copied, not moved,
+            // so the list keeps the allocator of the index.
+            (*word_to_document_positions_)[pooled_word][document_id] = new_positions.at(word);
+        }
+        row.emplace_back(pooled_word, freq);
+    }
+    for (; old_freq != old_row.end(); ++old_freq) {
+        erase_word(old_freq->first);
+    }
+    SetDocumentWords(data->second, row);
+    CompactForwardIndex();
+
+    total_document_length_ += words.size();
+    total_document_length_ -= data->second.length;
+    data->second.length = static_cast<uint32_t>(words.size());
+    if (statistics_) {
+        statistics_->AddDocument(GetDocumentWords(document_id), data->second.length);
+    }
+    UpdateDocument(document_id, status, ratings);
+    revision_.Renew();
+    DropImpactIndex();
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query) const {
-    return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
+void SearchServer::UpdateDocument(int document_id,
+                                  DocumentStatus status,
+                                  const std::vector<int> &ratings) {
+    const auto data = documents_->find(document_id);
+    if (data == documents_->end()) {
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    const int rating = ComputeAverageRating(ratings);
+    if (rating != data->second.rating) {
+        rating_index_->erase({data->second.rating, document_id});
+        rating_index_->emplace(rating, document_id);
+        data->second.rating = rating;
+    }
+    // Neither postings nor impacts depend on metadata, prepared queries stay valid
+    data->second.status = status;
+}
+
+PreparedQuery SearchServer::PrepareQuery(std::string_view raw_query) const {
+    PreparedQuery query;
+    query.text_ = std::make_shared<const std::string>(raw_query);
+    ParseQuery(*query.text_, query, query_mode_);
+    return query;
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
-                                                     DocumentStatus status) const {
-    return FindTopDocuments(std::execution::seq, raw_query, GetStatusPredicate(status));
+PreparedQuery SearchServer::PrepareQuery(std::string_view raw_query, QueryMode mode) const {
+    PreparedQuery query;
+    query.text_ = std::make_shared<const std::string>(raw_query);
+    ParseQuery(*query.text_, query, mode);
+    return query;
 }
 
 std::tuple<std::vector<std::string>, DocumentStatus>
 SearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
-    const auto query = ParseQuery(raw_query);
+    PreparedQuery query;
+    ParseQuery(raw_query, query, query_mode_);
+    return MatchDocument(query, document_id);
+}
+
+std::tuple<std::vector<std::string>, DocumentStatus>
+SearchServer::MatchDocument(const std::execution::sequenced_policy &,
+                            std::string_view raw_query,
+                            int document_id) const {
+    return MatchDocument(raw_query, document_id);
+}
 
-    for (const std::string_view &word : query.minus_words) {
-        if (IsWordFound(word, document_id)) {
-            return {{}, documents_.at(document_id).status};
+std::tuple<std::vector<std::string>, DocumentStatus>
+SearchServer::MatchDocument(const std::execution::parallel_policy &policy,
+                            std::string_view raw_query,
+                            int document_id) const {
+    PreparedQuery query;
+    ParseQuery(raw_query, query, query_mode_);
+    return MatchDocument(policy, query, document_id);
+}
+
+std::tuple<std::vector<std::string>, DocumentStatus>
+SearchServer::MatchDocument(const PreparedQuery &query, int document_id) const {
+    PreparedQuery storage;
+    const auto &actual_query = ActualizeQuery(query, storage);
+    const auto status = documents_->at(document_id).status;
+
+    for (const auto &term : actual_query.minus_terms_) {
+        if (term.Contains(document_id)) {
+            return {std::vector<std::string>{}, status};
+        }
+    }
+    for (const auto &term : actual_query.minus_expanded_terms_) {
+        if (term.Contains(document_id)) {
+            return {std::vector<std::string>{}, status};
         }
     }
+    if (!MatchesRequiredTerms(actual_query, document_id) ||
+        !MatchesPhrases(actual_query, document_id)) {
+        return {std::vector<std::string>{}, status};
+    }
     std::vector<std::string> matched_words;
-    for (const std::string_view &word : query.plus_words) {
-        if (IsWordFound(word, document_id)) {
-            matched_words.push_back(std::string(word));
+    for (const auto &term : actual_query.plus_terms_) {
+        if (term.Contains(document_id)) {
+            matched_words.push_back(std::string(term.word));
         }
     }
+    AddMatchedExpansions(actual_query, document_id, matched_words);
 
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, status};
 }
 
 std::tuple<std::vector<std::string>, DocumentStatus>
 SearchServer::MatchDocument(const std::execution::sequenced_policy &,
-                            std::string_view raw_query,
+                            const PreparedQuery &query,
                             int document_id) const {
-    return MatchDocument(raw_query, document_id);
+    return MatchDocument(query, document_id);
 }
 
 std::tuple<std::vector<std::string>, DocumentStatus>
 SearchServer::MatchDocument(const std::execution::parallel_policy &,
-                            std::string_view raw_query,
+                            const PreparedQuery &query,
                             int document_id) const {
-    const auto query = ParseQuery(raw_query);
-    if (any_of(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
-               [document_id, this](auto &word) { return IsWordFound(word, document_id); }))
-        return {{}, documents_.at(document_id).status};
+    PreparedQuery storage;
+    const auto &actual_query = ActualizeQuery(query, storage);
+    const auto status = documents_->at(document_id).status;
+
+    if (any_of(std::execution::par, actual_query.minus_terms_.begin(),
+               actual_query.minus_terms_.end(),
+               [document_id](const auto &term) { return term.Contains(document_id); }) ||
+        any_of(actual_query.minus_expanded_terms_.begin(),
+               actual_query.minus_expanded_terms_.end(),
+               [document_id](const auto &term) { return term.Contains(document_id); }) ||
+        !MatchesRequiredTerms(actual_query, document_id) ||
+        !MatchesPhrases(actual_query, document_id)) {
+        return {std::vector<std::string>{}, status};
+    }
 
-    std::vector<std::string> matched_words(query.plus_words.size());
+    std::vector<PreparedQuery::Term> matched_terms(actual_query.plus_terms_.size());
+    const auto matched_end =
+        copy_if(std::execution::par, actual_query.plus_terms_.begin(),
+                actual_query.plus_terms_.end(), matched_terms.begin(),
+                [document_id](const auto &term) { return term.Contains(document_id); });
 
-    copy_if(std::execution::par, query.plus_words.begin(), query.plus_words.end(),
-            matched_words.begin(),
-            [document_id, this](auto &word) { return IsWordFound(word, document_id); });
+    std::vector<std::string> matched_words(
+        static_cast<size_t>(distance(matched_terms.begin(), matched_end)));
+    transform(std::execution::par, matched_terms.begin(), matched_end, matched_words.begin(),
+              [](const auto &term) { return std::string(term.word); });
+    AddMatchedExpansions(actual_query, document_id, matched_words);
+
+    return {matched_words, status};
+}
 
-    //   sort(std::execution::par, words.begin(), words.end());
-    return {matched_words, documents_.at(document_id).status};
+std::vector<std::tuple<std::vector<std::string>, DocumentStatus>>
+SearchServer::MatchDocuments(const PreparedQuery &query,
+                             const std::vector<int> &document_ids) const {
+    return MatchDocuments(std::execution::seq, query, document_ids);
+}
+
+uint64_t SearchServer::NextRevision() {
+    static std::atomic<uint64_t> revision{0};
+    return ++revision;
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int> &ratings) {
@@ -143,50 +524,624 @@ bool SearchServer::IsValidWord(const std::string_view word) {
     return !std::any_of(word.begin(), word.end(), [](char c) { return c >= '\0' && c < ' '; });
 }
 
-std::vector<std::string_view>
-SearchServer::SplitIntoWordsNoStop(const std::string_view text) const {
-    std::vector<std::string_view> words;
-
-    for (const auto word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
-    }
-
-    return words;
-}
-
 SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
     if (text.empty()) {
         throw std::invalid_argument("Query word is empty"s);
     }
     bool is_minus = false;
+    bool is_required = false;
     if (text[0] == '-') {
         is_minus = true;
         text = text.substr(1);
+    } else if (text[0] == '+') {
+        is_required = true;
+        text = text.substr(1);
+    }
+    bool is_prefix = false;
+    int max_edits = -1;
+    if (text.size() > 1 && text.back() == '*') {
+        is_prefix = true;
+        text.remove_suffix(1);
+    } else if (text.size() > 2 && text[text.size() - 2] == '~' &&
+               std::isdigit(static_cast<unsigned char>(text.back()))) {
+        max_edits = text.back() - '0';
+        if (max_edits > max_edit_distance_) {
+            throw std::invalid_argument("Query word "s + std::string(text) +
+                                        " allows too many edits"s);
+        }
+        text.remove_suffix(2);
     }
-    if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
+    // Quotes are reserved for phrases
+    if (text.empty() || text[0] == '-' || text[0] == '+' || text.find('"') != text.npos ||
+        !IsValidWord(text)) {
         throw std::invalid_argument("Query word "s + std::string(text) + " is invalid"s);
     }
 
-    return {text, is_minus, IsStopWord(text)};
+    return {text, is_minus, is_required, is_prefix, max_edits};
+}
+
+void SearchServer::ParseQuery(std::string_view text,
+                              PreparedQuery &query,
+                              QueryMode mode) const {
+    SEARCH_METRICS_STAGE(PARSE_QUERY);
+    ParseQueryWords(text, *stop_words_, query, mode);
+    FinishQuery(query);
+}
+
+void SearchServer::FinishQuery(PreparedQuery &query) const {
+    // A word both required and not is required: the required copy comes first and stays
+    for (auto *terms : {&query.plus_terms_, &query.minus_terms_}) {
+        sort(terms->begin(), terms->end(), [](const auto &lhs, const auto &rhs) {
+            return std::tie(lhs.word, rhs.is_required) < std::tie(rhs.word, lhs.is_required);
+        });
+        terms->erase(unique(terms->begin(), terms->end(),
+                            [](const auto &lhs, const auto &rhs) { return lhs.word == rhs.word; }),
+                     terms->end());
+    }
+    for (auto *terms : {&query.plus_expanded_terms_, &query.minus_expanded_terms_}) {
+        sort(terms->begin(), terms->end(), [](const auto &lhs, const auto &rhs) {
+            return std::tie(lhs.text, rhs.is_required) < std::tie(rhs.text, lhs.is_required);
+        });
+        terms->erase(unique(terms->begin(), terms->end(),
+                            [](const auto &lhs, const auto &rhs) { return lhs.text == rhs.text; }),
+                     terms->end());
+    }
+
+    ResolveQuery(query);
 }
 
-SearchServer::Query SearchServer::ParseQuery(std::string_view text) const {
-    Query result;
-    for (const auto word : SplitIntoWords(text)) {
-        const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            query_word.is_minus ? result.minus_words.insert(query_word.data)
-                                : result.plus_words.insert(query_word.data);
+void SearchServer::ResolveQuery(PreparedQuery &query) const {
+    for (auto *terms : {&query.plus_terms_, &query.minus_terms_}) {
+        for (auto &term : *terms) {
+            const auto word_docs = word_to_document_freqs_->find(term.word);
+            if (word_docs == word_to_document_freqs_->end()) {
+                term.postings = nullptr;
+                term.inverse_document_freq = 0.0;
+            } else {
+                term.postings = &word_docs->second;
+                term.inverse_document_freq =
+                    ComputeInverseDocumentFreq(term.word, word_docs->second);
+            }
+        }
+    }
+    for (auto *terms : {&query.plus_expanded_terms_, &query.minus_expanded_terms_}) {
+        for (auto &term : *terms) {
+            if (term.max_edits < 0) {
+                ExpandPrefix(term);
+            } else {
+                ExpandFuzzy(term);
+            }
         }
     }
-    return result;
+    for (auto &phrase : query.phrases_) {
+        for (auto &term : phrase.terms) {
+            const auto word_positions = word_to_document_positions_->find(term.word);
+            term.positions = word_positions == word_to_document_positions_->end()
+                               ? nullptr
+                               : &word_positions->second;
+        }
+        // Rarest first: documents and positions of the phrase are intersected in this order
+        std::stable_sort(phrase.terms.begin(), phrase.terms.end(),
+                         [](const auto &lhs, const auto &rhs) {
+                             return (lhs.positions != nullptr ? lhs.positions->size() : 0) <
+                                    (rhs.positions != nullptr ? rhs.positions->size() : 0);
+                         });
+    }
+    query.server_ = this;
+    query.revision_ = revision_.Get();
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+void SearchServer::ExpandPrefix(PreparedQuery::ExpandedTerm &term) const {
+    std::vector<Expansion> expansions;
+    // The dictionary is sorted, so the words with the prefix form a contiguous range
+    for (auto word_docs = word_to_document_freqs_->lower_bound(term.word);
+         word_docs != word_to_document_freqs_->end() &&
+         word_docs->first.substr(0, term.word.size()) == term.word;
+         ++word_docs) {
+        AddExpansion(expansions, {0, word_docs});
+    }
+    SetExpansions(term, expansions);
+}
+
+void SearchServer::ExpandFuzzy(PreparedQuery::ExpandedTerm &term) const {
+    const std::string_view pattern = term.word;
+    const size_t width = pattern.size() + 1;
+
+    // Walks the sorted dictionary as a trie, running a Levenshtein automaton: row d of the
+    // edit distance table belongs to the first d letters of a word, so words sharing a
+    // prefix share its rows. Once all values of a row exceed max_edits, no word with that
+    // prefix can match, and the whole subtree is skipped with a single lower_bound.
+    std::vector<int> rows(width);
+    for (size_t i = 0; i < width; ++i) {
+        rows[i] = static_cast<int>(i);
+    }
+
+    std::vector<Expansion> expansions;
+    std::string_view previous;
+    auto word_docs = word_to_document_freqs_->begin();
+    while (word_docs != word_to_document_freqs_->end()) {
+        const std::string_view word = word_docs->first;
+        const size_t row_count = rows.size() / width;
+        size_t depth = 0;
+        while (depth < previous.size() && depth < word.size() && depth + 1 < row_count &&
+               previous[depth] == word[depth]) {
+            ++depth;
+        }
+        rows.resize((depth + 1) * width);
+        previous = word;
+
+        bool is_dead = false;
+        for (; depth < word.size(); ++depth) {
+            const size_t row = depth * width;
+            rows.resize(row + 2 * width);
+            rows[row + width] = rows[row] + 1;
+            int min_distance = rows[row + width];
+            for (size_t i = 1; i < width; ++i) {
+                rows[row + width + i] =
+                    std::min({rows[row + i] + 1, rows[row + width + i - 1] + 1,
+                              rows[row + i - 1] + (pattern[i - 1] == word[depth] ? 0 : 1)});
+                min_distance = std::min(min_distance, rows[row + width + i]);
+            }
+            if (min_distance > term.max_edits) {
+                is_dead = true;
+                break;
+            }
+        }
+
+        if (!is_dead) {
+            const int distance = rows.back();
+            if (distance <= term.max_edits) {
+                AddExpansion(expansions, {distance, word_docs});
+            }
+            ++word_docs;
+            continue;
+        }
+
+        // Smallest string greater than every word starting with word[0..depth]
+        std::string successor(word.substr(0, depth + 1));
+        while (!successor.empty() && static_cast<unsigned char>(successor.back()) == 0xff) {
+            successor.pop_back();
+        }
+        if (successor.empty()) {
+            break;
+        }
+        successor.back() = static_cast<char>(static_cast<unsigned char>(successor.back()) + 1);
+        word_docs = word_to_document_freqs_->lower_bound(successor);
+    }
+    SetExpansions(term, expansions);
+}
+
+void SearchServer::AddExpansion(std::vector<Expansion> &expansions,
+                                Expansion expansion) const {
+    // Max-heap by closeness has the worst kept expansion on top
+    const auto closer = [](const Expansion &lhs, const Expansion &rhs) {
+        return lhs.first != rhs.first ? lhs.first < rhs.first
+                                      : lhs.second->second.size() > rhs.second->second.size();
+    };
+    if (expansions.size() < max_term_expansions_) {
+        expansions.push_back(expansion);
+        std::push_heap(expansions.begin(), expansions.end(), closer);
+    } else if (!expansions.empty() && closer(expansion, expansions.front())) {
+        std::pop_heap(expansions.begin(), expansions.end(), closer);
+        expansions.back() = expansion;
+        std::push_heap(expansions.begin(), expansions.end(), closer);
+    }
+}
+
+void SearchServer::SetExpansions(PreparedQuery::ExpandedTerm &term,
+                                 std::vector<Expansion> &expansions) const {
+    std::sort(expansions.begin(), expansions.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.second->first < rhs.second->first;
+    });
+    term.words.clear();
+    for (const auto &[distance, word_docs] : expansions) {
+        // An exact match counts in full, every edit lowers the weight
+        term.words.push_back({{word_docs->first, &word_docs->second}, 1.0 / (1 + distance)});
+    }
+    MergePostings(term);
+}
+
+void SearchServer::MergePostings(PreparedQuery::ExpandedTerm &term) {
+    using Cursor = std::pair<PostingList::const_iterator, const PreparedQuery::ExpandedWord *>;
+    const auto later = [](const Cursor &lhs, const Cursor &rhs) {
+        return lhs.first->first > rhs.first->first;
+    };
+
+    std::vector<Cursor> heap;
+    heap.reserve(term.words.size());
+    size_t total_size = 0;
+    for (const auto &word : term.words) {
+        heap.emplace_back(word.postings->begin(), &word);
+        total_size += word.postings->size();
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    term.postings.clear();
+    term.postings.reserve(total_size);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        auto &[posting, word] = heap.back();
+        const double term_freq = posting->second * word->weight;
+        if (!term.postings.empty() && term.postings.back().first == posting->first) {
+            term.postings.back().second += term_freq;
+        } else {
+            term.postings.emplace_back(posting->first, term_freq);
+        }
+        if (++posting == word->postings->end()) {
+            heap.pop_back();
+        } else {
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+    }
+}
+
+void SearchServer::AddMatchedExpansions(const PreparedQuery &query,
+                                        int document_id,
+                                        std::vector<std::string> &matched_words) {
+    if (query.plus_expanded_terms_.empty()) {
+        return;
+    }
+    for (const auto &term : query.plus_expanded_terms_) {
+        for (const auto &word : term.words) {
+            if (word.Contains(document_id)) {
+                matched_words.push_back(std::string(word.word));
+            }
+        }
+    }
+    // A word may also be in the query as is, or match several patterns
+    std::sort(matched_words.begin(), matched_words.end());
+    matched_words.erase(std::unique(matched_words.begin(), matched_words.end()),
+                        matched_words.end());
+}
+
+const PreparedQuery &SearchServer::ActualizeQuery(const PreparedQuery &query,
+                                                  PreparedQuery &storage) const {
+    if (query.server_ == this && query.revision_ == revision_.Get()) {
+        return query;
+    }
+    storage = query;
+    ResolveQuery(storage);
+    return storage;
+}
+
+size_t SearchServer::GetCollectionDocumentCount() const {
+    return statistics_ ? statistics_->GetDocumentCount() : documents_->size();
+}
+
+size_t SearchServer::GetCollectionDocumentFreq(std::string_view word,
+                                               const PostingList &postings) const {
+    return statistics_ ? statistics_->GetDocumentFreq(word) : postings.size();
+}
+
+double SearchServer::GetAverageDocumentLength() const {
+    const size_t document_count = GetCollectionDocumentCount();
+    const uint64_t total_length =
+        statistics_ ? statistics_->GetTotalDocumentLength() : total_document_length_;
+    return document_count == 0 ? 0.0 : static_cast<double>(total_length) / document_count;
+}
+
+double SearchServer::ComputeInverseDocumentFreq(std::string_view word,
+                                                const PostingList &postings) const {
+    return TfIdfScorer::ComputeInverseDocumentFreq(GetCollectionDocumentCount(),
+                                                   GetCollectionDocumentFreq(word, postings));
+}
+
+std::vector<std::string_view> SearchServer::GetDocumentWords(int document_id) const {
+    std::vector<std::string_view> words;
+    for (const auto &[word, _] : GetWordFrequencies(document_id)) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+bool SearchServer::MatchesPhrase(const PreparedQuery::Phrase &phrase, int document_id) const {
+    std::vector<const PositionList *> lists;
+    lists.reserve(phrase.terms.size());
+    for (const auto &term : phrase.terms) {
+        if (term.positions == nullptr) {
+            return false;
+        }
+        const auto document_positions = term.positions->find(document_id);
+        if (document_positions == term.positions->end()) {
+            return false;
+        }
+        lists.push_back(&document_positions->second);
+    }
+
+    // Possible phrase starts come from the rarest word, every other word can only drop some
+    std::vector<uint32_t> starts;
+    starts.reserve(lists[0]->size());
+    for (const uint32_t position : *lists[0]) {
+        if (position >= phrase.terms[0].offset) {
+            starts.push_back(position - phrase.terms[0].offset);
+        }
+    }
+    for (size_t i = 1; i < lists.size() && !starts.empty(); ++i) {
+        const uint32_t offset = phrase.terms[i].offset;
+        auto position = lists[i]->begin();
+        const auto positions_end = lists[i]->end();
+        auto kept = starts.begin();
+        for (const uint32_t start : starts) {
+            while (position != positions_end && *position < start + offset) {
+                ++position;
+            }
+            if (position == positions_end) {
+                break;
+            }
+            if (*position == start + offset) {
+                *kept++ = start;
+            }
+        }
+        starts.erase(kept, starts.end());
+    }
+    return !starts.empty();
+}
+
+bool SearchServer::MatchesPhrases(const PreparedQuery &query, int document_id) const {
+    return std::all_of(query.phrases_.begin(), query.phrases_.end(),
+                       [this, document_id](const auto &phrase) {
+                           return MatchesPhrase(phrase, document_id) != phrase.is_minus;
+                       });
+}
+
+void SearchServer::FilterPhrases(const PreparedQuery &query,
+                                 std::map<int, double> &doc_to_rel) const {
+    // Every plus phrase is required, so if the rarest of their words is rarer than the
+    // candidates are, its documents are checked instead
+    const PositionPostings *rarest = nullptr;
+    for (const auto &phrase : query.phrases_) {
+        if (phrase.is_minus) {
+            continue;
+        }
+        const auto *positions = phrase.terms.front().positions;
+        if (positions == nullptr) {
+            doc_to_rel.clear();
+            return;
+        }
+        if (rarest == nullptr || positions->size() < rarest->size()) {
+            rarest = positions;
+        }
+    }
+
+    if (rarest != nullptr && rarest->size() < doc_to_rel.size()) {
+        std::map<int, double> matched;
+        for (const auto &[document_id, _] : *rarest) {
+            const auto candidate = doc_to_rel.find(document_id);
+            if (candidate != doc_to_rel.end() && MatchesPhrases(query, document_id)) {
+                matched.insert(*candidate);
+            }
+        }
+        doc_to_rel = std::move(matched);
+        return;
+    }
+
+    for (auto candidate = doc_to_rel.begin(); candidate != doc_to_rel.end();) {
+        if (MatchesPhrases(query, candidate->first)) {
+            ++candidate;
+        } else {
+            candidate = doc_to_rel.erase(candidate);
+        }
+    }
+}
+
+void SearchServer::SetDocumentWords(DocumentData &data, const std::vector<WordFrequency> &row) {
+    ReleaseDocumentWords(data);
+    data.words_offset = forward_index_->size();
+    data.word_count = static_cast<uint32_t>(row.size());
+    forward_index_->insert(forward_index_->end(), row.begin(), row.end());
+}
+
+void SearchServer::ReleaseDocumentWords(DocumentData &data) noexcept {
+    forward_index_garbage_ += data.word_count;
+    data.word_count = 0;
+}
+
+void SearchServer::CompactForwardIndex() {
+    const auto &rows = *std::as_const(forward_index_);
+    if (forward_index_garbage_ * 2 <= rows.size()) {
+        return;
+    }
+    decltype(forward_index_)::element_type compacted;
+    compacted.reserve(rows.size() - forward_index_garbage_);
+    for (auto &[_, data] : *documents_) {
+        const auto row = rows.begin() + static_cast<ptrdiff_t>(data.words_offset);
+        data.words_offset = compacted.size();
+        compacted.insert(compacted.end(), row, row + data.word_count);
+    }
+    // The old rows are not copied even if a clone shares them
+    forward_index_.Reset(std::move(compacted));
+    forward_index_garbage_ = 0;
+}
+
+void SearchServer::ErasePositions(std::string_view word, int document_id) {
+    const auto word_positions = word_to_document_positions_->find(word);
+    word_positions->second.erase(document_id);
+    if (word_positions->second.empty()) {
+        word_to_document_positions_->erase(word_positions);
+    }
+}
+
+bool SearchServer::MatchesRequiredTerms(const PreparedQuery &query, int document_id) {
+    return std::all_of(query.plus_terms_.begin(), query.plus_terms_.end(),
+                       [document_id](const auto &term) {
+                           return !term.is_required || term.Contains(document_id);
+                       }) &&
+           std::all_of(query.plus_expanded_terms_.begin(), query.plus_expanded_terms_.end(),
+                       [document_id](const auto &term) {
+                           return !term.is_required || term.Contains(document_id);
+                       });
+}
+
+std::optional<std::vector<int>> SearchServer::FindRequiredDocuments(const PreparedQuery &query) {
+    // One of the pointers is set
+    struct RequiredPostings {
+        size_t size = 0;
+        const PostingList *postings = nullptr;
+        const MergedPostings *merged_postings = nullptr;
+    };
+    std::vector<RequiredPostings> required;
+    for (const auto &term : query.plus_terms_) {
+        if (term.is_required) {
+            if (term.postings == nullptr) {
+                return std::vector<int>{};
+            }
+            required.push_back({term.postings->size(), term.postings, nullptr});
+        }
+    }
+    for (const auto &term : query.plus_expanded_terms_) {
+        if (term.is_required) {
+            required.push_back({term.postings.size(), nullptr, &term.postings});
+        }
+    }
+    if (required.empty()) {
+        return std::nullopt;
+    }
+    std::sort(required.begin(), required.end(),
+              [](const auto &lhs, const auto &rhs) { return lhs.size < rhs.size; });
+
+    std::vector<int> document_ids;
+    document_ids.reserve(required.front().size);
+    const auto add_documents = [&document_ids](const auto &postings) {
+        for (const auto &[document_id, _] : postings) {
+            document_ids.push_back(document_id);
+        }
+    };
+    if (required.front().postings != nullptr) {
+        add_documents(*required.front().postings);
+    } else {
+        add_documents(*required.front().merged_postings);
+    }
+
+    for (size_t i = 1; i < required.size() && !document_ids.empty(); ++i) {
+        const auto matched = required[i].postings != nullptr
+                               ? IntersectPostings(*required[i].postings, document_ids)
+                               : IntersectPostings(*required[i].merged_postings, document_ids);
+        document_ids.clear();
+        add_documents(matched);
+    }
+    return document_ids;
+}
+
+std::vector<int> SearchServer::GetDocumentsByRating(int min_rating, int max_rating) const {
+    std::vector<int> document_ids;
+    if (min_rating > max_rating) {
+        return document_ids;
+    }
+    const auto first = rating_index_->lower_bound({min_rating, std::numeric_limits<int>::min()});
+    const auto last = rating_index_->upper_bound({max_rating, std::numeric_limits<int>::max()});
+    for (auto it = std::make_reverse_iterator(last); it != std::make_reverse_iterator(first);
+         ++it) {
+        document_ids.push_back(it->second);
+    }
+    return document_ids;
+}
+
+std::optional<std::vector<int>>
+SearchServer::FindDocumentsByRating(int min_rating, int max_rating, size_t limit) const {
+    std::vector<int> document_ids;
+    for (auto it = rating_index_->lower_bound({min_rating, std::numeric_limits<int>::min()});
+         it != rating_index_->end() && it->first <= max_rating; ++it) {
+        if (document_ids.size() == limit) {
+            return std::nullopt;
+        }
+        document_ids.push_back(it->second);
+    }
+    std::sort(document_ids.begin(), document_ids.end());
+    return document_ids;
+}
+
+std::optional<std::vector<int>>
+SearchServer::RestrictCandidates(std::optional<std::vector<int>> candidates,
+                                 std::vector<int> document_ids) {
+    if (!candidates) {
+        return document_ids;
+    }
+    std::vector<int> common;
+    std::set_intersection(candidates->begin(), candidates->end(), document_ids.begin(),
+                          document_ids.end(), std::back_inserter(common));
+    return common;
+}
+
+std::optional<std::vector<int>>
+SearchServer::RestrictCandidates(std::optional<std::vector<int>> candidates,
+                                 const DocumentFilter &filter) const {
+    if (!filter.HasRatingRange() || (candidates && candidates->empty())) {
+        return candidates;
+    }
+    // Worth it while the range holds a small part of the documents left
+    const size_t limit = (candidates ? candidates->size() : documents_->size()) / 8;
+    auto rated = FindDocumentsByRating(filter.GetMinRating(), filter.GetMaxRating(), limit);
+    if (!rated) {
+        return candidates;
+    }
+    return RestrictCandidates(std::move(candidates), std::move(*rated));
+}
+
+void SearchServer::DropImpactIndex() {
+    if (!std::as_const(word_to_impacts_)->empty()) {
+        word_to_impacts_.Reset();
+    }
+    impact_scorer_.reset();
+    impact_quantum_ = 0.0;
+}
+
+std::optional<std::vector<int>>
+SearchServer::SelectImpactTop(const ImpactAccumulators &accumulators,
+                              const std::vector<uint32_t> &next_impacts,
+                              bool is_complete) {
+    struct Candidate {
+        uint32_t score;
+        // The most the document can still gain
+        uint32_t gain;
+        int document_id;
+    };
+    std::vector<Candidate> candidates;
+    for (const auto &[document_id, accumulator] : accumulators) {
+        if (accumulator.score == REJECTED_IMPACT) {
+            continue;
+        }
+        uint32_t gain = 0;
+        for (size_t term = 0; term < next_impacts.size(); ++term) {
+            if (term >= 32 || ((accumulator.seen_terms >> term) & 1u) == 0) {
+                gain += next_impacts[term];
+            }
+        }
+        candidates.push_back({accumulator.score, gain, document_id});
+    }
+    // Of equal scores the ones that can still grow go first, so the rest cannot pass them
+    const auto is_better = [](const Candidate &lhs, const Candidate &rhs) {
+        return std::tie(rhs.score, rhs.gain, lhs.document_id) <
+               std::tie(lhs.score, lhs.gain, rhs.document_id);
+    };
+
+    const size_t top_count = std::min(candidates.size(), size_t{MAX_RESULT_DOCUMENT_COUNT});
+    if (top_count < static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT) && !is_complete) {
+        return std::nullopt;
+    }
+    if (top_count == 0) {
+        return std::vector<int>();
+    }
+    std::nth_element(candidates.begin(), candidates.begin() + (top_count - 1), candidates.end(),
+                     is_better);
+    if (!is_complete) {
+        // Documents not met yet can gain every next impact
+        const uint32_t threshold = candidates[top_count - 1].score;
+        uint32_t remaining = 0;
+        for (const uint32_t impact : next_impacts) {
+            remaining += impact;
+        }
+        if (remaining > threshold ||
+            std::any_of(candidates.begin() + top_count, candidates.end(),
+                        [threshold](const Candidate &candidate) {
+                            return candidate.score + candidate.gain > threshold;
+                        })) {
+            return std::nullopt;
+        }
+    }
+    std::sort(candidates.begin(), candidates.begin() + top_count, is_better);
+    std::vector<int> top;
+    for (size_t i = 0; i < top_count; ++i) {
+        top.push_back(candidates[i].document_id);
+    }
+    return top;
 }
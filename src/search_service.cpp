@@ -0,0 +1,504 @@
+#include "search_service.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+namespace {
+// epoll tags of the service's own descriptors, connections are tagged by their ids
+const uint64_t EVENT_TAG = 0;
+const uint64_t UNIX_LISTEN_TAG = 1;
+const uint64_t TCP_LISTEN_TAG = 2;
+const uint64_t FIRST_CONNECTION_TAG = 3;
+
+const size_t READ_CHUNK_SIZE = 64 * 1024;
+const int MAX_EVENTS = 256;
+
+[[noreturn]] void ThrowSystemError(const std::string &what) {
+    throw std::runtime_error(what + ": "s + std::strerror(errno));
+}
+
+void AddToEpoll(int epoll_fd, int fd, uint32_t events, uint64_t tag) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = tag;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        ThrowSystemError("epoll_ctl"s);
+    }
+}
+
+int Listen(int fd, const sockaddr *address, socklen_t address_size) {
+    if (bind(fd, address, address_size) < 0 || listen(fd, SOMAXCONN) < 0) {
+        const int error = errno;
+        close(fd);
+        errno = error;
+        ThrowSystemError("Cannot listen"s);
+    }
+    return fd;
+}
+
+int ListenUnix(const std::string &path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Unix socket path is too long: "s + path);
+    }
+    std::memcpy(address.sun_path, path.data(), path.size());
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        ThrowSystemError("socket"s);
+    }
+    unlink(path.c_str());
+    return Listen(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+}
+
+int ListenTcp(const std::string &host, uint16_t port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+        throw std::invalid_argument("Invalid IPv4 address "s + host);
+    }
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        ThrowSystemError("socket"s);
+    }
+    const int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    return Listen(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+}
+
+// Id of a request that could not be parsed, 0 if the frame is too short to have one
+uint32_t PeekRequestId(std::string_view frame) {
+    if (frame.size() < FRAME_SIZE_BYTES + 4) {
+        return 0;
+    }
+    return ByteReader(frame.substr(FRAME_SIZE_BYTES)).GetUint32();
+}
+} // namespace
+
+struct SearchService::Connection {
+    Connection(uint64_t id, int fd) : id(id), fd(fd) {}
+
+    const uint64_t id;
+    const int fd;
+
+    // Touched by the event loop only
+    std::string input;
+    std::string output;
+    size_t output_offset = 0;
+    bool reading = true;
+    bool writing = false;
+    // Events the connection is polled for
+    uint32_t events = EPOLLIN;
+
+    std::mutex mutex;
+    // Complete request frames waiting for a worker
+    std::string requests;
+    // Responses waiting for the event loop
+    std::string responses;
+    // A worker is processing the requests or is about to
+    bool scheduled = false;
+
+    std::atomic<bool> closed{false};
+};
+
+class SearchService::WorkerPool {
+  public:
+    explicit WorkerPool(size_t worker_count) {
+        for (size_t i = 0; i < worker_count; ++i) {
+            threads_.emplace_back([this] { Work(); });
+        }
+    }
+
+    // Queued tasks are finished first
+    ~WorkerPool() {
+        {
+            std::lock_guard guard(mutex_);
+            stopping_ = true;
+        }
+        condition_.notify_all();
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void Submit(std::function<void()> task) {
+        {
+            std::lock_guard guard(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        condition_.notify_one();
+    }
+
+  private:
+    void Work() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex_);
+                condition_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
+
+SearchService::SearchService(SearchServer &server, const SearchServiceOptions &options)
+    : server_(server), options_(options), next_connection_id_(FIRST_CONNECTION_TAG) {
+    if (options_.unix_socket_path.empty() && !options_.tcp_port) {
+        throw std::invalid_argument("Service needs a Unix socket path or a TCP port"s);
+    }
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    try {
+        if (epoll_fd_ < 0 || event_fd_ < 0) {
+            ThrowSystemError("Cannot create event loop"s);
+        }
+        AddToEpoll(epoll_fd_, event_fd_, EPOLLIN, EVENT_TAG);
+        if (!options_.unix_socket_path.empty()) {
+            unix_fd_ = ListenUnix(options_.unix_socket_path);
+            AddToEpoll(epoll_fd_, unix_fd_, EPOLLIN, UNIX_LISTEN_TAG);
+        }
+        if (options_.tcp_port) {
+            tcp_fd_ = ListenTcp(options_.tcp_host, *options_.tcp_port);
+            AddToEpoll(epoll_fd_, tcp_fd_, EPOLLIN, TCP_LISTEN_TAG);
+            sockaddr_in address{};
+            socklen_t address_size = sizeof(address);
+            getsockname(tcp_fd_, reinterpret_cast<sockaddr *>(&address), &address_size);
+            tcp_port_ = ntohs(address.sin_port);
+        }
+    } catch (...) {
+        CloseDescriptors();
+        throw;
+    }
+    workers_ = std::make_unique<WorkerPool>(std::max<size_t>(1, options_.worker_count));
+}
+
+SearchService::~SearchService() {
+    // Workers hold connections and use the server, they go first
+    workers_.reset();
+    for (const auto &[_, connection] : connections_) {
+        close(connection->fd);
+    }
+    connections_.clear();
+    CloseDescriptors();
+}
+
+void SearchService::CloseDescriptors() noexcept {
+    for (const int fd : {unix_fd_, tcp_fd_, event_fd_, epoll_fd_}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    if (unix_fd_ >= 0) {
+        unlink(options_.unix_socket_path.c_str());
+    }
+    unix_fd_ = tcp_fd_ = event_fd_ = epoll_fd_ = -1;
+}
+
+void SearchService::Run() {
+    epoll_event events[MAX_EVENTS];
+    while (!stopping_.load()) {
+        const int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("epoll_wait"s);
+        }
+        for (int i = 0; i < count; ++i) {
+            const uint64_t tag = events[i].data.u64;
+            if (tag == EVENT_TAG) {
+                uint64_t value = 0;
+                [[maybe_unused]] const auto size = read(event_fd_, &value, sizeof(value));
+                OnResponsesReady();
+            } else if (tag == UNIX_LISTEN_TAG) {
+                Accept(unix_fd_);
+            } else if (tag == TCP_LISTEN_TAG) {
+                Accept(tcp_fd_);
+            } else {
+                const auto connection = connections_.find(tag);
+                if (connection == connections_.end()) {
+                    continue;
+                }
+                // Keeps the connection alive if a handler closes it
+                const auto current = connection->second;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    Close(current);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    OnReadable(current);
+                }
+                if ((events[i].events & EPOLLOUT) && !current->closed) {
+                    OnWritable(current);
+                }
+            }
+        }
+    }
+}
+
+void SearchService::Stop() noexcept {
+    stopping_.store(true);
+    Wake();
+}
+
+void SearchService::Accept(int listen_fd) {
+    for (;;) {
+        const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        if (listen_fd == tcp_fd_) {
+            // Responses are written whole, there is nothing to gain from Nagle's algorithm
+            const int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+        const uint64_t id = next_connection_id_++;
+        auto connection = std::make_shared<Connection>(id, fd);
+        AddToEpoll(epoll_fd_, fd, EPOLLIN, id);
+        connections_.emplace(id, std::move(connection));
+    }
+}
+
+void SearchService::OnReadable(const std::shared_ptr<Connection> &connection) {
+    auto &input = connection->input;
+    // Once a whole frame is buffered the rest may stay in the socket until the next event. A
+    // frame larger than max_queued_size is read on, it is bounded by max_frame_size.
+    while (input.size() < options_.max_queued_size || !GetFrameSize(input)) {
+        const size_t old_size = input.size();
+        input.resize(old_size + READ_CHUNK_SIZE);
+        const auto size = read(connection->fd, input.data() + old_size, READ_CHUNK_SIZE);
+        const int error = errno;
+        input.resize(old_size + static_cast<size_t>(std::max<ssize_t>(size, 0)));
+        if (size == 0 || (size < 0 && error != EAGAIN && error != EWOULDBLOCK)) {
+            Close(connection);
+            return;
+        }
+        if (size < 0) {
+            break;
+        }
+    }
+
+    // Whole frames go to a worker at once, an incomplete one waits for more bytes
+    size_t complete_size = 0;
+    for (;;) {
+        const std::string_view rest = std::string_view(input).substr(complete_size);
+        if (rest.size() >= FRAME_SIZE_BYTES &&
+            ByteReader(rest).GetUint32() > options_.max_frame_size) {
+            Close(connection);
+            return;
+        }
+        const auto frame_size = GetFrameSize(rest);
+        if (!frame_size) {
+            break;
+        }
+        complete_size += *frame_size;
+    }
+    if (complete_size == 0) {
+        return;
+    }
+
+    bool schedule = false;
+    size_t queued_size = 0;
+    {
+        std::lock_guard guard(connection->mutex);
+        connection->requests.append(input, 0, complete_size);
+        schedule = !connection->scheduled;
+        connection->scheduled = true;
+        queued_size = connection->requests.size() + connection->responses.size();
+    }
+    input.erase(0, complete_size);
+    if (schedule) {
+        workers_->Submit([this, connection] { Process(connection); });
+    }
+    SetQueuedSize(*connection,
+                  queued_size + connection->output.size() - connection->output_offset);
+}
+
+void SearchService::OnWritable(const std::shared_ptr<Connection> &connection) {
+    Flush(connection);
+}
+
+void SearchService::OnResponsesReady() {
+    std::vector<std::shared_ptr<Connection>> ready;
+    {
+        std::lock_guard guard(ready_mutex_);
+        ready.swap(ready_);
+    }
+    for (const auto &connection : ready) {
+        if (!connection->closed) {
+            Flush(connection);
+        }
+    }
+}
+
+void SearchService::Flush(const std::shared_ptr<Connection> &connection) {
+    auto &output = connection->output;
+    size_t requests_size = 0;
+    {
+        std::lock_guard guard(connection->mutex);
+        if (output.empty()) {
+            output.swap(connection->responses);
+        } else {
+            output += connection->responses;
+            connection->responses.clear();
+        }
+        requests_size = connection->requests.size();
+    }
+    while (connection->output_offset < output.size()) {
+        const auto size = send(connection->fd, output.data() + connection->output_offset,
+                               output.size() - connection->output_offset, MSG_NOSIGNAL);
+        if (size < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                connection->writing = true;
+                SetQueuedSize(*connection,
+                              requests_size + output.size() - connection->output_offset);
+                return;
+            }
+            Close(connection);
+            return;
+        }
+        connection->output_offset += static_cast<size_t>(size);
+    }
+    output.clear();
+    connection->output_offset = 0;
+    connection->writing = false;
+    SetQueuedSize(*connection, requests_size);
+}
+
+void SearchService::Close(const std::shared_ptr<Connection> &connection) {
+    if (connection->closed.exchange(true)) {
+        return;
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection->fd, nullptr);
+    close(connection->fd);
+    connections_.erase(connection->id);
+}
+
+void SearchService::SetQueuedSize(Connection &connection, size_t queued_size) {
+    connection.reading = queued_size < options_.max_queued_size;
+    UpdateEvents(connection);
+}
+
+void SearchService::UpdateEvents(Connection &connection) {
+    const uint32_t events =
+        (connection.reading ? EPOLLIN : 0u) | (connection.writing ? EPOLLOUT : 0u);
+    if (connection.events == events) {
+        return;
+    }
+    connection.events = events;
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = connection.id;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void SearchService::Process(const std::shared_ptr<Connection> &connection) {
+    for (;;) {
+        std::string requests;
+        {
+            std::lock_guard guard(connection->mutex);
+            if (connection->requests.empty() || connection->closed || stopping_) {
+                connection->scheduled = false;
+                return;
+            }
+            requests.swap(connection->requests);
+        }
+
+        // Responses are serialized straight into the buffer that is sent
+        std::string responses;
+        std::string_view rest = requests;
+        while (const auto frame_size = GetFrameSize(rest)) {
+            Execute(rest.substr(0, *frame_size), responses);
+            rest.remove_prefix(*frame_size);
+        }
+
+        {
+            std::lock_guard guard(connection->mutex);
+            if (connection->responses.empty()) {
+                connection->responses.swap(responses);
+            } else {
+                connection->responses += responses;
+            }
+        }
+        {
+            std::lock_guard guard(ready_mutex_);
+            ready_.push_back(connection);
+        }
+        Wake();
+    }
+}
+
+void SearchService::Execute(std::string_view frame, std::string &responses) {
+    SearchRequest request;
+    try {
+        request = ParseSearchRequest(frame);
+    } catch (const std::exception &e) {
+        WriteErrorResponse(responses, PeekRequestId(frame), SearchRequestType::SEARCH, e.what());
+        return;
+    }
+
+    try {
+        switch (request.type) {
+        case SearchRequestType::SEARCH: {
+            std::shared_lock lock(server_mutex_);
+            WriteSearchResponse(responses, request.id,
+                                server_.FindTopDocuments(request.text, request.status));
+            break;
+        }
+        case SearchRequestType::MATCH: {
+            std::shared_lock lock(server_mutex_);
+            WriteMatchResponse(responses, request.id,
+                               server_.MatchDocument(request.text, request.document_id));
+            break;
+        }
+        case SearchRequestType::ADD: {
+            std::unique_lock lock(server_mutex_);
+            server_.AddDocument(request.document_id, request.text, request.status,
+                                request.ratings);
+            WriteEmptyResponse(responses, request.id, request.type);
+            break;
+        }
+        case SearchRequestType::REMOVE: {
+            std::unique_lock lock(server_mutex_);
+            server_.RemoveDocument(request.document_id);
+            WriteEmptyResponse(responses, request.id, request.type);
+            break;
+        }
+        }
+    } catch (const std::exception &e) {
+        WriteErrorResponse(responses, request.id, request.type, e.what());
+    }
+}
+
+void SearchService::Wake() noexcept {
+    const uint64_t value = 1;
+    [[maybe_unused]] const auto size = write(event_fd_, &value, sizeof(value));
+}
@@ -0,0 +1,132 @@
+#include "sharded_search_server.h"
+
+void ShardedSearchServer::AddDocument(int document_id,
+                                      std::string_view document,
+                                      DocumentStatus status,
+                                      const std::vector<int> &ratings) {
+    // The shard rejects invalid and repeated ids, as a repeated id maps to the same shard
+    shards_[GetShardIndex(document_id)].AddDocument(document_id, document, status, ratings);
+    document_ids_.insert(document_id);
+}
+
+void ShardedSearchServer::UpdateDocument(int document_id,
+                                         std::string_view document,
+                                         DocumentStatus status,
+                                         const std::vector<int> &ratings) {
+    shards_[GetShardIndex(document_id)].UpdateDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::UpdateDocument(int document_id,
+                                         DocumentStatus status,
+                                         const std::vector<int> &ratings) {
+    shards_[GetShardIndex(document_id)].UpdateDocument(document_id, status, ratings);
+}
+
+SearchServer::WordFrequencies ShardedSearchServer::GetWordFrequencies(int document_id) const {
+    return shards_[GetShardIndex(document_id)].GetWordFrequencies(document_id);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    shards_[GetShardIndex(document_id)].RemoveDocument(document_id);
+    document_ids_.erase(document_id);
+}
+
+void ShardedSearchServer::RemoveDocument(const std::execution::sequenced_policy &,
+                                         int document_id) {
+    RemoveDocument(document_id);
+}
+
+void ShardedSearchServer::RemoveDocument(const std::execution::parallel_policy &policy,
+                                         int document_id) {
+    shards_[GetShardIndex(document_id)].RemoveDocument(policy, document_id);
+    document_ids_.erase(document_id);
+}
+
+void ShardedSearchServer::RemoveDocuments(const std::vector<int> &document_ids) {
+    const auto shard_document_ids = SplitByShard(document_ids);
+    // Shards are independent, and the shared statistics lock their own updates
+    std::vector<size_t> indexes(shards_.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(),
+                  [this, &shard_document_ids](size_t index) {
+                      for (const int document_id : shard_document_ids[index]) {
+                          shards_[index].RemoveDocument(document_id);
+                      }
+                  });
+    for (const int document_id : document_ids) {
+        document_ids_.erase(document_id);
+    }
+}
+
+std::tuple<std::vector<std::string>, DocumentStatus>
+ShardedSearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
+    return shards_[GetShardIndex(document_id)].MatchDocument(raw_query, document_id);
+}
+
+std::tuple<std::vector<std::string>, DocumentStatus>
+ShardedSearchServer::MatchDocument(const std::execution::sequenced_policy &,
+                                   std::string_view raw_query,
+                                   int document_id) const {
+    return MatchDocument(raw_query, document_id);
+}
+
+std::tuple<std::vector<std::string>, DocumentStatus>
+ShardedSearchServer::MatchDocument(const std::execution::parallel_policy &policy,
+                                   std::string_view raw_query,
+                                   int document_id) const {
+    return shards_[GetShardIndex(document_id)].MatchDocument(policy, raw_query, document_id);
+}
+
+std::vector<std::tuple<std::vector<std::string>, DocumentStatus>>
+ShardedSearchServer::MatchDocuments(std::string_view raw_query,
+                                    const std::vector<int> &document_ids) const {
+    const auto shard_document_ids = SplitByShard(document_ids);
+    std::vector<std::vector<std::tuple<std::vector<std::string>, DocumentStatus>>>
+        shard_results(shards_.size());
+    ForEachShard([&](size_t index) {
+        if (!shard_document_ids[index].empty()) {
+            const auto &shard = shards_[index];
+            shard_results[index] =
+                shard.MatchDocuments(shard.PrepareQuery(raw_query), shard_document_ids[index]);
+        }
+    });
+
+    // Back to the order of document_ids
+    std::vector<std::tuple<std::vector<std::string>, DocumentStatus>> result;
+    result.reserve(document_ids.size());
+    std::vector<size_t> next(shards_.size(), 0);
+    for (const int document_id : document_ids) {
+        const size_t index = GetShardIndex(document_id);
+        result.push_back(std::move(shard_results[index][next[index]++]));
+    }
+    return result;
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const noexcept {
+    return static_cast<size_t>(document_id) % shards_.size();
+}
+
+std::vector<std::vector<int>>
+ShardedSearchServer::SplitByShard(const std::vector<int> &document_ids) const {
+    std::vector<std::vector<int>> shard_document_ids(shards_.size());
+    for (const int document_id : document_ids) {
+        shard_document_ids[GetShardIndex(document_id)].push_back(document_id);
+    }
+    return shard_document_ids;
+}
+
+std::vector<Document>
+ShardedSearchServer::MergeTopDocuments(std::vector<std::vector<Document>> results) {
+    // The global top is within the union of the shard tops, as each shard keeps its best.
+    // It is sorted with IsRankedBefore, the order of a single server: relevance in 1e-6
+    // buckets, then rating, then id, so shards never disagree on ties.
+    std::vector<Document> documents;
+    for (auto &shard_documents : results) {
+        documents.insert(documents.end(), shard_documents.begin(), shard_documents.end());
+    }
+    std::sort(documents.begin(), documents.end(), IsRankedBefore);
+    if (documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    return documents;
+}
@@ -0,0 +1,32 @@
+#include "stop_word_set.h"
+
+StopWordSet::StopWordSet() : table_(GetStopWordTableSize(0)) {}
+
+StopWordSet::StopWordSet(std::vector<std::string> words)
+    : words_(std::move(words)), table_(GetStopWordTableSize(words_.size())) {
+    std::sort(words_.begin(), words_.end());
+    words_.shrink_to_fit();
+    BuildStopWordTable(words_, table_);
+}
+
+MemoryUsage StopWordSet::GetMemoryUsage() const {
+    MemoryUsage usage;
+    usage.elements = words_.size();
+    for (const size_t bytes : {words_.capacity() * sizeof(std::string),
+                               table_.capacity() * sizeof(uint32_t)}) {
+        if (bytes > 0) {
+            usage.bytes += bytes;
+            usage.allocated_bytes += EstimateAllocatedBytes(bytes);
+            ++usage.allocations;
+        }
+    }
+    // Words that do not fit into the small string buffer own a separate allocation
+    for (const auto &word : words_) {
+        if (word.capacity() > std::string().capacity()) {
+            usage.bytes += word.capacity() + 1;
+            usage.allocated_bytes += EstimateAllocatedBytes(word.capacity() + 1);
+            ++usage.allocations;
+        }
+    }
+    return usage;
+}
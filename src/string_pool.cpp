@@ -0,0 +1,205 @@
+#include "string_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const char EMPTY_STRING[] = "";
+const size_t NPOS = static_cast<size_t>(-1);
+} // namespace
+
+std::string_view StringPool::Intern(std::string_view str) {
+    if (const auto pooled = Find(str)) {
+        return *pooled;
+    }
+
+    if ((count_ + deleted_count_ + 1) * 4 > table_.size() * 3) {
+        size_t capacity = std::max<size_t>(table_.size(), 16);
+        while ((count_ + 1) * 2 > capacity) {
+            capacity *= 2;
+        }
+        Rehash(capacity);
+    }
+
+    std::string_view pooled(EMPTY_STRING, 0);
+    if (!str.empty()) {
+        char *data = Allocate(str.size());
+        std::memcpy(data, str.data(), str.size());
+        pooled = {data, str.size()};
+    }
+
+    const size_t mask = table_.size() - 1;
+    size_t index = std::hash<std::string_view>{}(pooled)&mask;
+    while (table_[index].state == SlotState::USED) {
+        index = (index + 1) & mask;
+    }
+    if (table_[index].state == SlotState::DELETED) {
+        --deleted_count_;
+    }
+    table_[index] = {pooled, SlotState::USED};
+
+    ++count_;
+    string_bytes_ += pooled.size();
+    return pooled;
+}
+
+std::optional<std::string_view> StringPool::Find(std::string_view str) const {
+    const size_t index = FindSlot(str);
+    if (index == NPOS) {
+        return std::nullopt;
+    }
+    return table_[index].str;
+}
+
+void StringPool::Release(std::string_view str) {
+    const size_t index = FindSlot(str);
+    if (index == NPOS) {
+        return;
+    }
+    const std::string_view pooled = table_[index].str;
+    table_[index].state = SlotState::DELETED;
+    ++deleted_count_;
+    --count_;
+    string_bytes_ -= pooled.size();
+
+    if (pooled.empty()) {
+        return;
+    }
+
+    const auto chunk = chunks_.lower_bound(pooled.data());
+    chunk->second.live_bytes -= pooled.size();
+    if (chunk->second.live_bytes > 0) {
+        free_slots_[pooled.size()].push_back(const_cast<char *>(pooled.data()));
+        return;
+    }
+
+    // The chunk holds no live strings: forget its free slots and give it back
+    const char *chunk_begin = chunk->first;
+    const char *chunk_end = chunk_begin + chunk->second.size;
+    for (auto it = free_slots_.begin(); it != free_slots_.end();) {
+        auto &slots = it->second;
+        slots.erase(std::remove_if(slots.begin(), slots.end(),
+                                   [chunk_begin, chunk_end](const char *data) {
+                                       return data >= chunk_begin && data < chunk_end;
+                                   }),
+                    slots.end());
+        it = slots.empty() ? free_slots_.erase(it) : std::next(it);
+    }
+
+    if (chunk_begin == current_chunk_) {
+        if (chunk->second.data.use_count() == 1) {
+            current_ = chunk->second.data.get();
+            current_left_ = chunk->second.size;
+            return;
+        }
+        current_chunk_ = nullptr;
+        current_ = nullptr;
+        current_left_ = 0;
+    }
+    chunks_.erase(chunk);
+}
+
+size_t StringPool::GetChunkBytes() const noexcept {
+    size_t bytes = 0;
+    for (const auto &[_, chunk] : chunks_) {
+        bytes += chunk.size;
+    }
+    return bytes;
+}
+
+MemoryUsage StringPool::GetMemoryUsage() const {
+    MemoryUsage usage;
+    for (const auto &[_, chunk] : chunks_) {
+        usage.bytes += chunk.size;
+        usage.allocated_bytes += EstimateAllocatedBytes(chunk.size);
+        ++usage.allocations;
+    }
+    if (!table_.empty()) {
+        usage.bytes += GetTableBytes();
+        usage.allocated_bytes += EstimateAllocatedBytes(GetTableBytes());
+        ++usage.allocations;
+    }
+    usage.elements = count_;
+    return usage;
+}
+
+size_t StringPool::FindSlot(std::string_view str) const {
+    if (table_.empty()) {
+        return NPOS;
+    }
+    const size_t mask = table_.size() - 1;
+    for (size_t index = std::hash<std::string_view>{}(str)&mask;;
+         index = (index + 1) & mask) {
+        const auto &slot = table_[index];
+        if (slot.state == SlotState::EMPTY) {
+            return NPOS;
+        }
+        if (slot.state == SlotState::USED && slot.str == str) {
+            return index;
+        }
+    }
+}
+
+void StringPool::Rehash(size_t capacity) {
+    std::vector<Slot> table(capacity);
+    const size_t mask = capacity - 1;
+    for (const auto &slot : table_) {
+        if (slot.state != SlotState::USED) {
+            continue;
+        }
+        size_t index = std::hash<std::string_view>{}(slot.str)&mask;
+        while (table[index].state == SlotState::USED) {
+            index = (index + 1) & mask;
+        }
+        table[index] = slot;
+    }
+    table_ = std::move(table);
+    deleted_count_ = 0;
+}
+
+StringPool::Chunk &StringPool::GetChunk(const char *data) {
+    return chunks_.lower_bound(data)->second;
+}
+
+char *StringPool::Allocate(size_t size) {
+    if (const auto free_slot = free_slots_.find(size); free_slot != free_slots_.end()) {
+        auto &slots = free_slot->second;
+        char *data = nullptr;
+        while (data == nullptr && !slots.empty()) {
+            // Bytes of a chunk shared with a copy of the pool may still be in use there
+            auto &chunk = GetChunk(slots.back());
+            if (chunk.data.use_count() == 1) {
+                data = slots.back();
+                chunk.live_bytes += size;
+            }
+            slots.pop_back();
+        }
+        if (slots.empty()) {
+            free_slots_.erase(free_slot);
+        }
+        if (data != nullptr) {
+            return data;
+        }
+    }
+
+    if (size > chunk_size_) {
+        Chunk chunk{std::shared_ptr<char[]>(new char[size]), size, size};
+        char *data = chunk.data.get();
+        chunks_.emplace(data, std::move(chunk));
+        return data;
+    }
+
+    if (current_chunk_ == nullptr || current_left_ < size ||
+        chunks_.at(current_chunk_).data.use_count() > 1) {
+        Chunk chunk{std::shared_ptr<char[]>(new char[chunk_size_]), chunk_size_, 0};
+        current_chunk_ = current_ = chunk.data.get();
+        current_left_ = chunk_size_;
+        chunks_.emplace(current_chunk_, std::move(chunk));
+    }
+
+    char *data = current_;
+    chunks_.at(current_chunk_).live_bytes += size;
+    current_ += size;
+    current_left_ -= size;
+    return data;
+}
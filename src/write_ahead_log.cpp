@@ -0,0 +1,302 @@
+#include "write_ahead_log.h"
+
+#include "search_protocol.h"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+namespace {
+[[noreturn]] void ThrowSystemError(const std::string &what) {
+    throw std::runtime_error(what + ": "s + std::strerror(errno));
+}
+
+// CRC-32 of zlib and PNG, reflected polynomial 0xEDB88320
+uint32_t ComputeCrc32(std::string_view data) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < table.size(); ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1u) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            table[i] = value;
+        }
+        return table;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (const char c : data) {
+        crc = table[(crc ^ static_cast<uint8_t>(c)) & 0xFFu] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+const size_t CRC_BYTES = 4;
+
+void EncodeRecordFrame(std::string &buffer, const WalRecord &record, uint64_t sequence) {
+    ByteWriter writer(buffer);
+    writer.BeginFrame();
+    const size_t crc_offset = buffer.size();
+    writer.PutUint32(0);
+    writer.PutUint32(static_cast<uint32_t>(sequence));
+    writer.PutUint32(static_cast<uint32_t>(sequence >> 32));
+    writer.PutUint8(static_cast<uint8_t>(record.type));
+    writer.PutInt32(record.document_id);
+    if (record.type == WalRecordType::ADD || record.type == WalRecordType::UPDATE ||
+        record.type == WalRecordType::UPDATE_METADATA) {
+        writer.PutUint8(static_cast<uint8_t>(record.status));
+        writer.PutUint32(static_cast<uint32_t>(record.ratings.size()));
+        for (const int rating : record.ratings) {
+            writer.PutInt32(rating);
+        }
+    }
+    if (record.type == WalRecordType::ADD || record.type == WalRecordType::UPDATE) {
+        writer.PutString(record.text);
+    }
+    writer.EndFrame();
+
+    const uint32_t crc =
+        ComputeCrc32(std::string_view(buffer).substr(crc_offset + CRC_BYTES));
+    for (size_t i = 0; i < CRC_BYTES; ++i) {
+        buffer[crc_offset + i] = static_cast<char>((crc >> (8 * i)) & 0xFF);
+    }
+}
+
+// Throws std::invalid_argument if the frame is not a valid record
+WalRecord DecodeRecord(std::string_view frame) {
+    ByteReader reader(frame.substr(FRAME_SIZE_BYTES));
+    const uint32_t crc = reader.GetUint32();
+    if (crc != ComputeCrc32(frame.substr(FRAME_SIZE_BYTES + CRC_BYTES))) {
+        throw std::invalid_argument("Record checksum does not match"s);
+    }
+
+    WalRecord record;
+    record.sequence = reader.GetUint32();
+    record.sequence |= static_cast<uint64_t>(reader.GetUint32()) << 32;
+    const uint8_t type = reader.GetUint8();
+    if (type < static_cast<uint8_t>(WalRecordType::ADD) ||
+        type > static_cast<uint8_t>(WalRecordType::CHECKPOINT)) {
+        throw std::invalid_argument("Unknown record type "s + std::to_string(type));
+    }
+    record.type = static_cast<WalRecordType>(type);
+    record.document_id = reader.GetInt32();
+    if (record.type == WalRecordType::ADD || record.type == WalRecordType::UPDATE ||
+        record.type == WalRecordType::UPDATE_METADATA) {
+        const uint8_t status = reader.GetUint8();
+        if (status > static_cast<uint8_t>(DocumentStatus::REMOVED)) {
+            throw std::invalid_argument("Unknown document status "s + std::to_string(status));
+        }
+        record.status = static_cast<DocumentStatus>(status);
+        const uint32_t rating_count = reader.GetUint32();
+        for (uint32_t i = 0; i < rating_count; ++i) {
+            record.ratings.push_back(reader.GetInt32());
+        }
+    }
+    if (record.type == WalRecordType::ADD || record.type == WalRecordType::UPDATE) {
+        record.text = std::string(reader.GetString());
+    }
+    if (!reader.IsEmpty()) {
+        throw std::invalid_argument("Record has trailing bytes"s);
+    }
+    return record;
+}
+
+void WriteAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        const ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("Cannot write the log"s);
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+}
+} // namespace
+
+WriteAheadLog::WriteAheadLog(std::string path, const WalOptions &options, uint64_t last_sequence)
+    : path_(std::move(path)), options_(options) {
+    size_t valid_size = 0;
+    const auto records = ReadRecords(path_, &valid_size);
+    last_sequence_ = records.empty() ? last_sequence
+                                     : std::max(last_sequence, records.back().sequence);
+    committed_sequence_ = last_sequence_;
+
+    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        ThrowSystemError("Cannot open "s + path_);
+    }
+    // A record torn by a crash is cut off, new ones go right after the last whole record
+    committed_size_ = valid_size;
+    if (ftruncate(fd_, static_cast<off_t>(valid_size)) < 0) {
+        const int error = errno;
+        close(fd_);
+        errno = error;
+        ThrowSystemError("Cannot truncate "s + path_);
+    }
+    if (options_.group_commit_delay.count() > 0) {
+        committer_ = std::thread([this] { RunCommitter(); });
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    commit_requested_.notify_one();
+    if (committer_.joinable()) {
+        committer_.join();
+    }
+    try {
+        Commit();
+    } catch (...) {
+        // Nothing can be reported from a destructor, the records are lost as in a crash
+    }
+    close(fd_);
+}
+
+uint64_t WriteAheadLog::Append(const WalRecord &record) {
+    uint64_t sequence = 0;
+    bool is_full = false;
+    {
+        std::lock_guard lock(mutex_);
+        ThrowIfFailed();
+        sequence = ++last_sequence_;
+        EncodeRecordFrame(pending_, record, sequence);
+        is_full = ++pending_count_ >= options_.group_commit_size;
+        if (pending_count_ == 1) {
+            commit_requested_.notify_one();
+        }
+    }
+    if (is_full) {
+        Commit();
+    }
+    return sequence;
+}
+
+void WriteAheadLog::Commit() {
+    std::lock_guard write_lock(write_mutex_);
+    uint64_t sequence = 0;
+    {
+        std::lock_guard lock(mutex_);
+        ThrowIfFailed();
+        if (pending_count_ == 0) {
+            return;
+        }
+        writing_.swap(pending_);
+        pending_.clear();
+        pending_count_ = 0;
+        sequence = last_sequence_;
+    }
+    // One write and one sync for the whole group
+    try {
+        WriteAll(fd_, writing_);
+        if (options_.sync && fdatasync(fd_) < 0) {
+            ThrowSystemError("Cannot sync the log"s);
+        }
+    } catch (const std::exception &e) {
+        // The group may be written in part. It is cut off, so that nothing is ever appended
+        // after a torn frame, and the log takes no more records.
+        const bool is_cut = ftruncate(fd_, static_cast<off_t>(committed_size_)) == 0;
+        writing_.clear();
+        std::lock_guard lock(mutex_);
+        failure_ = e.what();
+        if (!is_cut) {
+            failure_ += ", the group written in part is left in the file"s;
+        }
+        throw;
+    }
+    committed_size_ += writing_.size();
+    writing_.clear();
+    std::lock_guard lock(mutex_);
+    committed_sequence_ = sequence;
+}
+
+void WriteAheadLog::Truncate() {
+    Commit();
+    std::lock_guard write_lock(write_mutex_);
+    if (ftruncate(fd_, 0) < 0) {
+        ThrowSystemError("Cannot truncate "s + path_);
+    }
+    committed_size_ = 0;
+    if (options_.sync && fdatasync(fd_) < 0) {
+        ThrowSystemError("Cannot sync the log"s);
+    }
+}
+
+bool WriteAheadLog::IsFailed() const {
+    std::lock_guard lock(mutex_);
+    return !failure_.empty();
+}
+
+void WriteAheadLog::ThrowIfFailed() const {
+    if (!failure_.empty()) {
+        throw std::runtime_error("Log "s + path_ + " failed to commit: "s + failure_);
+    }
+}
+
+uint64_t WriteAheadLog::GetLastSequence() const {
+    std::lock_guard lock(mutex_);
+    return last_sequence_;
+}
+
+uint64_t WriteAheadLog::GetCommittedSequence() const {
+    std::lock_guard lock(mutex_);
+    return committed_sequence_;
+}
+
+std::vector<WalRecord> WriteAheadLog::ReadRecords(const std::string &path, size_t *valid_size) {
+    std::ifstream in(path, std::ios::binary);
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    std::vector<WalRecord> records;
+    std::string_view rest = data;
+    while (const auto size = GetFrameSize(rest)) {
+        try {
+            records.push_back(DecodeRecord(rest.substr(0, *size)));
+        } catch (const std::invalid_argument &) {
+            break;
+        }
+        rest.remove_prefix(*size);
+    }
+    if (valid_size != nullptr) {
+        *valid_size = data.size() - rest.size();
+    }
+    return records;
+}
+
+void WriteAheadLog::EncodeRecord(std::string &buffer, const WalRecord &record) {
+    EncodeRecordFrame(buffer, record, record.sequence);
+}
+
+void WriteAheadLog::RunCommitter() {
+    std::unique_lock lock(mutex_);
+    while (!stopping_) {
+        commit_requested_.wait(lock, [this] { return stopping_ || pending_count_ > 0; });
+        // The group waits for more records until the delay of its first one runs out
+        commit_requested_.wait_for(lock, options_.group_commit_delay,
+                                   [this] { return stopping_ || pending_count_ == 0; });
+        if (pending_count_ > 0) {
+            lock.unlock();
+            try {
+                Commit();
+            } catch (...) {
+                // The log is failed now, the next Append or Commit of a writer throws
+            }
+            lock.lock();
+            if (!failure_.empty()) {
+                return;
+            }
+        }
+    }
+}
@@ -1,11 +1,29 @@
 #include "test_runner.h"
 
+#include <csignal>
+#include <dataset_generator.h>
+#include <durable_search_server.h>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <list>
 #include <math.h>
+#include <numa_search_server.h>
 #include <paginator.h>
 #include <process_queries.h>
 #include <remove_duplicates.h>
 #include <request_queue.h>
+#include <search_client.h>
+#include <search_metrics.h>
 #include <search_server.h>
+#include <search_service.h>
+#include <sharded_search_server.h>
+#include <static_search_server.h>
+#include <stop_word_set.h>
+#include <string_pool.h>
+#include <sys/resource.h>
+#include <thread>
+#include <write_ahead_log.h>
 
 using namespace std;
 
@@ -159,6 +177,36 @@ void TestSetConstructorWithSpecialCharacters() {
     ASSERT(!exString.empty());
 }
 
+void TestStopWordSet() {
+    static constexpr auto static_words = MakeStaticStopWordSet("a"sv, "in"sv, "the"sv, "of"sv);
+    static_assert(static_words.Contains("the"sv));
+    static_assert(!static_words.Contains("them"sv));
+    static_assert(!static_words.Contains(""sv));
+    static_assert(!SearchServerConfig::STOP_WORDS.Contains("a"sv));
+
+    // Enough words for buckets of several words and for displacements to be searched for
+    vector<string> words;
+    for (int i = 0; i < 5000; ++i) {
+        words.push_back("w"s + to_string(i * 7));
+    }
+    const StopWordSet stop_words(words);
+    ASSERT_EQUAL(stop_words.size(), words.size());
+    for (int i = 0; i < 35000; ++i) {
+        ASSERT_EQUAL(stop_words.Contains("w"s + to_string(i)), i % 7 == 0);
+    }
+    ASSERT(!stop_words.Contains(""sv));
+    ASSERT(is_sorted(stop_words.begin(), stop_words.end()));
+    ASSERT(!StopWordSet().Contains("w0"sv));
+
+    string exString{};
+    try {
+        StopWordSet repeated({"in"s, "the"s, "in"s});
+    } catch (const invalid_argument &e) {
+        exString = e.what();
+    }
+    ASSERT(!exString.empty());
+}
+
 void TestAddDocWithNegativeID() {
     string exString{};
     SearchServer server("in the a"s);
@@ -316,6 +364,330 @@ void TestMatchDocumentQueryWithEmptyMinusWord() {
     ASSERT(!exString.empty());
 }
 
+void TestPreparedQueryFindTopDocuments() {
+    SearchServer server = GetSearchServerDifferentDocsStatus();
+    const auto query = server.PrepareQuery("cat dog -city"s);
+
+    for (const auto status : {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT,
+                              DocumentStatus::BANNED, DocumentStatus::REMOVED}) {
+        const auto expected = server.FindTopDocuments("cat dog -city"s, status);
+        const auto found_docs = server.FindTopDocuments(query, status);
+        const auto found_docs_par = server.FindTopDocuments(execution::par, query, status);
+
+        ASSERT_EQUAL(found_docs.size(), expected.size());
+        ASSERT_EQUAL(found_docs_par.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(found_docs[i].id, expected[i].id);
+            ASSERT_EQUAL(found_docs_par[i].id, expected[i].id);
+            ASSERT(std::abs(found_docs[i].relevance - expected[i].relevance) < 1e-6);
+        }
+    }
+}
+
+void TestPreparedQueryWords() {
+    SearchServer server("in the"s);
+    const auto query = server.PrepareQuery("the cat -dog in cat city"s);
+
+    ASSERT_EQUAL(query.GetPlusWords(), vector<string_view>({"cat"sv, "city"sv}));
+    ASSERT_EQUAL(query.GetMinusWords(), vector<string_view>({"dog"sv}));
+    ASSERT_EQUAL(query.GetStopWords(), vector<string_view>({"the"sv, "in"sv}));
+    ASSERT_THROWS(server.PrepareQuery("cat --dog"s), invalid_argument);
+}
+
+void TestPreparedQueryAfterServerModification() {
+    SearchServer server = GetSearchServer();
+    const auto query = server.PrepareQuery("city"s);
+
+    ASSERT_EQUAL(server.FindTopDocuments(query).size(), 1u);
+
+    server.AddDocument(100, "city of cats"s, DocumentStatus::ACTUAL, {1});
+    server.RemoveDocument(24);
+
+    const auto found_docs = server.FindTopDocuments(query);
+    ASSERT_EQUAL(found_docs.size(), 1u);
+    ASSERT_EQUAL(found_docs[0].id, 100);
+    ASSERT(std::abs(found_docs[0].relevance - log(5.0) / 3.0) < 1e-6);
+}
+
+void TestPreparedQueryAfterServerAssignment() {
+    const auto get_ids = [](const vector<Document> &documents) {
+        vector<int> ids;
+        for (const auto &document : documents) {
+            ids.push_back(document.id);
+        }
+        return ids;
+    };
+
+    // The assignment frees the postings the query was resolved against
+    SearchServer server = GetSearchServer();
+    SearchServer backup(server);
+    backup.RemoveDocument(13);
+    auto query = server.PrepareQuery("cat"s);
+    server = backup;
+    ASSERT_EQUAL(get_ids(server.FindTopDocuments(query)),
+                 get_ids(backup.FindTopDocuments("cat"s)));
+
+    query = server.PrepareQuery("cat"s);
+    SearchServer other = GetSearchServer();
+    other.RemoveDocument(43);
+    const auto expected = get_ids(other.FindTopDocuments("cat"s));
+    server = move(other);
+    ASSERT_EQUAL(get_ids(server.FindTopDocuments(query)), expected);
+}
+
+void TestPreparedQueryMatchDocuments() {
+    SearchServer server = GetSearchServer();
+    const auto query = server.PrepareQuery("happy dog -and"s);
+
+    const auto [words, status] = server.MatchDocument(query, 24);
+    ASSERT_EQUAL(words, vector<string>({"dog"s, "happy"s}));
+    ASSERT(status == DocumentStatus::ACTUAL);
+
+    const vector<int> ids = {0, 10, 24, 13, 43};
+    const auto matches = server.MatchDocuments(query, ids);
+    const auto matches_par = server.MatchDocuments(execution::par, query, ids);
+
+    ASSERT_EQUAL(matches.size(), ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        const auto [expected_words, _] = server.MatchDocument("happy dog -and"s, ids[i]);
+        const auto [par_words, __] = server.MatchDocument(execution::par, query, ids[i]);
+        ASSERT_EQUAL(get<0>(matches[i]), expected_words);
+        ASSERT_EQUAL(get<0>(matches_par[i]), expected_words);
+        ASSERT_EQUAL(par_words, expected_words);
+    }
+}
+
+void TestStringPool() {
+    StringPool pool(16);
+
+    const auto cat = pool.Intern("cat"s);
+    const auto dog = pool.Intern("dog"sv);
+    ASSERT_EQUAL(pool.Intern("cat"sv).data(), cat.data());
+    ASSERT_EQUAL(pool.size(), 2u);
+    ASSERT_EQUAL(pool.GetStringBytes(), 6u);
+    ASSERT(pool.Find("dog"sv) && pool.Find("dog"sv)->data() == dog.data());
+    ASSERT(!pool.Find("bird"sv));
+
+    const auto long_word = pool.Intern("a word longer than chunk"sv);
+    ASSERT_EQUAL(long_word, "a word longer than chunk"sv);
+
+    pool.Release("cat"sv);
+    ASSERT(!pool.Find("cat"sv));
+    ASSERT_EQUAL(pool.Intern("owl"sv).data(), cat.data());
+
+    pool.Release("long"sv);
+    pool.Release("a word longer than chunk"sv);
+    ASSERT_EQUAL(pool.GetChunkBytes(), 16u);
+    ASSERT_EQUAL(pool.Intern(""sv), ""sv);
+    ASSERT_EQUAL(pool.size(), 3u);
+}
+
+void TestStringPoolCopy() {
+    StringPool pool;
+    const auto cat = pool.Intern("cat"sv);
+
+    StringPool copy = pool;
+    copy.Release("cat"sv);
+    const auto owl = copy.Intern("owl"sv);
+
+    ASSERT(owl.data() != cat.data());
+    ASSERT_EQUAL(cat, "cat"sv);
+    ASSERT_EQUAL(pool.Find("cat"sv)->data(), cat.data());
+}
+
+void TestRemoveDocumentReleasesWords() {
+    SearchServer server(""s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(3, "black dog"s, DocumentStatus::ACTUAL, {1});
+
+    server.RemoveDocument(1);
+    server.RemoveDocument(execution::par, 3);
+
+    ASSERT(server.FindTopDocuments("white dog"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 1u);
+
+    server.AddDocument(4, "white owl"s, DocumentStatus::ACTUAL, {1});
+    const auto found_docs = server.FindTopDocuments("white"s);
+    ASSERT_EQUAL(found_docs.size(), 1u);
+    ASSERT_EQUAL(found_docs[0].id, 4);
+
+    // Documents of nothing but stop words are removed too
+    SearchServer stop_server("and or"s);
+    stop_server.AddDocument(1, "and or"s, DocumentStatus::ACTUAL, {1});
+    stop_server.AddDocument(2, "or"s, DocumentStatus::ACTUAL, {1});
+    stop_server.RemoveDocument(1);
+    stop_server.RemoveDocument(execution::par, 2);
+    ASSERT_EQUAL(stop_server.GetDocumentCount(), 0);
+}
+
+void TestForwardIndex() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat and white dog"s, DocumentStatus::ACTUAL, {1});
+    const auto words = server.GetWordFrequencies(1);
+    ASSERT_EQUAL(words.size(), 3u);
+    ASSERT_EQUAL(words.begin()->first, "cat"sv);
+    ASSERT_EQUAL(words.at("white"sv), 0.5);
+    ASSERT_EQUAL(words.count("and"sv), 0u);
+    ASSERT(words.find("owl"sv) == words.end());
+    ASSERT_THROWS(words.at("owl"sv), out_of_range);
+    ASSERT(server.GetWordFrequencies(2).empty());
+
+    // Rows left behind by removals and updates are compacted away, the others stay intact
+    SearchServer rebuilt("and"s);
+    rebuilt.AddDocument(1, "white cat and white dog"s, DocumentStatus::ACTUAL, {1});
+    for (int id = 2; id < 100; ++id) {
+        const string text = "cat"s + to_string(id % 7) + " dog"s + to_string(id % 5);
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+        if (id % 3 == 0) {
+            server.UpdateDocument(id, text + " owl"s, DocumentStatus::ACTUAL, {1});
+            rebuilt.AddDocument(id, text + " owl"s, DocumentStatus::ACTUAL, {1});
+        } else if (id % 3 == 1) {
+            rebuilt.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+        }
+    }
+    for (int id = 1; id < 100; ++id) {
+        if (id % 3 == 2) {
+            server.RemoveDocument(id);
+        }
+    }
+    for (int id = 1; id < 100; ++id) {
+        ASSERT(server.GetWordFrequencies(id) == rebuilt.GetWordFrequencies(id));
+    }
+    const auto stats = server.GetMemoryStats().document_to_words_freqs;
+    ASSERT_EQUAL(stats.elements, rebuilt.GetMemoryStats().document_to_words_freqs.elements);
+    // At most half of the rows are garbage, at most half of the capacity is unused
+    ASSERT(stats.bytes <= 4 * stats.elements * sizeof(WordFrequency));
+}
+
+void TestMemoryStats() {
+    SearchServer server("and"s);
+    {
+        const auto stats = server.GetMemoryStats();
+        ASSERT_EQUAL(stats.stop_words.elements, 1u);
+        ASSERT_EQUAL(stats.stop_words.allocations, 2u);
+        ASSERT_EQUAL(stats.word_to_document_freqs.bytes, 0u);
+        ASSERT_EQUAL(stats.documents.bytes, 0u);
+    }
+
+    server.AddDocument(1, "cat and dog"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "cat and cat"s, DocumentStatus::ACTUAL, {1});
+    {
+        const auto stats = server.GetMemoryStats();
+        ASSERT_EQUAL(stats.all_words.elements, 2u);
+        ASSERT_EQUAL(stats.word_to_document_freqs.elements, 5u);
+        ASSERT_EQUAL(stats.word_to_document_freqs.allocations, 5u);
+        // The forward index is a single buffer of (word, frequency) rows
+        ASSERT_EQUAL(stats.document_to_words_freqs.elements, 3u);
+        ASSERT_EQUAL(stats.document_to_words_freqs.allocations, 1u);
+        ASSERT_EQUAL(stats.documents.allocations, 2u);
+        ASSERT_EQUAL(stats.document_ids.elements, 2u);
+        ASSERT(stats.word_to_document_freqs.allocated_bytes >
+               stats.word_to_document_freqs.bytes);
+        ASSERT(stats.GetTotal().bytes > stats.word_to_document_freqs.bytes);
+
+        SearchServer copy = server;
+        copy.RemoveDocument(1);
+        copy.RemoveDocument(2);
+        const auto copy_stats = copy.GetMemoryStats();
+        ASSERT_EQUAL(copy_stats.word_to_document_freqs.bytes, 0u);
+        ASSERT_EQUAL(copy_stats.document_to_words_freqs.bytes, 0u);
+        ASSERT_EQUAL(server.GetMemoryStats().word_to_document_freqs.bytes,
+                     stats.word_to_document_freqs.bytes);
+    }
+
+    server.RemoveDocument(execution::par, 1);
+    server.RemoveDocument(2);
+    {
+        const auto stats = server.GetMemoryStats();
+        ASSERT_EQUAL(stats.all_words.elements, 0u);
+        ASSERT_EQUAL(stats.word_to_document_freqs.bytes, 0u);
+        ASSERT_EQUAL(stats.document_to_words_freqs.allocations, 0u);
+        ASSERT_EQUAL(stats.documents.bytes, 0u);
+        ASSERT_EQUAL(stats.document_ids.bytes, 0u);
+    }
+}
+
+void TestLatencyHistogram() {
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        histogram.Record(value * 1000);
+    }
+
+    ASSERT_EQUAL(histogram.GetCount(), 1000u);
+    ASSERT_EQUAL(histogram.GetSum(), 500'500'000u);
+    for (const double quantile : {0.5, 0.9, 0.99}) {
+        const double expected = quantile * 1'000'000;
+        const auto percentile = static_cast<double>(histogram.GetPercentile(quantile));
+        ASSERT(percentile >= expected && percentile <= expected * (1 + 1.0 / 16));
+    }
+    ASSERT_EQUAL(LatencyHistogram::GetBucketIndex(numeric_limits<uint64_t>::max()),
+                 LatencyHistogram::BUCKET_COUNT - 1);
+}
+
+void TestSearchMetrics() {
+    auto &metrics = SearchMetrics::Instance();
+    metrics.Reset();
+    metrics.SetEnabled(true);
+
+    SearchServer server = GetSearchServer();
+    server.FindTopDocuments("cat -city"s);
+    server.FindTopDocuments(execution::par, "dog"s);
+    server.RemoveDocument(0);
+
+    metrics.SetEnabled(false);
+    server.FindTopDocuments("cat"s);
+
+    const auto snapshot = metrics.GetSnapshot();
+    const auto stage_count = [&snapshot](SearchStage stage) {
+        return snapshot.stages[static_cast<size_t>(stage)].GetCount();
+    };
+    ASSERT_EQUAL(stage_count(SearchStage::ADD_DOCUMENT), 5u);
+    ASSERT_EQUAL(stage_count(SearchStage::REMOVE_DOCUMENT), 1u);
+    ASSERT_EQUAL(stage_count(SearchStage::PARSE_QUERY), 2u);
+    ASSERT_EQUAL(stage_count(SearchStage::SCORE_PLUS_WORDS), 2u);
+    ASSERT_EQUAL(stage_count(SearchStage::SORT_RESULTS), 2u);
+    // cat: 4 postings, city: 1, dog: 2
+    ASSERT_EQUAL(snapshot.counters[static_cast<size_t>(SearchCounter::POSTINGS_SCANNED)], 7u);
+    ASSERT_EQUAL(snapshot.counters[static_cast<size_t>(SearchCounter::DOCUMENTS_SCORED)], 6u);
+    ASSERT_EQUAL(snapshot.counters[static_cast<size_t>(SearchCounter::DOCUMENTS_EXCLUDED)], 0u);
+
+    string exported;
+    metrics.ExportPrometheus([&exported](string_view text) { exported = text; });
+    const auto parse_count =
+        "search_server_stage_duration_seconds_count{stage=\"parse_query\"} 2\n"s;
+    ASSERT(exported.find(parse_count) != string::npos);
+    ASSERT(exported.find("search_server_postings_scanned_total 7\n"s) != string::npos);
+
+    metrics.Reset();
+    ASSERT_EQUAL(metrics.GetSnapshot().stages[0].GetCount(), 0u);
+
+    // A reset while another thread records counts what the thread records after it, also
+    // once the thread has exited
+    metrics.SetEnabled(true);
+    promise<void> recorded;
+    promise<void> reset;
+    thread recorder([&] {
+        metrics.Add(SearchCounter::DOCUMENTS_SCORED, 5);
+        recorded.set_value();
+        reset.get_future().wait();
+        metrics.Add(SearchCounter::DOCUMENTS_SCORED, 2);
+        metrics.Record(SearchStage::SORT_RESULTS, 100);
+    });
+    recorded.get_future().wait();
+    metrics.Reset();
+    reset.set_value();
+    recorder.join();
+    metrics.SetEnabled(false);
+    const auto after_reset = metrics.GetSnapshot();
+    ASSERT_EQUAL(after_reset.counters[static_cast<size_t>(SearchCounter::DOCUMENTS_SCORED)], 2u);
+    ASSERT_EQUAL(after_reset.stages[static_cast<size_t>(SearchStage::SORT_RESULTS)].GetCount(),
+                 1u);
+    ASSERT_EQUAL(after_reset.stages[static_cast<size_t>(SearchStage::SORT_RESULTS)].GetSum(),
+                 100u);
+    metrics.Reset();
+}
+
 void TestSortFoundDocumentsToRelevance() {
     SearchServer server = GetSearchServer();
     const auto found_docs = server.FindTopDocuments("cat"s);
@@ -430,6 +802,1181 @@ void TestRelevance() {
     TestRelevanceCalc(3, relevance_3);
 }
 
+void TestScorers() {
+    const double epsilon = 1e-6;
+    SearchServer server(""s);
+    server.AddDocument(0, "cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(1, "cat dog dog dog"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(2, "dog"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(3, "bird parrot"s, DocumentStatus::ACTUAL, {4});
+
+    const auto bm25 = [](double count, double length, double average_length,
+                         double document_freq) {
+        const double idf = log(1.0 + (4 - document_freq + 0.5) / (document_freq + 0.5));
+        const double norm = 1.0 - 0.75 + 0.75 * length / average_length;
+        return idf * count * 2.2 / (count + 1.2 * norm);
+    };
+    const double average_length = 8 / 4.0;
+
+    {
+        // TF-IDF is the default
+        const auto tf_idf = server.FindTopDocuments<TfIdfScorer>("dog"s);
+        const auto found = server.FindTopDocuments("dog"s);
+        ASSERT_EQUAL(found.size(), 2u);
+        ASSERT_EQUAL(tf_idf.size(), 2u);
+        ASSERT_EQUAL(found[0].id, 2);
+        ASSERT(std::abs(found[0].relevance - log(2.0)) < epsilon);
+        ASSERT(std::abs(found[1].relevance - log(2.0) * 0.75) < epsilon);
+        ASSERT(std::abs(tf_idf[1].relevance - found[1].relevance) < epsilon);
+    }
+    {
+        const auto found = server.FindTopDocuments<Bm25Scorer>("dog"s);
+        ASSERT_EQUAL(found.size(), 2u);
+        ASSERT_EQUAL(found[0].id, 1);
+        ASSERT(std::abs(found[0].relevance - bm25(3, 4, average_length, 2)) < epsilon);
+        ASSERT_EQUAL(found[1].id, 2);
+        ASSERT(std::abs(found[1].relevance - bm25(1, 1, average_length, 2)) < epsilon);
+    }
+    {
+        const double delta = log(2.0);
+        const auto found = server.FindTopDocuments<Bm25PlusScorer>("cat dog"s);
+        ASSERT_EQUAL(found.size(), 3u);
+        ASSERT_EQUAL(found[0].id, 1);
+        ASSERT(std::abs(found[0].relevance - bm25(1, 4, average_length, 2) -
+                        bm25(3, 4, average_length, 2) - 2 * delta) < epsilon);
+    }
+    {
+        // Parameters are template arguments, B = 0 turns length normalization off
+        const auto found = server.FindTopDocuments<BasicBm25Scorer<1.2, 0.0>>("cat"s);
+        ASSERT_EQUAL(found.size(), 2u);
+        ASSERT(std::abs(found[0].relevance - found[1].relevance) < epsilon);
+    }
+    {
+        // Expanded words are scored by the scorer too
+        const auto exact = server.FindTopDocuments<Bm25Scorer>("cat"s);
+        const auto prefix = server.FindTopDocuments<Bm25Scorer>("ca*"s);
+        ASSERT_EQUAL(prefix.size(), exact.size());
+        for (size_t i = 0; i < exact.size(); ++i) {
+            ASSERT_EQUAL(prefix[i].id, exact[i].id);
+            ASSERT(std::abs(prefix[i].relevance - exact[i].relevance) < epsilon);
+        }
+        const auto fuzzy = server.FindTopDocuments<Bm25Scorer>("cot~1"s);
+        ASSERT_EQUAL(fuzzy.size(), exact.size());
+        ASSERT(std::abs(fuzzy[0].relevance - exact[0].relevance / 2) < epsilon);
+    }
+    {
+        const auto trace = server.ExplainQuery<Bm25Scorer>("dog"s);
+        ASSERT_EQUAL(trace.plus_terms.size(), 1u);
+        ASSERT(std::abs(trace.plus_terms[0].inverse_document_freq - log(2.0)) < epsilon);
+    }
+    {
+        // Removal updates the average length
+        server.RemoveDocument(3);
+        const auto found = server.FindTopDocuments<Bm25Scorer>("dog"s);
+        const double idf = log(1.0 + 1.5 / 2.5);
+        const double norm = 1.0 - 0.75 + 0.75 * 1 / (6 / 3.0);
+        ASSERT_EQUAL(found[1].id, 2);
+        ASSERT(std::abs(found[1].relevance - idf * 2.2 / (1 + 1.2 * norm)) < epsilon);
+    }
+}
+
+void TestPositionList() {
+    PositionList positions;
+    ASSERT(positions.empty());
+    ASSERT(positions.begin() == positions.end());
+
+    const vector<uint32_t> values = {0, 1, 127, 128, 300, 20'000, 5'000'000};
+    for (const uint32_t value : values) {
+        positions.Append(value);
+    }
+    ASSERT_EQUAL(positions.size(), values.size());
+    ASSERT(vector<uint32_t>(positions.begin(), positions.end()) == values);
+    // Small gaps take a byte, the last one takes four
+    ASSERT(positions.GetEncodedBytes() >= 11u);
+
+    ASSERT_THROWS(positions.Append(300), invalid_argument);
+}
+
+void TestPhraseQuery() {
+    SearchServer server("the and"s, SearchServerOptions{true});
+    server.AddDocument(1, "white cat and black dog"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "black cat and white dog"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "the white cat the cat"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(4, "cat white"s, DocumentStatus::ACTUAL, {4});
+
+    const auto ids = [&server](string_view query) {
+        set<int> result;
+        for (const auto &document : server.FindTopDocuments(query)) {
+            result.insert(document.id);
+        }
+        return result;
+    };
+
+    ASSERT(ids("\"white cat\""s) == (set{1, 3}));
+    ASSERT(ids("\"white cat\" dog"s) == (set{1, 3}));
+    ASSERT(ids("\"black dog\""s) == (set{1}));
+    ASSERT(ids("\" black dog \""s) == (set{1}));
+    // Stop words are not indexed, but keep their place in the phrase
+    ASSERT(ids("\"cat and white\""s) == (set{2}));
+    ASSERT(ids("\"cat the white\""s) == (set{2}));
+    ASSERT(ids("\"cat white\""s) == (set{4}));
+    ASSERT(ids("\"white cat\" \"black dog\""s) == (set{1}));
+    ASSERT(ids("cat -\"white cat\""s) == (set{2, 4}));
+    ASSERT(ids("\"white parrot\""s).empty());
+    ASSERT(ids("\"cat\" -\"cat\""s).empty());
+
+    const auto query = server.PrepareQuery("cat \"white and dog\" -\"black\""s);
+    ASSERT(query.GetPhrases() ==
+           (vector<vector<string_view>>{{"white"sv, "dog"sv}, {"black"sv}}));
+    ASSERT(query.GetPlusWords() == (vector{"cat"sv, "dog"sv, "white"sv}));
+    ASSERT(get<0>(server.MatchDocument(query, 1)).empty());
+    ASSERT(get<0>(server.MatchDocument(server.PrepareQuery("\"white cat\""s), 3)) ==
+           (vector{"cat"s, "white"s}));
+    ASSERT(get<0>(server.MatchDocument(execution::par, server.PrepareQuery("\"white cat\""s),
+                                       4))
+               .empty());
+
+    for (const auto &bad_query : {"\"white cat"s, "\"white -cat\""s, "wh\"ite"s}) {
+        ASSERT_THROWS(server.FindTopDocuments(bad_query), invalid_argument);
+    }
+
+    ASSERT(server.GetMemoryStats().positions.bytes > 0);
+    server.RemoveDocument(1);
+    server.RemoveDocument(execution::par, 3);
+    ASSERT(ids("\"white cat\""s).empty());
+    server.RemoveDocument(2);
+    server.RemoveDocument(4);
+    ASSERT_EQUAL(server.GetMemoryStats().positions.bytes, 0u);
+
+    // Encoded positions are counted, not estimated: a byte per position at least
+    string long_text;
+    for (int i = 0; i < 1000; ++i) {
+        long_text += "cat "s;
+    }
+    server.AddDocument(5, long_text, DocumentStatus::ACTUAL, {1});
+    ASSERT(server.GetMemoryStats().positions.bytes >= 1000u);
+    server.UpdateDocument(5, long_text + long_text, DocumentStatus::ACTUAL, {1});
+    ASSERT(server.GetMemoryStats().positions.bytes >= 2000u);
+    server.RemoveDocument(5);
+    ASSERT_EQUAL(server.GetMemoryStats().positions.bytes, 0u);
+
+    SearchServer without_positions("and"s);
+    without_positions.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(without_positions.GetMemoryStats().positions.bytes, 0u);
+    ASSERT_THROWS(without_positions.FindTopDocuments("\"white cat\""s), invalid_argument);
+}
+
+void TestPrefixQuery() {
+    SearchServer server("and"s, SearchServerOptions{false, 2});
+    server.AddDocument(1, "cat and catalog"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "cats and dogs"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "category"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(4, "cat dog"s, DocumentStatus::ACTUAL, {4});
+    server.AddDocument(5, "dog cat"s, DocumentStatus::ACTUAL, {5});
+
+    const auto ids = [&server](string_view query) {
+        set<int> result;
+        for (const auto &document : server.FindTopDocuments(query)) {
+            result.insert(document.id);
+        }
+        return result;
+    };
+
+    // cat is the most frequent word, then the first one of the rest in the dictionary order
+    const auto query = server.PrepareQuery("cat*"s);
+    ASSERT(query.GetExpandedWords() == (vector{"cat"sv, "catalog"sv}));
+    ASSERT(ids("cat*"s) == (set{1, 4, 5}));
+    ASSERT(ids("dog*"s) == (set{2, 4, 5}));
+    ASSERT(ids("dog* -cat*"s) == (set{2}));
+    ASSERT(ids("bird*"s).empty());
+    // Stop words are not in the index
+    ASSERT(ids("and*"s).empty());
+
+    // Scores are the same as of the words written out
+    SearchServer unlimited("and"s);
+    for (const int id : {1, 2, 3, 4, 5}) {
+        const auto &words = server.GetWordFrequencies(id);
+        string text;
+        for (const auto &[word, _] : words) {
+            text += string(word) + ' ';
+        }
+        text.pop_back();
+        unlimited.AddDocument(id, text, DocumentStatus::ACTUAL, {id});
+    }
+    const auto expanded = unlimited.FindTopDocuments("ca*"s);
+    const auto written = unlimited.FindTopDocuments("cat catalog cats category"s);
+    ASSERT_EQUAL(expanded.size(), written.size());
+    for (size_t i = 0; i < expanded.size(); ++i) {
+        ASSERT_EQUAL(expanded[i].id, written[i].id);
+        ASSERT(abs(expanded[i].relevance - written[i].relevance) < 1e-6);
+    }
+
+    ASSERT(get<0>(server.MatchDocument(server.PrepareQuery("cat cat*"s), 1)) ==
+           (vector{"cat"s, "catalog"s}));
+    ASSERT(get<0>(server.MatchDocument(execution::par, server.PrepareQuery("dog* -cat*"s), 2)) ==
+           vector{"dogs"s});
+    ASSERT(get<0>(server.MatchDocument(server.PrepareQuery("dog -cat*"s), 4)).empty());
+
+    // A prepared query picks up new words
+    server.AddDocument(6, "catalog catalog cattle"s, DocumentStatus::ACTUAL, {6});
+    ASSERT(ids("cat*"s) == (set{1, 4, 5, 6}));
+    ASSERT(query.GetExpandedWords() == (vector{"cat"sv, "catalog"sv}));
+
+    const auto trace = server.ExplainQuery("cat*"s);
+    ASSERT_EQUAL(trace.plus_terms.size(), 1u);
+    ASSERT_EQUAL(trace.plus_terms[0].word, "cat*"s);
+    ASSERT_EQUAL(trace.plus_terms[0].expansions, 2u);
+    ASSERT_EQUAL(trace.plus_terms[0].posting_length, 4u);
+}
+
+// Edit distance computed directly, to check the automaton against
+int GetEditDistance(string_view lhs, string_view rhs) {
+    vector<int> row(rhs.size() + 1);
+    for (size_t j = 0; j < row.size(); ++j) {
+        row[j] = static_cast<int>(j);
+    }
+    for (size_t i = 1; i <= lhs.size(); ++i) {
+        int diagonal = row[0];
+        row[0] = static_cast<int>(i);
+        for (size_t j = 1; j <= rhs.size(); ++j) {
+            const int above = row[j];
+            row[j] = min({row[j] + 1, row[j - 1] + 1,
+                          diagonal + (lhs[i - 1] == rhs[j - 1] ? 0 : 1)});
+            diagonal = above;
+        }
+    }
+    return row.back();
+}
+
+void TestFuzzyQuery() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "kitten"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "sitting"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "mitten and kitchen"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(4, "kitty"s, DocumentStatus::ACTUAL, {4});
+    server.AddDocument(5, "dog"s, DocumentStatus::ACTUAL, {5});
+
+    ASSERT(server.PrepareQuery("kitten~0"s).GetExpandedWords() == vector{"kitten"sv});
+    ASSERT(server.PrepareQuery("kitten~1"s).GetExpandedWords() ==
+           (vector{"kitten"sv, "mitten"sv}));
+    ASSERT(server.PrepareQuery("kitten~2"s).GetExpandedWords() ==
+           (vector{"kitchen"sv, "kitten"sv, "kitty"sv, "mitten"sv}));
+    ASSERT(server.PrepareQuery("kiten~1"s).GetExpandedWords() == vector{"kitten"sv});
+    ASSERT(server.PrepareQuery("og~1"s).GetExpandedWords() == vector{"dog"sv});
+    ASSERT(server.PrepareQuery("dgo~1"s).GetExpandedWords().empty());
+
+    // Closer words score higher
+    const auto found = server.FindTopDocuments("kitten~2"s);
+    ASSERT_EQUAL(found.size(), 3u);
+    ASSERT_EQUAL(found[0].id, 1);
+    ASSERT(found[0].relevance > found[1].relevance);
+    ASSERT(server.FindTopDocuments("kitten~1 -mitten~0"s).size() == 1u);
+    ASSERT(get<0>(server.MatchDocument(server.PrepareQuery("kitten~1"s), 3)) ==
+           vector{"mitten"s});
+
+    ASSERT_THROWS(server.FindTopDocuments("kitten~3"s), invalid_argument);
+    ASSERT(server.FindTopDocuments("kitten~"s).empty());
+
+    // The automaton agrees with the plain edit distance on a generated vocabulary
+    DatasetOptions options;
+    options.vocabulary_size = 2'000;
+    options.max_word_length = 6;
+    options.document_count = 300;
+    options.query_count = 0;
+    const auto dataset = DatasetGenerator(options).Generate();
+    SearchServerOptions server_options;
+    server_options.max_term_expansions = 10'000;
+    SearchServer generated(vector<string>{}, server_options);
+    for (const auto &document : dataset.documents) {
+        generated.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    set<string_view> indexed_words;
+    for (const auto &document : dataset.documents) {
+        for (const auto &[word, _] : generated.GetWordFrequencies(document.id)) {
+            indexed_words.insert(word);
+        }
+    }
+    for (const auto &pattern : {"abc"s, "q"s, "zzzz"s, dataset.vocabulary[7],
+                                dataset.vocabulary[100]}) {
+        for (const int edits : {1, 2}) {
+            vector<string_view> expected;
+            for (const auto word : indexed_words) {
+                if (GetEditDistance(word, pattern) <= edits) {
+                    expected.push_back(word);
+                }
+            }
+            const auto query = generated.PrepareQuery(pattern + '~' + to_string(edits));
+            ASSERT(query.GetExpandedWords() == expected);
+        }
+    }
+}
+
+bool HaveSameDocuments(const vector<Document> &lhs, const vector<Document> &rhs) {
+    return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                 [](const Document &l, const Document &r) {
+                     return l.id == r.id && l.relevance == r.relevance && l.rating == r.rating;
+                 });
+}
+
+bool HaveSameDocuments(const vector<vector<Document>> &lhs, const vector<vector<Document>> &rhs) {
+    return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                 [](const auto &l, const auto &r) { return HaveSameDocuments(l, r); });
+}
+
+void TestSeekPosting() {
+    PostingList postings;
+    MergedPostings merged_postings;
+    for (int document_id = 0; document_id < 1'000; document_id += 3) {
+        postings[document_id] = document_id / 10.0;
+        merged_postings.emplace_back(document_id, document_id / 10.0);
+    }
+
+    // Near and far targets, present and absent, from the start and from the middle
+    for (const int start : {0, 1, 299, 500}) {
+        for (const int target : {-1, 0, 1, 2, 3, 13, 14, 300, 301, 997, 998, 999, 5'000}) {
+            const int expected = target <= start ? -1 : target;
+            const auto it = SeekPosting(postings, postings.lower_bound(start), target);
+            const auto merged_it = SeekPosting(
+                merged_postings,
+                std::lower_bound(merged_postings.begin(), merged_postings.end(),
+                                 std::pair{start, 0.0}),
+                target);
+            if (expected < 0) {
+                // Seeking backwards stays in place
+                ASSERT(it == postings.lower_bound(start));
+                continue;
+            }
+            const auto etalon = postings.lower_bound(expected);
+            ASSERT(it == etalon);
+            ASSERT_EQUAL(merged_it - merged_postings.begin(),
+                         distance(postings.begin(), etalon));
+        }
+    }
+
+    const vector<int> document_ids = {0, 1, 2, 3, 299, 300, 997, 1'000};
+    const MergedPostings expected = {{0, 0 / 10.0}, {3, 3 / 10.0}, {300, 300 / 10.0}};
+    ASSERT(IntersectPostings(postings, document_ids) == expected);
+    ASSERT(IntersectPostings(merged_postings, document_ids) == expected);
+    ASSERT(IntersectPostings(postings, {}).empty());
+}
+
+void TestRequiredWords() {
+    SearchServer server("and"s);
+    server.AddDocument(0, "white cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(1, "white cat and black dog"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(3, "white parrot"s, DocumentStatus::ACTUAL, {4});
+
+    const auto get_ids = [](const vector<Document> &documents) {
+        vector<int> ids;
+        for (const auto &document : documents) {
+            ids.push_back(document.id);
+        }
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    ASSERT(get_ids(server.FindTopDocuments("white dog"s)) == vector<int>({0, 1, 2, 3}));
+    ASSERT(get_ids(server.FindTopDocuments("white +dog"s)) == vector<int>({1, 2}));
+    ASSERT(get_ids(server.FindTopDocuments("+white +dog"s)) == vector<int>({1}));
+    ASSERT(get_ids(server.FindTopDocuments("+white +dog -cat"s)).empty());
+    ASSERT(get_ids(server.FindTopDocuments("+white cat +wh*"s)) == vector<int>({0, 1, 3}));
+    ASSERT(get_ids(server.FindTopDocuments("+cot~1 dog"s)) == vector<int>({0, 1}));
+    ASSERT(get_ids(server.FindTopDocuments("+white +fish"s)).empty());
+    // A required stop word is still a stop word
+    ASSERT(get_ids(server.FindTopDocuments("+and dog"s)) == vector<int>({1, 2}));
+    // Required copies win over plain ones
+    ASSERT(get_ids(server.FindTopDocuments("dog +dog"s)) == vector<int>({1, 2}));
+
+    // Survivors score the same as without the requirement
+    {
+        const auto any = server.FindTopDocuments("white black dog"s);
+        const auto required = server.FindTopDocuments("white +black dog"s);
+        ASSERT_EQUAL(required.size(), 2u);
+        for (const auto &document : required) {
+            const auto same = find_if(any.begin(), any.end(), [&document](const auto &other) {
+                return other.id == document.id;
+            });
+            ASSERT(same != any.end());
+            ASSERT(std::abs(same->relevance - document.relevance) < 1e-6);
+        }
+    }
+
+    {
+        const auto query = server.PrepareQuery("white dog"s, QueryMode::ALL);
+        ASSERT(query.GetRequiredWords() == vector<string_view>({"dog"sv, "white"sv}));
+        ASSERT(get_ids(server.FindTopDocuments(query)) == vector<int>({1}));
+        ASSERT(server.PrepareQuery("white +dog"s).GetRequiredWords() ==
+               vector<string_view>({"dog"sv}));
+        ASSERT(server.PrepareQuery("white dog"s).GetRequiredWords().empty());
+    }
+    {
+        const auto [words, status] = server.MatchDocument("white +dog"s, 0);
+        ASSERT(words.empty());
+        const auto [par_words, par_status] = server.MatchDocument(execution::par, "+cat"s, 3);
+        ASSERT(par_words.empty());
+        const auto [matched_words, matched_status] = server.MatchDocument("+white dog"s, 1);
+        ASSERT(matched_words == vector<string>({"dog"s, "white"s}));
+    }
+    {
+        SearchServerOptions options;
+        options.query_mode = QueryMode::ALL;
+        SearchServer all_terms_server(""s, options);
+        all_terms_server.AddDocument(0, "white cat"s, DocumentStatus::ACTUAL, {1});
+        all_terms_server.AddDocument(1, "white dog"s, DocumentStatus::ACTUAL, {1});
+        ASSERT(get_ids(all_terms_server.FindTopDocuments("white dog"s)) == vector<int>({1}));
+        ASSERT(get_ids(all_terms_server.FindTopDocuments(execution::par, "white"s)) ==
+               vector<int>({0, 1}));
+        ASSERT(get_ids(all_terms_server.FindTopDocuments(
+                   all_terms_server.PrepareQuery("white dog"s, QueryMode::ANY))) ==
+               vector<int>({0, 1}));
+    }
+
+    ASSERT_THROWS(server.FindTopDocuments("+"s), invalid_argument);
+    ASSERT_THROWS(server.FindTopDocuments("++cat"s), invalid_argument);
+    ASSERT_THROWS(server.FindTopDocuments("+-cat"s), invalid_argument);
+    ASSERT_THROWS(server.FindTopDocuments("-+cat"s), invalid_argument);
+}
+
+void TestDocumentFilter() {
+    DocumentFilter filter;
+    ASSERT(filter(-5, DocumentStatus::REMOVED, numeric_limits<int>::min()));
+    filter.SetStatuses({DocumentStatus::ACTUAL, DocumentStatus::BANNED})
+        .SetRatingRange(-2, 3)
+        .SetIdRange(10, 100)
+        .DenyIds({50, 20, 50});
+    ASSERT(filter(10, DocumentStatus::BANNED, -2));
+    ASSERT(filter(100, DocumentStatus::ACTUAL, 3));
+    ASSERT(!filter(10, DocumentStatus::IRRELEVANT, 0));
+    ASSERT(!filter(10, DocumentStatus::ACTUAL, 4));
+    ASSERT(!filter(10, DocumentStatus::ACTUAL, -3));
+    ASSERT(!filter(101, DocumentStatus::ACTUAL, 0));
+    ASSERT(!filter(50, DocumentStatus::ACTUAL, 0));
+    ASSERT(filter.GetDeniedIds() == vector<int>({20, 50}));
+    ASSERT(!filter.IsEmpty());
+    ASSERT(!filter.RestrictCandidates(nullopt).has_value());
+    ASSERT(filter.RestrictCandidates(vector<int>{1, 10, 60, 100, 200}) ==
+           vector<int>({10, 60, 100}));
+
+    filter.AllowIds({90, 5, 60}).AllowIds({60, 90, 7});
+    ASSERT(filter.RestrictCandidates(nullopt) == vector<int>({60, 90}));
+    ASSERT(filter.RestrictCandidates(vector<int>{1, 60}) == vector<int>({60}));
+    ASSERT(!filter(70, DocumentStatus::ACTUAL, 0));
+
+    ASSERT(DocumentFilter().SetRatingRange(1, 0).IsEmpty());
+    ASSERT(!DocumentFilter().SetRatingRange(1, 0)(1, DocumentStatus::ACTUAL, 1));
+    ASSERT(DocumentFilter().SetStatuses({}).IsEmpty());
+    ASSERT(DocumentFilter().AllowIds({}).IsEmpty());
+
+    PostingList postings;
+    for (const int document_id : {1, 3, 5, 7}) {
+        postings.emplace(document_id, 1.0);
+    }
+    const auto [first, last] = SlicePostings(postings, 2, 5);
+    ASSERT_EQUAL(first->first, 3);
+    ASSERT_EQUAL(distance(first, last), 2);
+    const MergedPostings merged(postings.begin(), postings.end());
+    ASSERT_EQUAL(distance(SlicePostings(merged, 6, numeric_limits<int>::max()).first,
+                          merged.end()),
+                 1);
+
+    // Pushed down filters find what the same conditions as a lambda find
+    DatasetOptions options;
+    options.vocabulary_size = 100;
+    options.document_count = 300;
+    options.mean_document_length = 10.0;
+    options.query_count = 30;
+    const auto dataset = DatasetGenerator(options).Generate();
+    const auto server = MakeSearchServer(dataset);
+    auto queries = dataset.queries;
+    queries.push_back("+"s + dataset.vocabulary[0] + " "s + dataset.vocabulary[1]);
+    queries.push_back(dataset.vocabulary[2].substr(0, 1) + "*"s);
+
+    vector<int> allowed;
+    for (int document_id = 0; document_id < 300; document_id += 2) {
+        allowed.push_back(document_id);
+    }
+    const vector<DocumentFilter> filters = {
+        DocumentFilter().SetStatus(DocumentStatus::IRRELEVANT),
+        DocumentFilter().SetRatingRange(2, 4).SetIdRange(50, 250),
+        DocumentFilter().AllowIds(allowed).DenyIds({0, 10, 12}).SetIdRange(5, 290),
+        DocumentFilter().SetIdRange(290, 1000),
+    };
+    for (const auto &query : queries) {
+        for (const auto &filter : filters) {
+            const auto lambda = [&filter](int document_id, DocumentStatus status, int rating) {
+                return filter(document_id, status, rating);
+            };
+            const auto expected = server.FindTopDocuments(query, lambda);
+            ASSERT(HaveSameDocuments(server.FindTopDocuments(query, filter), expected));
+            ASSERT(HaveSameDocuments(server.FindTopDocuments(execution::par, query, filter),
+                                     expected));
+            ASSERT(HaveSameDocuments(server.FindTopDocuments<Bm25Scorer>(query, filter),
+                                     server.FindTopDocuments<Bm25Scorer>(query, lambda)));
+        }
+    }
+}
+
+void TestRatingIndex() {
+    SearchServer server(""s);
+    server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(2, "cat dog"s, DocumentStatus::ACTUAL, {5});
+    server.AddDocument(3, "dog"s, DocumentStatus::BANNED, {3});
+    server.AddDocument(4, "owl"s, DocumentStatus::ACTUAL, {-1});
+    ASSERT(server.GetDocumentsByRating(3, 5) == vector<int>({2, 3, 1}));
+    ASSERT(server.GetDocumentsByRating(-10, 10) == vector<int>({2, 3, 1, 4}));
+    ASSERT(server.GetDocumentsByRating(4, 3).empty());
+    server.RemoveDocument(2);
+    ASSERT(server.GetDocumentsByRating(3, 5) == vector<int>({3, 1}));
+    ASSERT_EQUAL(server.GetMemoryStats().rating_index.elements, 3u);
+
+    // Rating ordered results, from the rating index and from a whole search
+    DatasetOptions options;
+    options.vocabulary_size = 50;
+    options.document_count = 3000;
+    options.mean_document_length = 8.0;
+    options.query_count = 20;
+    options.max_rating_count = 1;
+    options.rating_stddev = 20.0;
+    const auto dataset = DatasetGenerator(options).Generate();
+    const auto rated_server = MakeSearchServer(dataset);
+    auto queries = dataset.queries;
+    queries.push_back(dataset.vocabulary[0]);
+    queries.push_back(dataset.vocabulary[45]);
+    for (const auto &query : queries) {
+        map<int, int> ratings;
+        const auto record_rating = [&ratings](int document_id, DocumentStatus, int rating) {
+            ratings[document_id] = rating;
+            return true;
+        };
+        rated_server.FindTopDocuments(query, record_rating);
+        const auto prepared = rated_server.PrepareQuery(query);
+        vector<int> expected_ratings;
+        for (const auto &[document_id, rating] : ratings) {
+            const auto [words, status] = rated_server.MatchDocument(prepared, document_id);
+            if (!words.empty() && status == DocumentStatus::ACTUAL) {
+                expected_ratings.push_back(rating);
+            }
+        }
+        sort(expected_ratings.rbegin(), expected_ratings.rend());
+        expected_ratings.resize(min<size_t>(expected_ratings.size(), MAX_RESULT_DOCUMENT_COUNT));
+
+        const auto found = rated_server.FindTopRatedDocuments(query);
+        ASSERT_EQUAL(found.size(), expected_ratings.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            ASSERT_EQUAL(found[i].rating, expected_ratings[i]);
+            const auto same = rated_server.FindTopDocuments(
+                query, [id = found[i].id](int document_id, DocumentStatus status, int) {
+                    return document_id == id && status == DocumentStatus::ACTUAL;
+                });
+            ASSERT_EQUAL(same.size(), 1u);
+            ASSERT(std::abs(same[0].relevance - found[i].relevance) < 1e-9);
+            if (i > 0 && found[i].rating == found[i - 1].rating) {
+                ASSERT(found[i].relevance <= found[i - 1].relevance + 1e-6);
+            }
+        }
+    }
+
+    // A selective rating range is served by the index
+    for (const auto &query : queries) {
+        const auto filter = DocumentFilter().SetRatingRange(10, 12);
+        const auto lambda = [](int, DocumentStatus, int rating) {
+            return rating >= 10 && rating <= 12;
+        };
+        ASSERT(HaveSameDocuments(rated_server.FindTopDocuments(query, filter),
+                                 rated_server.FindTopDocuments(query, lambda)));
+        ASSERT(HaveSameDocuments(rated_server.FindTopRatedDocuments(query, filter),
+                                 rated_server.FindTopRatedDocuments(query, lambda)));
+    }
+}
+
+void TestImpactIndex() {
+    SearchServer server(""s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "cat cat dog"s, DocumentStatus::BANNED, {3});
+    ASSERT(!server.HasImpactIndex());
+    ASSERT(HaveSameDocuments(server.FindTopDocumentsByImpact("cat"s),
+                             server.FindTopDocuments("cat"s)));
+    server.BuildImpactIndex<Bm25Scorer>();
+    ASSERT(server.HasImpactIndex<Bm25Scorer>());
+    ASSERT(!server.HasImpactIndex<TfIdfScorer>());
+    ASSERT(server.GetImpactQuantum() > 0.0);
+    ASSERT_EQUAL(server.GetMemoryStats().impact_index.elements, 4u + 6u);
+    // Document ids of the postings are allocated through the counter of the index
+    ASSERT(server.GetMemoryStats().impact_index.bytes >= 6 * sizeof(int));
+    ASSERT(HaveSameDocuments(server.FindTopDocumentsByImpact<Bm25Scorer>("cat dog -black"s),
+                             server.FindTopDocuments<Bm25Scorer>("cat dog -black"s)));
+    ASSERT(HaveSameDocuments(
+        server.FindTopDocumentsByImpact<Bm25Scorer>("cat"s, DocumentStatus::BANNED),
+        server.FindTopDocuments<Bm25Scorer>("cat"s, DocumentStatus::BANNED)));
+    server.AddDocument(4, "cat"s, DocumentStatus::ACTUAL, {4});
+    ASSERT(!server.HasImpactIndex<Bm25Scorer>());
+    ASSERT_EQUAL(server.GetMemoryStats().impact_index.bytes, 0u);
+
+    // On a generated collection the choice of documents is off by the documented bound at most
+    DatasetOptions options;
+    options.vocabulary_size = 300;
+    options.document_count = 2000;
+    options.mean_document_length = 12.0;
+    options.query_count = 30;
+    const auto dataset = DatasetGenerator(options).Generate();
+    auto generated = MakeSearchServer(dataset);
+    generated.BuildImpactIndex();
+    ASSERT(generated.GetMemoryStats().impact_index.bytes * 4 <
+           generated.GetMemoryStats().word_to_document_freqs.bytes);
+    for (const auto &query : dataset.queries) {
+        const auto all = generated.FindDocumentsPage(query, {0, 1'000'000, nullopt}).documents;
+        map<int, double> relevances;
+        for (const auto &document : all) {
+            relevances[document.id] = document.relevance;
+        }
+        const auto found = generated.FindTopDocumentsByImpact(query);
+        ASSERT_EQUAL(found.size(), min<size_t>(all.size(), MAX_RESULT_DOCUMENT_COUNT));
+        ASSERT(is_sorted(found.begin(), found.end(), IsRankedBefore));
+        const double error_bound = generated.GetImpactQuantum() *
+                                   static_cast<double>(generated.PrepareQuery(query)
+                                                           .GetPlusWords()
+                                                           .size());
+        for (const auto &document : found) {
+            ASSERT_EQUAL(relevances.count(document.id), 1u);
+            ASSERT(std::abs(relevances.at(document.id) - document.relevance) < 1e-9);
+            ASSERT(document.relevance >= all[found.size() - 1].relevance - error_bound - 1e-9);
+        }
+    }
+}
+
+void TestDocumentAtATime() {
+    DatasetOptions options;
+    options.vocabulary_size = 200;
+    options.document_count = 1500;
+    options.mean_document_length = 10.0;
+    options.query_count = 30;
+    const auto dataset = DatasetGenerator(options).Generate();
+    SearchServerOptions taat_options;
+    taat_options.store_positions = true;
+    auto daat_options = taat_options;
+    daat_options.evaluation = QueryEvaluation::DOCUMENT_AT_A_TIME;
+    SearchServer taat(dataset.stop_words, taat_options);
+    SearchServer daat(dataset.stop_words, daat_options);
+    for (const auto &document : dataset.documents) {
+        taat.AddDocument(document.id, document.text, document.status, document.ratings);
+        daat.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+
+    // Patterns, required words, phrases and minus words, next to the generated queries
+    auto queries = dataset.queries;
+    const auto &words = dataset.vocabulary;
+    queries.push_back(words[0].substr(0, 1) + "* "s + words[1]);
+    queries.push_back(words[2] + "~1 -"s + words[0]);
+    queries.push_back("+"s + words[0] + " "s + words[3] + " -"s + words[4].substr(0, 1) + "*"s);
+    const auto first_words = SplitIntoWords(dataset.documents[7].text);
+    queries.push_back("\""s + string(first_words[0]) + " "s + string(first_words[1]) + "\" "s +
+                      words[5]);
+    queries.push_back(words[1] + " -\""s + string(first_words[0]) + " "s +
+                      string(first_words[1]) + "\""s);
+
+    auto filter = DocumentFilter().SetIdRange(100, 900).SetRatingRange(-5, 20);
+    filter.DenyIds({101, 150, 200, 333});
+    const auto allowed = DocumentFilter().AllowIds({5, 50, 500, 700, 1000, 1400});
+    // Ids that are not in the index are allowed, but match nothing
+    const auto unknown = DocumentFilter().AllowIds({50, 1400, 5000, 99999});
+    const auto odd = [](int document_id, DocumentStatus, int) { return document_id % 2 == 1; };
+    for (const auto &query : queries) {
+        ASSERT(HaveSameDocuments(daat.FindTopDocuments(query), taat.FindTopDocuments(query)));
+        ASSERT(HaveSameDocuments(daat.FindTopDocuments<Bm25Scorer>(query),
+                                 taat.FindTopDocuments<Bm25Scorer>(query)));
+        ASSERT(HaveSameDocuments(daat.FindTopDocuments(query, DocumentStatus::BANNED),
+                                 taat.FindTopDocuments(query, DocumentStatus::BANNED)));
+        ASSERT(HaveSameDocuments(daat.FindTopDocuments<Bm25PlusScorer>(query, filter),
+                                 taat.FindTopDocuments<Bm25PlusScorer>(query, filter)));
+        ASSERT(HaveSameDocuments(daat.FindTopDocuments(query, allowed),
+                                 taat.FindTopDocuments(query, allowed)));
+        ASSERT(HaveSameDocuments(daat.FindTopDocuments(query, unknown),
+                                 taat.FindTopDocuments(query, unknown)));
+        ASSERT(HaveSameDocuments(daat.FindTopDocuments(query, odd),
+                                 taat.FindTopDocuments(query, odd)));
+        ASSERT(HaveSameDocuments(daat.FindTopDocuments(execution::par, query),
+                                 taat.FindTopDocuments(query)));
+    }
+}
+
+void TestUpdateDocument() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat and dog"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, {2});
+    server.UpdateDocument(1, "white owl owl"s, DocumentStatus::ACTUAL, {5});
+    ASSERT(server.FindTopDocuments("dog"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments("owl"s).at(0).rating, 5);
+    ASSERT_EQUAL(server.GetWordFrequencies(1).at("owl"sv), 2.0 / 3.0);
+
+    server.UpdateDocument(2, DocumentStatus::BANNED, {-4, -2});
+    ASSERT(server.FindTopDocuments("cat"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s, DocumentStatus::BANNED).at(0).rating, -3);
+    ASSERT(server.GetDocumentsByRating(-3, -3) == vector<int>({2}));
+
+    ASSERT_THROWS(server.UpdateDocument(3, "cat"s, DocumentStatus::ACTUAL, {1}),
+                  invalid_argument);
+    ASSERT_THROWS(server.UpdateDocument(3, DocumentStatus::ACTUAL, {1}), invalid_argument);
+    // An invalid text leaves the document as it was
+    ASSERT_THROWS(server.UpdateDocument(1, "white c\at"s, DocumentStatus::ACTUAL, {1}),
+                  invalid_argument);
+    ASSERT_EQUAL(server.FindTopDocuments("owl"s).size(), 1u);
+    server.UpdateDocument(1, "and"s, DocumentStatus::ACTUAL, {1});
+    ASSERT(server.FindTopDocuments("white owl"s).empty());
+    ASSERT(server.GetWordFrequencies(1).empty());
+    server.UpdateDocument(1, "white"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server.FindTopDocuments("white"s).size(), 1u);
+
+    // Updated in place, the index is the same as one built with the final texts
+    DatasetOptions options;
+    options.vocabulary_size = 150;
+    options.document_count = 400;
+    options.mean_document_length = 8.0;
+    options.query_count = 20;
+    const auto dataset = DatasetGenerator(options).Generate();
+    SearchServerOptions server_options;
+    server_options.store_positions = true;
+    SearchServer updated(dataset.stop_words, server_options);
+    SearchServer rebuilt(dataset.stop_words, server_options);
+    const auto &documents = dataset.documents;
+    for (const auto &document : documents) {
+        updated.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const auto &document = documents[i];
+        // Every third document gets the text of another one, every fifth new metadata
+        const auto &text = i % 3 == 0 ? documents[(i * 7 + 1) % documents.size()].text
+                                      : document.text;
+        const auto status = i % 5 == 0 ? DocumentStatus::IRRELEVANT : document.status;
+        const auto ratings = i % 5 == 0 ? vector<int>{static_cast<int>(i % 11)} : document.ratings;
+        if (i % 3 == 0) {
+            updated.UpdateDocument(document.id, text, status, ratings);
+        } else if (i % 5 == 0) {
+            updated.UpdateDocument(document.id, status, ratings);
+        }
+        rebuilt.AddDocument(document.id, text, status, ratings);
+    }
+    ASSERT_EQUAL(updated.GetMemoryStats().word_to_document_freqs.elements,
+                 rebuilt.GetMemoryStats().word_to_document_freqs.elements);
+    ASSERT(updated.GetDocumentsByRating(-100, 100) == rebuilt.GetDocumentsByRating(-100, 100));
+    for (const auto &document : documents) {
+        ASSERT(updated.GetWordFrequencies(document.id) == rebuilt.GetWordFrequencies(document.id));
+    }
+    auto queries = dataset.queries;
+    const auto first_words = SplitIntoWords(documents[3].text);
+    queries.push_back("\""s + string(first_words[0]) + " "s + string(first_words[1]) + "\""s);
+    for (const auto &query : queries) {
+        ASSERT(HaveSameDocuments(updated.FindTopDocuments<Bm25Scorer>(query),
+                                 rebuilt.FindTopDocuments<Bm25Scorer>(query)));
+        ASSERT(HaveSameDocuments(updated.FindTopDocuments(query, DocumentStatus::IRRELEVANT),
+                                 rebuilt.FindTopDocuments(query, DocumentStatus::IRRELEVANT)));
+    }
+}
+
+void TestWriteAheadLog() {
+    const auto directory = filesystem::temp_directory_path() / "search_server_wal_test"s;
+    filesystem::remove_all(directory);
+    filesystem::create_directories(directory);
+    const auto path = (directory / "log"s).string();
+
+    WalOptions wal_options;
+    wal_options.group_commit_size = 2;
+    wal_options.group_commit_delay = chrono::milliseconds(0);
+    wal_options.sync = false;
+    size_t valid_size = 0;
+    {
+        WriteAheadLog log(path, wal_options);
+        ASSERT_EQUAL(log.Append({0, WalRecordType::ADD, 7, DocumentStatus::BANNED, {1, -2}, "cat"s}),
+                     1u);
+        ASSERT_EQUAL(log.GetCommittedSequence(), 0u);
+        ASSERT_EQUAL(log.Append({0, WalRecordType::REMOVE, 3}), 2u);
+        // A full group is written at once
+        ASSERT_EQUAL(log.GetCommittedSequence(), 2u);
+        log.Append({0, WalRecordType::UPDATE_METADATA, 7, DocumentStatus::ACTUAL, {5}});
+    }
+    auto records = WriteAheadLog::ReadRecords(path, &valid_size);
+    ASSERT_EQUAL(records.size(), 3u);
+    ASSERT_EQUAL(valid_size, filesystem::file_size(path));
+    ASSERT(records[0].type == WalRecordType::ADD);
+    ASSERT_EQUAL(records[0].document_id, 7);
+    ASSERT(records[0].status == DocumentStatus::BANNED);
+    ASSERT(records[0].ratings == vector<int>({1, -2}));
+    ASSERT_EQUAL(records[0].text, "cat"s);
+    ASSERT(records[1].type == WalRecordType::REMOVE);
+    ASSERT_EQUAL(records[2].sequence, 3u);
+    ASSERT(records[2].ratings == vector<int>({5}));
+
+    // A record torn by a crash is ignored and then cut off
+    {
+        ofstream out(path, ios::binary | ios::app);
+        out << "\x20\0\0\0torn"s;
+    }
+    ASSERT_EQUAL(WriteAheadLog::ReadRecords(path).size(), 3u);
+    {
+        WriteAheadLog log(path, wal_options);
+        ASSERT_EQUAL(filesystem::file_size(path), valid_size);
+        ASSERT_EQUAL(log.Append({0, WalRecordType::REMOVE, 7}), 4u);
+    }
+    records = WriteAheadLog::ReadRecords(path);
+    ASSERT_EQUAL(records.size(), 4u);
+    ASSERT_EQUAL(records.back().document_id, 7);
+
+    // The background committer writes a group that does not fill up
+    {
+        WalOptions delayed_options = wal_options;
+        delayed_options.group_commit_size = 1000;
+        delayed_options.group_commit_delay = chrono::milliseconds(1);
+        WriteAheadLog log(path, delayed_options);
+        log.Append({0, WalRecordType::REMOVE, 8});
+        while (log.GetCommittedSequence() < 5u) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        ASSERT_EQUAL(WriteAheadLog::ReadRecords(path).size(), 5u);
+    }
+
+    // A server reopened from the snapshot and the log is the same as one never closed
+    DatasetOptions options;
+    options.vocabulary_size = 150;
+    options.document_count = 300;
+    options.mean_document_length = 8.0;
+    options.query_count = 20;
+    const auto dataset = DatasetGenerator(options).Generate();
+    SearchServerOptions server_options;
+    server_options.store_positions = true;
+    SearchServer reference(dataset.stop_words, server_options);
+    const auto server_directory = (directory / "server"s).string();
+    const auto &documents = dataset.documents;
+    auto queries = dataset.queries;
+    const auto first_words = SplitIntoWords(documents[5].text);
+    queries.push_back("\""s + string(first_words[0]) + " "s + string(first_words[1]) + "\""s);
+    const auto check_reopened = [&] {
+        DurableSearchServer reopened(server_directory,
+                                     SearchServer(dataset.stop_words, server_options),
+                                     wal_options);
+        ASSERT_EQUAL(reopened.GetServer().GetDocumentCount(), reference.GetDocumentCount());
+        ASSERT(reopened.GetServer().GetDocumentsByRating(-100, 100) ==
+               reference.GetDocumentsByRating(-100, 100));
+        for (const auto &query : queries) {
+            ASSERT(HaveSameDocuments(reopened.GetServer().FindTopDocuments<Bm25Scorer>(query),
+                                     reference.FindTopDocuments<Bm25Scorer>(query)));
+            ASSERT(HaveSameDocuments(
+                reopened.GetServer().FindTopDocuments(query, DocumentStatus::IRRELEVANT),
+                reference.FindTopDocuments(query, DocumentStatus::IRRELEVANT)));
+        }
+        return reopened.GetLastSequence();
+    };
+    {
+        DurableSearchServer server(server_directory,
+                                   SearchServer(dataset.stop_words, server_options),
+                                   wal_options);
+        for (size_t i = 0; i < documents.size() / 2; ++i) {
+            const auto &document = documents[i];
+            server.AddDocument(document.id, document.text, document.status, document.ratings);
+            reference.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        // Invalid changes are neither applied nor logged
+        ASSERT_THROWS(server.AddDocument(documents[0].id, "cat"s, DocumentStatus::ACTUAL, {1}),
+                      invalid_argument);
+        server.RemoveDocument(-1);
+        ASSERT_EQUAL(server.GetLastSequence(), documents.size() / 2);
+    }
+    ASSERT_EQUAL(check_reopened(), documents.size() / 2);
+    {
+        DurableSearchServer server(server_directory,
+                                   SearchServer(dataset.stop_words, server_options),
+                                   wal_options);
+        server.Checkpoint();
+        ASSERT_EQUAL(filesystem::file_size(directory / "server"s / "wal"s), 0u);
+        for (size_t i = documents.size() / 2; i < documents.size(); ++i) {
+            const auto &document = documents[i];
+            server.AddDocument(document.id, document.text, document.status, document.ratings);
+            reference.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        for (size_t i = 0; i < documents.size(); i += 7) {
+            const auto &text = documents[(i * 3 + 1) % documents.size()].text;
+            server.UpdateDocument(documents[i].id, text, DocumentStatus::IRRELEVANT, {3});
+            reference.UpdateDocument(documents[i].id, text, DocumentStatus::IRRELEVANT, {3});
+            server.RemoveDocument(documents[i + 1].id);
+            reference.RemoveDocument(documents[i + 1].id);
+            server.UpdateDocument(documents[i + 2].id, DocumentStatus::BANNED, {-4});
+            reference.UpdateDocument(documents[i + 2].id, DocumentStatus::BANNED, {-4});
+        }
+        server.Commit();
+    }
+    const uint64_t last_sequence = check_reopened();
+    {
+        DurableSearchServer server(server_directory,
+                                   SearchServer(dataset.stop_words, server_options),
+                                   wal_options);
+        server.Checkpoint();
+    }
+    // Sequences go on after a checkpoint emptied the log
+    ASSERT_EQUAL(check_reopened(), last_sequence);
+    filesystem::remove_all(directory);
+}
+
+void TestWriteAheadLogFailure() {
+    const auto directory = filesystem::temp_directory_path() / "search_server_wal_failure"s;
+    filesystem::remove_all(directory);
+    filesystem::create_directories(directory);
+    const auto path = (directory / "log"s).string();
+
+    // A file size limit makes writes of the log fail part way, as a full disk would
+    rlimit old_limit{};
+    getrlimit(RLIMIT_FSIZE, &old_limit);
+    const auto old_handler = signal(SIGXFSZ, SIG_IGN);
+    const auto limit_file_size = [&old_limit](rlim_t size) {
+        rlimit limit = old_limit;
+        limit.rlim_cur = size;
+        setrlimit(RLIMIT_FSIZE, &limit);
+    };
+    const WalRecord big_record{0, WalRecordType::ADD, 2, DocumentStatus::ACTUAL, {1},
+                               string(1'000, 'x')};
+
+    WalOptions wal_options;
+    wal_options.group_commit_size = 100;
+    wal_options.group_commit_delay = chrono::milliseconds(0);
+    wal_options.sync = false;
+    {
+        WriteAheadLog log(path, wal_options);
+        log.Append({0, WalRecordType::REMOVE, 1});
+        log.Commit();
+        const auto committed_size = filesystem::file_size(path);
+
+        limit_file_size(committed_size + 10);
+        log.Append(big_record);
+        ASSERT_THROWS(log.Commit(), runtime_error);
+        limit_file_size(old_limit.rlim_cur);
+
+        // The torn group is cut off and the log stays failed
+        ASSERT(log.IsFailed());
+        ASSERT_EQUAL(filesystem::file_size(path), committed_size);
+        ASSERT_EQUAL(log.GetCommittedSequence(), 1u);
+        ASSERT_THROWS(log.Append({0, WalRecordType::REMOVE, 3}), runtime_error);
+        ASSERT_THROWS(log.Commit(), runtime_error);
+    }
+    ASSERT_EQUAL(WriteAheadLog::ReadRecords(path).size(), 1u);
+
+    // A group that fails in the background is reported to the next writer
+    wal_options.group_commit_delay = chrono::milliseconds(1);
+    {
+        WriteAheadLog log(path, wal_options);
+        const auto committed_size = filesystem::file_size(path);
+        limit_file_size(committed_size + 10);
+        log.Append(big_record);
+        for (int i = 0; i < 5'000 && !log.IsFailed(); ++i) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        limit_file_size(old_limit.rlim_cur);
+        ASSERT(log.IsFailed());
+        ASSERT_THROWS(log.Append({0, WalRecordType::REMOVE, 3}), runtime_error);
+        ASSERT_EQUAL(filesystem::file_size(path), committed_size);
+    }
+    ASSERT_EQUAL(WriteAheadLog::ReadRecords(path).size(), 1u);
+
+    signal(SIGXFSZ, old_handler);
+    filesystem::remove_all(directory);
+}
+
+void TestClone() {
+    DatasetOptions options;
+    options.vocabulary_size = 150;
+    options.document_count = 300;
+    options.mean_document_length = 8.0;
+    options.query_count = 20;
+    const auto dataset = DatasetGenerator(options).Generate();
+    SearchServerOptions server_options;
+    server_options.store_positions = true;
+    const auto original = [&] {
+        SearchServer server(dataset.stop_words, server_options);
+        for (const auto &document : dataset.documents) {
+            server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        return server;
+    }();
+    SearchServer server = original;
+    server.BuildImpactIndex();
+    const auto prepared = server.PrepareQuery(dataset.queries[0]);
+
+    // A clone shares the structures, queries prepared for the original work on it
+    SearchServer clone = server.Clone();
+    ASSERT(clone.HasImpactIndex());
+    ASSERT(HaveSameDocuments(clone.FindTopDocuments(prepared),
+                             server.FindTopDocuments(prepared)));
+    ASSERT(clone.GetWordFrequencies(5).begin() == server.GetWordFrequencies(5).begin());
+
+    // Changes of either one are not seen by the other
+    const auto &document = dataset.documents[5];
+    clone.UpdateDocument(document.id, DocumentStatus::BANNED, {100});
+    ASSERT(server.GetDocumentStatus(document.id) == document.status);
+    ASSERT_EQUAL(clone.GetDocumentRating(document.id), 100);
+    // A metadata change leaves the postings shared
+    ASSERT(clone.GetWordFrequencies(5).begin() == server.GetWordFrequencies(5).begin());
+    for (int id = 0; id < 300; id += 2) {
+        clone.RemoveDocument(id);
+    }
+    clone.RemoveDocument(execution::par, 299);
+    clone.AddDocument(1000, "brand new words"s, DocumentStatus::ACTUAL, {1});
+    ASSERT(!clone.HasImpactIndex());
+    ASSERT(server.HasImpactIndex());
+    ASSERT_EQUAL(server.GetDocumentCount(), 300);
+    ASSERT(server.FindTopDocuments("brand"s).empty());
+
+    // Words released by the clone stay readable for the server, and new ones do not
+    // overwrite them
+    server.RemoveDocument(document.id);
+    SearchServer reference = original;
+    reference.RemoveDocument(document.id);
+    for (const auto &query : dataset.queries) {
+        ASSERT(HaveSameDocuments(server.FindTopDocuments<Bm25Scorer>(query),
+                                 reference.FindTopDocuments<Bm25Scorer>(query)));
+    }
+    for (int id = 0; id < 300; ++id) {
+        ASSERT(server.GetWordFrequencies(id) == reference.GetWordFrequencies(id));
+    }
+    ASSERT_EQUAL(clone.FindTopDocuments("brand"s).size(), 1u);
+}
+
+struct TestStaticConfig : SearchServerConfig {
+    static constexpr auto STOP_WORDS = MakeStaticStopWordSet("and", "in", "the");
+    static constexpr size_t TOP_K = 12;
+    using Scorer = Bm25Scorer;
+};
+
+struct TestStaticTaatConfig : TestStaticConfig {
+    static constexpr size_t TOP_K = 3;
+    static constexpr QueryMode QUERY_MODE = QueryMode::ALL;
+    static constexpr QueryEvaluation EVALUATION = QueryEvaluation::TERM_AT_A_TIME;
+};
+
+struct TestStaticPositionsConfig : TestStaticConfig {
+    static constexpr bool STORE_POSITIONS = true;
+};
+
+void TestStaticSearchServer() {
+    DatasetOptions options;
+    options.vocabulary_size = 150;
+    options.document_count = 300;
+    options.mean_document_length = 8.0;
+    options.query_count = 30;
+    const auto dataset = DatasetGenerator(options).Generate();
+
+    StaticSearchServer<TestStaticConfig> server;
+    StaticSearchServer<TestStaticTaatConfig> taat_server;
+    SearchServer reference("and in the"s);
+    SearchServerOptions all_options;
+    all_options.query_mode = QueryMode::ALL;
+    SearchServer all_reference("and in the"s, all_options);
+    for (const auto &document : dataset.documents) {
+        server.AddDocument(document.id, document.text, document.status, document.ratings);
+        taat_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        reference.AddDocument(document.id, document.text, document.status, document.ratings);
+        all_reference.AddDocument(document.id, document.text, document.status,
+                                  document.ratings);
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), 300);
+
+    // The same ranking as a SearchServer, only with a top of its own size
+    const auto top_documents = [](const SearchServer &server, string_view query, size_t top_k) {
+        PageRequest page;
+        page.limit = top_k;
+        return server.FindDocumentsPage<Bm25Scorer>(query, page).documents;
+    };
+    size_t max_found = 0;
+    for (const auto &query : dataset.queries) {
+        const auto found = server.FindTopDocuments(query);
+        max_found = max(max_found, found.size());
+        ASSERT(found.size() <= 12u);
+        ASSERT(HaveSameDocuments(found, top_documents(reference, query, 12)));
+        ASSERT(HaveSameDocuments(server.FindTopDocuments(server.PrepareQuery(query)), found));
+        ASSERT(HaveSameDocuments(taat_server.FindTopDocuments(query),
+                                 top_documents(all_reference, query, 3)));
+    }
+    ASSERT(max_found > static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+    // Stop words are not indexed
+    ASSERT(server.FindTopDocuments("the"s).empty());
+    const auto [words, status] = server.MatchDocument("the "s + dataset.queries[0],
+                                                      dataset.documents[0].id);
+    ASSERT(find(words.begin(), words.end(), "the"s) == words.end());
+
+    const auto &document = dataset.documents[0];
+    server.RemoveDocument(document.id);
+    ASSERT_EQUAL(server.GetServer().GetDocumentCount(), 299);
+
+    // Stop words still take positions, so phrases over them match as in a SearchServer
+    StaticSearchServer<TestStaticPositionsConfig> positions_server;
+    SearchServerOptions positions_options;
+    positions_options.store_positions = true;
+    positions_options.evaluation = QueryEvaluation::DOCUMENT_AT_A_TIME;
+    SearchServer positions_reference("and in the"s, positions_options);
+    for (const auto &[id, text] : {pair{1, "cat in the hat"s}, pair{2, "cat hat in the city"s},
+                                   pair{3, "the cat and the hat"s}}) {
+        positions_server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+        positions_reference.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+    }
+    for (const auto &query : {"\"cat hat\""s, "\"cat in the hat\""s, "hat -\"cat hat\""s}) {
+        ASSERT(HaveSameDocuments(positions_server.FindTopDocuments(query),
+                                 positions_reference.FindTopDocuments<Bm25Scorer>(query)));
+    }
+    ASSERT_EQUAL(positions_server.GetServer().GetDocumentText(1), "cat and and hat"s);
+}
+
+void TestExplainQuery() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "cat and dog"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "cat with collar"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "cat and bird"s, DocumentStatus::BANNED, {3});
+    server.AddDocument(4, "cat and d\\og"s, DocumentStatus::ACTUAL, {4});
+
+    for (const auto &trace : {server.ExplainQuery("cat and parrot -collar"s),
+                              server.ExplainQuery(execution::par, "cat and parrot -collar"s)}) {
+        ASSERT_EQUAL(trace.plus_terms.size(), 2u);
+        ASSERT_EQUAL(trace.plus_terms[0].word, "cat"s);
+        ASSERT_EQUAL(trace.plus_terms[0].posting_length, 4u);
+        ASSERT_EQUAL(trace.plus_terms[0].documents, 3u);
+        ASSERT(trace.plus_terms[0].inverse_document_freq == 0.0);
+        ASSERT_EQUAL(trace.plus_terms[1].word, "parrot"s);
+        ASSERT_EQUAL(trace.plus_terms[1].posting_length, 0u);
+        ASSERT_EQUAL(trace.minus_terms.size(), 1u);
+        ASSERT_EQUAL(trace.minus_terms[0].word, "collar"s);
+        ASSERT_EQUAL(trace.minus_terms[0].documents, 1u);
+        ASSERT(trace.stop_words == vector{"and"s});
+
+        ASSERT_EQUAL(trace.postings_scanned, 5u);
+        ASSERT_EQUAL(trace.postings_accepted, 3u);
+        ASSERT_EQUAL(trace.documents_scored, 3u);
+        ASSERT_EQUAL(trace.documents_excluded, 1u);
+        ASSERT_EQUAL(trace.candidate_count, 2u);
+        ASSERT_EQUAL(trace.results.size(), 2u);
+        ASSERT_EQUAL(trace.results[0].id, 4);
+        ASSERT_EQUAL(trace.stage_durations.size(), 5u);
+        ASSERT(trace.stage_durations.front().first == SearchStage::PARSE_QUERY);
+        ASSERT(trace.stage_durations.back().first == SearchStage::SORT_RESULTS);
+    }
+
+    const auto trace = server.ExplainQuery("d\\og -collar"s, DocumentStatus::ACTUAL);
+    ASSERT_EQUAL(trace.results.size(), 1u);
+    const auto json = trace.ToJson();
+    ASSERT(json.find("{\"query\":\"d\\\\og -collar\""s) == 0);
+    ASSERT(json.find("\"minus_terms\":[{\"word\":\"collar\",\"posting_length\":1,"s) !=
+           string::npos);
+    ASSERT(json.find("\"stage\":\"parse_query\""s) != string::npos);
+    ASSERT(json.find("\"results\":[{\"id\":4,"s) != string::npos);
+
+    // Only the postings in the id range of a filter and of the candidates are visited
+    const auto filter = DocumentFilter().SetStatus(DocumentStatus::ACTUAL).SetIdRange(2, 3);
+    const auto sliced = server.ExplainQuery("cat"s, filter);
+    ASSERT_EQUAL(sliced.plus_terms[0].posting_length, 4u);
+    ASSERT_EQUAL(sliced.postings_scanned, 2u);
+    ASSERT_EQUAL(sliced.postings_accepted, 1u);
+    const auto required = server.ExplainQuery("cat +collar"s);
+    ASSERT_EQUAL(required.postings_scanned, 2u);
+    ASSERT_EQUAL(required.postings_accepted, 2u);
+}
+
 void TestPaginator() {
     SearchServer server = GetSearchServer();
     const auto search_results = server.FindTopDocuments("dog cat"s);
@@ -447,6 +1994,127 @@ void TestPaginator() {
         const auto pages = Paginate(search_results, static_cast<size_t>(5));
         ASSERT_EQUAL(pages.size(), 1u);
     }
+
+    // Pages are made on demand, by number or one after another
+    const vector<int> numbers = {1, 2, 3, 4, 5, 6, 7};
+    const auto pages = Paginate(numbers, 3);
+    ASSERT_EQUAL(pages.size(), 3u);
+    ASSERT_EQUAL(pages[1].size(), 3u);
+    ASSERT_EQUAL(*pages[1].begin(), 4);
+    ASSERT_EQUAL(pages[2].size(), 1u);
+    ASSERT_EQUAL(*pages[2].begin(), 7);
+    vector<size_t> sizes;
+    for (const auto &page : pages) {
+        sizes.push_back(page.size());
+    }
+    ASSERT(sizes == vector<size_t>({3, 3, 1}));
+
+    const list<int> linked(numbers.begin(), numbers.end());
+    sizes.clear();
+    for (const auto &page : Paginate(linked, 4)) {
+        sizes.push_back(page.size());
+    }
+    ASSERT(sizes == vector<size_t>({4, 3}));
+    ASSERT_EQUAL(Paginate(vector<int>{}, 2).size(), 0u);
+    ASSERT(Paginate(vector<int>{}, 2).begin() == Paginate(vector<int>{}, 2).end());
+}
+
+void TestSearchPages() {
+    DatasetOptions options;
+    options.vocabulary_size = 100;
+    options.document_count = 500;
+    options.mean_document_length = 10.0;
+    options.query_count = 10;
+    const auto dataset = DatasetGenerator(options).Generate();
+    const auto server = MakeSearchServer(dataset);
+    SearchServerOptions daat_options;
+    daat_options.evaluation = QueryEvaluation::DOCUMENT_AT_A_TIME;
+    SearchServer daat_server(dataset.stop_words, daat_options);
+    for (const auto &document : dataset.documents) {
+        daat_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+
+    for (const auto &query : dataset.queries) {
+        const auto all = server.FindDocumentsPage(query, {0, 1'000'000, nullopt}).documents;
+        ASSERT(!server.FindDocumentsPage(query, {0, 1'000'000, nullopt}).next);
+        ASSERT(is_sorted(all.begin(), all.end(), IsRankedBefore));
+        ASSERT(HaveSameDocuments(server.FindDocumentsPage(query, {0, 5, nullopt}).documents,
+                                 server.FindTopDocuments(query)));
+
+        // Cursors and offsets walk through the same order
+        vector<Document> by_cursor;
+        PageRequest request{0, 7, nullopt};
+        for (;;) {
+            const auto page = server.FindDocumentsPage(query, request);
+            by_cursor.insert(by_cursor.end(), page.documents.begin(), page.documents.end());
+            if (!page.next) {
+                break;
+            }
+            // The heap of a document-at-a-time search takes the cursor into account
+            const auto daat_page = daat_server.FindDocumentsPage(query, request);
+            ASSERT(HaveSameDocuments(daat_page.documents, page.documents));
+            ASSERT_EQUAL(daat_page.next.has_value(), page.next.has_value());
+            request.search_after = DecodeCursor(EncodeCursor(*page.next));
+        }
+        ASSERT(HaveSameDocuments(by_cursor, all));
+
+        vector<Document> by_offset;
+        for (size_t offset = 0; offset < all.size(); offset += 7) {
+            const auto page = server.FindDocumentsPage(query, {offset, 7, nullopt});
+            by_offset.insert(by_offset.end(), page.documents.begin(), page.documents.end());
+        }
+        ASSERT(HaveSameDocuments(by_offset, all));
+
+        if (all.size() > 4) {
+            const auto page = server.FindDocumentsPage(query, {2, 2, MakeCursor(all[0])});
+            ASSERT(HaveSameDocuments(page.documents, {all[3], all[4]}));
+        }
+        ASSERT(server.FindDocumentsPage(query, {all.size(), 5, nullopt}).documents.empty());
+    }
+
+    // Relevance steps below the display tolerance still get a strict order, so pages of
+    // such a run neither overlap nor skip documents
+    vector<Document> close_documents;
+    for (int id = 0; id < 60; ++id) {
+        close_documents.emplace_back(id, (id % 20) * 4e-7, (id * 7) % 5);
+    }
+    vector<Document> sorted_documents = close_documents;
+    sort(sorted_documents.begin(), sorted_documents.end(), IsRankedBefore);
+    for (size_t i = 1; i < sorted_documents.size(); ++i) {
+        ASSERT(IsRankedBefore(sorted_documents[i - 1], sorted_documents[i]));
+    }
+    vector<Document> walked;
+    optional<SearchCursor> after;
+    while (walked.size() < close_documents.size()) {
+        vector<Document> rest;
+        for (const auto &document : close_documents) {
+            if (!after || IsAfterCursor(document, *after)) {
+                rest.push_back(document);
+            }
+        }
+        const size_t page_size = min<size_t>(7, rest.size());
+        partial_sort(rest.begin(), rest.begin() + page_size, rest.end(), IsRankedBefore);
+        walked.insert(walked.end(), rest.begin(), rest.begin() + page_size);
+        after = MakeCursor(rest[page_size - 1]);
+    }
+    ASSERT(HaveSameDocuments(walked, sorted_documents));
+
+    // Relevances that differ by float noise are equal, the higher rating goes first as with
+    // IsMoreRelevant; clearly different ones are ordered by relevance
+    const Document noisy{1, 0.5000004, 1};
+    const Document better_rated{2, 0.5000005, 9};
+    ASSERT(IsRankedBefore(better_rated, noisy) == IsMoreRelevant(better_rated, noisy));
+    ASSERT(IsRankedBefore(better_rated, noisy));
+    ASSERT(IsRankedBefore(Document{0, 0.5000004, 9}, better_rated));
+    ASSERT(IsRankedBefore(Document{4, 0.5000025, 1}, better_rated));
+
+    const SearchCursor cursor{0.25, -3, 42};
+    const auto decoded = DecodeCursor(EncodeCursor(cursor));
+    ASSERT_EQUAL(decoded.relevance, 0.25);
+    ASSERT_EQUAL(decoded.rating, -3);
+    ASSERT_EQUAL(decoded.id, 42);
+    ASSERT_THROWS(DecodeCursor("abc"s), invalid_argument);
+    ASSERT_THROWS(DecodeCursor(string(32, 'x')), invalid_argument);
 }
 
 void TestRequestQueue() {
@@ -516,6 +2184,340 @@ void TestRemoveDuplicates() {
     ASSERT_EQUAL(server.GetDocumentCount(), 5);
 }
 
+void TestZipfDistribution() {
+    const ZipfDistribution zipf(100, 1.0);
+    ASSERT_EQUAL(zipf(0.0), 0u);
+    ASSERT_EQUAL(zipf(0.999999), 99u);
+
+    vector<int> counts(100);
+    for (int i = 0; i < 10'000; ++i) {
+        ++counts[zipf((i + 0.5) / 10'000)];
+    }
+    // The first rank is twice as frequent as the second and far more than the last one
+    ASSERT(abs(counts[0] - 2 * counts[1]) < 50);
+    ASSERT(counts[0] > 50 * counts[99]);
+}
+
+void TestDatasetGenerator() {
+    DatasetOptions options;
+    options.vocabulary_size = 500;
+    options.stop_word_count = 3;
+    options.document_count = 200;
+    options.query_count = 300;
+    options.distinct_query_count = 20;
+    options.min_query_length = 2;
+    options.max_query_length = 4;
+
+    const auto dataset = DatasetGenerator(options).Generate();
+    ASSERT_EQUAL(dataset.vocabulary.size(), 500u);
+    ASSERT_EQUAL(set(dataset.vocabulary.begin(), dataset.vocabulary.end()).size(), 500u);
+    ASSERT(dataset.stop_words == vector(dataset.vocabulary.begin(),
+                                        dataset.vocabulary.begin() + 3));
+    ASSERT_EQUAL(dataset.documents.size(), 200u);
+    ASSERT_EQUAL(dataset.queries.size(), 300u);
+    ASSERT(set(dataset.queries.begin(), dataset.queries.end()).size() <= 20u);
+    for (const auto &query : dataset.queries) {
+        const auto words = count(query.begin(), query.end(), ' ') + 1;
+        ASSERT(words >= 2 && words <= 4);
+    }
+
+    // Same seed gives the same dataset, another seed gives another one
+    const auto same = DatasetGenerator(options).Generate();
+    ASSERT(same.vocabulary == dataset.vocabulary);
+    ASSERT(same.queries == dataset.queries);
+    ASSERT_EQUAL(same.documents.back().text, dataset.documents.back().text);
+    ASSERT(same.documents.back().ratings == dataset.documents.back().ratings);
+    options.seed += 1;
+    ASSERT(DatasetGenerator(options).Generate().vocabulary != dataset.vocabulary);
+
+    const auto server = MakeSearchServer(dataset);
+    ASSERT_EQUAL(server.GetDocumentCount(), 200);
+    ASSERT(server.GetWordFrequencies(0).count(dataset.stop_words[0]) == 0);
+}
+
+void TestWriteReadDataset() {
+    DatasetOptions options;
+    options.vocabulary_size = 100;
+    options.document_count = 20;
+    options.query_count = 10;
+    const auto dataset = DatasetGenerator(options).Generate();
+
+    const auto directory = (filesystem::temp_directory_path() / "search_server_dataset_test"s)
+                               .string();
+    WriteDataset(dataset, directory);
+    const auto read = ReadDataset(directory);
+    filesystem::remove_all(directory);
+
+    ASSERT(read.vocabulary == dataset.vocabulary);
+    ASSERT(read.stop_words == dataset.stop_words);
+    ASSERT(read.queries == dataset.queries);
+    ASSERT_EQUAL(read.documents.size(), dataset.documents.size());
+    for (size_t i = 0; i < read.documents.size(); ++i) {
+        ASSERT_EQUAL(read.documents[i].id, dataset.documents[i].id);
+        ASSERT_EQUAL(read.documents[i].text, dataset.documents[i].text);
+        ASSERT(read.documents[i].status == dataset.documents[i].status);
+        ASSERT(read.documents[i].ratings == dataset.documents[i].ratings);
+    }
+}
+
+template <typename Scorer>
+void CheckShardedRanking(const SearchServer &server,
+                         const ShardedSearchServer &sharded,
+                         const string &query) {
+    const auto expected = server.FindTopDocuments<Scorer>(query);
+    const auto found = sharded.FindTopDocuments<Scorer>(execution::par, query);
+    ASSERT_EQUAL(found.size(), expected.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+        // Documents of equal relevance and rating may come in any order
+        ASSERT(std::abs(found[i].relevance - expected[i].relevance) < 1e-9);
+        ASSERT_EQUAL(found[i].rating, expected[i].rating);
+        const auto same = server.FindTopDocuments<Scorer>(
+            query, [id = found[i].id](int document_id, DocumentStatus status, int) {
+                return document_id == id && status == DocumentStatus::ACTUAL;
+            });
+        ASSERT_EQUAL(same.size(), 1u);
+        ASSERT(std::abs(same[0].relevance - found[i].relevance) < 1e-9);
+    }
+}
+
+void TestShardedSearchServer() {
+    DatasetOptions options;
+    options.vocabulary_size = 300;
+    options.stop_word_count = 2;
+    options.document_count = 300;
+    options.mean_document_length = 10.0;
+    options.query_count = 40;
+    options.distinct_query_count = 40;
+    options.minus_word_probability = 0.1;
+    const auto dataset = DatasetGenerator(options).Generate();
+
+    auto server = MakeSearchServer(dataset);
+    ShardedSearchServer sharded(4, dataset.stop_words);
+    for (const auto &document : dataset.documents) {
+        sharded.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    ASSERT_EQUAL(sharded.GetShardCount(), 4u);
+    ASSERT_EQUAL(sharded.GetDocumentCount(), server.GetDocumentCount());
+    ASSERT(vector<int>(sharded.begin(), sharded.end()) ==
+           vector<int>(server.begin(), server.end()));
+    ASSERT_EQUAL(sharded.GetStatistics().GetDocumentCount(), 300u);
+    for (size_t i = 0; i < sharded.GetShardCount(); ++i) {
+        ASSERT(sharded.GetShard(i).GetDocumentCount() < 100);
+    }
+    ASSERT(sharded.GetWordFrequencies(7) == server.GetWordFrequencies(7));
+
+    auto queries = dataset.queries;
+    queries.push_back(dataset.vocabulary[10].substr(0, 1) + "*"s);
+    for (const auto &query : queries) {
+        CheckShardedRanking<TfIdfScorer>(server, sharded, query);
+        CheckShardedRanking<Bm25Scorer>(server, sharded, query);
+    }
+
+    vector<int> document_ids = {5, 3, 8, 100};
+    const auto matched = sharded.MatchDocuments(queries[0], document_ids);
+    ASSERT_EQUAL(matched.size(), document_ids.size());
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        ASSERT(matched[i] == server.MatchDocument(queries[0], document_ids[i]));
+        ASSERT(sharded.MatchDocument(execution::par, queries[0], document_ids[i]) ==
+               server.MatchDocument(queries[0], document_ids[i]));
+    }
+
+    // Removals change the statistics of every shard
+    document_ids.clear();
+    for (int document_id = 0; document_id < 300; document_id += 3) {
+        document_ids.push_back(document_id);
+        server.RemoveDocument(document_id);
+    }
+    sharded.RemoveDocuments(document_ids);
+    sharded.RemoveDocument(execution::par, 1);
+    server.RemoveDocument(1);
+    ASSERT_EQUAL(sharded.GetDocumentCount(), server.GetDocumentCount());
+    ASSERT_EQUAL(sharded.GetStatistics().GetDocumentCount(),
+                 static_cast<size_t>(server.GetDocumentCount()));
+    for (const auto &query : queries) {
+        CheckShardedRanking<TfIdfScorer>(server, sharded, query);
+        CheckShardedRanking<Bm25PlusScorer>(server, sharded, query);
+    }
+
+    // A pattern of a prepared query is scored with the statistics of the search, even if
+    // another shard changed them since
+    const auto &shard = sharded.GetShard(0);
+    const auto prepared = shard.PrepareQuery(queries.back());
+    int other_id = 1000;
+    while (sharded.GetShardIndex(other_id) == 0) {
+        ++other_id;
+    }
+    sharded.AddDocument(other_id, dataset.documents[2].text, DocumentStatus::ACTUAL, {1});
+    ASSERT(HaveSameDocuments(shard.FindTopDocuments(prepared),
+                             shard.FindTopDocuments(queries.back())));
+    ASSERT(HaveSameDocuments(shard.FindTopDocuments<Bm25Scorer>(prepared),
+                             shard.FindTopDocuments<Bm25Scorer>(queries.back())));
+
+    // A copy of a shard ranks as the shard did, and counts its changes in statistics of its own
+    const size_t collection_size = sharded.GetStatistics().GetDocumentCount();
+    SearchServer copy = shard;
+    SearchServer clone = shard.Clone();
+    ASSERT(HaveSameDocuments(copy.FindTopDocuments(queries[0]),
+                             shard.FindTopDocuments(queries[0])));
+    copy.AddDocument(other_id + 1, "cat"s, DocumentStatus::ACTUAL, {});
+    clone.RemoveDocument(*shard.begin());
+    ASSERT_EQUAL(sharded.GetStatistics().GetDocumentCount(), collection_size);
+    sharded.RemoveDocument(other_id);
+
+    ASSERT_THROWS(sharded.FindTopDocuments("--cat"s), invalid_argument);
+    ASSERT_THROWS(sharded.AddDocument(2, "cat"s, DocumentStatus::ACTUAL, {}), invalid_argument);
+    ASSERT_THROWS(sharded.AddDocument(-1, "cat"s, DocumentStatus::ACTUAL, {}), invalid_argument);
+    ASSERT_THROWS(ShardedSearchServer(0, ""s), invalid_argument);
+}
+
+void TestSearchProtocol() {
+    string buffer;
+    WriteSearchRequest(buffer, 7, "cat -dog"s, DocumentStatus::BANNED);
+    WriteAddRequest(buffer, 8, 42, "white cat"s, DocumentStatus::ACTUAL, {1, -2, 3});
+
+    const auto search_size = GetFrameSize(buffer);
+    ASSERT(search_size.has_value());
+    const auto search = ParseSearchRequest(string_view(buffer).substr(0, *search_size));
+    ASSERT_EQUAL(search.id, 7u);
+    ASSERT(search.type == SearchRequestType::SEARCH);
+    ASSERT(search.status == DocumentStatus::BANNED);
+    ASSERT_EQUAL(search.text, "cat -dog"s);
+
+    const auto add = ParseSearchRequest(string_view(buffer).substr(*search_size));
+    ASSERT(add.type == SearchRequestType::ADD);
+    ASSERT_EQUAL(add.document_id, 42);
+    ASSERT(add.ratings == vector<int>({1, -2, 3}));
+    ASSERT_EQUAL(add.text, "white cat"s);
+
+    // An incomplete frame has no size yet, a cut one does not parse
+    ASSERT(!GetFrameSize(string_view(buffer).substr(0, *search_size - 1)));
+    ASSERT(!GetFrameSize(string_view(buffer).substr(0, 3)));
+    ASSERT_THROWS(ParseSearchRequest(string_view(buffer).substr(0, *search_size - 1)),
+                  invalid_argument);
+    string wrong_type = buffer.substr(0, *search_size);
+    wrong_type[8] = 9;
+    ASSERT_THROWS(ParseSearchRequest(wrong_type), invalid_argument);
+
+    buffer.clear();
+    WriteSearchResponse(buffer, 7, {{1, 0.5, 4}, {2, 0.25, -1}});
+    WriteMatchResponse(buffer, 9, {{"cat"s, "white"s}, DocumentStatus::IRRELEVANT});
+    WriteErrorResponse(buffer, 10, SearchRequestType::REMOVE, "No document"s);
+
+    string_view rest = buffer;
+    vector<SearchResponse> responses;
+    while (const auto size = GetFrameSize(rest)) {
+        responses.push_back(ParseSearchResponse(rest.substr(0, *size)));
+        rest.remove_prefix(*size);
+    }
+    ASSERT(rest.empty());
+    ASSERT_EQUAL(responses.size(), 3u);
+    ASSERT_EQUAL(responses[0].request_id, 7u);
+    ASSERT_EQUAL(responses[0].documents.size(), 2u);
+    ASSERT_EQUAL(responses[0].documents[1].id, 2);
+    ASSERT_EQUAL(responses[0].documents[1].relevance, 0.25);
+    ASSERT_EQUAL(responses[0].documents[1].rating, -1);
+    ASSERT(responses[1].words == vector<string>({"cat"s, "white"s}));
+    ASSERT(responses[1].status == DocumentStatus::IRRELEVANT);
+    ASSERT(responses[2].code == SearchResponseCode::ERROR);
+    ASSERT(responses[2].type == SearchRequestType::REMOVE);
+    ASSERT_EQUAL(responses[2].error, "No document"s);
+}
+
+void TestSearchService() {
+    DatasetOptions options;
+    options.vocabulary_size = 200;
+    options.document_count = 200;
+    options.mean_document_length = 10.0;
+    options.query_count = 50;
+    const auto dataset = DatasetGenerator(options).Generate();
+    auto server = MakeSearchServer(dataset);
+    const auto expected_server = MakeSearchServer(dataset);
+
+    SearchServiceOptions service_options;
+    service_options.unix_socket_path =
+        (filesystem::temp_directory_path() / "search_service_test.sock"s).string();
+    service_options.tcp_port = 0;
+    service_options.worker_count = 3;
+    SearchService service(server, service_options);
+    ASSERT(service.GetTcpPort() != 0);
+    thread loop([&service] { service.Run(); });
+
+    {
+        // Pipelined requests are answered in order
+        auto client = SearchClient::ConnectUnix(service_options.unix_socket_path);
+        vector<uint32_t> ids;
+        for (const auto &query : dataset.queries) {
+            ids.push_back(client.SendSearch(query));
+        }
+        client.Flush();
+        for (size_t i = 0; i < dataset.queries.size(); ++i) {
+            const auto response = client.Receive();
+            ASSERT_EQUAL(response.request_id, ids[i]);
+            ASSERT(response.code == SearchResponseCode::OK);
+            const auto expected = expected_server.FindTopDocuments(dataset.queries[i]);
+            ASSERT_EQUAL(response.documents.size(), expected.size());
+            for (size_t j = 0; j < expected.size(); ++j) {
+                ASSERT_EQUAL(response.documents[j].id, expected[j].id);
+                ASSERT_EQUAL(response.documents[j].relevance, expected[j].relevance);
+            }
+        }
+
+        ASSERT(client.MatchDocument(dataset.queries[0], 3) ==
+               expected_server.MatchDocument(dataset.queries[0], 3));
+        ASSERT_THROWS(client.FindTopDocuments("--cat"s), runtime_error);
+        ASSERT_THROWS(client.AddDocument(3, "cat"s, DocumentStatus::ACTUAL, {}), runtime_error);
+    }
+
+    auto client = SearchClient::ConnectTcp("127.0.0.1"s, service.GetTcpPort());
+    client.AddDocument(1000, "zzzunique word"s, DocumentStatus::ACTUAL, {5});
+    auto found = client.FindTopDocuments("zzzunique"s);
+    ASSERT_EQUAL(found.size(), 1u);
+    ASSERT_EQUAL(found[0].id, 1000);
+    ASSERT_EQUAL(found[0].rating, 5);
+    client.RemoveDocument(1000);
+    ASSERT(client.FindTopDocuments("zzzunique"s).empty());
+
+    service.Stop();
+    loop.join();
+    ASSERT_EQUAL(server.GetDocumentCount(), expected_server.GetDocumentCount());
+
+    // A connection with more queued than allowed is not read until it drains, requests keep
+    // their order
+    service_options.tcp_port.reset();
+    service_options.max_queued_size = 64;
+    SearchService throttled(server, service_options);
+    thread throttled_loop([&throttled] { throttled.Run(); });
+    {
+        auto throttled_client = SearchClient::ConnectUnix(service_options.unix_socket_path);
+        vector<uint32_t> ids;
+        for (int i = 0; i < 20; ++i) {
+            for (const auto &query : dataset.queries) {
+                ids.push_back(throttled_client.SendSearch(query));
+            }
+        }
+        throttled_client.Flush();
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const auto response = throttled_client.Receive();
+            ASSERT_EQUAL(response.request_id, ids[i]);
+            ASSERT(response.code == SearchResponseCode::OK);
+            const auto &query = dataset.queries[i % dataset.queries.size()];
+            ASSERT_EQUAL(response.documents.size(),
+                         expected_server.FindTopDocuments(query).size());
+        }
+
+        // A request larger than max_queued_size is still read whole and answered
+        string long_text;
+        while (long_text.size() < 256 * 1024) {
+            long_text += "zzzlong "s;
+        }
+        throttled_client.AddDocument(1001, long_text, DocumentStatus::ACTUAL, {1});
+        ASSERT_EQUAL(throttled_client.FindTopDocuments("zzzlong"s).size(), 1u);
+        throttled_client.RemoveDocument(1001);
+    }
+    throttled.Stop();
+    throttled_loop.join();
+}
+
 void TestProcessQueries() {
     SearchServer search_server("and with"s);
 
@@ -578,6 +2580,52 @@ void TestProcessQueriesJoined() {
     result.pop_front();
 }
 
+void TestNumaSearchServer() {
+    DatasetOptions options;
+    options.vocabulary_size = 200;
+    options.document_count = 200;
+    options.mean_document_length = 10.0;
+    options.query_count = 30;
+    const auto dataset = DatasetGenerator(options).Generate();
+    auto server = MakeSearchServer(dataset);
+
+    NumaSearchServer machine(server);
+    ASSERT(machine.GetNodeCount() >= 1u);
+
+    // Two unpinned replicas stand for two nodes on any machine
+    NumaSearchServer numa(server, {tbb::task_arena::automatic, tbb::task_arena::automatic});
+    ASSERT_EQUAL(numa.GetNodeCount(), 2u);
+    ASSERT(&numa.GetReplica(0) != &numa.GetReplica(1));
+    ASSERT_EQUAL(numa.GetDocumentCount(), server.GetDocumentCount());
+
+    const auto expected = ProcessQueries(server, dataset.queries);
+    ASSERT(HaveSameDocuments(ProcessQueries(numa, dataset.queries), expected));
+    ASSERT(HaveSameDocuments(ProcessQueries(machine, dataset.queries), expected));
+    ASSERT_EQUAL(ProcessQueriesJoined(numa, dataset.queries).size(),
+                 ProcessQueriesJoined(server, dataset.queries).size());
+    for (size_t i = 0; i < 4; ++i) {
+        ASSERT(HaveSameDocuments(numa.FindTopDocuments(execution::par, dataset.queries[i]),
+                                 expected[i]));
+        ASSERT(HaveSameDocuments(
+            numa.FindTopDocuments<Bm25Scorer>(dataset.queries[i], DocumentStatus::ACTUAL),
+            server.FindTopDocuments<Bm25Scorer>(dataset.queries[i], DocumentStatus::ACTUAL)));
+        ASSERT(numa.MatchDocument(dataset.queries[i], 5) ==
+               server.MatchDocument(dataset.queries[i], 5));
+    }
+
+    // Every replica is changed
+    numa.AddDocument(1000, "zzzunique word"s, DocumentStatus::ACTUAL, {1});
+    numa.RemoveDocument(3);
+    for (size_t i = 0; i < numa.GetNodeCount(); ++i) {
+        ASSERT_EQUAL(numa.GetReplica(i).FindTopDocuments("zzzunique"s).size(), 1u);
+        ASSERT_EQUAL(numa.GetReplica(i).GetDocumentCount(), server.GetDocumentCount());
+    }
+    ASSERT_THROWS(numa.AddDocument(1000, "cat"s, DocumentStatus::ACTUAL, {}), invalid_argument);
+    ASSERT_THROWS(numa.FindTopDocuments("--cat"s), invalid_argument);
+    ASSERT_EQUAL(server.GetDocumentCount(), 200);
+    ASSERT_THROWS(NumaSearchServer(server, {}), invalid_argument);
+}
+
 void TestAll() {
     TestRunner tr;
 
@@ -587,6 +2635,7 @@ void TestAll() {
     RUN_TEST(tr, TestStringConstructorWithSpecialCharacters);
     RUN_TEST(tr, TestVectorConstructorWithSpecialCharacters);
     RUN_TEST(tr, TestSetConstructorWithSpecialCharacters);
+    RUN_TEST(tr, TestStopWordSet);
 
     RUN_TEST(tr, TestAddDocWithNegativeID);
     RUN_TEST(tr, TestAddDocWithAddedID);
@@ -603,6 +2652,12 @@ void TestAll() {
     RUN_TEST(tr, TestMatchDocumentQueryWithDoubleMinus);
     RUN_TEST(tr, TestMatchDocumentQueryWithEmptyMinusWord);
 
+    RUN_TEST(tr, TestPreparedQueryFindTopDocuments);
+    RUN_TEST(tr, TestPreparedQueryWords);
+    RUN_TEST(tr, TestPreparedQueryAfterServerModification);
+    RUN_TEST(tr, TestPreparedQueryAfterServerAssignment);
+    RUN_TEST(tr, TestPreparedQueryMatchDocuments);
+
     RUN_TEST(tr, TestSortFoundDocumentsToRelevance);
     RUN_TEST(tr, TestFoundDocumentsPlusRating);
     RUN_TEST(tr, TestFoundDocumentsMinusRating);
@@ -614,15 +2669,55 @@ void TestAll() {
     RUN_TEST(tr, TestRemovedStatusFilterFoundDocuments);
 
     RUN_TEST(tr, TestRelevance);
+    RUN_TEST(tr, TestScorers);
+
+    RUN_TEST(tr, TestExplainQuery);
+
+    RUN_TEST(tr, TestPositionList);
+    RUN_TEST(tr, TestPhraseQuery);
+    RUN_TEST(tr, TestPrefixQuery);
+    RUN_TEST(tr, TestFuzzyQuery);
+    RUN_TEST(tr, TestSeekPosting);
+    RUN_TEST(tr, TestRequiredWords);
+    RUN_TEST(tr, TestDocumentFilter);
+    RUN_TEST(tr, TestRatingIndex);
+    RUN_TEST(tr, TestImpactIndex);
+    RUN_TEST(tr, TestDocumentAtATime);
 
     RUN_TEST(tr, TestPaginator);
+    RUN_TEST(tr, TestSearchPages);
 
     RUN_TEST(tr, TestRequestQueue);
 
     RUN_TEST(tr, TestRemoveDuplicates);
 
+    RUN_TEST(tr, TestStringPool);
+    RUN_TEST(tr, TestStringPoolCopy);
+    RUN_TEST(tr, TestRemoveDocumentReleasesWords);
+    RUN_TEST(tr, TestForwardIndex);
+    RUN_TEST(tr, TestUpdateDocument);
+    RUN_TEST(tr, TestWriteAheadLog);
+    RUN_TEST(tr, TestWriteAheadLogFailure);
+    RUN_TEST(tr, TestClone);
+    RUN_TEST(tr, TestStaticSearchServer);
+
+    RUN_TEST(tr, TestMemoryStats);
+
+    RUN_TEST(tr, TestLatencyHistogram);
+#ifdef SEARCH_SERVER_METRICS
+    RUN_TEST(tr, TestSearchMetrics);
+#endif
+
+    RUN_TEST(tr, TestZipfDistribution);
+    RUN_TEST(tr, TestDatasetGenerator);
+    RUN_TEST(tr, TestWriteReadDataset);
+    RUN_TEST(tr, TestShardedSearchServer);
+    RUN_TEST(tr, TestSearchProtocol);
+    RUN_TEST(tr, TestSearchService);
+
     RUN_TEST(tr, TestProcessQueries);
     RUN_TEST(tr, TestProcessQueriesJoined);
+    RUN_TEST(tr, TestNumaSearchServer);
 }
 
 int main() {
@@ -64,9 +64,10 @@ vector<string> GenerateQueries(mt19937 &generator,
 
 ///////////////////////////////////////////////////////////////////////////////
 
-template <typename QueriesProcessor>
+// A function pointer picks the SearchServer overload of the processor
+template <typename Result>
 void Test(string_view mark,
-          QueriesProcessor processor,
+          Result (*processor)(const SearchServer &, const vector<string> &),
           const SearchServer &search_server,
           const vector<string> &queries) {
     LOG_DURATION_STREAM(mark, cout);
@@ -93,7 +94,7 @@ void TestRemoveDocument(string_view mark,
 
 template <typename ExecutionPolicy>
 void TestMatchDocument(string_view mark,
-                       SearchServer search_server,
+                       const SearchServer &search_server,
                        const string &query,
                        ExecutionPolicy &&policy) {
     LOG_DURATION_STREAM(mark, cout);
@@ -109,6 +110,25 @@ void TestMatchDocument(string_view mark,
 #define TEST_MATCH_DOCUMENT(policy)                                                           \
     TestMatchDocument(#policy, search_server, query, execution::policy)
 
+template <typename ExecutionPolicy>
+void TestMatchPreparedDocument(string_view mark,
+                               const SearchServer &search_server,
+                               const string &raw_query,
+                               ExecutionPolicy &&policy) {
+    LOG_DURATION_STREAM(mark, cout);
+    const auto query = search_server.PrepareQuery(raw_query);
+    const int document_count = search_server.GetDocumentCount();
+    int word_count = 0;
+    for (int id = 0; id < document_count; ++id) {
+        const auto [words, status] = search_server.MatchDocument(policy, query, id);
+        word_count += words.size();
+    }
+    cout << "word count: "s << word_count << endl;
+}
+
+#define TEST_MATCH_PREPARED_DOCUMENT(policy)                                                  \
+    TestMatchPreparedDocument("prepared " #policy, search_server, query, execution::policy)
+
 template <typename ExecutionPolicy>
 void TestFindTopDocuments(string_view mark,
                           const SearchServer &search_server,
@@ -176,6 +196,8 @@ int main() {
         }
         TEST_MATCH_DOCUMENT(seq);
         TEST_MATCH_DOCUMENT(par);
+        TEST_MATCH_PREPARED_DOCUMENT(seq);
+        TEST_MATCH_PREPARED_DOCUMENT(par);
     }
 
     cout << endl;
@@ -0,0 +1,81 @@
+#include <dataset_generator.h>
+
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+
+using namespace std;
+
+namespace {
+void PrintUsage(const map<string, function<void(const string &)>> &setters) {
+    cerr << "Usage: generate_dataset --output=DIRECTORY [--option=value ...]\n"s
+         << "Options:"s;
+    for (const auto &[name, _] : setters) {
+        cerr << " --"s << name;
+    }
+    cerr << endl;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    DatasetOptions options;
+    string output;
+
+    const auto to_int = [](int &field) {
+        return [&field](const string &value) { field = stoi(value); };
+    };
+    const auto to_double = [](double &field) {
+        return [&field](const string &value) { field = stod(value); };
+    };
+    const map<string, function<void(const string &)>> setters = {
+        {"output"s, [&output](const string &value) { output = value; }},
+        {"seed"s, [&options](const string &value) { options.seed = stoul(value); }},
+        {"vocabulary"s, to_int(options.vocabulary_size)},
+        {"zipf"s, to_double(options.zipf_exponent)},
+        {"max-word-length"s, to_int(options.max_word_length)},
+        {"stop-words"s, to_int(options.stop_word_count)},
+        {"documents"s, to_int(options.document_count)},
+        {"mean-document-length"s, to_double(options.mean_document_length)},
+        {"document-length-sigma"s, to_double(options.document_length_sigma)},
+        {"max-document-length"s, to_int(options.max_document_length)},
+        {"max-rating-count"s, to_int(options.max_rating_count)},
+        {"mean-rating"s, to_double(options.mean_rating)},
+        {"rating-stddev"s, to_double(options.rating_stddev)},
+        {"queries"s, to_int(options.query_count)},
+        {"distinct-queries"s, to_int(options.distinct_query_count)},
+        {"query-zipf"s, to_double(options.query_zipf_exponent)},
+        {"mean-query-length"s, to_double(options.mean_query_length)},
+        {"min-query-length"s, to_int(options.min_query_length)},
+        {"max-query-length"s, to_int(options.max_query_length)},
+        {"minus-word-probability"s, to_double(options.minus_word_probability)},
+    };
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const string arg = argv[i];
+            const auto eq = arg.find('=');
+            if (arg.substr(0, 2) != "--"s || eq == string::npos) {
+                throw invalid_argument("Invalid argument "s + arg);
+            }
+            const auto setter = setters.find(arg.substr(2, eq - 2));
+            if (setter == setters.end()) {
+                throw invalid_argument("Unknown option "s + arg);
+            }
+            setter->second(arg.substr(eq + 1));
+        }
+        if (output.empty()) {
+            throw invalid_argument("Output directory is not set"s);
+        }
+
+        const auto dataset = DatasetGenerator(options).Generate();
+        WriteDataset(dataset, output);
+        cout << "Written "s << dataset.documents.size() << " documents and "s
+             << dataset.queries.size() << " queries to "s << output << endl;
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        PrintUsage(setters);
+        return 1;
+    }
+    return 0;
+}
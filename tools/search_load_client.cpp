@@ -0,0 +1,162 @@
+#include <dataset_generator.h>
+#include <search_client.h>
+#include <search_metrics.h>
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+struct LoadOptions {
+    string unix_socket_path;
+    string host = "127.0.0.1"s;
+    uint16_t port = 0;
+    int connections = 4;
+    // Requests in flight on each connection
+    int pipeline = 8;
+    int requests = 100'000;
+};
+
+SearchClient Connect(const LoadOptions &options) {
+    return options.unix_socket_path.empty()
+               ? SearchClient::ConnectTcp(options.host, options.port)
+               : SearchClient::ConnectUnix(options.unix_socket_path);
+}
+
+// Sends a share of the queries keeping the pipeline full, records the latency of each one
+LatencyHistogram RunConnection(const LoadOptions &options,
+                               const vector<string> &queries,
+                               int first_request,
+                               int request_count) {
+    using Clock = chrono::steady_clock;
+    LatencyHistogram latencies;
+    SearchClient client = Connect(options);
+    deque<Clock::time_point> sent;
+    int next = 0;
+    while (next < request_count || !sent.empty()) {
+        while (next < request_count && sent.size() < static_cast<size_t>(options.pipeline)) {
+            client.SendSearch(queries[(first_request + next) % queries.size()]);
+            sent.push_back(Clock::now());
+            ++next;
+        }
+        client.Flush();
+        const auto response = client.Receive();
+        if (response.code == SearchResponseCode::ERROR) {
+            throw runtime_error(response.error);
+        }
+        latencies.Record(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - sent.front())
+                             .count());
+        sent.pop_front();
+    }
+    return latencies;
+}
+
+void PrintUsage(const map<string, function<void(const string &)>> &setters) {
+    cerr << "Usage: search_load_client (--unix=PATH | --port=PORT) [--option=value ...]\n"s
+         << "Options:"s;
+    for (const auto &[name, _] : setters) {
+        cerr << " --"s << name;
+    }
+    cerr << endl;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    LoadOptions options;
+    DatasetOptions dataset_options;
+    string dataset_directory;
+
+    const auto to_int = [](int &field) {
+        return [&field](const string &value) { field = stoi(value); };
+    };
+    const map<string, function<void(const string &)>> setters = {
+        {"unix"s, [&](const string &value) { options.unix_socket_path = value; }},
+        {"host"s, [&](const string &value) { options.host = value; }},
+        {"port"s, [&](const string &value) { options.port = static_cast<uint16_t>(stoul(value)); }},
+        {"connections"s, to_int(options.connections)},
+        {"pipeline"s, to_int(options.pipeline)},
+        {"requests"s, to_int(options.requests)},
+        {"dataset"s, [&](const string &value) { dataset_directory = value; }},
+        {"seed"s, [&](const string &value) { dataset_options.seed = stoul(value); }},
+    };
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const string arg = argv[i];
+            const auto eq = arg.find('=');
+            if (arg.substr(0, 2) != "--"s || eq == string::npos) {
+                throw invalid_argument("Invalid argument "s + arg);
+            }
+            const auto setter = setters.find(arg.substr(2, eq - 2));
+            if (setter == setters.end()) {
+                throw invalid_argument("Unknown option "s + arg);
+            }
+            setter->second(arg.substr(eq + 1));
+        }
+        if (options.unix_socket_path.empty() && options.port == 0) {
+            throw invalid_argument("Neither a Unix socket nor a TCP port is set"s);
+        }
+        if (options.connections < 1 || options.pipeline < 1 || options.requests < 1) {
+            throw invalid_argument("Connections, pipeline and requests must be positive"s);
+        }
+
+        // The query log of the dataset the service was started with
+        vector<string> queries;
+        if (dataset_directory.empty()) {
+            DatasetGenerator generator(dataset_options);
+            queries = generator.GenerateQueries(generator.GenerateVocabulary());
+        } else {
+            queries = ReadDataset(dataset_directory).queries;
+        }
+        if (queries.empty()) {
+            throw invalid_argument("Query log is empty"s);
+        }
+
+        LatencyHistogram latencies;
+        mutex latencies_mutex;
+        vector<thread> threads;
+        const auto start = chrono::steady_clock::now();
+        for (int i = 0; i < options.connections; ++i) {
+            const int first = options.requests / options.connections * i;
+            const int count = i + 1 == options.connections
+                                  ? options.requests - first
+                                  : options.requests / options.connections;
+            threads.emplace_back([&, first, count] {
+                try {
+                    const auto connection_latencies =
+                        RunConnection(options, queries, first, count);
+                    lock_guard guard(latencies_mutex);
+                    latencies.Merge(connection_latencies);
+                } catch (const exception &e) {
+                    lock_guard guard(latencies_mutex);
+                    cerr << "Connection failed: "s << e.what() << endl;
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+        const auto to_us = [&latencies](double quantile) {
+            return static_cast<double>(latencies.GetPercentile(quantile)) / 1000.0;
+        };
+        cout << latencies.GetCount() << " requests in "s << elapsed.count() << " s, "s
+             << static_cast<double>(latencies.GetCount()) / elapsed.count() << " QPS\n"s
+             << "Latency, us: p50 "s << to_us(0.5) << ", p90 "s << to_us(0.9) << ", p99 "s
+             << to_us(0.99) << ", p999 "s << to_us(0.999) << endl;
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        PrintUsage(setters);
+        return 1;
+    }
+    return 0;
+}
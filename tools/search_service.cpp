@@ -0,0 +1,89 @@
+#include <dataset_generator.h>
+#include <search_service.h>
+
+#include <csignal>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+
+using namespace std;
+
+namespace {
+SearchService *running_service = nullptr;
+
+void StopService(int) {
+    if (running_service != nullptr) {
+        running_service->Stop();
+    }
+}
+
+void PrintUsage(const map<string, function<void(const string &)>> &setters) {
+    cerr << "Usage: search_service (--unix=PATH | --port=PORT) [--option=value ...]\n"s
+         << "Options:"s;
+    for (const auto &[name, _] : setters) {
+        cerr << " --"s << name;
+    }
+    cerr << endl;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    SearchServiceOptions service_options;
+    DatasetOptions dataset_options;
+    string dataset_directory;
+
+    const map<string, function<void(const string &)>> setters = {
+        {"dataset"s, [&](const string &value) { dataset_directory = value; }},
+        {"documents"s,
+         [&](const string &value) { dataset_options.document_count = stoi(value); }},
+        {"seed"s, [&](const string &value) { dataset_options.seed = stoul(value); }},
+        {"unix"s, [&](const string &value) { service_options.unix_socket_path = value; }},
+        {"port"s,
+         [&](const string &value) {
+             service_options.tcp_port = static_cast<uint16_t>(stoul(value));
+         }},
+        {"host"s, [&](const string &value) { service_options.tcp_host = value; }},
+        {"workers"s, [&](const string &value) { service_options.worker_count = stoul(value); }},
+    };
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const string arg = argv[i];
+            const auto eq = arg.find('=');
+            if (arg.substr(0, 2) != "--"s || eq == string::npos) {
+                throw invalid_argument("Invalid argument "s + arg);
+            }
+            const auto setter = setters.find(arg.substr(2, eq - 2));
+            if (setter == setters.end()) {
+                throw invalid_argument("Unknown option "s + arg);
+            }
+            setter->second(arg.substr(eq + 1));
+        }
+
+        // Without a dataset directory the corpus is generated in memory
+        const auto dataset = dataset_directory.empty() ? DatasetGenerator(dataset_options).Generate()
+                                                       : ReadDataset(dataset_directory);
+        SearchServer server = MakeSearchServer(dataset);
+        SearchService service(server, service_options);
+
+        running_service = &service;
+        signal(SIGINT, StopService);
+        signal(SIGTERM, StopService);
+        cout << "Serving "s << server.GetDocumentCount() << " documents"s;
+        if (!service_options.unix_socket_path.empty()) {
+            cout << " on "s << service_options.unix_socket_path;
+        }
+        if (service_options.tcp_port) {
+            cout << " on "s << service_options.tcp_host << ':' << service.GetTcpPort();
+        }
+        cout << " with "s << service_options.worker_count << " workers"s << endl;
+        service.Run();
+        running_service = nullptr;
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        PrintUsage(setters);
+        return 1;
+    }
+    return 0;
+}